@@ -0,0 +1,246 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/ClusterNode>
+#include <osgEarth/kdbush.hpp>
+#include <osgEarth/Random>
+#include <osgEarth/Notify>
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+
+#include <iostream>
+#include <set>
+
+using namespace osgEarth;
+using namespace osgEarth::Contrib;
+
+// Compares per-frame screen-space clustering (KDBush rebuilt every frame,
+// as ClusterNode used to do) against lookups in a precomputed
+// ClusterHierarchy, over synthetic placemark sets and a sweep of zoom levels.
+
+int
+usage(const std::string& message)
+{
+    OE_WARN
+        << "\n\n" << message
+        << "\n\nUsage: osgearth_clusterbench"
+        << "\n"
+        << "\n     --count [num]            : Number of placemarks (default=50000)"
+        << "\n     --radius [pixels]        : Cluster radius in pixels (default=50)"
+        << "\n     --frames [num]           : Frames to simulate per zoom level (default=20)"
+        << "\n     --viewport [w] [h]       : Viewport size in pixels (default=1920 1080)"
+        << "\n"
+        << std::endl;
+
+    return -1;
+}
+
+struct Place
+{
+    double lon, lat;
+    double x, y; // normalized mercator
+};
+
+void
+makePlaces(unsigned count, std::vector<Place>& places)
+{
+    // Half uniform, half in dense city-like blobs.
+    Random prng(0);
+    const unsigned numBlobs = 50;
+    std::vector<std::pair<double, double>> blobs;
+    for (unsigned i = 0; i < numBlobs; ++i)
+        blobs.emplace_back(-180.0 + 360.0*prng.next(), -60.0 + 120.0*prng.next());
+
+    places.resize(count);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        Place& p = places[i];
+        if (i % 2 == 0)
+        {
+            p.lon = -180.0 + 360.0*prng.next();
+            p.lat = -80.0 + 160.0*prng.next();
+        }
+        else
+        {
+            const auto& blob = blobs[prng.next(numBlobs)];
+            p.lon = osg::clampBetween(blob.first + 2.0*(prng.next() - 0.5), -180.0, 180.0);
+            p.lat = osg::clampBetween(blob.second + 2.0*(prng.next() - 0.5), -85.0, 85.0);
+        }
+
+        p.x = p.lon / 360.0 + 0.5;
+        double s = sin(osg::DegreesToRadians(p.lat));
+        p.y = 0.5 - 0.25 * log((1.0 + s) / (1.0 - s)) / osg::PI;
+    }
+}
+
+// The old per-frame algorithm: project visible places, build a KDBush,
+// and greedily claim neighbors using a std::set.
+unsigned
+clusterPerFrame(const std::vector<Place>& places, double cx, double cy, double scale, int width, int height, unsigned radius)
+{
+    typedef std::pair<int, int> TPoint;
+    std::vector<TPoint> points;
+
+    for (auto& p : places)
+    {
+        double sx = (p.x - cx)*scale + 0.5*width;
+        double sy = (p.y - cy)*scale + 0.5*height;
+        if (sx >= 0 && sx <= width && sy >= 0 && sy <= height)
+            points.push_back(TPoint(sx, sy));
+    }
+
+    if (points.empty())
+        return 0u;
+
+    kdbush::KDBush<TPoint> index(points);
+    std::set<unsigned> clustered;
+    unsigned numClusters = 0u;
+    std::vector<std::size_t> indices;
+
+    for (unsigned i = 0; i < points.size(); ++i)
+    {
+        if (clustered.find(i) != clustered.end())
+            continue;
+
+        indices.clear();
+        const TPoint& screen = points[i];
+        index.range(screen.first - radius, screen.second - radius, screen.first + radius, screen.second + radius, indices);
+        for (auto j : indices)
+            clustered.insert(j);
+        clustered.insert(i);
+        ++numClusters;
+    }
+    return numClusters;
+}
+
+// The new per-frame work: pick the level and cull its clusters.
+unsigned
+clusterFromHierarchy(const ClusterHierarchy& hierarchy, const std::vector<Place>& places, double cx, double cy, double scale, int width, int height)
+{
+    unsigned numClusters = 0u;
+    int level = hierarchy.getLevel(scale);
+
+    auto visible = [&](const Place& p)
+    {
+        double sx = (p.x - cx)*scale + 0.5*width;
+        double sy = (p.y - cy)*scale + 0.5*height;
+        return sx >= 0 && sx <= width && sy >= 0 && sy <= height;
+    };
+
+    if (level > hierarchy.getMaxZoom())
+    {
+        for (auto& p : places)
+            if (visible(p))
+                ++numClusters;
+    }
+    else
+    {
+        for (auto& cluster : hierarchy.getClusters(level))
+            if (!cluster.points.empty() && visible(places[cluster.seed]))
+                ++numClusters;
+    }
+    return numClusters;
+}
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc, argv);
+
+    if (arguments.read("--help"))
+        return usage("Help");
+
+    unsigned count = 50000;
+    arguments.read("--count", count);
+
+    unsigned radius = 50;
+    arguments.read("--radius", radius);
+
+    unsigned frames = 20;
+    arguments.read("--frames", frames);
+
+    int width = 1920, height = 1080;
+    arguments.read("--viewport", width, height);
+
+    std::vector<Place> places;
+    makePlaces(count, places);
+
+    osg::Timer* timer = osg::Timer::instance();
+
+    // one-time build
+    ClusterHierarchy hierarchy(radius);
+    osg::Timer_t t0 = timer->tick();
+    for (unsigned i = 0; i < places.size(); ++i)
+        hierarchy.insert(i, places[i].lon, places[i].lat);
+    double buildMs = timer->delta_m(t0, timer->tick());
+
+    // incremental updates: remove and re-add 1% of the places
+    unsigned numUpdates = std::max(1u, count / 100u);
+    t0 = timer->tick();
+    for (unsigned i = 0; i < numUpdates; ++i)
+    {
+        unsigned id = (i * 7919u) % count;
+        hierarchy.remove(id);
+        hierarchy.insert(id, places[id].lon, places[id].lat);
+    }
+    double updateMs = timer->delta_m(t0, timer->tick());
+
+    std::cout
+        << "Places: " << count << ", radius: " << radius << "px, viewport: " << width << "x" << height << std::endl
+        << "Hierarchy build: " << buildMs << " ms" << std::endl
+        << "Incremental update: " << (1000.0*updateMs / (double)numUpdates) << " us per remove+insert" << std::endl
+        << std::endl
+        << "zoom   clusters(old/new)   per-frame ms (old)   per-frame ms (new)" << std::endl;
+
+    Random prng(1);
+
+    for (int zoom = 0; zoom <= hierarchy.getMaxZoom() + 1; zoom += 2)
+    {
+        // pixels per normalized unit at this zoom, nudged inside the level
+        double scale = ldexp(256.0, zoom) * 1.5;
+
+        double oldMs = 0.0, newMs = 0.0;
+        unsigned oldClusters = 0u, newClusters = 0u;
+
+        for (unsigned f = 0; f < frames; ++f)
+        {
+            // center each frame's view on a random place, like a user panning
+            const Place& center = places[prng.next(count)];
+
+            t0 = timer->tick();
+            oldClusters += clusterPerFrame(places, center.x, center.y, scale, width, height, radius);
+            oldMs += timer->delta_m(t0, timer->tick());
+
+            t0 = timer->tick();
+            newClusters += clusterFromHierarchy(hierarchy, places, center.x, center.y, scale, width, height);
+            newMs += timer->delta_m(t0, timer->tick());
+        }
+
+        std::cout
+            << zoom << "\t"
+            << (oldClusters / frames) << "/" << (newClusters / frames) << "\t\t\t"
+            << (oldMs / (double)frames) << "\t\t\t"
+            << (newMs / (double)frames) << std::endl;
+    }
+
+    return 0;
+}
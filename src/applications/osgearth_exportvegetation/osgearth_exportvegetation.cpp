@@ -48,6 +48,7 @@ usage(const char* name, const std::string& error)
         << "\n  --extents swlong swlat nelong nelat  ; extents in degrees"
         << "\n  --out out.shp                        ; output features"
         << "\n  --include-asset-property <name>      ; include asset property name as attribute (optional)"
+        << "\n  --threads num                        ; number of generating threads (default=4)"
         << std::endl;
 
     return -1;
@@ -60,9 +61,7 @@ struct App
     GeoExtent extent;
     VegetationFeatureGenerator featureGen;
     osg::ref_ptr<OGRFeatureSource> outfs;
-
-    Threading::Mutexed<std::queue<FeatureList*> > outputQueue;
-    Threading::Event gate;
+    unsigned numThreads;
     bool debug;
 
     App() { }
@@ -82,6 +81,9 @@ struct App
         std::string layername;
         arguments.read("--layer", layername);
 
+        numThreads = 4u;
+        arguments.read("--threads", numThreads);
+
         double xmin, ymin, xmax, ymax;
         if (!arguments.read("--extents", xmin, ymin, xmax, ymax))
             return usage(argv[0], "Missing --extents");
@@ -135,19 +137,6 @@ struct App
 
         return 0; 
     }
-
-    void exportKey(const TileKey& key)
-    {
-        // even if the output if empty, we still must push a FeatureList
-        // to the output queue b/c it's expecting an exact number of keys.
-        FeatureList* output = new FeatureList();
-        featureGen.getFeatures(key, *output);
-
-        outputQueue.lock();
-        outputQueue.push(output);
-        gate.set();
-        outputQueue.unlock();
-    }
 };
 
 int
@@ -160,61 +149,43 @@ main(int argc, char** argv)
     if (app.open(argc, argv) < 0)
         return -1;
 
-    // find all intersecting tile keys
+    // count the intersecting tile keys for progress reporting
     std::vector<TileKey> keys;
     unsigned lod = app.veglayer->options().group(AssetGroup::TREES).lod().get();
     app.mapNode->getMap()->getProfile()->getIntersectingTiles(app.extent, lod, keys);
     if (keys.empty())
         return usage(argv[0], "No data in extent");
 
-    JobArena arena("Vegetation Export", 4u);
-
-    std::cout << "Exporting " << keys.size() << " keys.." << std::endl;
-
-    for(const auto& key : keys)
-    {
-        Job().dispatch(
-            [&app, key](Cancelable*)
-            {
-                app.exportKey(key);
-            }
-        );
-    }
+    std::cout << "Exporting " << keys.size() << " keys on " << app.numThreads << " threads.." << std::endl;
 
+    unsigned numKeys = 0u;
     unsigned totalFeatures = 0u;
-    std::vector<TimeSpan> writeTimes;
+    double totalWriteTime = 0.0;
 
-    for(unsigned i=0; i<keys.size(); )
-    {
-        app.gate.waitAndReset();
-
-        std::vector<FeatureList*> outputs;
-
-        app.outputQueue.lock();
-        while(!app.outputQueue.empty())
-        {
-            outputs.push_back(app.outputQueue.front());
-            app.outputQueue.pop();
-        }
-        app.outputQueue.unlock();
-
-        for(unsigned j=0; j<outputs.size(); ++j)
+    // tiles arrive in key order on this thread, so the output file is
+    // identical no matter how many threads generate them.
+    Status status = app.featureGen.forEachTile(
+        app.extent,
+        [&](const TileKey& key, FeatureList& features)
         {
             osg::Timer_t startWrite = osg::Timer::instance()->tick();
 
-            FeatureList* output = outputs[j];
-            for(FeatureList::iterator k = output->begin(); k != output->end(); ++k)
+            for (auto& feature : features)
             {
-                app.outfs->insertFeature(k->get());
+                app.outfs->insertFeature(feature.get());
                 ++totalFeatures;
             }
 
-            delete output;
-            std::cout << "\r" << (++i) << "/" << keys.size() << std::flush;
+            std::cout << "\r" << (++numKeys) << "/" << keys.size() << std::flush;
 
             osg::Timer_t endWrite = osg::Timer::instance()->tick();
-            writeTimes.push_back(osg::Timer::instance()->delta_s(startWrite, endWrite));
-        }
+            totalWriteTime += osg::Timer::instance()->delta_s(startWrite, endWrite);
+        },
+        app.numThreads);
+
+    if (status.isError())
+    {
+        OE_WARN << LC << status.message() << std::endl;
     }
 
     std::cout << "\nBuilding index.." << std::flush;
@@ -225,10 +196,6 @@ main(int argc, char** argv)
     osg::Timer_t end = osg::Timer::instance()->tick();
     double totalTime = osg::Timer::instance()->delta_s(start, end);
 
-    TimeSpan avgWriteTime=0, totalWriteTime=0;
-    for(int i=0; i<writeTimes.size(); ++i) totalWriteTime += writeTimes[i];
-    avgWriteTime /= writeTimes.size();
-
     std::cout 
         << "\rDone"
         << "; keys=" << keys.size()
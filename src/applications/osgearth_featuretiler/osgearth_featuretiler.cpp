@@ -21,19 +21,35 @@
 */
 #include <osgEarth/Notify>
 #include <osgEarth/TDTiles>
-#include <osgEarthFeatures/FeatureSource>
-#include <osgEarthFeatures/FeatureCursor>
-#include <osgEarthFeatures/ResampleFilter>
-#include <osgEarthDrivers/feature_ogr/OGRFeatureOptions>
+#include <osgEarth/OGRFeatureSource>
+#include <osgEarth/FeatureCursor>
+#include <osgEarth/ResampleFilter>
+#include <osgEarth/GeometryCompiler>
+#include <osgEarth/ExtrusionSymbol>
+#include <osgEarth/PolygonSymbol>
+#include <osgEarth/Session>
+#include <osgEarth/Map>
+#include <osgEarth/Threading>
+#include <osgEarth/StringUtils>
 #include <osg/ArgumentParser>
+#include <osg/BoundingBox>
 #include <osgDB/FileUtils>
+#include <osgDB/WriteFile>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
 
 #define LC "[featuretiler] "
 
 using namespace osgEarth;
-using namespace osgEarth::Features;
-using namespace osgEarth::Drivers;
+using namespace osgEarth::Util;
+namespace TDTiles = osgEarth::Contrib::ThreeDTiles;
 
 int
 usage(const char* msg)
@@ -44,238 +60,354 @@ usage(const char* msg)
         << "\n    --in [location]        ; filename of source data (e.g. a shapefile)"
         << "\n    --out [directory]      ; output folder name"
         << "\n    --errors [...]         ; Comma-delimited geometric error per level (e.g. 1,150,500)"
+        << "\n    --height [attribute]   ; extrude polygons by this attribute"
+        << "\n    --threads [n]          ; number of compile threads (default = all cores)"
+        << "\n    --max-pending [n]      ; tiles held in memory at once (default = 2 x threads)"
+        << "\n    --fragment-depth [n]   ; write subtrees at this depth as separate tileset files (default = 4)"
+        << "\n    --report [seconds]     ; progress report interval (default = 5)"
+        << "\n    --resume               ; skip tiles recorded in the checkpoint of a previous run"
         << std::endl;
     return -1;
 }
 
-struct Env
+// Per-feature record kept by the partition pass. No geometry is held,
+// so the pass runs in a small, fixed amount of memory per feature.
+struct FeatureData
 {
-    osg::ref_ptr<FeatureSource> input;
-    double* geometricError;
-    unsigned maxDepth;
-    URIContext uriContext;
-    unsigned counter;
-
-    ~Env() { delete [] geometricError; }
-};
-
-struct FeatureData {
     double x, y;
-    FeatureID fid;
+    float size;
 };
 
-struct SortByX {
-    bool operator()(const FeatureData& lhs, const FeatureData& rhs) const {
-        return lhs.x < rhs.x;
+// One node of the 3D-Tiles hierarchy. Regions split on the median feature
+// centroid; a feature belongs to the region holding its centroid, so each
+// feature lands in exactly one tile per level.
+struct TileNode
+{
+    std::string id;
+    unsigned depth;
+    double xmin, ymin, xmax, ymax;
+    bool closedX, closedY;   // region includes its max edge (true on the outer boundary)
+    double error;
+    std::size_t count;       // features big enough for this level
+    std::unique_ptr<TileNode> children[2];
+
+    // results of the compile pass: the actual bounds of the features written,
+    // which may extend past the region since features are placed by centroid
+    bool written = false;
+    osg::BoundingBoxd content;
+
+    bool contains(const FeatureData& d) const
+    {
+        return
+            d.x >= xmin && (d.x < xmax || (closedX && d.x == xmax)) &&
+            d.y >= ymin && (d.y < ymax || (closedY && d.y == ymax));
     }
 };
 
-struct SortByY {
-    bool operator()(const FeatureData& lhs, const FeatureData& rhs) const {
-        return lhs.y < rhs.y;
-    }
+struct Env
+{
+    osg::ref_ptr<FeatureSource> input;
+    std::vector<double> geometricError;
+    unsigned maxDepth;
+    std::string outDir;
+    std::string heightAttr;
+    unsigned fragmentDepth;
+    osg::ref_ptr<Session> session;
+    Style style;
 };
 
-int
-split(const GeoExtent& extent, TDTiles::Tile* parentTile, unsigned depth, Env& env)
+//! Streams every feature once and records its centroid and size
+void
+collect(Env& env, std::vector<FeatureData>& data)
 {
-    const Profile* profile = 0L;
-    const FeatureProfile* inputFP = env.input->getFeatureProfile();
-    if (inputFP && inputFP->getExtent().isValid())
-    {
-        const GeoExtent& fex = inputFP->getExtent();
-        profile = Profile::create(fex.getSRS(), fex.xMin(), fex.yMin(), fex.xMax(), fex.yMax());
-    }
-
-    OGRFeatureOptions outputConf[2];
-    osg::ref_ptr<FeatureSource> output[2];
-
-    for (unsigned i = 0; i < 2; ++i)
-    {
-        outputConf[i].url() = URI(Stringify() << "test_" << depth << "_" << (env.counter++) << "_" << i << ".shp", env.uriContext);
-        outputConf[i].openWrite() = true;
-        if (profile)
-            outputConf[i].profile() = profile->toProfileOptions();
-
-        output[i] = FeatureSourceFactory::create(outputConf[i]);
-        if (!output[i].valid())
-            return usage("Failed to open output dataset");
-
-        const Status& outputStatus = output[i]->create(
-            env.input->getFeatureProfile(),
-            env.input->getSchema(),
-            env.input->getGeometryType(),
-            NULL);
-
-        if (outputStatus.isError())
-            return usage(outputStatus.message().c_str());
-    }
-
-    std::vector<FeatureData> data;
     int count = env.input->getFeatureCount();
     if (count > 0)
-    {
-        //OE_INFO << "Feature count = " << count << std::endl;
         data.reserve(count);
-    }
-    else
-    {
-        OE_INFO << "Feature count not available" << std::endl;
-    }
-
-    // Just divide the error by 10 each level. Placeholder for something smarter.
-    double error = env.geometricError[depth];
 
-    FeatureList features;
-    unsigned i = 0;
-    Query query;
-    query.bounds() = extent.bounds();
-    osg::ref_ptr<FeatureCursor> cursor = env.input->createFeatureCursor(query, 0L);
-    if (!cursor.valid())
+    osg::ref_ptr<FeatureCursor> cursor = env.input->createFeatureCursor(Query(), nullptr);
+    while (cursor.valid() && cursor->hasMore())
     {
-        OE_WARN << "Feature cursor error" << std::endl;
-        return 0;
-    }
-
-    cursor->fill(features);
-    if (features.empty())
-        return 0;
-
-    ResampleFilter resample(error, DBL_MAX);
-    FilterContext fc(0L, env.input->getFeatureProfile(), extent);
-    resample.push(features, fc);
-    
-    for(FeatureList::iterator i = features.begin(); i != features.end(); ++i)
-    {
-        Feature* f = i->get();
-        const GeoExtent& fex = f->getExtent();
-        if (fex.width() < error && fex.height() < error)
+        Feature* f = cursor->nextFeature();
+        if (!f || !f->getGeometry())
             continue;
 
+        const GeoExtent& fex = f->getExtent();
         FeatureData d;
         fex.getCentroid(d.x, d.y);
-        d.fid = f->getFID();
+        d.size = (float)std::max(fex.width(), fex.height());
         data.push_back(d);
     }
+}
 
-    bool isWide = extent.width() > extent.height();
+//! Builds the tile hierarchy over data[begin, end), which it reorders
+void
+partition(TileNode& node, std::vector<FeatureData>& data, std::size_t begin, std::size_t end, const Env& env)
+{
+    if (node.depth > env.maxDepth)
+        return;
 
-    OE_INFO << "Depth = " << depth << ", features = " << data.size() << std::endl;
+    bool isWide = (node.xmax - node.xmin) > (node.ymax - node.ymin);
+    auto coord = [isWide](const FeatureData& d) { return isWide ? d.x : d.y; };
 
     double median;
+    if (end > begin)
+    {
+        auto mid = data.begin() + begin + (end - begin) / 2;
+        std::nth_element(data.begin() + begin, mid, data.begin() + end,
+            [&](const FeatureData& lhs, const FeatureData& rhs) { return coord(lhs) < coord(rhs); });
+        median = coord(*mid);
+    }
+    else
+    {
+        median = isWide ? 0.5 * (node.xmin + node.xmax) : 0.5 * (node.ymin + node.ymax);
+    }
 
-    if (data.size() > 0)
+    std::size_t pivot = std::partition(data.begin() + begin, data.begin() + end,
+        [&](const FeatureData& d) { return coord(d) < median; }) - data.begin();
+
+    double error = env.geometricError[node.depth];
+
+    for (unsigned i = 0; i < 2; ++i)
     {
+        TileNode* child = new TileNode();
+        node.children[i].reset(child);
+
+        child->id = node.id + (i == 0 ? "0" : "1");
+        child->depth = node.depth + 1;
+        child->error = error;
+        child->xmin = node.xmin; child->xmax = node.xmax; child->closedX = node.closedX;
+        child->ymin = node.ymin; child->ymax = node.ymax; child->closedY = node.closedY;
+
         if (isWide)
         {
-            SortByX sortByX;
-            std::sort(data.begin(), data.end(), sortByX);
-            median = ((data.size() & 0x1) == 0) ?
-                0.5 * (data[data.size() / 2].x + data[data.size() / 2].x) :
-                data[data.size() / 2].x;
-            OE_INFO << "  Median X = " << median << std::endl;
+            if (i == 0) { child->xmax = median; child->closedX = false; }
+            else child->xmin = median;
         }
         else
         {
-            SortByY sortByY;
-            std::sort(data.begin(), data.end(), sortByY);
-            median = ((data.size() & 0x1) == 0) ?
-                0.5 * (data[data.size() / 2].y + data[data.size() / 2].y) :
-                data[data.size() / 2].y;
-            OE_INFO << "  Median Y = " << median << std::endl;
+            if (i == 0) { child->ymax = median; child->closedY = false; }
+            else child->ymin = median;
         }
-    }
-    else
-    {
-        if (isWide)
-            median = extent.xMin() + extent.width()/2.0;
-        else
-            median = extent.yMin() + extent.height()/2.0;
-    }
 
-    osg::ref_ptr<TDTiles::Tile> child[2];
+        std::size_t b = (i == 0) ? begin : pivot;
+        std::size_t e = (i == 0) ? pivot : end;
+
+        child->count = std::count_if(data.begin() + b, data.begin() + e,
+            [error](const FeatureData& d) { return d.size >= error; });
+
+        if (child->depth <= env.maxDepth)
+            partition(*child, data, b, e, env);
+    }
+}
 
-    child[0] = new TDTiles::Tile();
-    child[0]->refine() = TDTiles::REFINE_REPLACE;
-    parentTile->children().push_back(child[0].get());
+void
+collectNodes(TileNode& node, std::vector<TileNode*>& output)
+{
+    if (node.count > 0)
+        output.push_back(&node);
+    for (auto& child : node.children)
+        if (child)
+            collectNodes(*child, output);
+}
 
-    child[1] = new TDTiles::Tile();
-    child[0]->refine() = TDTiles::REFINE_REPLACE;
-    parentTile->children().push_back(child[1].get());
+//! Reads, simplifies, compiles and writes the content of one tile, and
+//! sets numFeatures to the number of features written (zero for a tile
+//! with no features). Returns false if the tile could not be built.
+bool
+compileTile(TileNode& node, Env& env, std::size_t& numFeatures)
+{
+    numFeatures = 0u;
 
-    unsigned afeatures = 0u, bfeatures = 0u;
+    GeoExtent extent(env.input->getFeatureProfile()->getSRS(), node.xmin, node.ymin, node.xmax, node.ymax);
 
-    for (unsigned i = 0; i < data.size(); ++i)
+    Query query;
+    query.bounds() = extent.bounds();
+    osg::ref_ptr<FeatureCursor> cursor = env.input->createFeatureCursor(query, nullptr);
+    if (!cursor.valid())
     {
-        const FeatureData& d = data[i];
-        Feature* f = env.input->getFeature(d.fid);
-        double x, y;
-        f->getExtent().getCentroid(x, y);
-        double side = isWide ? x : y;
-        if (side < median)
+        OE_WARN << LC << "Failed to query features for tile " << node.id << std::endl;
+        return false;
+    }
+
+    FeatureList features;
+    cursor->fill(features, [&](const Feature* f)
         {
-            afeatures++;
-            output[0]->insertFeature(f);
-        }
-        else
+            if (!f->getGeometry())
+                return false;
+            const GeoExtent& fex = f->getExtent();
+            FeatureData d;
+            fex.getCentroid(d.x, d.y);
+            d.size = (float)std::max(fex.width(), fex.height());
+            return d.size >= node.error && node.contains(d);
+        });
+
+    if (features.empty())
+        return true;
+
+    // bounds of the content, including extrusion height
+    node.content.init();
+    for (auto& f : features)
+    {
+        double height = env.heightAttr.empty() ? 0.0 : f->getDouble(env.heightAttr, 0.0);
+        ConstGeometryIterator iter(f->getGeometry(), false);
+        while (iter.hasMore())
         {
-            bfeatures++;
-            output[1]->insertFeature(f);
+            for (auto& p : *iter.next())
+            {
+                node.content.expandBy(p);
+                node.content.expandBy(osg::Vec3d(p.x(), p.y(), p.z() + height));
+            }
         }
     }
 
-    GeoExtent a(extent.getSRS()), b(extent.getSRS());
+    FilterContext fc(env.session.get(), env.input->getFeatureProfile(), extent);
+
+    ResampleFilter resample(node.error, DBL_MAX);
+    fc = resample.push(features, fc);
+
+    std::size_t count = features.size();
 
-    if (isWide)
+    GeometryCompiler compiler;
+    osg::ref_ptr<osg::Node> result = compiler.compile(features, env.style, fc);
+    if (!result.valid())
     {
-        a.set(extent.xMin(), extent.yMin(), median, extent.yMax());
-        b.set(median, extent.yMin(), extent.xMax(), extent.yMax());
+        OE_WARN << LC << "Failed to compile tile " << node.id << std::endl;
+        return false;
     }
-    else
+
+    std::string filename = Stringify() << env.outDir << "/tiles/" << node.id << ".b3dm";
+    if (!osgDB::writeNodeFile(*result.get(), filename))
     {
-        a.set(extent.xMin(), extent.yMin(), extent.xMax(), median);
-        b.set(extent.xMin(), median, extent.xMax(), extent.yMax());
+        OE_WARN << LC << "Failed to write " << filename << std::endl;
+        return false;
     }
 
-    if (depth < env.maxDepth)
+    node.written = true;
+    numFeatures = count;
+    return true;
+}
+
+//! Bounding region in EPSG:4979 of the content of a subtree
+void
+setRegion(TDTiles::Tile* tile, const osg::BoundingBoxd& box, const SpatialReference* srs)
+{
+    GeoExtent e(srs, box.xMin(), box.yMin(), box.xMax(), box.yMax());
+    e = e.transform(SpatialReference::get("epsg:4979"));
+    tile->boundingVolume()->region()->set(
+        osg::DegreesToRadians(e.xMin()), osg::DegreesToRadians(e.yMin()), box.zMin(),
+        osg::DegreesToRadians(e.xMax()), osg::DegreesToRadians(e.yMax()), box.zMax());
+}
+
+void
+writeTileset(TDTiles::Tile* root, double geometricError, const std::string& filename)
+{
+    osg::ref_ptr<TDTiles::Tileset> tileset = new TDTiles::Tileset();
+    tileset->root() = root;
+    tileset->asset()->version() = "1.0";
+    tileset->geometricError() = geometricError;
+
+    std::ofstream out(filename.c_str());
+    Json::Value tilesetJSON = tileset->getJSON();
+    Json::StyledStreamWriter writer;
+    writer.write(out, tilesetJSON);
+}
+
+//! Builds the tileset JSON for a subtree. Subtrees at the fragment depth go
+//! to their own files as soon as they are built and are referenced from the
+//! parent as external tilesets, so no file holds the whole hierarchy.
+//! Returns null for subtrees with no content.
+TDTiles::Tile*
+buildTiles(const TileNode& node, Env& env, osg::BoundingBoxd& box)
+{
+    const SpatialReference* srs = env.input->getFeatureProfile()->getSRS();
+
+    osg::ref_ptr<TDTiles::Tile> tile = new TDTiles::Tile();
+    tile->refine() = REFINE_REPLACE;
+    tile->geometricError() = node.error;
+
+    // a region must hold its own content and all of its children's
+    box.init();
+    if (node.written)
+        box.expandBy(node.content);
+
+    for (auto& child : node.children)
     {
-        split(a, child[0].get(), depth + 1, env);
-        split(b, child[1].get(), depth + 1, env);
+        if (!child)
+            continue;
+        osg::BoundingBoxd childBox;
+        osg::ref_ptr<TDTiles::Tile> childTile = buildTiles(*child, env, childBox);
+        if (childTile.valid())
+        {
+            tile->children().push_back(childTile.get());
+            box.expandBy(childBox);
+        }
     }
 
-    output[0] = 0L;
-    output[1] = 0L;
+    if (!node.written && tile->children().empty())
+        return nullptr;
 
-    //TODO: heights
-    const float zmin = 0.0f;
-    const float zmax = 1.0f;
+    if (node.written)
+        tile->content()->uri() = URI(Stringify() << "tiles/" << node.id << ".b3dm");
 
-    const SpatialReference* epsg4979 = SpatialReference::get("epsg:4979");
-    a = a.transform(epsg4979);
-    b = b.transform(epsg4979);
+    setRegion(tile.get(), box, srs);
 
-    if (afeatures > 0u)
-        child[0]->content()->uri() = outputConf[0].url().get();
+    if (node.depth == env.fragmentDepth && node.depth > 0)
+    {
+        std::string name = Stringify() << "tileset_" << node.id << ".json";
+        writeTileset(tile.get(), node.error, env.outDir + "/" + name);
+
+        // stub that points at the external tileset
+        osg::ref_ptr<TDTiles::Tile> stub = new TDTiles::Tile();
+        stub->refine() = REFINE_REPLACE;
+        stub->geometricError() = node.error;
+        stub->content()->uri() = URI(name);
+        setRegion(stub.get(), box, srs);
+        return stub.release();
+    }
 
-    child[0]->boundingVolume()->region()->set(
-        osg::DegreesToRadians(a.xMin()), osg::DegreesToRadians(a.yMin()), zmin, 
-        osg::DegreesToRadians(a.xMax()), osg::DegreesToRadians(a.yMax()), zmax);
-    child[0]->geometricError() = error;
+    return tile.release();
+}
+
+// Checkpoint file: one line per finished tile,
+// "<id> <features> <xmin> <ymin> <zmin> <xmax> <ymax> <zmax>" (content bounds)
+struct Checkpoint
+{
+    std::string filename;
+    std::ofstream out;
+    Threading::Mutex mutex;
 
-    if (bfeatures > 0u)
-        child[1]->content()->uri() = outputConf[1].url().get();
+    std::unordered_map<std::string, osg::BoundingBoxd> load()
+    {
+        std::unordered_map<std::string, osg::BoundingBoxd> done;
+        std::ifstream in(filename.c_str());
+        std::string id;
+        std::size_t count;
+        osg::BoundingBoxd box;
+        while (in >> id >> count >> box._min.x() >> box._min.y() >> box._min.z() >> box._max.x() >> box._max.y() >> box._max.z())
+            done[id] = box;
+        return done;
+    }
 
-    child[1]->boundingVolume()->region()->set(
-        osg::DegreesToRadians(b.xMin()), osg::DegreesToRadians(b.yMin()), zmin,
-        osg::DegreesToRadians(b.xMax()), osg::DegreesToRadians(b.yMax()), zmax);
-    child[1]->geometricError() = error;
+    void open(bool append)
+    {
+        out.open(filename.c_str(), append ? std::ios::app : std::ios::trunc);
+    }
 
-    return 0;
-}
+    void record(const TileNode& node, std::size_t count)
+    {
+        Threading::ScopedMutexLock lock(mutex);
+        const osg::BoundingBoxd& b = node.content;
+        out << node.id << ' ' << count << std::setprecision(17)
+            << ' ' << b.xMin() << ' ' << b.yMin() << ' ' << b.zMin()
+            << ' ' << b.xMax() << ' ' << b.yMax() << ' ' << b.zMax() << std::endl;
+    }
+};
 
 int
 main(int argc, char** argv)
 {
+    osgEarth::initialize();
+
     osg::ArgumentParser arguments(&argc,argv);
 
     if (arguments.read("--help"))
@@ -292,21 +424,30 @@ main(int argc, char** argv)
     std::string errors("1,80,200");
     arguments.read("--errors", errors);
 
-    if (!osgDB::makeDirectory(outputLocation))
-        return usage("Unable to create/find output location");
+    unsigned threads = Threading::getConcurrency();
+    arguments.read("--threads", threads);
+    threads = std::max(threads, 1u);
 
-    osg::ref_ptr<TDTiles::Tile> root = new TDTiles::Tile();
+    unsigned maxPending = 2u * threads;
+    arguments.read("--max-pending", maxPending);
+    maxPending = std::max(maxPending, 1u);
 
-    std::string outFile = Stringify() << outputLocation << "/tileset.json";
-    URIContext uriContext(outFile);
+    unsigned fragmentDepth = 4u;
+    arguments.read("--fragment-depth", fragmentDepth);
 
-    Config inputConf;
-    inputConf.set("driver", "ogr");
-    inputConf.set("url", source);
-    osg::ref_ptr<FeatureSource> input = FeatureSourceFactory::create(ConfigOptions(inputConf));
-    if (!input.valid())
-        return usage("Failed to create the input feature source");
+    double reportInterval = 5.0;
+    arguments.read("--report", reportInterval);
 
+    bool resume = arguments.read("--resume");
+
+    Env env;
+    arguments.read("--height", env.heightAttr);
+
+    if (!osgDB::makeDirectory(outputLocation) || !osgDB::makeDirectory(outputLocation + "/tiles"))
+        return usage("Unable to create/find output location");
+
+    osg::ref_ptr<OGRFeatureSource> input = new OGRFeatureSource();
+    input->setURL(source);
     if (input->open().isError())
         return usage("Failed to open the input feature source");
 
@@ -315,11 +456,10 @@ main(int argc, char** argv)
     if (errorStrings.size() < 1)
         return usage("Illegal errors input");
 
-    Env env;
     env.input = input.get();
-    env.counter = 0;
-    env.uriContext = uriContext;    
-    env.geometricError = new double[errorStrings.size()];
+    env.outDir = outputLocation;
+    env.fragmentDepth = fragmentDepth;
+    env.geometricError.resize(errorStrings.size());
     env.maxDepth = errorStrings.size()-1;
 
     // generate level errors:
@@ -335,20 +475,187 @@ main(int argc, char** argv)
     }
     OE_NOTIFY(osg::NOTICE, std::endl);
 
-    // make it so
-    split(input->getFeatureProfile()->getExtent(), root, 0, env);
+    // Geographic map, so compiled geometry comes out in ECEF
+    osg::ref_ptr<Map> map = new Map();
+    env.session = new Session(map.get());
+    env.style.getOrCreate<PolygonSymbol>()->fill()->color() = Color::White;
+    if (!env.heightAttr.empty())
+    {
+        env.style.getOrCreate<ExtrusionSymbol>()->heightExpression() =
+            NumericExpression(Stringify() << "[" << env.heightAttr << "]");
+    }
 
-    osg::ref_ptr<TDTiles::Tileset> tileset = new TDTiles::Tileset();
-    tileset->root() = root.get();
+    // Pass 1: partition
+    auto startTime = std::chrono::steady_clock::now();
 
-    TDTiles::Asset asset;
-    tileset->asset()->version() = "1.0";
+    const GeoExtent& fullExtent = input->getFeatureProfile()->getExtent();
 
-    std::ofstream out(outFile.c_str());
-    Json::Value tilesetJSON = tileset->getJSON();
-    Json::StyledStreamWriter writer;
-    writer.write(out, tilesetJSON);
-    out.close();
+    TileNode root;
+    root.id = "r";
+    root.depth = 0u;
+    root.xmin = fullExtent.xMin(); root.ymin = fullExtent.yMin();
+    root.xmax = fullExtent.xMax(); root.ymax = fullExtent.yMax();
+    root.closedX = root.closedY = true;
+    root.error = env.geometricError[0];
+    root.count = 0u;
+
+    {
+        std::vector<FeatureData> data;
+        collect(env, data);
+
+        // feature extents can spill past the layer extent
+        for (auto& d : data)
+        {
+            root.xmin = std::min(root.xmin, d.x); root.xmax = std::max(root.xmax, d.x);
+            root.ymin = std::min(root.ymin, d.y); root.ymax = std::max(root.ymax, d.y);
+        }
+
+        partition(root, data, 0u, data.size(), env);
+
+        OE_NOTICE << LC << "Partitioned " << data.size() << " features in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() << "s" << std::endl;
+    }
+
+    std::vector<TileNode*> nodes;
+    collectNodes(root, nodes);
+
+    // Pass 2: compile and write tile content in parallel
+    Checkpoint checkpoint;
+    checkpoint.filename = outputLocation + "/featuretiler.checkpoint";
+
+    std::atomic<std::size_t> tilesDone(0u), featuresDone(0u), tilesFailed(0u);
+    std::size_t tilesTotal = nodes.size();
+
+    if (resume)
+    {
+        auto done = checkpoint.load();
+        std::vector<TileNode*> remaining;
+        for (auto node : nodes)
+        {
+            auto i = done.find(node->id);
+            if (i != done.end())
+            {
+                node->content = i->second;
+                node->written = node->content.valid();
+                ++tilesDone;
+            }
+            else remaining.push_back(node);
+        }
+        OE_NOTICE << LC << "Resuming; " << tilesDone << " of " << tilesTotal << " tiles already done" << std::endl;
+        nodes.swap(remaining);
+    }
+    checkpoint.open(resume);
+
+    JobArena::setConcurrency("oe.featuretiler", threads);
+    JobArena* arena = JobArena::get("oe.featuretiler");
+    JobGroup group;
+
+    // Bounds the number of tiles whose features and geometry are in memory
+    Threading::Mutex pendingMutex("featuretiler.pending");
+    std::condition_variable_any pendingCV;
+    unsigned pending = 0u;
+
+    auto lastReport = std::chrono::steady_clock::now();
+    auto compileStart = lastReport;
+    std::size_t tilesAtStart = tilesDone;
+
+    auto report = [&](bool force)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (!force && std::chrono::duration<double>(now - lastReport).count() < reportInterval)
+            return;
+        lastReport = now;
+
+        double elapsed = std::chrono::duration<double>(now - compileStart).count();
+        std::size_t done = tilesDone;
+        double tileRate = elapsed > 0.0 ? (double)(done - tilesAtStart) / elapsed : 0.0;
+        double featureRate = elapsed > 0.0 ? (double)featuresDone / elapsed : 0.0;
+        double eta = tileRate > 0.0 ? (double)(tilesTotal - done) / tileRate : 0.0;
+
+        // format locally so the flags don't stick to the shared notify stream
+        std::ostringstream buf;
+        buf << done << "/" << tilesTotal << " tiles, "
+            << featuresDone << " features, "
+            << std::fixed << std::setprecision(1) << tileRate << " tiles/s, "
+            << featureRate << " features/s, ETA " << eta << "s";
+        OE_NOTICE << LC << buf.str() << std::endl;
+    };
+
+    for (auto node : nodes)
+    {
+        {
+            Threading::ScopedMutexLock lock(pendingMutex);
+            while (pending >= maxPending)
+            {
+                pendingCV.wait_for(pendingMutex, std::chrono::milliseconds(250));
+                report(false);
+            }
+            ++pending;
+        }
+
+        Job job(arena, &group);
+        job.setName("featuretiler " + node->id);
+        job.dispatch([&, node](Cancelable*)
+            {
+                std::size_t count;
+                bool ok = compileTile(*node, env, count);
+                if (!node->written)
+                {
+                    node->content.init(); // marks an empty tile
+                }
+
+                // only finished tiles go to the checkpoint, so --resume retries failures
+                if (ok)
+                {
+                    checkpoint.record(*node, count);
+                    featuresDone += count;
+                }
+                else
+                {
+                    ++tilesFailed;
+                }
+                ++tilesDone;
+
+                Threading::ScopedMutexLock lock(pendingMutex);
+                --pending;
+                pendingCV.notify_all();
+            });
+
+        report(false);
+    }
+
+    {
+        Threading::ScopedMutexLock lock(pendingMutex);
+        while (pending > 0u)
+        {
+            pendingCV.wait_for(pendingMutex, std::chrono::milliseconds(250));
+            report(false);
+        }
+    }
+    group.join();
+    report(true);
+
+    if (tilesFailed > 0u)
+    {
+        OE_WARN << LC << tilesFailed << " of " << tilesTotal << " tiles failed; "
+            << "run again with --resume to retry them" << std::endl;
+        return -1;
+    }
+
+    // Pass 3: tileset.json, with fragments written as they are built
+    osg::BoundingBoxd rootBox;
+    osg::ref_ptr<TDTiles::Tile> rootTile = buildTiles(root, env, rootBox);
+    if (!rootTile.valid())
+    {
+        OE_WARN << LC << "No tiles were written" << std::endl;
+        return -1;
+    }
+
+    rootTile->geometricError() = env.geometricError[0];
+    writeTileset(rootTile.get(), env.geometricError[0], outputLocation + "/tileset.json");
+
+    OE_NOTICE << LC << "Done in "
+        << std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() << "s" << std::endl;
 
     return 0;
 }
@@ -0,0 +1,179 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/MapNode>
+#include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
+#include <osgEarthProcedural/LifeMapLayer>
+#include <osgDB/ReadFile>
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+using namespace osgEarth;
+using namespace osgEarth::Procedural;
+
+// Measures the rate at which a LifeMapLayer generates tiles at 256 and 512
+// pixels, using the inputs (elevation, land cover, masks) of an earth file.
+
+int
+usage(const std::string& message)
+{
+    OE_WARN
+        << "\n\n" << message
+        << "\n\nUsage: osgearth_lifemapbench file.earth"
+        << "\n"
+        << "\n     --center [lon] [lat]     : Center of the benchmark area (default=0 0)"
+        << "\n     --level [lod]            : Level of the tiles to generate (default=12)"
+        << "\n     --tiles [num]            : Width of the square block of tiles (default=4)"
+        << "\n     --iterations [num]       : Number of passes over the tiles (default=3)"
+        << "\n     --threads [num]          : Number of generating threads (default=1)"
+        << "\n"
+        << "\nIf the earth file contains a LifeMapLayer its options are used;"
+        << "\notherwise a default LifeMapLayer is benchmarked."
+        << "\n"
+        << std::endl;
+
+    return -1;
+}
+
+double
+run(Map* map, const LifeMapLayer::Options& templateOptions, unsigned size, const std::vector<TileKey>& keys, unsigned iterations, unsigned numThreads, unsigned& generated)
+{
+    LifeMapLayer::Options options(templateOptions);
+    options.name() = Stringify() << "lifemap bench " << size;
+    options.tileSize() = size;
+    options.cachePolicy() = CachePolicy::NO_CACHE;
+
+    osg::ref_ptr<LifeMapLayer> layer = new LifeMapLayer(options);
+    map->addLayer(layer.get());
+    if (!layer->isOpen())
+    {
+        OE_WARN << layer->getStatus().message() << std::endl;
+        map->removeLayer(layer.get());
+        return 0.0;
+    }
+
+    // warm up the elevation and input caches so we measure the kernel
+    for (auto& key : keys)
+        layer->createImage(key, nullptr);
+
+    unsigned total = keys.size() * iterations;
+    std::atomic_uint next(0u);
+    std::atomic_uint numGenerated(0u);
+
+    auto work = [&]()
+    {
+        unsigned i;
+        while ((i = next++) < total)
+        {
+            GeoImage image = layer->createImage(keys[i % keys.size()], nullptr);
+            if (image.valid())
+                ++numGenerated;
+        }
+    };
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < numThreads; ++i)
+        threads.emplace_back(work);
+    work();
+    for (auto& t : threads)
+        t.join();
+
+    double s = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+    generated = numGenerated;
+    map->removeLayer(layer.get());
+    return s;
+}
+
+int
+main(int argc, char** argv)
+{
+    osgEarth::initialize();
+
+    osg::ArgumentParser arguments(&argc, argv);
+
+    double lon = 0.0, lat = 0.0;
+    arguments.read("--center", lon, lat);
+
+    unsigned level = 12u;
+    arguments.read("--level", level);
+
+    unsigned width = 4u;
+    arguments.read("--tiles", width);
+    width = std::max(width, 1u);
+
+    unsigned iterations = 3u;
+    arguments.read("--iterations", iterations);
+    iterations = std::max(iterations, 1u);
+
+    unsigned numThreads = 1u;
+    arguments.read("--threads", numThreads);
+    numThreads = std::max(numThreads, 1u);
+
+    osg::ref_ptr<osg::Node> node = osgDB::readNodeFiles(arguments);
+    MapNode* mapNode = MapNode::get(node.get());
+    if (!mapNode)
+        return usage("Missing or invalid earth file");
+
+    Map* map = mapNode->getMap();
+
+    LifeMapLayer::Options options;
+    LifeMapLayer* existing = map->getLayer<LifeMapLayer>();
+    if (existing)
+        options = existing->options();
+
+    // LifeMapLayer tiles are always in the global geodetic profile
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    TileKey origin = profile->createTileKey(lon, lat, level);
+    if (!origin.valid())
+        return usage("Center is outside the profile");
+
+    std::vector<TileKey> keys;
+    int half = (int)width / 2;
+    for (int y = 0; y < (int)width; ++y)
+        for (int x = 0; x < (int)width; ++x)
+            keys.push_back(origin.createNeighborKey(x - half, y - half));
+
+    std::cout << "Generating " << keys.size() << " tiles at level " << level
+        << " x " << iterations << " iterations on " << numThreads << " thread(s)" << std::endl;
+
+    const unsigned sizes[2] = { 256u, 512u };
+    for (unsigned size : sizes)
+    {
+        unsigned generated = 0u;
+        double s = run(map, options, size, keys, iterations, numThreads, generated);
+        if (s > 0.0)
+        {
+            std::cout << size << "x" << size << ": "
+                << (double)generated / s << " tiles/s, "
+                << (1000.0 * s / (double)std::max(generated, 1u)) << " ms/tile" << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,170 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+// TODO:  Reconfigure CMake to not require this.....
+#define OSGEARTH_HAVE_MVT 1
+#define OSGEARTH_HAVE_SQLITE3 1
+
+#include <osgEarth/TileKey>
+#include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
+#include <osgEarth/MVT>
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <sqlite3.h>
+
+#include <iostream>
+#include <sstream>
+
+using namespace osgEarth;
+
+// Compares the streaming MVT decoder against the protobuf reference decoder
+// over the tiles of an mbtiles database.
+
+int
+usage(const std::string& message)
+{
+    OE_WARN
+        << "\n\n" << message
+        << "\n\nUsage: osgearth_mvtbench file.mbtiles"
+        << "\n"
+        << "\n     --zoom [level]           : Zoom level of the tiles to decode (default=14)"
+        << "\n     --limit [num]            : Maximum number of tiles to read (default=1000)"
+        << "\n     --iterations [num]       : Number of passes over the tiles (default=5)"
+        << "\n     --attribute [name]       : Only decode the named attribute in the streaming pass. Will accept multiple --attribute arguments"
+        << "\n"
+        << std::endl;
+
+    return -1;
+}
+
+struct Tile
+{
+    TileKey key;
+    std::string data;
+};
+
+template<typename FUNC>
+double run(const char* name, const std::vector<Tile>& tiles, int iterations, FUNC&& func)
+{
+    std::size_t numFeatures = 0;
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (auto& tile : tiles)
+        {
+            FeatureList features;
+            func(tile, features);
+            numFeatures += features.size();
+        }
+    }
+    double s = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+    std::cout << name << ": " << s << " s, "
+        << (1000.0 * s / (double)(tiles.size() * iterations)) << " ms/tile, "
+        << numFeatures / iterations << " features" << std::endl;
+    return s;
+}
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc, argv);
+
+    if (argc < 2)
+        return usage("Missing mbtiles file");
+
+    std::string filename = argv[1];
+
+    int zoom = 14;
+    arguments.read("--zoom", zoom);
+
+    int limit = 1000;
+    arguments.read("--limit", limit);
+
+    int iterations = 5;
+    arguments.read("--iterations", iterations);
+
+    MVT::AttributeNames attributes;
+    std::string attribute;
+    while (arguments.read("--attribute", attribute))
+        attributes.insert(attribute);
+
+    sqlite3* database = nullptr;
+    if (sqlite3_open_v2(filename.c_str(), &database, SQLITE_OPEN_READONLY, 0L) != SQLITE_OK)
+        return usage(Stringify() << "Failed to open " << filename);
+
+    const Profile* profile = Registry::instance()->getSphericalMercatorProfile();
+    unsigned numCols, numRows;
+    profile->getNumTiles(zoom, numCols, numRows);
+
+    std::vector<Tile> tiles;
+    sqlite3_stmt* select = nullptr;
+    std::string query = Stringify()
+        << "SELECT tile_column, tile_row, tile_data FROM tiles WHERE zoom_level = " << zoom
+        << " LIMIT " << limit;
+
+    if (sqlite3_prepare_v2(database, query.c_str(), -1, &select, 0L) == SQLITE_OK)
+    {
+        while (sqlite3_step(select) == SQLITE_ROW)
+        {
+            Tile tile;
+            tile.key = TileKey(zoom, sqlite3_column_int(select, 0), numRows - sqlite3_column_int(select, 1) - 1, profile);
+            const char* data = (const char*)sqlite3_column_blob(select, 2);
+            tile.data.assign(data, sqlite3_column_bytes(select, 2));
+            tiles.push_back(tile);
+        }
+    }
+    sqlite3_finalize(select);
+    sqlite3_close(database);
+
+    if (tiles.empty())
+        return usage(Stringify() << "No tiles found at zoom " << zoom);
+
+    std::cout << "Decoding " << tiles.size() << " tiles x " << iterations << " iterations" << std::endl;
+
+    double protobuf = run("protobuf ", tiles, iterations, [](const Tile& tile, FeatureList& features)
+    {
+        std::istringstream in(tile.data);
+        MVT::readTileProtobuf(in, tile.key, features);
+    });
+
+    double streaming = run("streaming", tiles, iterations, [](const Tile& tile, FeatureList& features)
+    {
+        std::istringstream in(tile.data);
+        MVT::readTile(in, tile.key, features);
+    });
+
+    std::cout << "speedup: " << protobuf / streaming << "x" << std::endl;
+
+    if (!attributes.empty())
+    {
+        double filtered = run("filtered ", tiles, iterations, [&attributes](const Tile& tile, FeatureList& features)
+        {
+            std::istringstream in(tile.data);
+            MVT::readTile(in, tile.key, features, &attributes);
+        });
+
+        std::cout << "speedup: " << protobuf / filtered << "x" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/OGRFeatureSource>
+#include <osgEarth/FeatureCursor>
+#include <osgEarth/Registry>
+#include <osgEarth/Random>
+#include <osgEarth/StringUtils>
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+// Measures the rate at which an OGRFeatureSource creates tile-sized cursors,
+// with and without pooled dataset handles.
+
+int
+usage(const std::string& message)
+{
+    OE_WARN
+        << "\n\n" << message
+        << "\n\nUsage: osgearth_ogrbench file.shp"
+        << "\n"
+        << "\n     --level [lod]            : Level of the tiles to query (default=8)"
+        << "\n     --count [num]            : Number of cursors to create per run (default=2000)"
+        << "\n     --threads [num]          : Number of querying threads (default=1)"
+        << "\n     --pool-size [num]        : Pool size for the pooled run (default=number of threads)"
+        << "\n"
+        << std::endl;
+
+    return -1;
+}
+
+double
+run(unsigned poolSize, const std::string& url, unsigned level, unsigned count, unsigned numThreads, unsigned& features)
+{
+    osg::ref_ptr<OGRFeatureSource> fs = new OGRFeatureSource();
+    fs->setURL(url);
+    fs->options().poolSize() = poolSize;
+    if (fs->open().isError())
+    {
+        OE_WARN << fs->getStatus().message() << std::endl;
+        return 0.0;
+    }
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    GeoExtent extent = fs->getFeatureProfile()->getExtent().transform(profile->getSRS());
+
+    std::atomic_uint next(0u);
+    std::atomic_uint numFeatures(0u);
+
+    auto work = [&](unsigned seed)
+    {
+        Random prng(seed);
+        while (next++ < count)
+        {
+            // random tile inside the data extent
+            double x = extent.xMin() + prng.next() * extent.width();
+            double y = extent.yMin() + prng.next() * extent.height();
+            TileKey key = profile->createTileKey(x, y, level);
+
+            Query query;
+            query.tileKey() = key;
+            osg::ref_ptr<FeatureCursor> cursor = fs->createFeatureCursor(query, nullptr);
+            if (cursor.valid() && cursor->hasMore())
+            {
+                cursor->nextFeature();
+                ++numFeatures;
+            }
+        }
+    };
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < numThreads; ++i)
+        threads.emplace_back(work, i);
+    work(0u);
+    for (auto& t : threads)
+        t.join();
+
+    double s = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+    features = numFeatures;
+    fs->close();
+    return s;
+}
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc, argv);
+
+    if (argc < 2)
+        return usage("Missing feature file");
+
+    std::string url = argv[1];
+
+    unsigned level = 8u;
+    arguments.read("--level", level);
+
+    unsigned count = 2000u;
+    arguments.read("--count", count);
+
+    unsigned numThreads = 1u;
+    arguments.read("--threads", numThreads);
+    numThreads = std::max(numThreads, 1u);
+
+    unsigned poolSize = numThreads;
+    arguments.read("--pool-size", poolSize);
+    poolSize = std::max(poolSize, 1u);
+
+    unsigned hits = 0u;
+
+    double unpooled = run(0u, url, level, count, numThreads, hits);
+    std::cout << "unpooled: " << count / unpooled << " cursors/s (" << hits << " non-empty)" << std::endl;
+
+    double pooled = run(poolSize, url, level, count, numThreads, hits);
+    std::cout << "pooled:   " << count / pooled << " cursors/s (" << hits << " non-empty)" << std::endl;
+
+    if (pooled > 0.0)
+        std::cout << "speedup:  " << unpooled / pooled << "x" << std::endl;
+
+    return 0;
+}
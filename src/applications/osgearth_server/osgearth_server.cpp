@@ -27,6 +27,10 @@
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/ExampleResources>
 #include <osgEarth/Threading>
+#include <osgEarth/ImageLayer>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/DebugImageLayer>
 #include <osgDB/ReaderWriter>
 #include <osgDB/ReadFile>
 #include <osgDB/Registry>
@@ -40,6 +44,10 @@
 #include <Poco/Net/HTTPServerResponse.h>
 #include <Poco/Net/HTTPServerParams.h>
 #include <Poco/Net/ServerSocket.h>
+#include <Poco/Net/HTTPClientSession.h>
+#include <Poco/Net/HTTPRequest.h>
+#include <Poco/Net/HTTPResponse.h>
+#include <Poco/Net/SocketAddress.h>
 #include <Poco/Timestamp.h>
 #include <Poco/DateTimeFormatter.h>
 #include <Poco/DateTimeFormat.h>
@@ -49,7 +57,12 @@
 #include <Poco/Util/Option.h>
 #include <Poco/Util/OptionSet.h>
 #include <Poco/Util/HelpFormatter.h>
+#include <atomic>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 using Poco::Net::ServerSocket;
 using Poco::Net::HTTPRequestHandler;
@@ -297,6 +310,13 @@ usage(const char* name)
 {
     OE_NOTICE
         << "\nUsage: " << name << " file.earth" << std::endl
+        << "    --port <port>       : port to listen on (default = 8000)" << std::endl
+        << "    --headless          : serve /{layer}/{z}/{x}/{y}.{ext} from the map layers" << std::endl
+        << "                          directly, without a graphics context" << std::endl
+        << "    --threads <n>       : request threads in headless mode" << std::endl
+        << "    --profile <name>    : tiling profile in headless mode (default = map profile)" << std::endl
+        << "    --tms               : rows count from the bottom (TMS) in headless mode" << std::endl
+        << "    --selftest          : run the headless service over loopback and exit" << std::endl
         << MapNodeHelper().usage() << std::endl;
 
     return 0;
@@ -550,11 +570,370 @@ class TileRequestHandlerFactory : public HTTPRequestHandlerFactory
     }
 };
 
+/**
+ * Headless tile service. Answers /{layer}/{z}/{x}/{y}.{ext} directly from
+ * ImageLayer::createImage and ElevationLayer::createHeightField, with no
+ * graphics context, so requests run in parallel on the HTTP thread pool.
+ *
+ * The layer name "_map" composites every visible image layer in the map.
+ * Elevation tiles are encoded as Mapbox Terrain-RGB PNGs.
+ */
+class LayerTileService
+{
+public:
+    struct Tile
+    {
+        Tile() : status(Poco::Net::HTTPResponse::HTTP_NOT_FOUND) { }
+        Poco::Net::HTTPResponse::HTTPStatus status;
+        std::string mimeType;
+        std::string body;
+    };
+    using TileRef = std::shared_ptr<const Tile>;
+
+    LayerTileService(const Map* map, const Profile* profile, bool tms) :
+        _map(map),
+        _profile(profile ? profile : map->getProfile()),
+        _tms(tms),
+        _inflightMutex("LayerTileService(OE)")
+    {
+        //nop
+    }
+
+    //! Parses a request path into a layer name, tile key and extension.
+    bool parse(const std::string& uri, std::string& layerName, TileKey& key, std::string& ext) const
+    {
+        std::string path = uri.substr(0, uri.find('?'));
+        StringTokenizer tok("/");
+        StringVector tized;
+        tok.tokenize(path, tized);
+        if (tized.size() != 5 || tized[1].empty())
+            return false;
+
+        layerName = tized[1];
+        unsigned z = as<unsigned>(tized[2], 0u);
+        unsigned x = as<unsigned>(tized[3], 0u);
+        unsigned y = as<unsigned>(osgDB::getNameLessExtension(tized[4]), 0u);
+        ext = osgDB::convertToLowerCase(osgDB::getFileExtension(tized[4]));
+
+        unsigned cols = 0, rows = 0;
+        _profile->getNumTiles(z, cols, rows);
+        if (x >= cols || y >= rows)
+            return false;
+
+        // TileKeys count rows from the top, like XYZ.
+        if (_tms)
+            y = rows - y - 1;
+
+        key = TileKey(z, x, y, _profile.get());
+        return true;
+    }
+
+    //! Entity tag for a tile. It folds in the layer revisions, so it changes
+    //! whenever the data behind the tile does, and costs nothing to compute.
+    std::string etag(const std::string& layerName, const TileKey& key, const std::string& ext) const
+    {
+        std::stringstream buf;
+        buf << layerName << '/' << key.str() << '.' << ext;
+        if (layerName == "_map")
+        {
+            buf << '/' << _map->getDataModelRevision();
+        }
+        else
+        {
+            const Layer* layer = _map->getLayerByName(layerName);
+            buf << '/' << (layer ? layer->getRevision() : -1);
+        }
+        return Stringify() << '"' << std::hex << std::hash<std::string>()(buf.str()) << '"';
+    }
+
+    //! Creates and encodes a tile. Concurrent requests for the same tile
+    //! share one build instead of each doing the work.
+    TileRef getTile(const std::string& layerName, const TileKey& key, const std::string& ext, const std::string& etag)
+    {
+        std::string id = etag;
+        Promise<TileRef> promise;
+        Future<TileRef> future;
+        bool builder = false;
+        {
+            ScopedMutexLock lock(_inflightMutex);
+            auto i = _inflight.find(id);
+            if (i != _inflight.end())
+            {
+                future = i->second;
+            }
+            else
+            {
+                future = promise.getFuture();
+                _inflight[id] = future;
+                builder = true;
+            }
+        }
+
+        if (!builder)
+        {
+            TileRef tile = future.join();
+            return tile ? tile : std::make_shared<Tile>();
+        }
+
+        // always resolve the promise so that waiting requests don't hang
+        TileRef tile;
+        try
+        {
+            tile = buildTile(layerName, key, ext);
+        }
+        catch (const std::exception& ex)
+        {
+            OE_WARN << "Failed to build tile " << key.str() << " of \"" << layerName << "\": " << ex.what() << std::endl;
+        }
+        catch (...)
+        {
+            OE_WARN << "Failed to build tile " << key.str() << " of \"" << layerName << "\"" << std::endl;
+        }
+
+        if (!tile)
+        {
+            auto error = std::make_shared<Tile>();
+            error->status = Poco::Net::HTTPResponse::HTTP_INTERNAL_SERVER_ERROR;
+            tile = error;
+        }
+
+        promise.resolve(tile);
+        {
+            ScopedMutexLock lock(_inflightMutex);
+            _inflight.erase(id);
+        }
+        return tile;
+    }
+
+private:
+    osg::ref_ptr<const Map> _map;
+    osg::ref_ptr<const Profile> _profile;
+    bool _tms;
+    Mutex _inflightMutex;
+    std::unordered_map<std::string, Future<TileRef>> _inflight;
+
+    TileRef buildTile(const std::string& layerName, const TileKey& key, const std::string& ext) const
+    {
+        auto tile = std::make_shared<Tile>();
+
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(ext);
+        if (!rw)
+        {
+            tile->status = Poco::Net::HTTPResponse::HTTP_BAD_REQUEST;
+            return tile;
+        }
+        if (ext == "jpg" || ext == "jpeg")
+            tile->mimeType = "image/jpeg";
+        else
+            tile->mimeType = Stringify() << "image/" << ext;
+
+        osg::ref_ptr<osg::Image> image;
+
+        if (layerName == "_map")
+        {
+            image = compositeImageLayers(key);
+        }
+        else
+        {
+            Layer* layer = _map->getLayerByName(layerName);
+            ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(layer);
+            ElevationLayer* elevationLayer = dynamic_cast<ElevationLayer*>(layer);
+
+            if (imageLayer && imageLayer->isOpen())
+            {
+                GeoImage geoImage = imageLayer->createImage(key, nullptr);
+                if (geoImage.valid())
+                    image = const_cast<osg::Image*>(geoImage.getImage());
+            }
+            else if (elevationLayer && elevationLayer->isOpen())
+            {
+                GeoHeightField geoHF = elevationLayer->createHeightField(key, nullptr);
+                if (geoHF.valid())
+                    image = encodeTerrainRGB(geoHF.getHeightField());
+            }
+        }
+
+        if (!image.valid())
+        {
+            return tile;
+        }
+
+        // JPEG has no alpha channel
+        if ((ext == "jpg" || ext == "jpeg") && image->getPixelFormat() != GL_RGB)
+        {
+            image = ImageUtils::convertToRGB8(image.get());
+        }
+
+        std::stringstream buf;
+        if (!image.valid() || rw->writeImage(*image.get(), buf).status() != osgDB::ReaderWriter::WriteResult::FILE_SAVED)
+        {
+            tile->status = Poco::Net::HTTPResponse::HTTP_INTERNAL_SERVER_ERROR;
+            return tile;
+        }
+
+        tile->body = buf.str();
+        tile->status = Poco::Net::HTTPResponse::HTTP_OK;
+        return tile;
+    }
+
+    //! Blends all visible image layers, bottom to top, at their opacity
+    osg::Image* compositeImageLayers(const TileKey& key) const
+    {
+        ImageLayerVector layers;
+        _map->getLayers(layers);
+
+        osg::ref_ptr<osg::Image> result;
+
+        for (auto& layer : layers)
+        {
+            if (!layer->isOpen() || !layer->getVisible())
+                continue;
+
+            GeoImage geoImage = layer->createImage(key, nullptr);
+            if (!geoImage.valid())
+                continue;
+
+            osg::ref_ptr<osg::Image> image = ImageUtils::convertToRGBA8(geoImage.getImage());
+            if (!image.valid())
+                continue;
+
+            if (!result.valid())
+            {
+                result = new osg::Image(*image.get(), osg::CopyOp::DEEP_COPY_ALL);
+                ImageUtils::PixelReader read(result.get());
+                ImageUtils::PixelWriter write(result.get());
+                osg::Vec4f c;
+                for (int t = 0; t < result->t(); ++t)
+                {
+                    for (int s = 0; s < result->s(); ++s)
+                    {
+                        read(c, s, t);
+                        c.a() *= layer->getOpacity();
+                        write(c, s, t);
+                    }
+                }
+                continue;
+            }
+
+            if (image->s() != result->s() || image->t() != result->t())
+            {
+                osg::ref_ptr<osg::Image> resized;
+                if (!ImageUtils::resizeImage(image.get(), result->s(), result->t(), resized))
+                    continue;
+                image = resized;
+            }
+
+            ImageUtils::PixelReader readSrc(image.get());
+            ImageUtils::PixelReader readDst(result.get());
+            ImageUtils::PixelWriter write(result.get());
+            osg::Vec4f src, dst;
+            float opacity = layer->getOpacity();
+            for (int t = 0; t < result->t(); ++t)
+            {
+                for (int s = 0; s < result->s(); ++s)
+                {
+                    readSrc(src, s, t);
+                    readDst(dst, s, t);
+                    float a = src.a() * opacity;
+                    float outA = a + dst.a() * (1.0f - a);
+                    osg::Vec3f rgb(0, 0, 0);
+                    if (outA > 0.0f)
+                    {
+                        rgb =
+                            (osg::Vec3f(src.r(), src.g(), src.b()) * a +
+                             osg::Vec3f(dst.r(), dst.g(), dst.b()) * dst.a() * (1.0f - a)) / outA;
+                    }
+                    write(osg::Vec4f(rgb, outA), s, t);
+                }
+            }
+        }
+
+        return result.release();
+    }
+
+    //! Mapbox Terrain-RGB: height = -10000 + (R*65536 + G*256 + B) * 0.1
+    static osg::Image* encodeTerrainRGB(const osg::HeightField* hf)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(hf->getNumColumns(), hf->getNumRows(), 1, GL_RGB, GL_UNSIGNED_BYTE);
+        for (unsigned r = 0; r < hf->getNumRows(); ++r)
+        {
+            for (unsigned c = 0; c < hf->getNumColumns(); ++c)
+            {
+                float h = hf->getHeight(c, r);
+                if (h == NO_DATA_VALUE)
+                    h = 0.0f;
+                unsigned v = (unsigned)osg::clampBetween((h + 10000.0f) * 10.0f, 0.0f, 16777215.0f);
+                unsigned char* p = image->data(c, r);
+                p[0] = (v >> 16) & 0xFF;
+                p[1] = (v >> 8) & 0xFF;
+                p[2] = v & 0xFF;
+            }
+        }
+        return image;
+    }
+};
+
+static LayerTileService* _service;
+
+class LayerTileRequestHandler : public HTTPRequestHandler
+{
+public:
+    void handleRequest(HTTPServerRequest& request,
+                       HTTPServerResponse& response)
+    {
+        std::string layerName, ext;
+        TileKey key;
+        if (!_service->parse(request.getURI(), layerName, key, ext))
+        {
+            response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);
+            response.send();
+            return;
+        }
+
+        std::string etag = _service->etag(layerName, key, ext);
+        response.set("ETag", etag);
+        response.set("Cache-Control", "no-cache");
+
+        if (request.has("If-None-Match") && request.get("If-None-Match") == etag)
+        {
+            response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_NOT_MODIFIED);
+            response.send();
+            return;
+        }
+
+        LayerTileService::TileRef tile = _service->getTile(layerName, key, ext, etag);
+
+        response.setStatusAndReason(tile->status);
+        if (tile->status == Poco::Net::HTTPResponse::HTTP_OK)
+        {
+            response.setContentType(tile->mimeType);
+            response.sendBuffer(tile->body.data(), tile->body.size());
+        }
+        else
+        {
+            response.send();
+        }
+    }
+};
+
+class LayerTileRequestHandlerFactory : public HTTPRequestHandlerFactory
+{
+public:
+    HTTPRequestHandler* createRequestHandler(
+        const HTTPServerRequest& request)
+    {
+        return new LayerTileRequestHandler();
+    }
+};
+
 class TileHTTPServer: public Poco::Util::ServerApplication
 {
 public:
-    TileHTTPServer(int port):
-      _port(port)
+    TileHTTPServer(int port, HTTPRequestHandlerFactory* factory, int threads):
+      _port(port),
+      _factory(factory),
+      _threads(threads)
     {
     }
 
@@ -577,17 +956,121 @@ protected:
     int main(const std::vector<std::string>& args)
     {
         ServerSocket svs(_port);
-        HTTPServer srv(new TileRequestHandlerFactory(), svs, new HTTPServerParams);
-        srv.start();
+
+        // threads == 0 keeps Poco's default thread pool and settings
+        std::unique_ptr<ThreadPool> pool;
+        HTTPServerParams* params = new HTTPServerParams;
+        if (_threads > 0)
+        {
+            pool.reset(new ThreadPool(_threads, _threads));
+            params->setMaxThreads(_threads);
+        }
+
+        std::unique_ptr<HTTPServer> srv(pool ?
+            new HTTPServer(_factory, *pool, svs, params) :
+            new HTTPServer(_factory, svs, params));
+
+        srv->start();
         waitForTerminationRequest();
-        srv.stop();
+        srv->stop();
         return Application::EXIT_OK;
     }
 
 private:
     int _port;
+    HTTPRequestHandlerFactory* _factory;
+    int _threads;
+};
+
+// Debug layer whose revision the self test can change
+struct SelfTestLayer : public DebugImageLayer
+{
+    void touch() { bumpRevision(); }
 };
 
+//! Serves a debug layer over loopback and checks the responses.
+int
+selfTest(int threads)
+{
+    osg::ref_ptr<Map> map = new Map();
+    osg::ref_ptr<SelfTestLayer> debug = new SelfTestLayer();
+    debug->setName("debug");
+    map->addLayer(debug.get());
+
+    _service = new LayerTileService(map.get(), nullptr, false);
+
+    ThreadPool pool(threads, threads);
+    HTTPServerParams* params = new HTTPServerParams;
+    params->setMaxThreads(threads);
+    ServerSocket svs(Poco::Net::SocketAddress("127.0.0.1", 0));
+    HTTPServer srv(new LayerTileRequestHandlerFactory(), pool, svs, params);
+    srv.start();
+
+    Poco::UInt16 port = svs.address().port();
+    int failures = 0;
+
+    auto fetch = [port](const std::string& path, const std::string& etag, std::string& outETag)
+    {
+        Poco::Net::HTTPClientSession session("127.0.0.1", port);
+        Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_GET, path);
+        if (!etag.empty())
+            request.set("If-None-Match", etag);
+        session.sendRequest(request);
+        Poco::Net::HTTPResponse response;
+        std::istream& in = session.receiveResponse(response);
+        std::string body((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        outETag = response.has("ETag") ? response.get("ETag") : "";
+        return std::make_pair(response.getStatus(), body);
+    };
+
+    auto check = [&failures](bool ok, const std::string& what)
+    {
+        OE_NOTICE << (ok ? "PASS: " : "FAIL: ") << what << std::endl;
+        if (!ok) ++failures;
+    };
+
+    std::string etag, etag2;
+    auto r = fetch("/debug/1/0/0.png", "", etag);
+    check(r.first == Poco::Net::HTTPResponse::HTTP_OK && r.second.size() > 8 && r.second.compare(1, 3, "PNG") == 0, "image tile");
+
+    r = fetch("/debug/1/0/0.png", etag, etag2);
+    check(r.first == Poco::Net::HTTPResponse::HTTP_NOT_MODIFIED && etag == etag2, "ETag revalidation");
+
+    debug->touch();
+    r = fetch("/debug/1/0/0.png", etag, etag2);
+    check(r.first == Poco::Net::HTTPResponse::HTTP_OK && etag != etag2, "new ETag after revision change");
+
+    r = fetch("/missing/1/0/0.png", "", etag);
+    check(r.first == Poco::Net::HTTPResponse::HTTP_NOT_FOUND, "unknown layer");
+
+    r = fetch("/debug/1/99/0.png", "", etag);
+    check(r.first == Poco::Net::HTTPResponse::HTTP_NOT_FOUND, "tile out of range");
+
+    r = fetch("/_map/2/1/1.png", "", etag);
+    check(r.first == Poco::Net::HTTPResponse::HTTP_OK, "composite tile");
+
+    // many clients asking for the same tile at once
+    std::vector<std::thread> clients;
+    std::atomic_int ok(0);
+    for (int i = 0; i < 2 * threads; ++i)
+    {
+        clients.emplace_back([&]() {
+            std::string tag;
+            if (fetch("/debug/3/2/5.png", "", tag).first == Poco::Net::HTTPResponse::HTTP_OK)
+                ++ok;
+        });
+    }
+    for (auto& client : clients)
+        client.join();
+    check(ok == 2 * threads, "concurrent requests for one tile");
+
+    srv.stop();
+    delete _service;
+    _service = nullptr;
+
+    return failures == 0 ? 0 : -1;
+}
+
 
 
 int
@@ -603,12 +1086,24 @@ main(int argc, char** argv)
 
     int port = 8000;
     arguments.read("--port", port);
-    OE_NOTICE << "Listening on port " << port << std::endl;
+
+    int threads = std::max(2u, getConcurrency());
+    arguments.read("--threads", threads);
 
     // thread-safe initialization of the OSG wrapper manager. Calling this here
     // prevents the "unsupported wrapper" messages from OSG
     osgDB::Registry::instance()->getObjectWrapperManager()->findWrapper("osg::Image");
 
+    if (arguments.read("--selftest"))
+        return selfTest(threads);
+
+    bool headless = arguments.read("--headless");
+    bool tms = arguments.read("--tms");
+    std::string profileName;
+    arguments.read("--profile", profileName);
+
+    OE_NOTICE << "Listening on port " << port << std::endl;
+
         // load an earth file, and support all or our example command-line options
     // and earth file <external> tags
     osg::ref_ptr< osg::Node> node = osgDB::readNodeFiles( arguments );
@@ -619,8 +1114,23 @@ main(int argc, char** argv)
         OE_NOTICE << "Found map node" << std::endl;
     }
 
+    if (headless)
+    {
+        if (!mapNode.valid())
+            return usage(argv[0]);
+
+        osg::ref_ptr<const Profile> profile;
+        if (!profileName.empty())
+            profile = Profile::create(profileName);
+
+        _service = new LayerTileService(mapNode->getMap(), profile.get(), tms);
+
+        TileHTTPServer app(port, new LayerTileRequestHandlerFactory(), threads);
+        return app.run(argc, argv);
+    }
+
     _server = new TileImageServer( mapNode.get() );
 
-    TileHTTPServer app(port);
+    TileHTTPServer app(port, new TileRequestHandlerFactory(), 0);
     return app.run(argc, argv);
 }
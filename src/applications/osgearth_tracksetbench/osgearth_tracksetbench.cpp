@@ -0,0 +1,181 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/TrackSet>
+#include <osgEarth/TrackNode>
+#include <osgEarth/SpatialReference>
+#include <osgEarth/Random>
+#include <osgEarth/Notify>
+#include <osg/ArgumentParser>
+#include <osg/Viewport>
+#include <osg/Timer>
+
+#include <iostream>
+#include <sstream>
+
+using namespace osgEarth;
+
+// Headless benchmark of TrackSet: times a full position/heading/label
+// update of every track (batch build + submit + apply) and the per-frame
+// cull/projection pass, at several track counts. Optionally times the
+// same position update through one TrackNode per track for comparison.
+
+int
+usage(const std::string& message)
+{
+    OE_WARN
+        << "\n\n" << message
+        << "\n\nUsage: osgearth_tracksetbench"
+        << "\n"
+        << "\n     --count [num]            : Benchmark only this many tracks (default=10000, 50000, 100000)"
+        << "\n     --frames [num]           : Frames to simulate per count (default=20)"
+        << "\n     --viewport [w] [h]       : Viewport size in pixels (default=1920 1080)"
+        << "\n     --tracknodes             : Also time updating one TrackNode per track"
+        << "\n"
+        << std::endl;
+
+    return -1;
+}
+
+void
+makeUpdates(unsigned count, unsigned frame, Random& prng, TrackSet::Updates& updates)
+{
+    for (unsigned i = 0; i < count; ++i)
+    {
+        updates.setPosition(i, -180.0 + 360.0*prng.next(), -80.0 + 160.0*prng.next(), 10000.0*prng.next());
+        updates.setHeading(i, 360.0f*prng.next());
+        if (frame == 0)
+        {
+            std::stringstream buf;
+            buf << "Track " << i;
+            updates.setField(i, 0, buf.str());
+            updates.setPriority(i, (float)prng.next(100));
+        }
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc, argv);
+
+    if (arguments.read("--help"))
+        return usage("Help");
+
+    std::vector<unsigned> counts;
+    unsigned count = 0;
+    if (arguments.read("--count", count))
+    {
+        counts.push_back(count);
+    }
+    else
+    {
+        counts.push_back(10000);
+        counts.push_back(50000);
+        counts.push_back(100000);
+    }
+
+    unsigned frames = 20;
+    arguments.read("--frames", frames);
+
+    int width = 1920, height = 1080;
+    arguments.read("--viewport", width, height);
+
+    bool trackNodes = arguments.read("--tracknodes");
+
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+
+    // camera 8000km above the equator looking at the earth's center
+    osg::Vec3d eye;
+    wgs84->transform(osg::Vec3d(0, 0, 8.0e6), wgs84->getGeocentricSRS(), eye);
+    osg::Matrixd view = osg::Matrixd::lookAt(eye, osg::Vec3d(0, 0, 0), osg::Vec3d(0, 0, 1));
+    osg::Matrixd proj = osg::Matrixd::perspective(45.0, (double)width / (double)height, 1000.0, 2.0e7);
+    osg::ref_ptr<osg::Viewport> viewport = new osg::Viewport(0, 0, width, height);
+    osg::Matrixd mvpw = view * proj * viewport->computeWindowMatrix();
+
+    osg::Timer* timer = osg::Timer::instance();
+
+    std::cout
+        << "Viewport: " << width << "x" << height << ", frames: " << frames << std::endl
+        << std::endl
+        << "tracks   visible   update ms   project ms";
+    if (trackNodes)
+        std::cout << "   TrackNode update ms";
+    std::cout << std::endl;
+
+    for (unsigned c = 0; c < counts.size(); ++c)
+    {
+        count = counts[c];
+
+        osg::ref_ptr<TrackSet> tracks = new TrackSet();
+        TrackSet::Projection projection;
+        Random prng(0);
+
+        double updateMs = 0.0, projectMs = 0.0;
+        unsigned visible = 0u;
+
+        for (unsigned f = 0; f < frames; ++f)
+        {
+            osg::Timer_t t0 = timer->tick();
+            TrackSet::Updates updates;
+            makeUpdates(count, f, prng, updates);
+            tracks->submit(updates);
+            tracks->applyUpdates();
+            updateMs += timer->delta_m(t0, timer->tick());
+
+            t0 = timer->tick();
+            tracks->project(mvpw, eye, width, height, projection);
+            projectMs += timer->delta_m(t0, timer->tick());
+            visible += projection.ids.size();
+        }
+
+        std::cout
+            << count << "\t "
+            << (visible / frames) << "\t   "
+            << (updateMs / (double)frames) << "\t"
+            << (projectMs / (double)frames);
+
+        if (trackNodes)
+        {
+            std::vector<osg::ref_ptr<TrackNode>> nodes(count);
+            for (unsigned i = 0; i < count; ++i)
+                nodes[i] = new TrackNode(GeoPoint(wgs84, 0, 0, 0), (osg::Image*)0L, TrackNodeFieldSchema());
+
+            double nodeMs = 0.0;
+            for (unsigned f = 0; f < frames; ++f)
+            {
+                osg::Timer_t t0 = timer->tick();
+                for (unsigned i = 0; i < count; ++i)
+                {
+                    nodes[i]->setPosition(GeoPoint(wgs84,
+                        -180.0 + 360.0*prng.next(), -80.0 + 160.0*prng.next(), 10000.0*prng.next()));
+                }
+                nodeMs += timer->delta_m(t0, timer->tick());
+            }
+            std::cout << "\t\t" << (nodeMs / (double)frames);
+        }
+
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -33,6 +33,7 @@
 #include <osgEarth/GLUtils>
 #include <osgEarth/Text>
 #include <osgEarth/LineDrawable>
+#include <osgEarth/Containers>
 
 #include <osgText/Text>
 #include <osg/Depth>
@@ -41,6 +42,7 @@
 #include <osg/MatrixTransform>
 #include <osg/LightModel>
 #include <osg/Projection>
+#include <sstream>
 
 using namespace osgEarth;
 
@@ -60,13 +62,52 @@ AnnotationUtils::convertTextSymbolEncoding (const TextSymbol::Encoding encoding)
     return text_encoding;
 }
 
+namespace
+{
+    // Fully symbolized and laid-out text drawables, keyed by everything that
+    // goes into building one. Labels that share a string and a style (unit
+    // designators, road names) are cloned from the cached prototype instead of
+    // resolving the font and re-running the glyph layout for every style setting.
+    typedef LRUCache<std::string, osg::ref_ptr<osgEarth::Text> > TextPrototypeCache;
+
+    TextPrototypeCache& getTextPrototypeCache()
+    {
+        static TextPrototypeCache s_cache(true, 1024u);
+        return s_cache;
+    }
+
+    std::string makeTextPrototypeKey(const std::string& text,
+                                     const TextSymbol*  symbol,
+                                     const BBoxSymbol*  bbox,
+                                     const osg::BoundingBox& box)
+    {
+        std::stringstream buf;
+        buf << text << '\x1f'
+            << (symbol ? symbol->getConfig().toJSON() : std::string()) << '\x1f'
+            << (bbox ? bbox->getConfig().toJSON() : std::string()) << '\x1f'
+            << box.xMin() << ',' << box.yMin() << ',' << box.zMin() << ','
+            << box.xMax() << ',' << box.yMax() << ',' << box.zMax();
+        return buf.str();
+    }
+}
+
 osgText::Text*
 AnnotationUtils::createTextDrawable(const std::string& text,
                                     const TextSymbol*  symbol,
                                     const BBoxSymbol* bbox,
                                     const osg::BoundingBox& box)
 {
-    osgText::Text* drawable = new osgEarth::Text();
+    TextPrototypeCache& cache = getTextPrototypeCache();
+    std::string key = makeTextPrototypeKey(text, symbol, bbox, box);
+
+    TextPrototypeCache::Record record;
+    if (cache.get(key, record))
+    {
+        // shares the font, state set and settings of the prototype
+        return new osgEarth::Text(*record.value().get(), osg::CopyOp::SHALLOW_COPY);
+    }
+
+    osg::ref_ptr<osgEarth::Text> drawable = new osgEarth::Text();
 
     osgText::String::Encoding text_encoding = osgText::String::ENCODING_UNDEFINED;
     if ( symbol && symbol->encoding().isSet() )
@@ -77,7 +118,7 @@ AnnotationUtils::createTextDrawable(const std::string& text,
     drawable->setText( text, text_encoding );
 
     TextSymbolizer symbolizer(symbol);
-    symbolizer.apply(drawable, 0L, 0L, &box);
+    symbolizer.apply(drawable.get(), 0L, 0L, &box);
 
     // osgText::Text turns on depth writing by default, even if you turned it off.
     drawable->setEnableDepthWrites( false );
@@ -98,7 +139,10 @@ AnnotationUtils::createTextDrawable(const std::string& text,
         drawable->setDrawMode(mask);
     }
 
-    return drawable;
+    // the cached prototype is never drawn or modified; callers get a copy
+    cache.insert(key, drawable.get());
+
+    return new osgEarth::Text(*drawable.get(), osg::CopyOp::SHALLOW_COPY);
 }
 
 osg::Geometry*
@@ -137,6 +137,19 @@ BuildGeometryFilter::processPolygons(FeatureList& features, FilterContext& conte
         makeECEF   = context.getOutputSRS()->isGeographic();
     }
 
+    // Polygons are projected first and then tessellated together in one
+    // batch, which reuses the tessellator's scratch memory across the list.
+    struct PendingPolygon
+    {
+        osg::ref_ptr<osg::Geometry> _geom;
+        Feature* _feature;
+        osg::Matrixd _local2world;
+        osg::Vec4f _color;
+        bool _queued;
+    };
+    std::vector<PendingPolygon> polygons;
+    Tessellator::Batch batch;
+
     for( FeatureList::iterator f = features.begin(); f != features.end(); ++f )
     {
         Feature* input = f->get();
@@ -207,61 +220,92 @@ BuildGeometryFilter::processPolygons(FeatureList& features, FilterContext& conte
             for(Geometry::const_iterator i = part->begin(); i != part->end(); ++i )
                 hats->push_back( i->z() );
 
-            // build the geometry:
-            tileAndBuildPolygon(part, featureSRS, outputSRS, makeECEF, true, osgGeom.get(), w2l);
+            // project the polygon and queue it for tessellation:
+            unsigned queued = batch.size();
+            tileAndBuildPolygon(part, featureSRS, outputSRS, makeECEF, true, osgGeom.get(), w2l, &batch);
+
+            PendingPolygon pending;
+            pending._geom = osgGeom;
+            pending._feature = input;
+            pending._local2world = l2w;
+            pending._color = primaryColor;
+            pending._queued = batch.size() > queued;
+            polygons.push_back(pending);
+        }
+    }
 
-            osg::Vec3Array* allPoints = static_cast<osg::Vec3Array*>(osgGeom->getVertexArray());
-            if (allPoints && allPoints->size() > 0)
+    // tessellate all queued polygons in one pass:
+    if (batch.size() > 0)
+    {
+        std::vector<osg::Geometry*> targets;
+        targets.reserve(batch.size());
+        for (auto& pending : polygons)
+        {
+            if (pending._queued)
+                targets.push_back(pending._geom.get());
+        }
+
+        Tessellator tess;
+        tess.tessellate2D(batch, targets, Tessellator::PLANE_AUTO);
+    }
+
+    for (auto& pending : polygons)
+    {
+        Feature* input = pending._feature;
+        osg::Geometry* osgGeom = pending._geom.get();
+        const osg::Matrixd& l2w = pending._local2world;
+
+        osg::Vec3Array* allPoints = static_cast<osg::Vec3Array*>(osgGeom->getVertexArray());
+        if (allPoints && allPoints->size() > 0 && osgGeom->getNumPrimitiveSets() > 0)
+        {
+            // subdivide the mesh if necessary to conform to an ECEF globe:
+            if ( makeECEF )
             {
-                // subdivide the mesh if necessary to conform to an ECEF globe:
-                if ( makeECEF )
+                //convert back to world coords
+                for( osg::Vec3Array::iterator i = allPoints->begin(); i != allPoints->end(); ++i )
                 {
-                    //convert back to world coords
-                    for( osg::Vec3Array::iterator i = allPoints->begin(); i != allPoints->end(); ++i )
-                    {
-                        osg::Vec3d v(*i);
-                        v = v * l2w;
-                        v = v * _world2local;
+                    osg::Vec3d v(*i);
+                    v = v * l2w;
+                    v = v * _world2local;
 
-                        (*i)._v[0] = v[0];
-                        (*i)._v[1] = v[1];
-                        (*i)._v[2] = v[2];
-                    }
-
-                    double threshold = osg::DegreesToRadians( *_maxAngle_deg );
-                    //OE_TEST << "Running mesh subdivider with threshold " << *_maxAngle_deg << std::endl;
-                    MeshSubdivider ms( _world2local, _local2world );
-                    if ( input->geoInterp().isSet() )
-                        ms.run( *osgGeom, threshold, *input->geoInterp() );
-                    else
-                        ms.run( *osgGeom, threshold, *_geoInterp );
+                    (*i)._v[0] = v[0];
+                    (*i)._v[1] = v[1];
+                    (*i)._v[2] = v[2];
                 }
 
-                // assign the primary color array. PER_VERTEX required in order to support
-                // vertex optimization later
-                unsigned count = osgGeom->getVertexArray()->getNumElements();
-                osg::Vec4Array* colors = new osg::Vec4Array(osg::Array::BIND_PER_VERTEX);
-                colors->assign( count, primaryColor );
-                osgGeom->setColorArray( colors );
+                double threshold = osg::DegreesToRadians( *_maxAngle_deg );
+                //OE_TEST << "Running mesh subdivider with threshold " << *_maxAngle_deg << std::endl;
+                MeshSubdivider ms( _world2local, _local2world );
+                if ( input->geoInterp().isSet() )
+                    ms.run( *osgGeom, threshold, *input->geoInterp() );
+                else
+                    ms.run( *osgGeom, threshold, *_geoInterp );
+            }
 
-                geode->addDrawable( osgGeom );
+            // assign the primary color array. PER_VERTEX required in order to support
+            // vertex optimization later
+            unsigned count = osgGeom->getVertexArray()->getNumElements();
+            osg::Vec4Array* colors = new osg::Vec4Array(osg::Array::BIND_PER_VERTEX);
+            colors->assign( count, pending._color );
+            osgGeom->setColorArray( colors );
 
-                // record the geometry's primitive set(s) in the index:
-                if ( context.featureIndex() )
-                    context.featureIndex()->tagDrawable( osgGeom.get(), input );
+            geode->addDrawable( osgGeom );
 
-                // install clamping attributes if necessary
-                if (_style.has<AltitudeSymbol>() &&
-                    _style.get<AltitudeSymbol>()->technique() == AltitudeSymbol::TECHNIQUE_GPU)
-                {
-                    Clamping::applyDefaultClampingAttrs( osgGeom.get(), input->getDouble("__oe_verticalOffset", 0.0) );
-                }
-            }
-            else
+            // record the geometry's primitive set(s) in the index:
+            if ( context.featureIndex() )
+                context.featureIndex()->tagDrawable( osgGeom, input );
+
+            // install clamping attributes if necessary
+            if (_style.has<AltitudeSymbol>() &&
+                _style.get<AltitudeSymbol>()->technique() == AltitudeSymbol::TECHNIQUE_GPU)
             {
-                OE_TEST << LC << "Oh no. buildAndTilePolygon returned nothing.\n";
+                Clamping::applyDefaultClampingAttrs( osgGeom, input->getDouble("__oe_verticalOffset", 0.0) );
             }
         }
+        else
+        {
+            OE_TEST << LC << "Oh no. buildAndTilePolygon returned nothing.\n";
+        }
     }
 
     OE_TEST << LC << "Num drawables = " << geode->getNumDrawables() << "\n";
@@ -956,7 +1000,8 @@ BuildGeometryFilter::tileAndBuildPolygon(
     bool                    makeECEF,
     bool                    tessellate,
     osg::Geometry*          osgGeom,
-    const osg::Matrixd&     world2local)
+    const osg::Matrixd&     world2local,
+    Tessellator::Batch*     batch)
 {
     OE_SOFT_ASSERT_AND_RETURN(input != nullptr, __func__, );
     OE_SOFT_ASSERT_AND_RETURN(input->getType() != Geometry::TYPE_MULTI, __func__, );
@@ -1027,17 +1072,20 @@ BuildGeometryFilter::tileAndBuildPolygon(
         }
     }
 
-    // tessellate
-    Tessellator tess;
-
-    std::vector<uint32_t> indices;
-    if (tess.tessellate2D(proj.get(), indices, plane) == false)
-        return;
-
-    if (indices.empty())
-        return;
-
-    int offset = verts->size();
+    // queue for the caller to tessellate with the rest of its polygons,
+    // or tessellate now.
+    if (batch)
+    {
+        batch->add(proj.get());
+    }
+    else
+    {
+        Tessellator tess;
+        Tessellator::Batch single;
+        single.add(proj.get());
+        if (tess.tessellate2D(single, std::vector<osg::Geometry*>(1, osgGeom), plane) == false)
+            return;
+    }
 
     osg::Vec3d temp, vert;
 
@@ -1069,13 +1117,7 @@ BuildGeometryFilter::tileAndBuildPolygon(
         }
     }
 
-    osg::DrawElements* de = new osg::DrawElementsUInt(
-        GL_TRIANGLES,
-        indices.size(),
-        &indices[0]);
-
     osgGeom->setVertexArray(verts.get());
-    osgGeom->addPrimitiveSet(de);
 }
 
 #else
@@ -1087,7 +1129,8 @@ BuildGeometryFilter::tileAndBuildPolygon(Geometry*               ring,
                                          bool                    makeECEF,
                                          bool                    tessellate,
                                          osg::Geometry*          osgGeom,
-                                         const osg::Matrixd      &world2local)
+                                         const osg::Matrixd      &world2local,
+                                         Tessellator::Batch*     batch)
 {
     if (ring==NULL)
         return;
@@ -1,13 +1,206 @@
 #include <osgEarth/ClusterNode>
 
-#include <osgEarth/kdbush.hpp>
-
-typedef std::pair<int, int> TPoint;
-typedef std::vector< std::size_t > TIds;
+#include <cfloat>
+#include <cmath>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
 
+namespace
+{
+    // normalized web-mercator coordinates in [0..1], as used by Supercluster
+    inline void toMercator(double lon, double lat, double& x, double& y)
+    {
+        x = lon / 360.0 + 0.5;
+        double s = sin(osg::DegreesToRadians(lat));
+        double m = 0.5 - 0.25 * log((1.0 + s) / (1.0 - s)) / osg::PI;
+        y = osg::clampBetween(m, 0.0, 1.0);
+    }
+
+    inline std::uint64_t cellKey(std::int64_t cx, std::int64_t cy)
+    {
+        return ((std::uint64_t)(std::uint32_t)cx << 32) | (std::uint64_t)(std::uint32_t)cy;
+    }
+}
+
+ClusterHierarchy::ClusterHierarchy(unsigned radius, int maxZoom) :
+    _radius(radius),
+    _maxZoom(maxZoom),
+    _size(0u)
+{
+    setRadius(radius);
+}
+
+void
+ClusterHierarchy::setRadius(unsigned radius)
+{
+    _radius = radius;
+    _size = 0u;
+    _positions.clear();
+    _present.clear();
+
+    _levels.clear();
+    _levels.resize(_maxZoom + 1);
+    for (int z = 0; z <= _maxZoom; ++z)
+    {
+        // zoom level z spans 256 * 2^z pixels
+        _levels[z].radius = (double)std::max(radius, 1u) / ldexp(256.0, z);
+    }
+}
+
+void
+ClusterHierarchy::clear()
+{
+    setRadius(_radius);
+}
+
+void
+ClusterHierarchy::insert(unsigned id, double lon, double lat)
+{
+    if (id < _present.size() && _present[id])
+        remove(id);
+
+    if (id >= _positions.size())
+    {
+        _positions.resize(id + 1);
+        _present.resize(id + 1, false);
+        for (auto& level : _levels)
+            level.membership.resize(id + 1);
+    }
+
+    double x, y;
+    toMercator(lon, lat, x, y);
+    _positions[id].set(x, y);
+    _present[id] = true;
+    ++_size;
+
+    for (auto& level : _levels)
+    {
+        double r = level.radius;
+        std::int64_t cx = (std::int64_t)floor(x / r);
+        std::int64_t cy = (std::int64_t)floor(y / r);
+
+        // seeds live in cells one radius wide, so any seed within range
+        // of this point is in the 3x3 block of cells around it.
+        int best = -1;
+        double bestDist2 = DBL_MAX;
+        for (std::int64_t i = cx - 1; i <= cx + 1; ++i)
+        {
+            for (std::int64_t j = cy - 1; j <= cy + 1; ++j)
+            {
+                auto cell = level.grid.find(cellKey(i, j));
+                if (cell == level.grid.end())
+                    continue;
+
+                for (unsigned c : cell->second)
+                {
+                    const Cluster& cluster = level.clusters[c];
+                    double dx = cluster.x - x, dy = cluster.y - y;
+                    if (fabs(dx) > r || fabs(dy) > r)
+                        continue;
+
+                    double dist2 = dx * dx + dy * dy;
+                    if (dist2 < bestDist2 && (!_canCluster || _canCluster(cluster.seed, id)))
+                    {
+                        best = (int)c;
+                        bestDist2 = dist2;
+                    }
+                }
+            }
+        }
+
+        if (best < 0)
+        {
+            if (!level.freeClusters.empty())
+            {
+                best = (int)level.freeClusters.back();
+                level.freeClusters.pop_back();
+            }
+            else
+            {
+                best = (int)level.clusters.size();
+                level.clusters.emplace_back();
+            }
+
+            Cluster& cluster = level.clusters[best];
+            cluster.x = x;
+            cluster.y = y;
+            cluster.seed = id;
+            level.grid[cellKey(cx, cy)].push_back((unsigned)best);
+        }
+
+        level.clusters[best].points.push_back(id);
+        level.membership[id] = (unsigned)best;
+    }
+}
+
+void
+ClusterHierarchy::remove(unsigned id)
+{
+    if (id >= _present.size() || !_present[id])
+        return;
+
+    for (auto& level : _levels)
+    {
+        unsigned c = level.membership[id];
+        Cluster& cluster = level.clusters[c];
+
+        auto i = std::find(cluster.points.begin(), cluster.points.end(), id);
+        if (i != cluster.points.end())
+            cluster.points.erase(i);
+
+        if (cluster.points.empty())
+        {
+            double r = level.radius;
+            auto cell = level.grid.find(cellKey(
+                (std::int64_t)floor(cluster.x / r),
+                (std::int64_t)floor(cluster.y / r)));
+
+            if (cell != level.grid.end())
+            {
+                auto j = std::find(cell->second.begin(), cell->second.end(), c);
+                if (j != cell->second.end())
+                    cell->second.erase(j);
+                if (cell->second.empty())
+                    level.grid.erase(cell);
+            }
+            level.freeClusters.push_back(c);
+        }
+        else if (cluster.seed == id)
+        {
+            // the cluster keeps its position; only the representative changes
+            cluster.seed = cluster.points.front();
+        }
+    }
+
+    _present[id] = false;
+    --_size;
+}
+
+int
+ClusterHierarchy::getLevel(double pixelsPerUnit) const
+{
+    if (pixelsPerUnit <= 256.0)
+        return 0;
+
+    int level = (int)floor(log2(pixelsPerUnit / 256.0));
+    return std::min(level, _maxZoom + 1);
+}
+
+const std::vector<ClusterHierarchy::Cluster>&
+ClusterHierarchy::getClusters(int level) const
+{
+    return _levels[osg::clampBetween(level, 0, _maxZoom)].clusters;
+}
+
+unsigned
+ClusterHierarchy::getCluster(int level, unsigned id) const
+{
+    return _levels[osg::clampBetween(level, 0, _maxZoom)].membership[id];
+}
+
+//........................................................................
+
 ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
     _radius(50),
     _mapNode(mapNode),
@@ -20,13 +213,23 @@ ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
     setCullingActive(false);
     
     _horizon = new Horizon();
+
+    _hierarchy.setCanCluster([this](unsigned seed, unsigned point)
+    {
+        return
+            !_canClusterCallback.valid() ||
+            (*_canClusterCallback)(_indexedNodes[seed].get(), _indexedNodes[point].get());
+    });
 }
 
 void ClusterNode::addNode(osg::Node* node)
 {
     _nodes.push_back(node);
+    if (!_dirtyIndex)
+    {
+        insertIntoIndex(node);
+    }
     _dirty = true;
-    _dirtyIndex = true;
 }
 
 void ClusterNode::removeNode(osg::Node* node)
@@ -36,8 +239,19 @@ void ClusterNode::removeNode(osg::Node* node)
     {
         _nodes.erase(itr);
     }
+
+    if (!_dirtyIndex)
+    {
+        auto id = _nodeIds.find(node);
+        if (id != _nodeIds.end())
+        {
+            _hierarchy.remove(id->second);
+            _indexedNodes[id->second] = nullptr;
+            _freeIds.push_back(id->second);
+            _nodeIds.erase(id);
+        }
+    }
     _dirty = true;
-    _dirtyIndex = true;
 }
 
 void ClusterNode::clear()
@@ -54,7 +268,11 @@ unsigned int ClusterNode::getRadius() const
 
 void ClusterNode::setRadius(unsigned int radius)
 {
-    _radius = radius;
+    if (_radius != radius)
+    {
+        _radius = radius;
+        _dirtyIndex = true;
+    }
     _dirty = true;
 }
 
@@ -107,43 +325,95 @@ void ClusterNode::setCanClusterCallback(ClusterNode::CanClusterCallback* callbac
 {
     _canClusterCallback = callback;
     _dirty = true;
+    _dirtyIndex = true;
 }
 
-namespace
+void ClusterNode::insertIntoIndex(osg::Node* node)
 {
-    bool boundSort(const osg::ref_ptr< osg::Node> &i, const osg::ref_ptr< osg::Node> &j)
+    if (!_mapNode.valid())
     {
-        osg::BoundingSphere bsI = i->getBound();
-        osg::BoundingSphere bsJ = j->getBound();
+        _dirtyIndex = true;
+        return;
+    }
 
-        return bsI.center().x() < bsJ.center().x();
+    if (_nodeIds.find(node) != _nodeIds.end())
+        return;
+
+    unsigned id;
+    if (!_freeIds.empty())
+    {
+        id = _freeIds.back();
+        _freeIds.pop_back();
+        _indexedNodes[id] = node;
+    }
+    else
+    {
+        id = _indexedNodes.size();
+        _indexedNodes.push_back(node);
+    }
+    _nodeIds[node] = id;
+
+    if (id >= _indexedPoints.size())
+    {
+        _indexedPoints.resize(id + 1);
     }
+
+    indexPoint(id);
 }
-void ClusterNode::buildIndex()
+
+void ClusterNode::indexPoint(unsigned id)
 {
-    if (_dirtyIndex)
-    {
-        _clusterIndex.clear();
+    const SpatialReference* mapSRS = _mapNode->getMapSRS();
+    IndexedPoint& indexed = _indexedPoints[id];
+    indexed.world = _indexedNodes[id]->getBound().center();
 
-        std::sort(_nodes.begin(), _nodes.end(), boundSort);
+    GeoPoint point;
+    point.fromWorld(mapSRS, indexed.world);
+    point = point.transform(mapSRS->getGeographicSRS());
 
-        unsigned int maxNodes = 10000;
+    indexed.metersPerUnit =
+        2.0 * osg::PI * mapSRS->getEllipsoid().getRadiusEquator() *
+        cos(osg::DegreesToRadians(point.y()));
 
-        osg::Group* currentGroup = 0;
+    // re-inserting an ID moves the point
+    _hierarchy.insert(id, point.x(), point.y());
+}
 
-        for (unsigned int i = 0; i < _nodes.size(); i++)
+bool ClusterNode::updateIndex()
+{
+    // Re-cluster any node whose bound moved since it was indexed,
+    // e.g. a PlaceNode after setPosition.
+    bool moved = false;
+    for (unsigned id = 0; id < _indexedNodes.size(); ++id)
+    {
+        osg::Node* node = _indexedNodes[id].get();
+        if (node && node->getBound().center() != _indexedPoints[id].world)
         {
-            if (!currentGroup || currentGroup->getNumChildren() >= maxNodes)
-            {
-                currentGroup = new osg::Group;
-                _clusterIndex.push_back(currentGroup);
-            }
-            currentGroup->addChild(_nodes[i]);                      
+            indexPoint(id);
+            moved = true;
         }
     }
-    _dirtyIndex = false;
+    return moved;
 }
 
+void ClusterNode::buildIndex()
+{
+    if (_dirtyIndex && _mapNode.valid())
+    {
+        _dirtyIndex = false;
+
+        _hierarchy.setRadius(_radius);
+        _indexedNodes.clear();
+        _indexedPoints.clear();
+        _nodeIds.clear();
+        _freeIds.clear();
+
+        for (auto& node : _nodes)
+        {
+            insertIntoIndex(node.get());
+        }
+    }
+}
 
 void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
 {
@@ -161,105 +431,143 @@ void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
         camera->getProjectionMatrix() *
         camera->getViewport()->computeWindowMatrix();
 
-    std::vector<TPoint> points;
-
-    osg::NodeList validPlaces;
-
     buildIndex();
 
-    for (osg::NodeList::iterator itr = _clusterIndex.begin(); itr != _clusterIndex.end(); ++itr)
+    if (_nodeIds.empty())
     {
-        osg::Group* index = static_cast<osg::Group*>(itr->get());
-        if (cv->isCulled(index->getBound()))
-        {
-            continue;
-        }
+        return;
+    }
 
-        for (unsigned int i = 0; i < index->getNumChildren(); i++)
+    auto isVisible = [&](osg::Node* node, osg::Vec3d& world)
+    {
+        world = node->getBound().center();
+
+        if (cv->isCulled(*node) || !_horizon->isVisible(world))
         {
-            osg::Node* node = index->getChild(i);
-            osg::Vec3d world = node->getBound().center();
+            return false;
+        }
 
-            if (cv->isCulled(*node))
-            {
-                continue;
-            }
+        osg::Vec3d screen = world * mvpw;
+        return
+            screen.x() >= 0 && screen.x() <= viewport->width() &&
+            screen.y() >= 0 && screen.y() <= viewport->height();
+    };
 
-            if (!_horizon->isVisible(world))
-            {
-                continue;
-            }
+    auto addCluster = [&](Cluster& cluster, const osg::Vec3d& world)
+    {
+        std::stringstream buf;
+        buf << cluster.nodes.size() << std::endl;
 
-            osg::Vec3d screen = world * mvpw;
+        PlaceNode* marker = getOrCreateLabel();
+        GeoPoint markerPos;
+        markerPos.fromWorld(_mapNode->getMapSRS(), world);
+        marker->setPosition(markerPos);
+        marker->setText(buf.str());
 
-            if (screen.x() >= 0 && screen.x() <= viewport->width() &&
-                screen.y() >= 0 && screen.y() <= viewport->height())
-            {
-                validPlaces.push_back(node);
-                points.push_back(TPoint(screen.x(), screen.y()));
-            }
-        }
+        cluster.marker = marker;
+        out.push_back(cluster);
+    };
+
+    // Screen scale in pixels per meter: at one meter from the eye for a
+    // perspective camera (divide by distance), or everywhere for ortho.
+    bool perspective = false;
+    double pixelsPerMeter = 0.0;
+    double fovy, ar, zn, zf, left, right, bottom, top;
+    if (camera->getProjectionMatrixAsPerspective(fovy, ar, zn, zf))
+    {
+        perspective = true;
+        pixelsPerMeter = viewport->height() / (2.0 * tan(osg::DegreesToRadians(0.5 * fovy)));
+    }
+    else if (camera->getProjectionMatrixAsOrtho(left, right, bottom, top, zn, zf) && top > bottom)
+    {
+        pixelsPerMeter = viewport->height() / (top - bottom);
     }
 
-    if (validPlaces.size() == 0) return;
-
-    kdbush::KDBush<TPoint> index(points);
-    std::set< unsigned int > clustered;
+    osg::Vec3d eye = camera->getInverseViewMatrix().getTrans();
+    int maxZoom = _hierarchy.getMaxZoom();
 
-    for (unsigned int i = 0; i < validPlaces.size(); i++)
+    // Each node picks the level matching its own screen scale and joins its
+    // cluster at that level, so near nodes break apart while distant ones
+    // stay grouped. Nodes that land in the same cluster are drawn together.
+    struct Group
     {
-        TPoint &screen = points[i];
-        osg::Node* node = validPlaces[i].get();
+        int level;
+        unsigned cluster;
+        std::vector<unsigned> ids;
+    };
+    std::vector<Group> groups;
+    std::unordered_map<std::uint64_t, unsigned> groupIndex;
+    std::vector<int> levels(_indexedNodes.size(), -1);
+
+    osg::Vec3d world;
 
-        // If this thing is already part of a cluster then just continue.
-        if (clustered.find(i) != clustered.end())
+    for (unsigned id = 0; id < _indexedNodes.size(); ++id)
+    {
+        osg::Node* node = _indexedNodes[id].get();
+        if (!node)
         {
             continue;
         }
 
-        osg::Vec3d world = node->getBound().center();
-
-        // Get any matching indices that are part of this cluster.
-        TIds indices;
-
-        index.range(screen.first - _radius, screen.second - _radius, screen.first + _radius, screen.second + _radius, indices);
-
-        // Create a new cluster.
-        Cluster cluster;
+        const IndexedPoint& indexed = _indexedPoints[id];
+        double scale = pixelsPerMeter * indexed.metersPerUnit;
+        if (perspective)
+        {
+            scale /= osg::maximum((indexed.world - eye).length(), 1.0);
+        }
 
-        unsigned int actualCount = 0;
+        int level = _hierarchy.getLevel(scale);
+        levels[id] = level;
 
-        // Add all of the points to the cluster.
-        for (unsigned int j = 0; j < indices.size(); j++)
+        if (level > maxZoom)
         {
-            if (clustered.find(indices[j]) == clustered.end())
+            // Zoomed in past the last clustering level; the node stands alone.
+            if (isVisible(node, world))
             {
-                if (_canClusterCallback.valid())
-                {
-                    bool canCluster = (*_canClusterCallback)(node, validPlaces[indices[j]].get());
-                    if (!canCluster) {
-                        continue;
-                    }
-                }
-                cluster.nodes.push_back(validPlaces[indices[j]]);
-                actualCount++;
-                clustered.insert(indices[j]);
+                Cluster cluster;
+                cluster.nodes.push_back(node);
+                addCluster(cluster, world);
             }
+            continue;
         }
 
-        std::stringstream buf;
-        buf << actualCount << std::endl;
+        unsigned c = _hierarchy.getCluster(level, id);
+        std::uint64_t key = ((std::uint64_t)level << 32) | c;
+        auto g = groupIndex.find(key);
+        if (g == groupIndex.end())
+        {
+            groupIndex[key] = groups.size();
+            groups.push_back(Group{ level, c, std::vector<unsigned>() });
+            groups.back().ids.push_back(id);
+        }
+        else
+        {
+            groups[g->second].ids.push_back(id);
+        }
+    }
 
-        PlaceNode* marker = getOrCreateLabel();
-        GeoPoint markerPos;
-        markerPos.fromWorld(_mapNode->getMapSRS(), world);
-        marker->setPosition(markerPos);
-        marker->setText(buf.str());
+    for (auto& group : groups)
+    {
+        // A cluster is drawn at, and culled by, its representative node:
+        // the seed if it chose this level too, else its first member.
+        unsigned seed = _hierarchy.getClusters(group.level)[group.cluster].seed;
+        if (levels[seed] != group.level)
+        {
+            seed = group.ids.front();
+        }
 
-        cluster.marker = marker;
-        out.push_back(cluster);
+        if (!isVisible(_indexedNodes[seed].get(), world))
+        {
+            continue;
+        }
 
-        clustered.insert(i);
+        Cluster cluster;
+        cluster.nodes.reserve(group.ids.size());
+        for (unsigned id : group.ids)
+        {
+            cluster.nodes.push_back(_indexedNodes[id]);
+        }
+        addCluster(cluster, world);
     }
 }
 
@@ -281,6 +589,12 @@ void ClusterNode::traverse(osg::NodeVisitor& nv)
         {
             if (_mapNode.valid())
             {
+                buildIndex();
+                if (!_dirtyIndex && updateIndex())
+                {
+                    _dirty = true;
+                }
+
                 const osg::Matrixd &currentViewMatrix = cv->getCurrentCamera()->getViewMatrix();
                 if (_lastViewMatrix != currentViewMatrix || _dirty)
                 {
@@ -22,13 +22,373 @@
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/HeightFieldUtils>
 #include <osgEarth/ImageToHeightFieldConverter>
+#include <osgEarth/TerrainEngineNode>
 #include <osg/MatrixTransform>
 #include <osg/BlendFunc>
 #include <osg/BlendEquation>
+#include <osgEarth/rtree.h>
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
 
+#define LC "[DecalStore] "
+
+namespace
+{
+    struct Rect {
+        double _min[2], _max[2];
+    };
+
+    // Expresses an extent as one or two rectangles in the index SRS,
+    // splitting at the antimeridian. Returns false if it has no valid
+    // representation there.
+    bool toRects(const GeoExtent& extent, const SpatialReference* srs, std::vector<Rect>& rects)
+    {
+        GeoExtent e = extent.getSRS()->isHorizEquivalentTo(srs) ? extent : extent.transform(srs);
+        if (!e.isValid())
+            return false;
+
+        GeoExtent a, b;
+        if (e.crossesAntimeridian() && e.splitAcrossAntimeridian(a, b))
+        {
+            rects.push_back(Rect{ { a.xMin(), a.yMin() }, { a.xMax(), a.yMax() } });
+            rects.push_back(Rect{ { b.xMin(), b.yMin() }, { b.xMax(), b.yMax() } });
+        }
+        else
+        {
+            rects.push_back(Rect{ { e.xMin(), e.yMin() }, { e.xMax(), e.yMax() } });
+        }
+        return true;
+    }
+
+    bool overlaps(const std::vector<Rect>& a, const std::vector<Rect>& b)
+    {
+        for (auto& r : a)
+            for (auto& q : b)
+                if (r._min[0] <= q._max[0] && r._max[0] >= q._min[0] &&
+                    r._min[1] <= q._max[1] && r._max[1] >= q._min[1])
+                    return true;
+        return false;
+    }
+
+    // Refreshes the terrain tiles under the decals that changed in a batch,
+    // merging overlapping extents so no area is invalidated twice.
+    void invalidate(osg::observer_ptr<TerrainEngineNode>& engine, const Layer* layer, const std::vector<GeoExtent>& dirty)
+    {
+        osg::ref_ptr<TerrainEngineNode> node;
+        if (!engine.lock(node))
+            return;
+
+        std::vector<GeoExtent> regions;
+        for (auto& extent : dirty)
+        {
+            GeoExtent region = extent;
+            for (unsigned i = 0; i < regions.size(); )
+            {
+                if (regions[i].getSRS()->isHorizEquivalentTo(region.getSRS()) &&
+                    regions[i].intersects(region))
+                {
+                    region.expandToInclude(regions[i]);
+                    regions[i] = regions.back();
+                    regions.pop_back();
+                    i = 0; // the grown region may now touch one we passed
+                }
+                else ++i;
+            }
+            regions.push_back(region);
+        }
+
+        std::vector<const Layer*> layers { layer };
+        for (auto& region : regions)
+            node->invalidateRegion(layers, region);
+    }
+}
+
+// R-tree over the decals present when it was built
+struct DecalStore::Base
+{
+    RTree<unsigned, double, 2> _index;
+    std::unordered_map<unsigned, DecalPtr> _decals;
+    std::vector<unsigned> _unindexed; // decals with no extent in the index SRS
+};
+
+// What query() sees: a shared base tree plus the decals added
+// to and removed from it since it was built.
+struct DecalStore::Snapshot
+{
+    struct Added {
+        DecalPtr _decal;
+        std::vector<Rect> _rects; // empty if it has no extent in the index SRS
+    };
+    osg::ref_ptr<const SpatialReference> _srs;
+    std::shared_ptr<const Base> _base;
+    std::vector<Added> _added;
+    std::unordered_set<unsigned> _removed;
+};
+
+DecalStore::DecalStore() :
+    _batchDepth(0u),
+    _nextOrder(0u)
+{
+    std::shared_ptr<Snapshot> s = std::make_shared<Snapshot>();
+    s->_base = std::make_shared<Base>();
+    _snapshot = s;
+}
+
+void
+DecalStore::setSRS(const SpatialReference* srs)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    // re-index any existing decals in the new SRS
+    _srs = srs;
+    _working = std::make_shared<Snapshot>();
+    _working->_srs = srs;
+    rebuild(*_working);
+    publish();
+}
+
+DecalStore::Snapshot&
+DecalStore::edit()
+{
+    if (!_working)
+    {
+        // copies only the pending changes; the tree is shared
+        _working = std::make_shared<Snapshot>(*_snapshot);
+    }
+    return *_working;
+}
+
+void
+DecalStore::rebuild(Snapshot& s) const
+{
+    std::shared_ptr<Base> base = std::make_shared<Base>();
+
+    for (auto& i : _ids)
+    {
+        const DecalPtr& decal = i.second;
+        std::vector<Rect> rects;
+        if (s._srs.valid() && toRects(decal->_extent, s._srs.get(), rects))
+        {
+            for (auto& rect : rects)
+                base->_index.Insert(rect._min, rect._max, decal->_order);
+        }
+        else
+        {
+            base->_unindexed.push_back(decal->_order);
+        }
+        base->_decals[decal->_order] = decal;
+    }
+
+    s._base = base;
+    s._added.clear();
+    s._removed.clear();
+}
+
+void
+DecalStore::publish()
+{
+    if (_batchDepth == 0u && _working)
+    {
+        // Fold the changes into a new tree once scanning them costs more
+        // than the occasional rebuild (amortized O(sqrt(n)) per change).
+        std::size_t changes = _working->_added.size() + _working->_removed.size();
+        std::size_t limit = std::max((std::size_t)64u, (std::size_t)std::sqrt((double)_ids.size()));
+        if (changes > limit)
+        {
+            rebuild(*_working);
+        }
+
+        std::atomic_store(&_snapshot, std::shared_ptr<const Snapshot>(_working));
+        _working = nullptr;
+        _dirty.clear();
+    }
+}
+
+bool
+DecalStore::add(const std::string& id, const GeoExtent& extent, const osg::Referenced* data)
+{
+    if (!extent.isValid())
+        return false;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (_ids.count(id) > 0)
+        return false;
+
+    std::shared_ptr<Decal> decal = std::make_shared<Decal>();
+    decal->_extent = extent;
+    decal->_data = data;
+    decal->_order = _nextOrder++;
+
+    Snapshot& s = edit();
+
+    Snapshot::Added added;
+    added._decal = decal;
+    if (!s._srs.valid() || !toRects(extent, s._srs.get(), added._rects))
+        added._rects.clear();
+    s._added.push_back(added);
+
+    _ids[id] = decal;
+    _dirty.push_back(extent);
+
+    publish();
+    return true;
+}
+
+GeoExtent
+DecalStore::remove(const std::string& id)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    auto i = _ids.find(id);
+    if (i == _ids.end())
+        return GeoExtent::INVALID;
+
+    DecalPtr decal = i->second;
+    _ids.erase(i);
+
+    Snapshot& s = edit();
+
+    auto added = std::find_if(
+        s._added.begin(), s._added.end(),
+        [&](const Snapshot::Added& a) { return a._decal == decal; });
+
+    if (added != s._added.end())
+        s._added.erase(added);
+    else
+        s._removed.insert(decal->_order);
+
+    _dirty.push_back(decal->_extent);
+
+    publish();
+    return decal->_extent;
+}
+
+void
+DecalStore::clear()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    for (auto& i : _ids)
+        _dirty.push_back(i.second->_extent);
+
+    _ids.clear();
+    _working = std::make_shared<Snapshot>();
+    _working->_srs = _srs;
+    _working->_base = std::make_shared<Base>();
+    publish();
+}
+
+bool
+DecalStore::contains(const std::string& id) const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _ids.count(id) > 0;
+}
+
+GeoExtent
+DecalStore::getDecalExtent(const std::string& id) const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    auto i = _ids.find(id);
+    return i != _ids.end() ? i->second->_extent : GeoExtent::INVALID;
+}
+
+GeoExtent
+DecalStore::getExtent() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    GeoExtent extent;
+    for (auto& i : _ids)
+        extent.expandToInclude(i.second->_extent);
+    return extent;
+}
+
+void
+DecalStore::query(const GeoExtent& extent, std::vector<DecalPtr>& output) const
+{
+    // hold a reference so writers can publish while we read
+    std::shared_ptr<const Snapshot> s = std::atomic_load(&_snapshot);
+    const Base& base = *s->_base;
+
+    if (base._decals.empty() && s->_added.empty())
+        return;
+
+    std::vector<unsigned> hits;
+    std::vector<Rect> rects;
+    bool indexed = s->_srs.valid() && toRects(extent, s->_srs.get(), rects);
+
+    if (indexed)
+    {
+        for (auto& rect : rects)
+            base._index.Search(rect._min, rect._max, &hits, ~0);
+
+        hits.insert(hits.end(), base._unindexed.begin(), base._unindexed.end());
+    }
+    else
+    {
+        for (auto& i : base._decals)
+            hits.push_back(i.first);
+    }
+
+    std::vector<DecalPtr> found;
+    found.reserve(hits.size() + s->_added.size());
+
+    for (unsigned order : hits)
+    {
+        if (s->_removed.count(order) == 0)
+            found.push_back(base._decals.at(order));
+    }
+
+    for (auto& added : s->_added)
+    {
+        if (!indexed || added._rects.empty() || overlaps(added._rects, rects))
+            found.push_back(added._decal);
+    }
+
+    // preserve the order in which decals were added, since later
+    // decals draw over earlier ones.
+    std::sort(found.begin(), found.end(),
+        [](const DecalPtr& a, const DecalPtr& b) { return a->_order < b->_order; });
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+
+    output.insert(output.end(), found.begin(), found.end());
+}
+
+void
+DecalStore::beginBatch()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    ++_batchDepth;
+}
+
+std::vector<GeoExtent>
+DecalStore::endBatch()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    std::vector<GeoExtent> dirty;
+    if (_batchDepth > 0u && --_batchDepth == 0u)
+    {
+        dirty.swap(_dirty);
+        publish();
+    }
+    return dirty;
+}
+
+bool
+DecalStore::inBatch() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _batchDepth > 0u;
+}
+
+//........................................................................
+
+#undef  LC
 #define LC "[DecalImageLayer] "
 
 REGISTER_OSGEARTH_LAYER(decalimage, DecalImageLayer);
@@ -56,39 +416,47 @@ DecalImageLayer::init()
     // Set the layer profile.
     setProfile(Profile::create(Profile::GLOBAL_GEODETIC));
 
+    // Index decals in the profile's SRS
+    _decals.setSRS(getProfile()->getSRS());
+
     // Never cache decals
     layerHints().cachePolicy() = CachePolicy::NO_CACHE;
 }
 
+void
+DecalImageLayer::prepareForRendering(TerrainEngine* engine)
+{
+    ImageLayer::prepareForRendering(engine);
+
+    // for refreshing tiles at the end of a decal batch
+    _engine = dynamic_cast<TerrainEngineNode*>(engine);
+}
+
 GeoImage
 DecalImageLayer::createImageImplementation(
     const GeoImage& canvas,
     const TileKey& key,
     ProgressCallback* progress) const
 {
-    std::vector<Decal> decals;
+    std::vector<DecalStore::DecalPtr> decals;
     std::vector<GeoExtent> outputExtentsInDecalSRS;
     std::vector<GeoExtent> intersections;
 
     const GeoExtent& outputExtent = key.getExtent();
 
-    // thread-safe collection of intersecting decals
-    {
-        Threading::ScopedMutexLock lock(layerMutex());
+    // lock-free collection of intersecting decals
+    std::vector<DecalStore::DecalPtr> candidates;
+    _decals.query(outputExtent, candidates);
 
-        for (std::list<Decal>::const_iterator i = _decalList.begin();
-            i != _decalList.end();
-            ++i)
+    for (auto& decal : candidates)
+    {
+        GeoExtent outputExtentInDecalSRS = outputExtent.transform(decal->_extent.getSRS());
+        GeoExtent intersectionExtent = decal->_extent.intersectionSameSRS(outputExtentInDecalSRS);
+        if (intersectionExtent.isValid())
         {
-            const Decal& decal = *i;
-            GeoExtent outputExtentInDecalSRS = outputExtent.transform(decal._extent.getSRS());
-            GeoExtent intersectionExtent = decal._extent.intersectionSameSRS(outputExtentInDecalSRS);
-            if (intersectionExtent.isValid())
-            {
-                decals.push_back(decal);
-                outputExtentsInDecalSRS.push_back(outputExtentInDecalSRS);
-                intersections.push_back(intersectionExtent);
-            }
+            decals.push_back(decal);
+            outputExtentsInDecalSRS.push_back(outputExtentInDecalSRS);
+            intersections.push_back(intersectionExtent);
         }
     }
 
@@ -118,9 +486,9 @@ DecalImageLayer::createImageImplementation(
 
     for (unsigned d = 0; d < decals.size(); ++d)
     {
-        const Decal& decal = decals[d];
+        const DecalStore::Decal& decal = *decals[d];
         const GeoExtent& decalExtent = decal._extent;
-        ImageUtils::PixelReader readInput(decal._image.get());
+        ImageUtils::PixelReader readInput(static_cast<const osg::Image*>(decal._data.get()));
         const GeoExtent& outputExtentInDecalSRS = outputExtentsInDecalSRS[d];
         const GeoExtent& intersection = intersections[d];
         bool normalizeX = decalExtent.crossesAntimeridian();
@@ -220,21 +588,14 @@ DecalImageLayer::addDecal(const std::string& id, const GeoExtent& extent, const
 {
     Threading::ScopedMutexLock lock(layerMutex());
 
-    DecalIndex::iterator i = _decalIndex.find(id);
-    if (i != _decalIndex.end())
+    if (!_decals.add(id, extent, image))
         return false;
 
-    _decalList.push_back(Decal());
-    Decal& decal = _decalList.back();
-    decal._extent = extent;
-    decal._image = image;
-
-    _decalIndex[id] = --_decalList.end();
-
     _extent.expandToInclude(extent);
 
-    // data changed so up the revsion.
-    bumpRevision();
+    // data changed so up the revsion (once, at the end, in a batch).
+    if (!_decals.inBatch())
+        bumpRevision();
     return true;
 }
 
@@ -243,41 +604,52 @@ DecalImageLayer::removeDecal(const std::string& id)
 {
     Threading::ScopedMutexLock lock(layerMutex());
 
-    DecalIndex::iterator i = _decalIndex.find(id);
-    if (i != _decalIndex.end())
+    if (_decals.remove(id).isValid())
     {
-        _decalList.erase(i->second);
-        _decalIndex.erase(i);
-
-        _extent = GeoExtent();
-        for (auto& decal : _decalList)
-            _extent.expandToInclude(decal._extent);
+        _extent = _decals.getExtent();
 
-        // data changed so up the revsion.
-        bumpRevision();
+        // data changed so up the revsion (once, at the end, in a batch).
+        if (!_decals.inBatch())
+            bumpRevision();
     }
 }
 
-const GeoExtent&
+GeoExtent
 DecalImageLayer::getDecalExtent(const std::string& id) const
 {
-    Threading::ScopedMutexLock lock(layerMutex());
-    DecalIndex::const_iterator i = _decalIndex.find(id);
-    if (i != _decalIndex.end())
-    {
-        return i->second->_extent;
-    }
-    return GeoExtent::INVALID;
+    return _decals.getDecalExtent(id);
 }
 
 void
 DecalImageLayer::clearDecals()
 {
     Threading::ScopedMutexLock lock(layerMutex());
-    _decalIndex.clear();
-    _decalList.clear();
+    _decals.clear();
     _extent = GeoExtent();
-    bumpRevision();
+    if (!_decals.inBatch())
+        bumpRevision();
+}
+
+void
+DecalImageLayer::beginDecalBatch()
+{
+    Threading::ScopedMutexLock lock(layerMutex());
+    _decals.beginBatch();
+}
+
+std::vector<GeoExtent>
+DecalImageLayer::endDecalBatch()
+{
+    std::vector<GeoExtent> dirty;
+    {
+        Threading::ScopedMutexLock lock(layerMutex());
+        dirty = _decals.endBatch();
+        if (dirty.empty())
+            return dirty;
+        bumpRevision();
+    }
+    invalidate(_engine, this, dirty);
+    return dirty;
 }
 
 //........................................................................
@@ -311,6 +683,9 @@ DecalElevationLayer::init()
     // Set the layer profile.
     setProfile(Profile::create(Profile::GLOBAL_GEODETIC));
 
+    // Index decals in the profile's SRS
+    _decals.setSRS(getProfile()->getSRS());
+
     // This is an offset layer (the elevation values are offsets)
     setOffset(true);
 
@@ -318,32 +693,37 @@ DecalElevationLayer::init()
     layerHints().cachePolicy() = CachePolicy::NO_CACHE;
 }
 
+void
+DecalElevationLayer::prepareForRendering(TerrainEngine* engine)
+{
+    ElevationLayer::prepareForRendering(engine);
+
+    // for refreshing tiles at the end of a decal batch
+    _engine = dynamic_cast<TerrainEngineNode*>(engine);
+}
+
 GeoHeightField
 DecalElevationLayer::createHeightFieldImplementation(const TileKey& key, ProgressCallback* progress) const
 {
-    std::vector<Decal> decals;
+    std::vector<DecalStore::DecalPtr> decals;
     std::vector<GeoExtent> outputExtentsInDecalSRS;
     std::vector<GeoExtent> intersections;
 
     const GeoExtent& outputExtent = key.getExtent();
 
-    // thread-safe collection of intersecting decals
-    {
-        Threading::ScopedMutexLock lock(layerMutex());
+    // lock-free collection of intersecting decals
+    std::vector<DecalStore::DecalPtr> candidates;
+    _decals.query(outputExtent, candidates);
 
-        for(std::list<Decal>::const_iterator i = _decalList.begin();
-            i != _decalList.end();
-            ++i)
+    for (auto& decal : candidates)
+    {
+        GeoExtent outputExtentInDecalSRS = outputExtent.transform(decal->_extent.getSRS());
+        GeoExtent intersectionExtent = decal->_extent.intersectionSameSRS(outputExtentInDecalSRS);
+        if (intersectionExtent.isValid())
         {
-            const Decal& decal = *i;
-            GeoExtent outputExtentInDecalSRS = outputExtent.transform(decal._heightfield.getExtent().getSRS());
-            GeoExtent intersectionExtent = decal._heightfield.getExtent().intersectionSameSRS(outputExtentInDecalSRS);
-            if (intersectionExtent.isValid())
-            {
-                decals.push_back(decal);
-                outputExtentsInDecalSRS.push_back(outputExtentInDecalSRS);
-                intersections.push_back(intersectionExtent);
-            }
+            decals.push_back(decal);
+            outputExtentsInDecalSRS.push_back(outputExtentInDecalSRS);
+            intersections.push_back(intersectionExtent);
         }
     }
 
@@ -357,12 +737,12 @@ DecalElevationLayer::createHeightFieldImplementation(const TileKey& key, Progres
 
     for(unsigned i=0; i<decals.size(); ++i)
     {
-        const Decal& decal = decals[i];
+        const DecalStore::Decal& decal = *decals[i];
 
-        const GeoExtent& decalExtent = decal._heightfield.getExtent();
+        const GeoExtent& decalExtent = decal._extent;
         const GeoExtent& outputExtentInDecalSRS = outputExtentsInDecalSRS[i];
         const GeoExtent& intersection = intersections[i];
-        const osg::HeightField* decal_hf = decal._heightfield.getHeightField();
+        const osg::HeightField* decal_hf = static_cast<const osg::HeightField*>(decal._data.get());
 
         double xInterval = outputExtentInDecalSRS.width() / (double)(output->getNumColumns()-1);
         double yInterval = outputExtentInDecalSRS.height() / (double)(output->getNumRows()-1);
@@ -414,11 +794,10 @@ DecalElevationLayer::addDecal(
 
     Threading::ScopedMutexLock lock(layerMutex());
 
-    DecalIndex::iterator i = _decalIndex.find(id);
-    if (i != _decalIndex.end())
+    if (_decals.contains(id))
         return false;
 
-    osg::HeightField* hf = new osg::HeightField();
+    osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
     hf->allocate(image->s(), image->t());
 
     ImageUtils::PixelReader read(image);
@@ -443,16 +822,14 @@ DecalElevationLayer::addDecal(
         }
     }
 
-    _decalList.push_back(Decal());
-    Decal& decal = _decalList.back();
-    decal._heightfield = GeoHeightField(hf, extent);
-
-    _decalIndex[id] = --_decalList.end();
+    if (!_decals.add(id, extent, hf.get()))
+        return false;
 
     _extent.expandToInclude(extent);
 
-    // data changed so up the revsion.
-    bumpRevision();
+    // data changed so up the revsion (once, at the end, in a batch).
+    if (!_decals.inBatch())
+        bumpRevision();
     return true;
 }
 
@@ -470,11 +847,10 @@ DecalElevationLayer::addDecal(
 
     Threading::ScopedMutexLock lock(layerMutex());
 
-    DecalIndex::iterator i = _decalIndex.find(id);
-    if (i != _decalIndex.end())
+    if (_decals.contains(id))
         return false;
 
-    osg::HeightField* hf = new osg::HeightField();
+    osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
     hf->allocate(image->s(), image->t());
 
     ImageUtils::PixelReader read(image);
@@ -497,16 +873,14 @@ DecalElevationLayer::addDecal(
         }
     }
 
-    _decalList.push_back(Decal());
-    Decal& decal = _decalList.back();
-    decal._heightfield = GeoHeightField(hf, extent);
-
-    _decalIndex[id] = --_decalList.end();
+    if (!_decals.add(id, extent, hf.get()))
+        return false;
 
     _extent.expandToInclude(extent);
 
-    // data changed so up the revsion.
-    bumpRevision();
+    // data changed so up the revsion (once, at the end, in a batch).
+    if (!_decals.inBatch())
+        bumpRevision();
     return true;
 }
 
@@ -515,40 +889,52 @@ DecalElevationLayer::removeDecal(const std::string& id)
 {
     Threading::ScopedMutexLock lock(layerMutex());
 
-    DecalIndex::iterator i = _decalIndex.find(id);
-    if (i != _decalIndex.end())
+    if (_decals.remove(id).isValid())
     {
-        _decalList.erase(i->second);
-        _decalIndex.erase(i);
-
-        for (auto& decal : _decalList)
-            _extent.expandToInclude(decal._heightfield.getExtent());
+        _extent = _decals.getExtent();
 
-        // data changed so up the revsion.
-        bumpRevision();
+        // data changed so up the revsion (once, at the end, in a batch).
+        if (!_decals.inBatch())
+            bumpRevision();
     }
 }
 
-const GeoExtent&
+GeoExtent
 DecalElevationLayer::getDecalExtent(const std::string& id) const
 {
-    Threading::ScopedMutexLock lock(layerMutex());
-    DecalIndex::const_iterator i = _decalIndex.find(id);
-    if (i != _decalIndex.end())
-    {
-        return i->second->_heightfield.getExtent();
-    }
-    return GeoExtent::INVALID;
+    return _decals.getDecalExtent(id);
 }
 
 void
 DecalElevationLayer::clearDecals()
 {
     Threading::ScopedMutexLock lock(layerMutex());
-    _decalIndex.clear();
-    _decalList.clear();
+    _decals.clear();
     _extent = GeoExtent();
-    bumpRevision();
+    if (!_decals.inBatch())
+        bumpRevision();
+}
+
+void
+DecalElevationLayer::beginDecalBatch()
+{
+    Threading::ScopedMutexLock lock(layerMutex());
+    _decals.beginBatch();
+}
+
+std::vector<GeoExtent>
+DecalElevationLayer::endDecalBatch()
+{
+    std::vector<GeoExtent> dirty;
+    {
+        Threading::ScopedMutexLock lock(layerMutex());
+        dirty = _decals.endBatch();
+        if (dirty.empty())
+            return dirty;
+        bumpRevision();
+    }
+    invalidate(_engine, this, dirty);
+    return dirty;
 }
 
 //........................................................................
@@ -579,10 +965,22 @@ DecalLandCoverLayer::init()
     // Set the layer profile.
     setProfile(Profile::create(Profile::GLOBAL_GEODETIC));
 
+    // Index decals in the profile's SRS
+    _decals.setSRS(getProfile()->getSRS());
+
     // Never cache decals
     layerHints().cachePolicy() = CachePolicy::NO_CACHE;
 }
 
+void
+DecalLandCoverLayer::prepareForRendering(TerrainEngine* engine)
+{
+    LandCoverLayer::prepareForRendering(engine);
+
+    // for refreshing tiles at the end of a decal batch
+    _engine = dynamic_cast<TerrainEngineNode*>(engine);
+}
+
 Status
 DecalLandCoverLayer::openImplementation()
 {
@@ -598,36 +996,33 @@ DecalLandCoverLayer::openImplementation()
         setProfile(profile);
     }
 
+    _decals.setSRS(profile->getSRS());
+
     return Status::NoError;
 }
 
 GeoImage
 DecalLandCoverLayer::createImageImplementation(const TileKey& key, ProgressCallback* progress) const
 {
-    std::vector<Decal> decals;
+    std::vector<DecalStore::DecalPtr> decals;
     std::vector<GeoExtent> outputExtentsInDecalSRS;
     std::vector<GeoExtent> intersections;
 
     const GeoExtent& outputExtent = key.getExtent();
 
-    // thread-safe collection of intersecting decals
-    {
-        Threading::ScopedMutexLock lock(layerMutex());
+    // lock-free collection of intersecting decals
+    std::vector<DecalStore::DecalPtr> candidates;
+    _decals.query(outputExtent, candidates);
 
-        for(std::list<Decal>::const_iterator i = _decalList.begin();
-            i != _decalList.end();
-            ++i)
+    for (auto& decal : candidates)
+    {
+        GeoExtent outputExtentInDecalSRS = outputExtent.transform(decal->_extent.getSRS());
+        GeoExtent intersectionExtent = decal->_extent.intersectionSameSRS(outputExtentInDecalSRS);
+        if (intersectionExtent.isValid())
         {
-            const Decal& decal = *i;
-            const GeoExtent& decalExtent = decal._extent;
-            GeoExtent outputExtentInDecalSRS = outputExtent.transform(decalExtent.getSRS());
-            GeoExtent intersectionExtent = decalExtent.intersectionSameSRS(outputExtentInDecalSRS);
-            if (intersectionExtent.isValid())
-            {
-                decals.push_back(decal);
-                outputExtentsInDecalSRS.push_back(outputExtentInDecalSRS);
-                intersections.push_back(intersectionExtent);
-            }
+            decals.push_back(decal);
+            outputExtentsInDecalSRS.push_back(outputExtentInDecalSRS);
+            intersections.push_back(intersectionExtent);
         }
     }
 
@@ -647,9 +1042,9 @@ DecalLandCoverLayer::createImageImplementation(const TileKey& key, ProgressCallb
 
     for(unsigned i=0; i<decals.size(); ++i)
     {
-        const Decal& decal = decals[i];
+        const DecalStore::Decal& decal = *decals[i];
         const GeoExtent& decalExtent = decal._extent;
-        ImageUtils::PixelReader readInput(decal._image.get());
+        ImageUtils::PixelReader readInput(static_cast<const osg::Image*>(decal._data.get()));
         const GeoExtent& outputExtentInDecalSRS = outputExtentsInDecalSRS[i];
         const GeoExtent& intersection = intersections[i];
 
@@ -689,21 +1084,14 @@ DecalLandCoverLayer::addDecal(const std::string& id, const GeoExtent& extent, co
 {
     Threading::ScopedMutexLock lock(layerMutex());
 
-    DecalIndex::iterator i = _decalIndex.find(id);
-    if (i != _decalIndex.end())
+    if (!_decals.add(id, extent, image))
         return false;
 
-    _decalList.push_back(Decal());
-    Decal& decal = _decalList.back();
-    decal._extent = extent;
-    decal._image = image;
-
-    _decalIndex[id] = --_decalList.end();
-
     _extent.expandToInclude(extent);
 
-    // data changed so up the revsion.
-    bumpRevision();
+    // data changed so up the revsion (once, at the end, in a batch).
+    if (!_decals.inBatch())
+        bumpRevision();
     return true;
 }
 
@@ -712,39 +1100,50 @@ DecalLandCoverLayer::removeDecal(const std::string& id)
 {
     Threading::ScopedMutexLock lock(layerMutex());
 
-    DecalIndex::iterator i = _decalIndex.find(id);
-    if (i != _decalIndex.end())
+    if (_decals.remove(id).isValid())
     {
-        _decalList.erase(i->second);
-        _decalIndex.erase(i);
+        _extent = _decals.getExtent();
 
-        _extent = GeoExtent();
-        for (auto& decal : _decalList)
-            _extent.expandToInclude(decal._extent);
-
-        // data changed so up the revsion.
-        bumpRevision();
+        // data changed so up the revsion (once, at the end, in a batch).
+        if (!_decals.inBatch())
+            bumpRevision();
     }
 }
 
-const GeoExtent&
+GeoExtent
 DecalLandCoverLayer::getDecalExtent(const std::string& id) const
 {
-    Threading::ScopedMutexLock lock(layerMutex());
-    DecalIndex::const_iterator i = _decalIndex.find(id);
-    if (i != _decalIndex.end())
-    {
-        return i->second->_extent;
-    }
-    return GeoExtent::INVALID;
+    return _decals.getDecalExtent(id);
 }
 
 void
 DecalLandCoverLayer::clearDecals()
 {
     Threading::ScopedMutexLock lock(layerMutex());
-    _decalIndex.clear();
-    _decalList.clear();
+    _decals.clear();
     _extent = GeoExtent();
-    bumpRevision();
+    if (!_decals.inBatch())
+        bumpRevision();
+}
+
+void
+DecalLandCoverLayer::beginDecalBatch()
+{
+    Threading::ScopedMutexLock lock(layerMutex());
+    _decals.beginBatch();
+}
+
+std::vector<GeoExtent>
+DecalLandCoverLayer::endDecalBatch()
+{
+    std::vector<GeoExtent> dirty;
+    {
+        Threading::ScopedMutexLock lock(layerMutex());
+        dirty = _decals.endBatch();
+        if (dirty.empty())
+            return dirty;
+        bumpRevision();
+    }
+    invalidate(_engine, this, dirty);
+    return dirty;
 }
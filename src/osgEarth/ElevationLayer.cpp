@@ -22,6 +22,9 @@
 #include <osgEarth/MemCache>
 #include <osgEarth/Metrics>
 #include <osgEarth/NetworkMonitor>
+#include <osgEarth/VerticalDatum>
+#include <osgEarth/Containers>
+#include <osgEarth/Threading>
 #include <cinttypes>
 
 using namespace osgEarth;
@@ -30,6 +33,8 @@ using namespace osgEarth;
 
 //#define ANALYZE
 
+#define ARENA_ELEVATION_COMPOSITE "oe.elevation.composite"
+
 //------------------------------------------------------------------------
 
 Config
@@ -651,6 +656,119 @@ namespace
     };
 
     typedef std::vector<LayerData> LayerDataVector;
+
+    // Output posts transformed into one source SRS, shared by all
+    // source heightfields in that SRS.
+    struct PostGrid
+    {
+        const SpatialReference* srs;
+        std::vector<osg::Vec3d> points;
+        std::vector<unsigned char> valid;
+    };
+
+    // Samples one source heightfield at the output posts. All per-heightfield
+    // setup (SRS transform, sample intervals, datum checks) happens once in
+    // init() instead of once per post.
+    struct HeightFieldSampler
+    {
+        const GeoHeightField* _geoHF;
+        const osg::HeightField* _hf;
+        const GeoExtent* _extent;
+        const SpatialReference* _extentSRS;
+        const SpatialReference* _outputSRS;
+        const PostGrid* _grid;
+        double _xInterval, _yInterval;
+        bool _convertDatum;
+
+        void init(
+            const GeoHeightField& geoHF,
+            const SpatialReference* keySRS,
+            const std::vector<osg::Vec3d>& keyPoints,
+            std::vector<PostGrid>& grids)
+        {
+            _geoHF = &geoHF;
+            _hf = geoHF.getHeightField();
+            _extent = &geoHF.getExtent();
+            _extentSRS = _extent->getSRS();
+            _outputSRS = keySRS;
+            _xInterval = _extent->width() / (double)(_hf->getNumColumns() - 1);
+            _yInterval = _extent->height() / (double)(_hf->getNumRows() - 1);
+            _convertDatum = keySRS && !_extentSRS->isVertEquivalentTo(keySRS);
+            _grid = 0L;
+
+            if (keySRS != _extentSRS)
+            {
+                for (unsigned i = 0; i < grids.size() && !_grid; ++i)
+                {
+                    if (grids[i].srs == _extentSRS)
+                        _grid = &grids[i];
+                }
+
+                if (!_grid)
+                {
+                    grids.push_back(PostGrid());
+                    PostGrid& grid = grids.back();
+                    grid.srs = _extentSRS;
+                    grid.points = keyPoints;
+                    grid.valid.assign(keyPoints.size(), 1u);
+                    if (keySRS && !keySRS->transform(grid.points, _extentSRS))
+                    {
+                        // at least one point failed; redo them one by one to
+                        // find out which.
+                        for (unsigned i = 0; i < keyPoints.size(); ++i)
+                        {
+                            grid.valid[i] = keySRS->transform(keyPoints[i], _extentSRS, grid.points[i]) ? 1u : 0u;
+                        }
+                    }
+                    _grid = &grid;
+                }
+            }
+        }
+
+        //! Same result as GeoHeightField::getElevation(keySRS, x, y, interp, keySRS, out)
+        //! for the post at index "post" with key coordinates (x, y).
+        bool sample(unsigned post, double x, double y, RasterInterpolation interp, float& out) const
+        {
+            if (_grid)
+            {
+                if (!_grid->valid[post])
+                    return false;
+                x = _grid->points[post].x();
+                y = _grid->points[post].y();
+            }
+
+            if (!_extent->contains(x, y))
+                return false;
+
+            out = HeightFieldUtils::getHeightAtLocation(
+                _hf,
+                x, y,
+                _extent->xMin(), _extent->yMin(),
+                _xInterval, _yInterval,
+                interp);
+
+            if (out != NO_DATA_VALUE && _convertDatum)
+            {
+                osg::Vec3d geolocal(x, y, 0);
+                if (!_extentSRS->isGeographic())
+                {
+                    _extentSRS->transform(geolocal, _extentSRS->getGeographicSRS(), geolocal);
+                }
+
+                VerticalDatum::transform(
+                    _extentSRS->getVerticalDatum(),
+                    _outputSRS->getVerticalDatum(),
+                    geolocal.y(), geolocal.x(), out);
+            }
+
+            return true;
+        }
+    };
+
+    // Set on threads that are fetching heightfields for a composite, so
+    // that nested composites (e.g. a composite elevation layer) fetch
+    // serially instead of waiting on their own arena.
+    PerThread<bool> s_compositeFetchThreads;
 }
 
 bool
@@ -801,12 +919,11 @@ ElevationLayerVector::populateHeightField(
 
     unsigned int total = numColumns * numRows;
 
-    int nodataCount = 0;
-
-    TileKey actualKey; // Storage if a new key needs to be constructed
-
     bool requiresResample = true;
 
+    // Keep the single contender's heightfield in case it still needs resampling
+    GeoHeightField singleHF;
+
     // If we only have a single contender layer, and the tile is the same size as the requested
     // heightfield then we just use it directly and avoid having to resample it
     if (contenders.size() == 1 && offsets.empty())
@@ -816,6 +933,8 @@ ElevationLayerVector::populateHeightField(
         GeoHeightField layerHF = layer->createHeightField(contenders[0].key, progress);
         if (layerHF.valid())
         {
+            singleHF = layerHF;
+
             if (layerHF.getHeightField()->getNumColumns() == hf->getNumColumns() &&
                 layerHF.getHeightField()->getNumRows() == hf->getNumRows())
             {
@@ -838,198 +957,236 @@ ElevationLayerVector::populateHeightField(
         }
     }
 
-    // If we need to mosaic multiple layers or resample it to a new output tilesize go through a resampling loop.
+    // If we need to mosaic multiple layers or resample it to a new output tilesize,
+    // fetch every source heightfield up front and composite them in row-major passes.
     if (requiresResample)
     {
-        // We will load the actual heightfields on demand. We might not need them all.
         GeoHeightFieldVector heightFields(contenders.size());
         std::vector<TileKey> heightFieldActualKeys(contenders.size());
         GeoHeightFieldVector offsetFields(offsets.size());
-        std::vector<bool>    heightFallback(contenders.size(), false);
-        std::vector<bool>    heightFailed(contenders.size(), false);
-        std::vector<bool>    offsetFailed(offsets.size(), false);
 
-        // Initialize the actual keys to match the contender keys.
-        // We'll adjust these as necessary if we need to fall back
         for(unsigned i=0; i<contenders.size(); ++i)
         {
             heightFieldActualKeys[i] = contenders[i].key;
         }
 
-        // The maximum number of heightfields to keep in this local cache
-        const unsigned maxHeightFields = 50;
-        unsigned numHeightFieldsInCache = 0;
+        if (singleHF.valid())
+        {
+            heightFields[0] = singleHF;
+        }
 
-        for (unsigned c = 0; c < numColumns; ++c)
+        // Fetch a contender, falling back on parent keys to make sure that
+        // we have data at the location even if it's fallback.
+        auto fetchContender = [&](unsigned i)
         {
-            double x = xmin + (dx * (double)c);
+            ElevationLayer* layer = contenders[i].layer.get();
+            TileKey& actualKey = heightFieldActualKeys[i];
+            GeoHeightField& layerHF = heightFields[i];
 
-            // periodically check for cancelation
-            if (progress && progress->isCanceled())
+            while (!layerHF.valid() && actualKey.valid() && layer->isKeyInLegalRange(actualKey))
             {
-                return false;
-            }
+                if (progress && progress->isCanceled())
+                    return;
 
-            for (unsigned r = 0; r < numRows; ++r)
-            {
-                double y = ymin + (dy * (double)r);
+                layerHF = layer->createHeightField(actualKey, progress);
+                if (!layerHF.valid())
+                {
+                    actualKey.makeParent();
+                }
+            }
+        };
 
-                // Collect elevations from each layer as necessary.
-                int resolvedIndex = -1;
+        auto fetchOffset = [&](unsigned i)
+        {
+            offsetFields[i] = offsets[i].layer->createHeightField(offsets[i].key, progress);
+        };
 
-                float resolution = FLT_MAX;
+        unsigned numFetches = contenders.size() + offsets.size();
+        bool& nested = s_compositeFetchThreads.get();
 
-                osg::Vec3 normal_sum(0, 0, 0);
+        if (numFetches == 1u || nested)
+        {
+            for (unsigned i = 0; i < contenders.size(); ++i)
+                fetchContender(i);
+            for (unsigned i = 0; i < offsets.size(); ++i)
+                fetchOffset(i);
+        }
+        else
+        {
+            // Fetch all but the first source in parallel; this thread takes the first.
+            JobArena* arena = JobArena::get(ARENA_ELEVATION_COMPOSITE);
+            JobGroup fetches;
 
-                for (int i = 0; i < contenders.size() && resolvedIndex < 0; ++i)
+            for (unsigned f = 1; f < numFetches; ++f)
+            {
+                Job job(arena, &fetches);
+                job.dispatch([&, f](Cancelable*)
                 {
-                    ElevationLayer* layer = contenders[i].layer.get();
-                    TileKey& contenderKey = contenders[i].key;
-                    int index = contenders[i].index;
+                    bool& flag = s_compositeFetchThreads.get();
+                    flag = true;
+                    if (f < contenders.size())
+                        fetchContender(f);
+                    else
+                        fetchOffset(f - contenders.size());
+                    flag = false;
+                });
+            }
 
-                    if (heightFailed[i])
-                        continue;
+            nested = true;
+            if (contenders.empty())
+                fetchOffset(0);
+            else
+                fetchContender(0);
+            nested = false;
 
-                    GeoHeightField& layerHF = heightFields[i];
-                    TileKey& actualKey = heightFieldActualKeys[i];
+            fetches.join();
+        }
 
-                    if (!layerHF.valid())
-                    {
-                        // We couldn't get the heightfield from the cache, so try to create it.
-                        // We also fallback on parent layers to make sure that we have data at the location even if it's fallback.
-                        while (!layerHF.valid() && actualKey.valid() && layer->isKeyInLegalRange(actualKey))
-                        {
-                            layerHF = layer->createHeightField(actualKey, progress);
-                            if (!layerHF.valid())
-                            {
-                                actualKey.makeParent();
-                            }
-                        }
+        if (progress && progress->isCanceled())
+        {
+            return false;
+        }
 
-                        // Mark this layer as fallback if necessary.
-                        if (layerHF.valid())
-                        {
-                            //TODO: check this. Should it be actualKey != keyToUse...?
-                            heightFallback[i] =
-                                contenders[i].isFallback ||
-                                (actualKey != contenderKey);
+        // Key-SRS coordinates of every output post, row-major.
+        std::vector<osg::Vec3d> keyPoints(total);
+        for (unsigned r = 0; r < numRows; ++r)
+        {
+            double y = ymin + (dy * (double)r);
+            for (unsigned c = 0; c < numColumns; ++c)
+            {
+                keyPoints[r*numColumns + c].set(xmin + (dx * (double)c), y, 0.0);
+            }
+        }
 
-                            numHeightFieldsInCache++;
-                        }
-                        else
-                        {
-                            heightFailed[i] = true;
-#ifdef ANALYZE
-                            layerAnalysis[layer].failed = true;
-                            layerAnalysis[layer].actualKeyValid = actualKey->valid();
-                            if (progress) layerAnalysis[layer].message = progress->message();
-#endif
-                            continue;
-                        }
-                    }
+        // Source posts for heightfields in other SRSs, one grid per SRS.
+        // Reserved so the samplers' pointers into it stay valid.
+        std::vector<PostGrid> grids;
+        grids.reserve(numFetches);
 
-                    if (layerHF.valid())
-                    {
-                        bool isFallback = heightFallback[i];
+        // Per-post compositing state: the index of the layer that supplied
+        // the height (offsets only apply on top of it) and its resolution.
+        std::vector<int> resolvedIndex(total, -1);
+        std::vector<float> resolution(total, FLT_MAX);
+        unsigned numUnresolved = total;
+
+        // Contenders in priority order; each fills the posts that higher
+        // priority layers left empty.
+        for (unsigned i = 0; i < contenders.size() && numUnresolved > 0u; ++i)
+        {
+            GeoHeightField& layerHF = heightFields[i];
+            if (!layerHF.valid())
+            {
 #ifdef ANALYZE
-                        layerAnalysis[layer].fallback = isFallback;
+                layerAnalysis[contenders[i].layer.get()].failed = true;
+                layerAnalysis[contenders[i].layer.get()].actualKeyValid = heightFieldActualKeys[i].valid();
+                if (progress) layerAnalysis[contenders[i].layer.get()].message = progress->message();
 #endif
+                continue;
+            }
 
-                        // We only have real data if this is not a fallback heightfield.
-                        if (!isFallback)
-                        {
-                            realData = true;
-                        }
-
-                        float elevation;
-                        if (layerHF.getElevation(keySRS, x, y, interpolation, keySRS, elevation))
-                        {
-                            if (elevation != NO_DATA_VALUE)
-                            {
-                                // remember the index so we can only apply offset layers that
-                                // sit on TOP of this layer.
-                                resolvedIndex = index;
+            bool isFallback =
+                contenders[i].isFallback ||
+                (heightFieldActualKeys[i] != contenders[i].key);
 
-                                hf->setHeight(c, r, elevation);
+            // We only have real data if this is not a fallback heightfield.
+            if (!isFallback)
+            {
+                realData = true;
+            }
 
-                                resolution = actualKey.getResolution(hf->getNumColumns()).second;
 #ifdef ANALYZE
-                                layerAnalysis[layer].samples++;
+            layerAnalysis[contenders[i].layer.get()].fallback = isFallback;
 #endif
-                            }
-                            else
-                            {
-                                ++nodataCount;
-                            }
-                        }
-                    }
 
+            HeightFieldSampler sampler;
+            sampler.init(layerHF, keySRS, keyPoints, grids);
+
+            int index = contenders[i].index;
+            float layerResolution = heightFieldActualKeys[i].getResolution(hf->getNumColumns()).second;
+            float* heights = &hf->getFloatArray()->front();
+
+            for (unsigned r = 0; r < numRows; ++r)
+            {
+                if (progress && progress->isCanceled())
+                {
+                    return false;
+                }
 
-                    // Clear the heightfield cache if we have too many heightfields in the cache.
-                    if (numHeightFieldsInCache >= maxHeightFields)
+                unsigned post = r*numColumns;
+                for (unsigned c = 0; c < numColumns; ++c, ++post)
+                {
+                    if (resolvedIndex[post] >= 0)
+                        continue;
+
+                    float elevation;
+                    if (sampler.sample(post, keyPoints[post].x(), keyPoints[post].y(), interpolation, elevation) &&
+                        elevation != NO_DATA_VALUE)
                     {
-                        //OE_NOTICE << "Clearing cache" << std::endl;
-                        for (unsigned int k = 0; k < heightFields.size(); k++)
-                        {
-                            heightFields[k] = GeoHeightField::INVALID;
-                            heightFallback[k] = false;
-                        }
-                        numHeightFieldsInCache = 0;
+                        resolvedIndex[post] = index;
+                        heights[post] = elevation;
+                        resolution[post] = layerResolution;
+                        --numUnresolved;
+#ifdef ANALYZE
+                        layerAnalysis[contenders[i].layer.get()].samples++;
+#endif
                     }
                 }
+            }
+        }
 
-                for (int i = offsets.size() - 1; i >= 0; --i)
-                {
-                    if (progress && progress->isCanceled())
-                        return false;
+        // Offsets, lowest priority first, each applied only on top of
+        // posts resolved by a layer beneath it (or not resolved at all).
+        for (int i = offsets.size() - 1; i >= 0; --i)
+        {
+            GeoHeightField& layerHF = offsetFields[i];
+            if (!layerHF.valid())
+                continue;
 
-                    // Only apply an offset layer if it sits on top of the resolved layer
-                    // (or if there was no resolved layer).
-                    if (resolvedIndex >= 0 && offsets[i].index < resolvedIndex)
-                        continue;
+            int index = offsets[i].index;
 
-                    TileKey& contenderKey = offsets[i].key;
+            HeightFieldSampler sampler;
+            sampler.init(layerHF, keySRS, keyPoints, grids);
 
-                    if (offsetFailed[i] == true)
-                        continue;
+            float* heights = &hf->getFloatArray()->front();
+            bool applied = false;
 
-                    GeoHeightField& layerHF = offsetFields[i];
-                    if (!layerHF.valid())
-                    {
-                        ElevationLayer* offset = offsets[i].layer.get();
+            for (unsigned r = 0; r < numRows; ++r)
+            {
+                if (progress && progress->isCanceled())
+                {
+                    return false;
+                }
 
-                        layerHF = offset->createHeightField(contenderKey, progress);
-                        if (!layerHF.valid())
-                        {
-                            offsetFailed[i] = true;
-                            continue;
-                        }
-                    }
+                unsigned post = r*numColumns;
+                for (unsigned c = 0; c < numColumns; ++c, ++post)
+                {
+                    if (resolvedIndex[post] >= 0 && index < resolvedIndex[post])
+                        continue;
 
-                    // If we actually got a layer then we have real data
-                    realData = true;
+                    applied = true;
 
                     float elevation = 0.0f;
-                    if (layerHF.getElevation(keySRS, x, y, interpolation, keySRS, elevation) &&
+                    if (sampler.sample(post, keyPoints[post].x(), keyPoints[post].y(), interpolation, elevation) &&
                         elevation != NO_DATA_VALUE &&
-                        !osg::equivalent(elevation, 0.0f) )
+                        !osg::equivalent(elevation, 0.0f))
                     {
-                        hf->getHeight(c, r) += elevation;
-
-                        // Technically this is correct, but the resultin normal maps
-                        // look awful and faceted. TODO
-                        //resolution = osg::minimum(
-                        //    resolution,
-                        //    (float)contenderKey.getResolution(hf->getNumColumns()).second);
+                        heights[post] += elevation;
                     }
                 }
+            }
 
-                if (resolutions)
-                {
-                    (*resolutions)[r*numColumns+c] = resolution;
-                }
+            // If we actually used an offset layer then we have real data
+            if (applied)
+            {
+                realData = true;
             }
         }
+
+        if (resolutions)
+        {
+            for (unsigned post = 0; post < total; ++post)
+                (*resolutions)[post] = resolution[post];
+        }
     }
 
 #ifdef ANALYZE
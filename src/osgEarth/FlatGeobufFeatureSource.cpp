@@ -0,0 +1,1499 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/FlatGeobufFeatureSource>
+#include <osgEarth/FeatureCursor>
+#include <osgEarth/Filter>
+#include <osgEarth/StringUtils>
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+
+#ifdef _WIN32
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#define LC "[FlatGeobufFeatureSource] "
+
+using namespace osgEarth;
+
+// FlatGeobuf is little-endian and built on flatbuffers. The schema lives at
+// https://github.com/flatgeobuf/flatgeobuf/tree/master/src/fbs
+namespace osgEarth { namespace FlatGeobuf
+{
+    const std::uint8_t MAGIC[8] = { 0x66, 0x67, 0x62, 0x03, 0x66, 0x67, 0x62, 0x00 };
+
+    enum GeometryType : std::uint8_t
+    {
+        GT_UNKNOWN = 0,
+        GT_POINT = 1,
+        GT_LINESTRING = 2,
+        GT_POLYGON = 3,
+        GT_MULTIPOINT = 4,
+        GT_MULTILINESTRING = 5,
+        GT_MULTIPOLYGON = 6,
+        GT_GEOMETRYCOLLECTION = 7,
+        GT_TRIANGLE = 17
+    };
+
+    enum ColumnType : std::uint8_t
+    {
+        CT_BYTE, CT_UBYTE, CT_BOOL, CT_SHORT, CT_USHORT, CT_INT, CT_UINT,
+        CT_LONG, CT_ULONG, CT_FLOAT, CT_DOUBLE, CT_STRING, CT_JSON,
+        CT_DATETIME, CT_BINARY
+    };
+
+    // Field ids, in schema order
+    namespace HeaderField { enum { NAME = 0, ENVELOPE = 1, GEOMETRY_TYPE = 2, HAS_Z = 3, COLUMNS = 7, FEATURES_COUNT = 8, INDEX_NODE_SIZE = 9, CRS = 10 }; }
+    namespace ColumnField { enum { NAME = 0, TYPE = 1 }; }
+    namespace CrsField { enum { ORG = 0, CODE = 1, WKT = 4 }; }
+    namespace GeometryField { enum { ENDS = 0, XY = 1, Z = 2, TYPE = 6, PARTS = 7 }; }
+    namespace FeatureField { enum { GEOMETRY = 0, PROPERTIES = 1 }; }
+
+    // One entry in the packed R-tree
+    struct NodeItem
+    {
+        double minX, minY, maxX, maxY;
+        std::uint64_t offset;
+    };
+
+    //! Bounds of each tree level in storage order, root level last
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> levelBounds(std::uint64_t numItems, std::uint16_t nodeSize)
+    {
+        std::vector<std::uint64_t> levelNumNodes;
+        std::uint64_t n = numItems;
+        std::uint64_t numNodes = n;
+        levelNumNodes.push_back(n);
+        do {
+            n = (n + nodeSize - 1) / nodeSize;
+            numNodes += n;
+            levelNumNodes.push_back(n);
+        } while (n != 1);
+
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> result;
+        n = numNodes;
+        for (auto size : levelNumNodes)
+        {
+            n -= size;
+            result.emplace_back(n, n + size);
+        }
+        return result;
+    }
+
+    //! Read-only view of a flatbuffers table, bounds-checked against its buffer
+    class Table
+    {
+    public:
+        Table() : _buf(nullptr), _size(0), _pos(0), _vt(0), _vtSize(0) { }
+
+        Table(const std::uint8_t* buf, std::size_t size, std::size_t pos) :
+            _buf(nullptr), _size(size), _pos(pos), _vt(0), _vtSize(0)
+        {
+            if (pos + 4 > size)
+                return;
+            std::int64_t vt = (std::int64_t)pos - read<std::int32_t>(buf, pos);
+            if (vt < 0 || (std::size_t)vt + 4 > size)
+                return;
+            _vt = (std::size_t)vt;
+            _vtSize = read<std::uint16_t>(buf, _vt);
+            if (_vt + _vtSize > size)
+                return;
+            _buf = buf;
+        }
+
+        static Table root(const std::uint8_t* buf, std::size_t size)
+        {
+            return size >= 4 ? Table(buf, size, read<std::uint32_t>(buf, 0)) : Table();
+        }
+
+        bool valid() const { return _buf != nullptr; }
+
+        const std::uint8_t* data() const { return _buf; }
+
+        template<typename T>
+        static T read(const std::uint8_t* buf, std::size_t pos)
+        {
+            T value;
+            ::memcpy(&value, buf + pos, sizeof(T));
+            return value;
+        }
+
+        template<typename T>
+        T read(std::size_t pos) const { return read<T>(_buf, pos); }
+
+        template<typename T>
+        T scalar(unsigned id, T defaultValue) const
+        {
+            std::size_t f = field(id);
+            return f && f + sizeof(T) <= _size ? read<T>(f) : defaultValue;
+        }
+
+        Table table(unsigned id) const
+        {
+            std::size_t t = indirect(id);
+            return t ? Table(_buf, _size, t) : Table();
+        }
+
+        //! Position and length of a vector field
+        template<typename T>
+        bool vector(unsigned id, std::size_t& pos, std::size_t& count) const
+        {
+            std::size_t v = indirect(id);
+            if (!v || v + 4 > _size)
+                return false;
+            count = read<std::uint32_t>(v);
+            pos = v + 4;
+            return count <= (_size - pos) / sizeof(T);
+        }
+
+        std::string string(unsigned id) const
+        {
+            std::size_t pos, count;
+            return vector<char>(id, pos, count) ? std::string((const char*)_buf + pos, count) : std::string();
+        }
+
+        //! Element of a vector of tables
+        Table tableAt(std::size_t vectorPos, std::size_t i) const
+        {
+            std::size_t e = vectorPos + 4 * i;
+            std::size_t t = e + read<std::uint32_t>(e);
+            return t < _size ? Table(_buf, _size, t) : Table();
+        }
+
+    private:
+        const std::uint8_t* _buf;
+        std::size_t _size;
+        std::size_t _pos;
+        std::size_t _vt;
+        std::size_t _vtSize;
+
+        std::size_t field(unsigned id) const
+        {
+            std::size_t e = 4 + 2 * id;
+            if (!_buf || e + 2 > _vtSize)
+                return 0;
+            std::uint16_t offset = read<std::uint16_t>(_vt + e);
+            return offset ? _pos + offset : 0;
+        }
+
+        std::size_t indirect(unsigned id) const
+        {
+            std::size_t f = field(id);
+            if (!f || f + 4 > _size)
+                return 0;
+            std::size_t t = f + read<std::uint32_t>(f);
+            return t < _size ? t : 0;
+        }
+    };
+
+    struct Column
+    {
+        std::string name;
+        std::uint8_t type;
+    };
+
+    //! Appends the points [begin, end) to the target, dropping consecutive duplicates.
+    //! Returns false, reading nothing, if the range is not within [0, numPoints].
+    bool readPoints(const Table& g, std::size_t xy, std::size_t z, bool hasZ, std::size_t numPoints, std::size_t begin, std::size_t end, Geometry* target)
+    {
+        if (begin > end || end > numPoints)
+            return false;
+
+        target->reserve(target->size() + (end - begin));
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            osg::Vec3d p(
+                g.read<double>(xy + 16 * i),
+                g.read<double>(xy + 16 * i + 8),
+                hasZ ? g.read<double>(z + 8 * i) : 0.0);
+
+            if (target->empty() || target->back() != p)
+                target->push_back(p);
+        }
+        return true;
+    }
+
+    Geometry* decodeGeometry(const Table& g, std::uint8_t type, bool rewind)
+    {
+        if (!g.valid())
+            return nullptr;
+
+        if (type == GT_UNKNOWN)
+            type = g.scalar<std::uint8_t>(GeometryField::TYPE, GT_UNKNOWN);
+
+        std::size_t xy = 0, numXY = 0, z = 0, numZ = 0, ends = 0, numEnds = 0;
+        g.vector<double>(GeometryField::XY, xy, numXY);
+        std::size_t numPoints = numXY / 2;
+        bool hasZ = g.vector<double>(GeometryField::Z, z, numZ) && numZ >= numPoints;
+        if (!g.vector<std::uint32_t>(GeometryField::ENDS, ends, numEnds))
+            numEnds = 0;
+
+        // each "end" is the exclusive end point index of a ring or line
+        auto partEnd = [&](std::size_t i) {
+            return numEnds == 0 ? numPoints : (std::size_t)g.read<std::uint32_t>(ends + 4 * i);
+        };
+        std::size_t numParts = numEnds == 0 ? 1 : numEnds;
+
+        switch (type)
+        {
+        case GT_POINT:
+        {
+            osgEarth::Point* point = new osgEarth::Point();
+            readPoints(g, xy, z, hasZ, numPoints, 0, std::min(numPoints, (std::size_t)1), point);
+            return point;
+        }
+
+        case GT_MULTIPOINT:
+        {
+            PointSet* points = new PointSet();
+            readPoints(g, xy, z, hasZ, numPoints, 0, numPoints, points);
+            return points;
+        }
+
+        case GT_LINESTRING:
+        {
+            LineString* line = new LineString();
+            readPoints(g, xy, z, hasZ, numPoints, 0, numPoints, line);
+            return line;
+        }
+
+        case GT_MULTILINESTRING:
+        {
+            osg::ref_ptr<MultiGeometry> multi = new MultiGeometry();
+            for (std::size_t i = 0, begin = 0; i < numParts; ++i)
+            {
+                std::size_t end = partEnd(i);
+                osg::ref_ptr<LineString> line = new LineString();
+                if (!readPoints(g, xy, z, hasZ, numPoints, begin, end, line.get()))
+                {
+                    OE_DEBUG << LC << "Skipping geometry with invalid part ends" << std::endl;
+                    return nullptr;
+                }
+                multi->add(line.get());
+                begin = end;
+            }
+            return multi.release();
+        }
+
+        case GT_POLYGON:
+        case GT_TRIANGLE:
+        {
+            osg::ref_ptr<osgEarth::Polygon> polygon = new osgEarth::Polygon();
+            for (std::size_t i = 0, begin = 0; i < numParts; ++i)
+            {
+                std::size_t end = partEnd(i);
+                osg::ref_ptr<Ring> ring = i == 0 ? polygon.get() : new Ring();
+                if (!readPoints(g, xy, z, hasZ, numPoints, begin, end, ring.get()))
+                {
+                    OE_DEBUG << LC << "Skipping geometry with invalid ring ends" << std::endl;
+                    return nullptr;
+                }
+                if (rewind)
+                {
+                    ring->open();
+                    ring->rewind(i == 0 ? Ring::ORIENTATION_CCW : Ring::ORIENTATION_CW);
+                }
+                if (i > 0)
+                    polygon->getHoles().push_back(ring);
+                begin = end;
+            }
+            return polygon.release();
+        }
+
+        case GT_MULTIPOLYGON:
+        case GT_GEOMETRYCOLLECTION:
+        {
+            MultiGeometry* multi = new MultiGeometry();
+            std::size_t parts, count;
+            if (g.vector<std::uint32_t>(GeometryField::PARTS, parts, count))
+            {
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    Geometry* part = decodeGeometry(
+                        g.tableAt(parts, i),
+                        type == GT_MULTIPOLYGON ? (std::uint8_t)GT_POLYGON : (std::uint8_t)GT_UNKNOWN,
+                        rewind);
+                    if (part)
+                        multi->add(part);
+                }
+            }
+            return multi;
+        }
+
+        default:
+            OE_DEBUG << LC << "Unsupported geometry type " << (int)type << std::endl;
+            return nullptr;
+        }
+    }
+
+    //! Decodes the (column index, value) pairs of a feature's properties
+    void readProperties(const Table& f, const std::vector<Column>& columns, Feature* feature)
+    {
+        std::size_t pos, count;
+        if (!f.vector<std::uint8_t>(FeatureField::PROPERTIES, pos, count))
+            return;
+
+        const std::size_t end = pos + count;
+
+        while (pos + 2 <= end)
+        {
+            std::uint16_t index = f.read<std::uint16_t>(pos);
+            pos += 2;
+            if (index >= columns.size())
+                return;
+
+            const Column& column = columns[index];
+
+#define FGB_SET(TYPE, CAST) \
+            if (pos + sizeof(TYPE) > end) return; \
+            feature->set(column.name, (CAST)f.read<TYPE>(pos)); \
+            pos += sizeof(TYPE); \
+            break;
+
+            switch (column.type)
+            {
+            case CT_BYTE:   FGB_SET(std::int8_t, long long)
+            case CT_UBYTE:  FGB_SET(std::uint8_t, long long)
+            case CT_BOOL:   FGB_SET(std::uint8_t, long long)
+            case CT_SHORT:  FGB_SET(std::int16_t, long long)
+            case CT_USHORT: FGB_SET(std::uint16_t, long long)
+            case CT_INT:    FGB_SET(std::int32_t, long long)
+            case CT_UINT:   FGB_SET(std::uint32_t, long long)
+            case CT_LONG:   FGB_SET(std::int64_t, long long)
+            case CT_ULONG:  FGB_SET(std::uint64_t, long long)
+            case CT_FLOAT:  FGB_SET(float, double)
+            case CT_DOUBLE: FGB_SET(double, double)
+            case CT_STRING:
+            case CT_JSON:
+            case CT_DATETIME:
+            case CT_BINARY:
+            {
+                if (pos + 4 > end) return;
+                std::uint32_t len = f.read<std::uint32_t>(pos);
+                pos += 4;
+                if (len > end - pos) return;
+                if (column.type != CT_BINARY)
+                {
+                    feature->set(column.name, std::string((const char*)f.data() + pos, len));
+                }
+                pos += len;
+                break;
+            }
+            default:
+                return;
+            }
+#undef FGB_SET
+        }
+    }
+
+    /**
+     * Memory-mapped FlatGeobuf file. All queries are read-only, so a
+     * single Reader can serve any number of threads.
+     */
+    class Reader
+    {
+    public:
+        Reader() :
+            _geometryType(GT_UNKNOWN),
+            _featuresCount(0u),
+            _data(nullptr),
+            _size(0u),
+            _nodeSize(0u),
+            _numNodes(0u),
+            _indexOffset(0u),
+            _featuresOffset(0u)
+#ifdef _WIN32
+            , _file(INVALID_HANDLE_VALUE), _mapping(nullptr)
+#endif
+        {
+            //nop
+        }
+
+        ~Reader()
+        {
+            unmap();
+        }
+
+        Status open(const std::string& filename)
+        {
+            if (!map(filename))
+                return Status(Status::ResourceUnavailable, Stringify() << "Failed to map \"" << filename << "\"");
+
+            if (_size < 12 || ::memcmp(_data, MAGIC, 3) != 0 || ::memcmp(_data + 4, MAGIC + 4, 3) != 0 || _data[3] != MAGIC[3])
+                return Status(Status::ResourceUnavailable, Stringify() << "\"" << filename << "\" is not a FlatGeobuf v3 file");
+
+            std::uint32_t headerSize = Table::read<std::uint32_t>(_data, 8);
+            if (12u + headerSize > _size)
+                return Status(Status::ResourceUnavailable, "Truncated FlatGeobuf header");
+
+            Table header = Table::root(_data + 12, headerSize);
+            if (!header.valid())
+                return Status(Status::ResourceUnavailable, "Invalid FlatGeobuf header");
+
+            _geometryType = header.scalar<std::uint8_t>(HeaderField::GEOMETRY_TYPE, GT_UNKNOWN);
+            _featuresCount = header.scalar<std::uint64_t>(HeaderField::FEATURES_COUNT, 0u);
+            _nodeSize = header.scalar<std::uint16_t>(HeaderField::INDEX_NODE_SIZE, 16u);
+
+            std::size_t columns, numColumns;
+            if (header.vector<std::uint32_t>(HeaderField::COLUMNS, columns, numColumns))
+            {
+                for (std::size_t i = 0; i < numColumns; ++i)
+                {
+                    Table c = header.tableAt(columns, i);
+                    Column column;
+                    column.name = toLower(c.string(ColumnField::NAME));
+                    column.type = c.scalar<std::uint8_t>(ColumnField::TYPE, CT_STRING);
+                    _columns.push_back(column);
+                }
+            }
+
+            Table crs = header.table(HeaderField::CRS);
+            if (crs.valid())
+            {
+                std::string org = toLower(crs.string(CrsField::ORG));
+                int code = crs.scalar<std::int32_t>(CrsField::CODE, 0);
+                if (code != 0 && (org.empty() || org == "epsg"))
+                    _srs = SpatialReference::create(Stringify() << "epsg:" << code);
+                if (!_srs.valid() && !crs.string(CrsField::WKT).empty())
+                    _srs = SpatialReference::create(crs.string(CrsField::WKT));
+            }
+
+            _indexOffset = 12u + headerSize;
+
+            std::size_t indexSize = 0u;
+            if (hasIndex())
+            {
+                if (_nodeSize < 2u)
+                    return Status(Status::ResourceUnavailable, "Invalid FlatGeobuf index node size");
+
+                _levelBounds = levelBounds(_featuresCount, _nodeSize);
+                _numNodes = _levelBounds.front().second;
+                indexSize = _numNodes * sizeof(NodeItem);
+            }
+
+            _featuresOffset = _indexOffset + indexSize;
+            if (_featuresOffset > _size)
+                return Status(Status::ResourceUnavailable, "Truncated FlatGeobuf index");
+
+            return Status::NoError;
+        }
+
+        bool hasIndex() const
+        {
+            return _nodeSize > 0u && _featuresCount > 0u;
+        }
+
+        NodeItem node(std::uint64_t i) const
+        {
+            return Table::read<NodeItem>(_data, _indexOffset + i * sizeof(NodeItem));
+        }
+
+        //! Extent of all features, from the index root or the header envelope
+        bool getBounds(Bounds& bounds) const
+        {
+            if (hasIndex())
+            {
+                NodeItem root = node(0);
+                bounds = Bounds(root.minX, root.minY, root.maxX, root.maxY);
+                return true;
+            }
+            return false;
+        }
+
+        //! Finds the features whose index boxes intersect the bounds, as
+        //! (byte offset, feature index) pairs in file order.
+        void search(const Bounds& b, std::vector<std::pair<std::uint64_t, std::uint64_t>>& hits) const
+        {
+            const std::uint64_t leafStart = _numNodes - _featuresCount;
+
+            std::vector<std::pair<std::uint64_t, std::size_t>> stack;
+            stack.emplace_back(0u, _levelBounds.size() - 1);
+
+            while (!stack.empty())
+            {
+                std::uint64_t nodeIndex = stack.back().first;
+                std::size_t level = stack.back().second;
+                stack.pop_back();
+
+                bool isLeaf = nodeIndex >= leafStart;
+                std::uint64_t end = std::min(nodeIndex + _nodeSize, _levelBounds[level].second);
+
+                for (std::uint64_t pos = nodeIndex; pos < end; ++pos)
+                {
+                    NodeItem n = node(pos);
+                    if (n.maxX < b.xMin() || n.maxY < b.yMin() || n.minX > b.xMax() || n.minY > b.yMax())
+                        continue;
+
+                    if (isLeaf)
+                        hits.emplace_back(n.offset, pos - leafStart);
+                    else if (level > 0 && n.offset < _numNodes)
+                        stack.emplace_back(n.offset, level - 1);
+                }
+            }
+
+            // read features in file order
+            std::sort(hits.begin(), hits.end());
+        }
+
+        //! Visits every feature in file order
+        void scan(const std::function<void(std::uint64_t offset, std::uint64_t index)>& visit) const
+        {
+            std::uint64_t offset = 0u;
+            for (std::uint64_t i = 0; _featuresOffset + offset + 4 <= _size; ++i)
+            {
+                visit(offset, i);
+                offset += 4u + Table::read<std::uint32_t>(_data, _featuresOffset + offset);
+            }
+        }
+
+        //! Offset of a feature by index; requires the index
+        bool offsetOf(std::uint64_t index, std::uint64_t& offset) const
+        {
+            if (!hasIndex() || index >= _featuresCount)
+                return false;
+            offset = node(_numNodes - _featuresCount + index).offset;
+            return true;
+        }
+
+        Feature* readFeature(std::uint64_t offset, FeatureID fid, bool rewind) const
+        {
+            std::size_t pos = _featuresOffset + offset;
+            if (pos + 4 > _size)
+                return nullptr;
+
+            std::uint32_t len = Table::read<std::uint32_t>(_data, pos);
+            if (pos + 4 + len > _size)
+                return nullptr;
+
+            Table f = Table::root(_data + pos + 4, len);
+            if (!f.valid())
+                return nullptr;
+
+            Geometry* geom = decodeGeometry(f.table(FeatureField::GEOMETRY), _geometryType, rewind);
+            Feature* feature = new Feature(geom, _srs.get(), Style(), fid);
+            readProperties(f, _columns, feature);
+            return feature;
+        }
+
+        std::uint8_t _geometryType;
+        std::uint64_t _featuresCount;
+        std::vector<Column> _columns;
+        osg::ref_ptr<const SpatialReference> _srs;
+
+    private:
+        const std::uint8_t* _data;
+        std::size_t _size;
+        std::uint16_t _nodeSize;
+        std::uint64_t _numNodes;
+        std::size_t _indexOffset;
+        std::size_t _featuresOffset;
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> _levelBounds;
+
+#ifdef _WIN32
+        HANDLE _file;
+        HANDLE _mapping;
+
+        bool map(const std::string& filename)
+        {
+            _file = ::CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (_file == INVALID_HANDLE_VALUE)
+                return false;
+            LARGE_INTEGER size;
+            if (!::GetFileSizeEx(_file, &size) || size.QuadPart == 0)
+                return false;
+            _mapping = ::CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!_mapping)
+                return false;
+            _data = (const std::uint8_t*)::MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+            _size = (std::size_t)size.QuadPart;
+            return _data != nullptr;
+        }
+
+        void unmap()
+        {
+            if (_data) ::UnmapViewOfFile(_data);
+            if (_mapping) ::CloseHandle(_mapping);
+            if (_file != INVALID_HANDLE_VALUE) ::CloseHandle(_file);
+            _data = nullptr;
+            _mapping = nullptr;
+            _file = INVALID_HANDLE_VALUE;
+        }
+#else
+        bool map(const std::string& filename)
+        {
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (::fstat(fd, &st) != 0 || st.st_size == 0)
+            {
+                ::close(fd);
+                return false;
+            }
+            void* ptr = ::mmap(nullptr, (std::size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (ptr == MAP_FAILED)
+                return false;
+            _data = (const std::uint8_t*)ptr;
+            _size = (std::size_t)st.st_size;
+            return true;
+        }
+
+        void unmap()
+        {
+            if (_data)
+                ::munmap((void*)_data, _size);
+            _data = nullptr;
+        }
+#endif
+    };
+} }
+
+using namespace osgEarth::FlatGeobuf;
+
+//........................................................................
+
+Config
+FlatGeobufFeatureSource::Options::getConfig() const
+{
+    Config conf = FeatureSource::Options::getConfig();
+    conf.set("url", _url);
+    return conf;
+}
+
+void
+FlatGeobufFeatureSource::Options::fromConfig(const Config& conf)
+{
+    conf.get("url", _url);
+}
+
+//........................................................................
+
+REGISTER_OSGEARTH_LAYER(flatgeobuffeatures, FlatGeobufFeatureSource);
+
+OE_LAYER_PROPERTY_IMPL(FlatGeobufFeatureSource, URI, URL, url);
+
+void
+FlatGeobufFeatureSource::init()
+{
+    FeatureSource::init();
+    _reader = nullptr;
+    _geometryType = Geometry::TYPE_UNKNOWN;
+    _warnedExpression = false;
+}
+
+FlatGeobufFeatureSource::~FlatGeobufFeatureSource()
+{
+    close();
+}
+
+Status
+FlatGeobufFeatureSource::openImplementation()
+{
+    Status parent = FeatureSource::openImplementation();
+    if (parent.isError())
+        return parent;
+
+    if (!options().url().isSet())
+        return Status(Status::ConfigurationError, "Missing required URL");
+
+    std::shared_ptr<Reader> reader = std::make_shared<Reader>();
+    Status status = reader->open(options().url()->full());
+    if (status.isError())
+        return status;
+
+    if (!reader->_srs.valid())
+    {
+        OE_WARN << LC << "No CRS found in \"" << options().url()->full() << "\"; assuming WGS84" << std::endl;
+        reader->_srs = SpatialReference::create("wgs84");
+    }
+
+    Bounds bounds;
+    if (!reader->getBounds(bounds))
+    {
+        // no index, so compute the extent the hard way
+        reader->scan([&](std::uint64_t offset, std::uint64_t index) {
+            osg::ref_ptr<Feature> f = reader->readFeature(offset, index, false);
+            if (f.valid() && f->getGeometry())
+                bounds.expandBy(f->getGeometry()->getBounds());
+        });
+    }
+
+    GeoExtent extent(reader->_srs.get(), bounds);
+    if (!extent.isValid())
+    {
+        extent = GeoExtent(reader->_srs.get());
+    }
+
+    FeatureProfile* profile = new FeatureProfile(extent);
+    if (options().geoInterp().isSet())
+        profile->geoInterp() = options().geoInterp().get();
+    setFeatureProfile(profile);
+
+    _schema.clear();
+    for (auto& column : reader->_columns)
+    {
+        _schema[column.name] =
+            column.type == CT_STRING || column.type == CT_JSON || column.type == CT_DATETIME ? ATTRTYPE_STRING :
+            column.type == CT_FLOAT || column.type == CT_DOUBLE ? ATTRTYPE_DOUBLE :
+            column.type == CT_BINARY ? ATTRTYPE_UNSPECIFIED :
+            ATTRTYPE_INT;
+    }
+
+    switch (reader->_geometryType)
+    {
+    case GT_POINT: _geometryType = Geometry::TYPE_POINT; break;
+    case GT_MULTIPOINT: _geometryType = Geometry::TYPE_POINTSET; break;
+    case GT_LINESTRING: _geometryType = Geometry::TYPE_LINESTRING; break;
+    case GT_POLYGON: _geometryType = Geometry::TYPE_POLYGON; break;
+    case GT_MULTILINESTRING:
+    case GT_MULTIPOLYGON:
+    case GT_GEOMETRYCOLLECTION: _geometryType = Geometry::TYPE_MULTI; break;
+    default: _geometryType = Geometry::TYPE_UNKNOWN;
+    }
+
+    _reader = reader;
+
+    return Status::NoError;
+}
+
+Status
+FlatGeobufFeatureSource::closeImplementation()
+{
+    init();
+    return FeatureSource::closeImplementation();
+}
+
+FeatureCursor*
+FlatGeobufFeatureSource::createFeatureCursorImplementation(const Query& query, ProgressCallback* progress)
+{
+    std::shared_ptr<Reader> reader = _reader;
+    if (!reader)
+        return nullptr;
+
+    const FeatureProfile* profile = getFeatureProfile();
+    const bool rewind = options().rewindPolygons().get();
+
+    // FlatGeobuf has no query language; say so once instead of
+    // quietly returning unfiltered results.
+    if (query.expression().isSet() && !query.expression()->empty() && !_warnedExpression.exchange(true))
+    {
+        OE_WARN << LC << getName() << ": query expressions are not supported and will be ignored (\""
+            << query.expression().get() << "\")" << std::endl;
+    }
+
+    // establish the query bounds in the feature SRS:
+    Bounds bounds;
+    GeoExtent queryExtent = profile->getExtent();
+    if (query.bounds().isSet())
+    {
+        bounds = query.bounds().get();
+        queryExtent = GeoExtent(profile->getSRS(), bounds);
+    }
+    else if (query.tileKey().isSet())
+    {
+        queryExtent = query.tileKey()->getExtent().transform(profile->getSRS());
+        bounds = queryExtent.bounds();
+    }
+
+    FeatureList features;
+
+    auto accept = [&](std::uint64_t offset, std::uint64_t index)
+    {
+        if (isBlacklisted((FeatureID)index))
+            return;
+
+        osg::ref_ptr<Feature> f = reader->readFeature(offset, (FeatureID)index, rewind);
+        if (f.valid() && f->getGeometry() && f->getGeometry()->isValid())
+        {
+            if (profile->geoInterp().isSet())
+                f->geoInterp() = profile->geoInterp().get();
+            features.push_back(f.get());
+        }
+    };
+
+    if (reader->hasIndex())
+    {
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> hits;
+        if (bounds.isValid())
+            reader->search(bounds, hits);
+        else
+            reader->search(Bounds(-DBL_MAX, -DBL_MAX, DBL_MAX, DBL_MAX), hits);
+
+        for (auto& hit : hits)
+        {
+            if (progress && progress->isCanceled())
+                return nullptr;
+            accept(hit.first, hit.second);
+        }
+    }
+    else
+    {
+        reader->scan([&](std::uint64_t offset, std::uint64_t index) {
+            std::size_t before = features.size();
+            accept(offset, index);
+            if (bounds.isValid() && features.size() > before)
+            {
+                Bounds fb = features.back()->getGeometry()->getBounds();
+                if (fb.xMax() < bounds.xMin() || fb.yMax() < bounds.yMin() || fb.xMin() > bounds.xMax() || fb.yMin() > bounds.yMax())
+                    features.pop_back();
+            }
+        });
+    }
+
+    applyFilters(features, queryExtent);
+
+    // If we have any features and we have an fid attribute, override the fid of the features
+    if (options().fidAttribute().isSet())
+    {
+        for (auto& f : features)
+        {
+            std::string attr = f->getString(options().fidAttribute().get());
+            f->setFID(as<FeatureID>(attr, 0));
+        }
+    }
+
+    return new FeatureListCursor(features);
+}
+
+int
+FlatGeobufFeatureSource::getFeatureCount() const
+{
+    return _reader ? (int)_reader->_featuresCount : -1;
+}
+
+bool
+FlatGeobufFeatureSource::supportsGetFeature() const
+{
+    return _reader && _reader->hasIndex();
+}
+
+Feature*
+FlatGeobufFeatureSource::getFeature(FeatureID fid)
+{
+    std::shared_ptr<Reader> reader = _reader;
+    std::uint64_t offset;
+    if (reader && !isBlacklisted(fid) && reader->offsetOf(fid, offset))
+    {
+        return reader->readFeature(offset, fid, options().rewindPolygons().get());
+    }
+    return nullptr;
+}
+
+//........................................................................
+
+namespace
+{
+    // Minimal flatbuffers encoder. Each table is written front to back with
+    // its vtable just ahead of it and its children after it, which keeps
+    // every offset positive as the format requires.
+    struct Builder
+    {
+        std::vector<std::uint8_t> buf;
+
+        void align(std::size_t a)
+        {
+            while (buf.size() % a) buf.push_back(0);
+        }
+
+        template<typename T>
+        std::size_t put(T value)
+        {
+            std::size_t pos = buf.size();
+            buf.resize(pos + sizeof(T));
+            ::memcpy(&buf[pos], &value, sizeof(T));
+            return pos;
+        }
+
+        template<typename T>
+        void patch(std::size_t pos, T value)
+        {
+            ::memcpy(&buf[pos], &value, sizeof(T));
+        }
+    };
+
+    // Writes an out-of-line object and returns its position
+    typedef std::function<std::size_t(Builder&)> ChildWriter;
+
+    struct TableDef
+    {
+        struct Field
+        {
+            unsigned id;
+            unsigned size;
+            std::uint64_t bits;
+            ChildWriter child;
+        };
+        std::vector<Field> fields;
+
+        template<typename T>
+        void scalar(unsigned id, T value)
+        {
+            Field f;
+            f.id = id;
+            f.size = sizeof(T);
+            f.bits = 0u;
+            ::memcpy(&f.bits, &value, sizeof(T));
+            fields.push_back(f);
+        }
+
+        void child(unsigned id, const ChildWriter& writer)
+        {
+            Field f;
+            f.id = id;
+            f.size = 4u;
+            f.bits = 0u;
+            f.child = writer;
+            fields.push_back(f);
+        }
+
+        std::size_t write(Builder& b) const
+        {
+            // largest fields first so every field lands on its natural alignment
+            std::vector<Field> sorted(fields);
+            std::stable_sort(sorted.begin(), sorted.end(), [](const Field& l, const Field& r) { return l.size > r.size; });
+
+            unsigned numSlots = 0u;
+            for (auto& f : sorted)
+                numSlots = std::max(numSlots, f.id + 1u);
+
+            std::vector<std::uint16_t> slots(numSlots, 0u);
+            std::vector<std::uint16_t> offsets;
+            std::size_t size = 4u;
+            if (!sorted.empty() && sorted.front().size == 8u)
+                size = 8u;
+            for (auto& f : sorted)
+            {
+                size = (size + f.size - 1) / f.size * f.size;
+                slots[f.id] = (std::uint16_t)size;
+                offsets.push_back((std::uint16_t)size);
+                size += f.size;
+            }
+
+            b.align(2);
+            std::size_t vtable = b.put<std::uint16_t>((std::uint16_t)(4u + 2u * numSlots));
+            b.put<std::uint16_t>((std::uint16_t)size);
+            for (auto slot : slots)
+                b.put<std::uint16_t>(slot);
+
+            b.align(8);
+            std::size_t table = b.buf.size();
+            b.buf.resize(table + size, 0u);
+            b.patch<std::int32_t>(table, (std::int32_t)(table - vtable));
+
+            for (std::size_t i = 0; i < sorted.size(); ++i)
+            {
+                if (!sorted[i].child)
+                    ::memcpy(&b.buf[table + offsets[i]], &sorted[i].bits, sorted[i].size);
+            }
+
+            for (std::size_t i = 0; i < sorted.size(); ++i)
+            {
+                if (sorted[i].child)
+                {
+                    std::size_t at = table + offsets[i];
+                    std::size_t target = sorted[i].child(b);
+                    b.patch<std::uint32_t>(at, (std::uint32_t)(target - at));
+                }
+            }
+
+            return table;
+        }
+    };
+
+    ChildWriter stringWriter(const std::string& value)
+    {
+        return [value](Builder& b) {
+            b.align(4);
+            std::size_t pos = b.put<std::uint32_t>((std::uint32_t)value.size());
+            b.buf.insert(b.buf.end(), value.begin(), value.end());
+            b.buf.push_back(0);
+            return pos;
+        };
+    }
+
+    template<typename T>
+    ChildWriter vectorWriter(const std::vector<T>& values)
+    {
+        return [values](Builder& b) {
+            // elements must be aligned to their size; the length precedes them
+            std::size_t a = std::max(sizeof(T), (std::size_t)4);
+            while ((b.buf.size() + 4) % a) b.buf.push_back(0);
+            std::size_t pos = b.put<std::uint32_t>((std::uint32_t)values.size());
+            for (auto& v : values)
+                b.put<T>(v);
+            return pos;
+        };
+    }
+
+    ChildWriter tablesWriter(const std::vector<TableDef>& tables)
+    {
+        return [tables](Builder& b) {
+            b.align(4);
+            std::size_t pos = b.put<std::uint32_t>((std::uint32_t)tables.size());
+            std::size_t first = b.buf.size();
+            b.buf.resize(first + 4 * tables.size(), 0u);
+            for (std::size_t i = 0; i < tables.size(); ++i)
+            {
+                std::size_t t = tables[i].write(b);
+                b.patch<std::uint32_t>(first + 4 * i, (std::uint32_t)(t - (first + 4 * i)));
+            }
+            return pos;
+        };
+    }
+
+    ChildWriter tableWriter(const TableDef& table)
+    {
+        return [table](Builder& b) { return table.write(b); };
+    }
+
+    std::vector<std::uint8_t> finish(const TableDef& root)
+    {
+        Builder b;
+        b.put<std::uint32_t>(0u);
+        std::size_t pos = root.write(b);
+        b.patch<std::uint32_t>(0u, (std::uint32_t)pos);
+        b.align(8);
+        return b.buf;
+    }
+
+    // Flattened coordinates of a geometry, in FlatGeobuf layout
+    struct Coords
+    {
+        std::vector<double> xy;
+        std::vector<double> z;
+        std::vector<std::uint32_t> ends;
+
+        void add(const Geometry* g, bool close)
+        {
+            for (auto& p : *g)
+            {
+                xy.push_back(p.x());
+                xy.push_back(p.y());
+                z.push_back(p.z());
+            }
+            if (close && g->size() > 2 && g->front() != g->back())
+            {
+                xy.push_back(g->front().x());
+                xy.push_back(g->front().y());
+                z.push_back(g->front().z());
+            }
+            ends.push_back((std::uint32_t)(xy.size() / 2));
+        }
+
+        void write(TableDef& def, bool withEnds, bool hasZ) const
+        {
+            if (withEnds && ends.size() > 1)
+                def.child(GeometryField::ENDS, vectorWriter(ends));
+            def.child(GeometryField::XY, vectorWriter(xy));
+            if (hasZ)
+                def.child(GeometryField::Z, vectorWriter(z));
+        }
+    };
+
+    std::uint8_t typeOf(const Geometry* g)
+    {
+        switch (g->getType())
+        {
+        case Geometry::TYPE_POINT: return GT_POINT;
+        case Geometry::TYPE_POINTSET: return GT_MULTIPOINT;
+        case Geometry::TYPE_LINESTRING: return GT_LINESTRING;
+        case Geometry::TYPE_RING:
+        case Geometry::TYPE_POLYGON: return GT_POLYGON;
+        case Geometry::TYPE_MULTI:
+        {
+            const MultiGeometry* multi = static_cast<const MultiGeometry*>(g);
+            std::uint8_t partType = GT_UNKNOWN;
+            for (auto& part : multi->getComponents())
+            {
+                std::uint8_t t = typeOf(part.get());
+                if (partType != GT_UNKNOWN && t != partType)
+                    return GT_GEOMETRYCOLLECTION;
+                partType = t;
+            }
+            return
+                partType == GT_POLYGON ? GT_MULTIPOLYGON :
+                partType == GT_LINESTRING ? GT_MULTILINESTRING :
+                partType == GT_POINT || partType == GT_MULTIPOINT ? GT_MULTIPOINT :
+                GT_GEOMETRYCOLLECTION;
+        }
+        default: return GT_UNKNOWN;
+        }
+    }
+
+    TableDef encodeGeometry(const Geometry* g, bool hasZ)
+    {
+        TableDef def;
+        std::uint8_t type = typeOf(g);
+        def.scalar<std::uint8_t>(GeometryField::TYPE, type);
+
+        Coords coords;
+
+        switch (type)
+        {
+        case GT_POINT:
+        case GT_MULTIPOINT:
+        case GT_LINESTRING:
+            if (g->getType() == Geometry::TYPE_MULTI)
+            {
+                for (auto& part : static_cast<const MultiGeometry*>(g)->getComponents())
+                    coords.add(part.get(), false);
+            }
+            else
+            {
+                coords.add(g, false);
+            }
+            coords.write(def, false, hasZ);
+            break;
+
+        case GT_MULTILINESTRING:
+            for (auto& part : static_cast<const MultiGeometry*>(g)->getComponents())
+                coords.add(part.get(), false);
+            coords.write(def, true, hasZ);
+            break;
+
+        case GT_POLYGON:
+            coords.add(g, true);
+            if (g->getType() == Geometry::TYPE_POLYGON)
+            {
+                for (auto& hole : static_cast<const osgEarth::Polygon*>(g)->getHoles())
+                    coords.add(hole.get(), true);
+            }
+            coords.write(def, true, hasZ);
+            break;
+
+        case GT_MULTIPOLYGON:
+        case GT_GEOMETRYCOLLECTION:
+        {
+            std::vector<TableDef> parts;
+            for (auto& part : static_cast<const MultiGeometry*>(g)->getComponents())
+                parts.push_back(encodeGeometry(part.get(), hasZ));
+            def.child(GeometryField::PARTS, tablesWriter(parts));
+            break;
+        }
+        }
+
+        return def;
+    }
+
+    // Hilbert curve index of a point on a 2^16 x 2^16 grid
+    std::uint32_t hilbert(std::uint32_t x, std::uint32_t y)
+    {
+        std::uint32_t a = x ^ y;
+        std::uint32_t b = 0xFFFF ^ a;
+        std::uint32_t c = 0xFFFF ^ (x | y);
+        std::uint32_t d = x & (y ^ 0xFFFF);
+
+        std::uint32_t A = a | (b >> 1);
+        std::uint32_t B = (a >> 1) ^ a;
+        std::uint32_t C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+        std::uint32_t D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+        a = A; b = B; c = C; d = D;
+        A = ((a & (a >> 2)) ^ (b & (b >> 2)));
+        B = ((a & (b >> 2)) ^ (b & ((a ^ b) >> 2)));
+        C ^= ((a & (c >> 2)) ^ (b & (d >> 2)));
+        D ^= ((b & (c >> 2)) ^ ((a ^ b) & (d >> 2)));
+
+        a = A; b = B; c = C; d = D;
+        A = ((a & (a >> 4)) ^ (b & (b >> 4)));
+        B = ((a & (b >> 4)) ^ (b & ((a ^ b) >> 4)));
+        C ^= ((a & (c >> 4)) ^ (b & (d >> 4)));
+        D ^= ((b & (c >> 4)) ^ ((a ^ b) & (d >> 4)));
+
+        a = A; b = B; c = C; d = D;
+        C ^= ((a & (c >> 8)) ^ (b & (d >> 8)));
+        D ^= ((b & (c >> 8)) ^ ((a ^ b) & (d >> 8)));
+
+        a = C ^ (C >> 1);
+        b = D ^ (D >> 1);
+
+        std::uint32_t i0 = x ^ y;
+        std::uint32_t i1 = b | (0xFFFF ^ (i0 | a));
+
+        i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+        i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+        i0 = (i0 | (i0 << 2)) & 0x33333333;
+        i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+        i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+        i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+        i1 = (i1 | (i1 << 2)) & 0x33333333;
+        i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+        return (i1 << 1) | i0;
+    }
+}
+
+Status
+FlatGeobufFeatureSource::write(const std::string& filename, const FeatureList& input, const SpatialReference* srs)
+{
+    const std::uint16_t nodeSize = 16u;
+
+    struct Item
+    {
+        const Feature* feature;
+        Bounds bounds;
+        std::uint32_t hilbert;
+    };
+
+    // collect features, their bounds and the overall extent
+    std::vector<Item> items;
+    Bounds extent;
+    bool hasZ = false;
+    std::uint8_t geometryType = GT_UNKNOWN;
+    bool mixed = false;
+
+    std::vector<Column> columns;
+    std::map<std::string, std::uint16_t> columnIndex;
+
+    for (auto& f : input)
+    {
+        const Geometry* g = f->getGeometry();
+        if (!g || !g->isValid())
+            continue;
+
+        Item item;
+        item.feature = f.get();
+        item.bounds = g->getBounds();
+        item.hilbert = 0u;
+        items.push_back(item);
+        extent.expandBy(item.bounds);
+
+        ConstGeometryIterator iter(g, false);
+        while (iter.hasMore())
+        {
+            for (auto& p : *iter.next())
+                hasZ = hasZ || p.z() != 0.0;
+        }
+
+        std::uint8_t type = typeOf(g);
+        if (items.size() == 1)
+            geometryType = type;
+        else if (type != geometryType)
+            mixed = true;
+
+        for (auto& attr : f->getAttrs())
+        {
+            if (columnIndex.count(attr.first) > 0)
+                continue;
+            Column column;
+            column.name = attr.first;
+            switch (attr.second.first)
+            {
+            case ATTRTYPE_STRING: column.type = CT_STRING; break;
+            case ATTRTYPE_INT: column.type = CT_LONG; break;
+            case ATTRTYPE_DOUBLE: column.type = CT_DOUBLE; break;
+            case ATTRTYPE_BOOL: column.type = CT_BOOL; break;
+            default: continue;
+            }
+            columnIndex[column.name] = (std::uint16_t)columns.size();
+            columns.push_back(column);
+        }
+    }
+
+    if (mixed)
+        geometryType = GT_UNKNOWN;
+
+    // sort along a Hilbert curve so nearby features share index nodes
+    if (!items.empty())
+    {
+        double w = extent.width() > 0.0 ? extent.width() : 1.0;
+        double h = extent.height() > 0.0 ? extent.height() : 1.0;
+        for (auto& item : items)
+        {
+            osg::Vec2d c = item.bounds.center2d();
+            item.hilbert = hilbert(
+                (std::uint32_t)(65535.0 * (c.x() - extent.xMin()) / w),
+                (std::uint32_t)(65535.0 * (c.y() - extent.yMin()) / h));
+        }
+        std::stable_sort(items.begin(), items.end(), [](const Item& l, const Item& r) { return l.hilbert < r.hilbert; });
+    }
+
+    // encode the features
+    std::vector<std::vector<std::uint8_t>> encoded;
+    std::vector<std::uint64_t> offsets;
+    std::uint64_t offset = 0u;
+
+    for (auto& item : items)
+    {
+        const Feature* f = item.feature;
+
+        std::vector<std::uint8_t> props;
+        for (auto& attr : f->getAttrs())
+        {
+            auto c = columnIndex.find(attr.first);
+            if (c == columnIndex.end() || !attr.second.second.set)
+                continue;
+
+            std::uint16_t index = c->second;
+            std::size_t pos = props.size();
+            props.resize(pos + 2);
+            ::memcpy(&props[pos], &index, 2);
+
+            auto append = [&props](const void* data, std::size_t len) {
+                const std::uint8_t* p = (const std::uint8_t*)data;
+                props.insert(props.end(), p, p + len);
+            };
+
+            switch (columns[index].type)
+            {
+            case CT_STRING:
+            {
+                std::string s = attr.second.getString();
+                std::uint32_t len = (std::uint32_t)s.size();
+                append(&len, 4);
+                append(s.data(), s.size());
+                break;
+            }
+            case CT_LONG:
+            {
+                std::int64_t v = attr.second.getInt();
+                append(&v, 8);
+                break;
+            }
+            case CT_DOUBLE:
+            {
+                double v = attr.second.getDouble();
+                append(&v, 8);
+                break;
+            }
+            case CT_BOOL:
+            {
+                std::uint8_t v = attr.second.getBool() ? 1u : 0u;
+                append(&v, 1);
+                break;
+            }
+            }
+        }
+
+        TableDef def;
+        def.child(FeatureField::GEOMETRY, tableWriter(encodeGeometry(f->getGeometry(), hasZ)));
+        if (!props.empty())
+            def.child(FeatureField::PROPERTIES, vectorWriter(props));
+
+        encoded.push_back(finish(def));
+        offsets.push_back(offset);
+        offset += 4u + encoded.back().size();
+    }
+
+    // build the packed R-tree, root first
+    std::vector<NodeItem> nodes;
+    if (!items.empty())
+    {
+        auto levels = levelBounds(items.size(), nodeSize);
+        nodes.resize(levels.front().second);
+
+        for (std::size_t i = 0; i < items.size(); ++i)
+        {
+            NodeItem& n = nodes[levels.front().first + i];
+            n.minX = items[i].bounds.xMin();
+            n.minY = items[i].bounds.yMin();
+            n.maxX = items[i].bounds.xMax();
+            n.maxY = items[i].bounds.yMax();
+            n.offset = offsets[i];
+        }
+
+        for (std::size_t level = 0; level + 1 < levels.size(); ++level)
+        {
+            for (std::uint64_t child = levels[level].first; child < levels[level].second; child += nodeSize)
+            {
+                NodeItem& parent = nodes[levels[level + 1].first + (child - levels[level].first) / nodeSize];
+                parent.minX = parent.minY = DBL_MAX;
+                parent.maxX = parent.maxY = -DBL_MAX;
+                parent.offset = child;
+
+                std::uint64_t end = std::min(child + nodeSize, levels[level].second);
+                for (std::uint64_t i = child; i < end; ++i)
+                {
+                    parent.minX = std::min(parent.minX, nodes[i].minX);
+                    parent.minY = std::min(parent.minY, nodes[i].minY);
+                    parent.maxX = std::max(parent.maxX, nodes[i].maxX);
+                    parent.maxY = std::max(parent.maxY, nodes[i].maxY);
+                }
+            }
+        }
+    }
+
+    // header
+    TableDef header;
+    header.scalar<std::uint8_t>(HeaderField::GEOMETRY_TYPE, geometryType);
+    header.scalar<std::uint8_t>(HeaderField::HAS_Z, hasZ ? 1u : 0u);
+    header.scalar<std::uint64_t>(HeaderField::FEATURES_COUNT, items.size());
+    header.scalar<std::uint16_t>(HeaderField::INDEX_NODE_SIZE, items.empty() ? 0u : nodeSize);
+
+    if (!items.empty())
+    {
+        std::vector<double> envelope = { extent.xMin(), extent.yMin(), extent.xMax(), extent.yMax() };
+        header.child(HeaderField::ENVELOPE, vectorWriter(envelope));
+    }
+
+    std::vector<TableDef> columnDefs;
+    for (auto& column : columns)
+    {
+        TableDef c;
+        c.child(ColumnField::NAME, stringWriter(column.name));
+        c.scalar<std::uint8_t>(ColumnField::TYPE, column.type);
+        columnDefs.push_back(c);
+    }
+    if (!columnDefs.empty())
+        header.child(HeaderField::COLUMNS, tablesWriter(columnDefs));
+
+    if (srs)
+    {
+        TableDef crs;
+        crs.child(CrsField::WKT, stringWriter(srs->getWKT()));
+        header.child(HeaderField::CRS, tableWriter(crs));
+    }
+
+    std::vector<std::uint8_t> headerBuf = finish(header);
+
+    // write it all out
+    std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary);
+    if (!out.is_open())
+        return Status(Status::ResourceUnavailable, Stringify() << "Failed to create \"" << filename << "\"");
+
+    std::uint32_t headerSize = (std::uint32_t)headerBuf.size();
+    out.write((const char*)MAGIC, 8);
+    out.write((const char*)&headerSize, 4);
+    out.write((const char*)headerBuf.data(), headerBuf.size());
+    if (!nodes.empty())
+        out.write((const char*)nodes.data(), nodes.size() * sizeof(NodeItem));
+    for (auto& buf : encoded)
+    {
+        std::uint32_t len = (std::uint32_t)buf.size();
+        out.write((const char*)&len, 4);
+        out.write((const char*)buf.data(), buf.size());
+    }
+
+    if (!out.good())
+        return Status(Status::GeneralError, Stringify() << "Failed to write \"" << filename << "\"");
+
+    return Status::NoError;
+}
@@ -0,0 +1,863 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/GeoJSONReader>
+#include <osgEarth/Geometry>
+#include <osgEarth/StringUtils>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#define LC "[GeoJSONReader] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    // Exact powers of ten for the fast number path
+    const double s_pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    // Span of raw JSON text inside the buffer
+    struct Span
+    {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+        bool valid() const { return begin != nullptr; }
+    };
+
+    // Single-pass recursive descent parser over the input buffer.
+    // All state is local to one read() call.
+    struct Parser
+    {
+        const char* p;
+        const char* end;
+        bool ok;
+        bool rewind;
+        const FeatureProfile* profile;
+        const SpatialReference* srs;
+        FeatureList& output;
+        FeatureID nextFID;
+        std::string key;    // scratch, reused across members
+        std::string value;  // scratch, reused across members
+
+        Parser(const char* data, std::size_t size, bool rewindPolygons, const FeatureProfile* prof, FeatureList& out) :
+            p(data),
+            end(data + size),
+            ok(true),
+            rewind(rewindPolygons),
+            profile(prof),
+            srs(prof ? prof->getSRS() : nullptr),
+            output(out),
+            nextFID(0)
+        {
+            // skip a UTF-8 byte order mark
+            if (size >= 3 && (unsigned char)p[0] == 0xEF && (unsigned char)p[1] == 0xBB && (unsigned char)p[2] == 0xBF)
+                p += 3;
+        }
+
+        bool fail()
+        {
+            ok = false;
+            p = end;
+            return false;
+        }
+
+        void ws()
+        {
+            while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+                ++p;
+        }
+
+        bool peek(char c)
+        {
+            ws();
+            return p < end && *p == c;
+        }
+
+        bool expect(char c)
+        {
+            ws();
+            if (p < end && *p == c)
+            {
+                ++p;
+                return true;
+            }
+            return fail();
+        }
+
+        //! After an element: true if another follows, false at the closing bracket
+        bool nextElement(char close)
+        {
+            ws();
+            if (p < end && *p == ',')
+            {
+                ++p;
+                return true;
+            }
+            if (p < end && *p == close)
+            {
+                ++p;
+                return false;
+            }
+            return fail();
+        }
+
+        //! Opens an object or array; returns false if it's empty (and consumes it)
+        bool open(char openc, char close)
+        {
+            if (!expect(openc))
+                return false;
+            if (peek(close))
+            {
+                ++p;
+                return false;
+            }
+            return true;
+        }
+
+        bool literal(const char* lit, std::size_t len)
+        {
+            if (std::size_t(end - p) >= len && ::strncmp(p, lit, len) == 0)
+            {
+                p += len;
+                return true;
+            }
+            return fail();
+        }
+
+        static void appendUTF8(std::string& out, unsigned cp)
+        {
+            if (cp < 0x80)
+            {
+                out.push_back((char)cp);
+            }
+            else if (cp < 0x800)
+            {
+                out.push_back((char)(0xC0 | (cp >> 6)));
+                out.push_back((char)(0x80 | (cp & 0x3F)));
+            }
+            else if (cp < 0x10000)
+            {
+                out.push_back((char)(0xE0 | (cp >> 12)));
+                out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+                out.push_back((char)(0x80 | (cp & 0x3F)));
+            }
+            else
+            {
+                out.push_back((char)(0xF0 | (cp >> 18)));
+                out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+                out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+                out.push_back((char)(0x80 | (cp & 0x3F)));
+            }
+        }
+
+        bool hex4(unsigned& cp)
+        {
+            if (end - p < 4)
+                return fail();
+            cp = 0u;
+            for (int i = 0; i < 4; ++i)
+            {
+                char c = *p++;
+                cp <<= 4;
+                if (c >= '0' && c <= '9') cp |= unsigned(c - '0');
+                else if (c >= 'a' && c <= 'f') cp |= unsigned(c - 'a' + 10);
+                else if (c >= 'A' && c <= 'F') cp |= unsigned(c - 'A' + 10);
+                else return fail();
+            }
+            return true;
+        }
+
+        bool parseString(std::string& out)
+        {
+            out.clear();
+            if (!expect('"'))
+                return false;
+
+            while (p < end)
+            {
+                // copy runs of unescaped characters in one go
+                const char* run = p;
+                while (p < end && *p != '"' && *p != '\\')
+                    ++p;
+                out.append(run, p - run);
+
+                if (p >= end)
+                    break;
+
+                if (*p == '"')
+                {
+                    ++p;
+                    return true;
+                }
+
+                // escape sequence
+                if (++p >= end)
+                    break;
+
+                char c = *p++;
+                switch (c)
+                {
+                case '"': out.push_back('"'); break;
+                case '\\': out.push_back('\\'); break;
+                case '/': out.push_back('/'); break;
+                case 'b': out.push_back('\b'); break;
+                case 'f': out.push_back('\f'); break;
+                case 'n': out.push_back('\n'); break;
+                case 'r': out.push_back('\r'); break;
+                case 't': out.push_back('\t'); break;
+                case 'u':
+                {
+                    unsigned cp;
+                    if (!hex4(cp))
+                        return false;
+                    if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                    {
+                        p += 2;
+                        unsigned lo;
+                        if (!hex4(lo))
+                            return false;
+                        if (lo >= 0xDC00 && lo <= 0xDFFF)
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    }
+                    appendUTF8(out, cp);
+                    break;
+                }
+                default:
+                    return fail();
+                }
+            }
+            return fail();
+        }
+
+        bool skipString()
+        {
+            if (!expect('"'))
+                return false;
+            while (p < end)
+            {
+                if (*p == '\\')
+                    p += 2;
+                else if (*p++ == '"')
+                    return true;
+            }
+            return fail();
+        }
+
+        //! Parses a number. isInt is true if it had no fraction or exponent
+        //! and fits in a long long.
+        bool parseNumber(double& d, long long& i, bool& isInt)
+        {
+            ws();
+            const char* start = p;
+            bool neg = false;
+            if (p < end && *p == '-')
+            {
+                neg = true;
+                ++p;
+            }
+
+            std::uint64_t mantissa = 0u;
+            int digits = 0;
+            int scale = 0;
+            const char* intStart = p;
+
+            while (p < end && *p >= '0' && *p <= '9')
+            {
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10u + std::uint64_t(*p - '0');
+                    if (mantissa != 0u) ++digits;
+                }
+                else
+                {
+                    ++scale;
+                }
+                ++p;
+            }
+
+            if (p == intStart)
+                return fail();
+
+            isInt = true;
+
+            if (p < end && *p == '.')
+            {
+                isInt = false;
+                ++p;
+                const char* fracStart = p;
+                while (p < end && *p >= '0' && *p <= '9')
+                {
+                    if (digits < 19)
+                    {
+                        mantissa = mantissa * 10u + std::uint64_t(*p - '0');
+                        if (mantissa != 0u) ++digits;
+                        --scale;
+                    }
+                    ++p;
+                }
+                if (p == fracStart)
+                    return fail();
+            }
+
+            if (p < end && (*p == 'e' || *p == 'E'))
+            {
+                isInt = false;
+                ++p;
+                bool expNeg = false;
+                if (p < end && (*p == '+' || *p == '-'))
+                    expNeg = (*p++ == '-');
+                const char* expStart = p;
+                int exp = 0;
+                while (p < end && *p >= '0' && *p <= '9')
+                {
+                    if (exp < 10000)
+                        exp = exp * 10 + (*p - '0');
+                    ++p;
+                }
+                if (p == expStart)
+                    return fail();
+                scale += expNeg ? -exp : exp;
+            }
+
+            if (isInt && scale == 0 && mantissa <= std::uint64_t(INT64_MAX))
+            {
+                i = neg ? -(long long)mantissa : (long long)mantissa;
+                d = (double)i;
+                return true;
+            }
+
+            isInt = false;
+
+            // Exact when both the mantissa and the power of ten are representable.
+            if (digits <= 15 && scale >= -22 && scale <= 22)
+            {
+                d = (double)mantissa;
+                d = scale < 0 ? d / s_pow10[-scale] : d * s_pow10[scale];
+                if (neg) d = -d;
+            }
+            else
+            {
+                std::string text(start, p - start);
+                d = ::strtod(text.c_str(), nullptr);
+            }
+            i = (long long)d;
+            return true;
+        }
+
+        bool parseDouble(double& d)
+        {
+            long long i;
+            bool isInt;
+            return parseNumber(d, i, isInt);
+        }
+
+        bool skipValue()
+        {
+            ws();
+            if (p >= end)
+                return fail();
+
+            switch (*p)
+            {
+            case '"':
+                return skipString();
+            case '{':
+                if (open('{', '}'))
+                {
+                    do {
+                        if (!skipString() || !expect(':') || !skipValue())
+                            return false;
+                    } while (nextElement('}'));
+                }
+                return ok;
+            case '[':
+                if (open('[', ']'))
+                {
+                    do {
+                        if (!skipValue())
+                            return false;
+                    } while (nextElement(']'));
+                }
+                return ok;
+            case 't':
+                return literal("true", 4);
+            case 'f':
+                return literal("false", 5);
+            case 'n':
+                return literal("null", 4);
+            default:
+            {
+                double d;
+                return parseDouble(d);
+            }
+            }
+        }
+
+        bool capture(Span& span)
+        {
+            ws();
+            span.begin = p;
+            bool result = skipValue();
+            span.end = p;
+            return result;
+        }
+
+        bool isNull()
+        {
+            if (peek('n'))
+                return literal("null", 4);
+            return false;
+        }
+
+        //! [x, y, z?, ...] appended to the target, dropping consecutive duplicates
+        bool parsePosition(Geometry* target)
+        {
+            osg::Vec3d v(0, 0, 0);
+            if (!open('[', ']'))
+                return ok;
+
+            int n = 0;
+            do {
+                double d;
+                if (!parseDouble(d))
+                    return false;
+                if (n < 3)
+                    v[n] = d;
+                ++n;
+            } while (nextElement(']'));
+
+            if (!ok || n < 2)
+                return fail();
+
+            if (target->empty() || target->back() != v)
+                target->push_back(v);
+            return true;
+        }
+
+        bool parsePositions(Geometry* target)
+        {
+            if (isNull())
+                return true;
+            if (open('[', ']'))
+            {
+                do {
+                    if (!parsePosition(target))
+                        return false;
+                } while (nextElement(']'));
+            }
+            return ok;
+        }
+
+        Polygon* parsePolygon()
+        {
+            if (isNull())
+                return nullptr;
+
+            osg::ref_ptr<Polygon> polygon;
+            if (open('[', ']'))
+            {
+                do {
+                    if (!polygon.valid())
+                    {
+                        polygon = new Polygon();
+                        if (!parsePositions(polygon.get()))
+                            return nullptr;
+                        if (rewind)
+                        {
+                            polygon->open();
+                            polygon->rewind(Ring::ORIENTATION_CCW);
+                        }
+                    }
+                    else
+                    {
+                        osg::ref_ptr<Ring> hole = new Ring();
+                        if (!parsePositions(hole.get()))
+                            return nullptr;
+                        if (rewind)
+                        {
+                            hole->open();
+                            hole->rewind(Ring::ORIENTATION_CW);
+                        }
+                        polygon->getHoles().push_back(hole.get());
+                    }
+                } while (nextElement(']'));
+            }
+            return ok ? polygon.release() : nullptr;
+        }
+
+        //! Builds a geometry from "coordinates" once the type is known
+        Geometry* parseCoordinates(const std::string& type, const Span& span)
+        {
+            const char* resume = p;
+            p = span.begin;
+
+            osg::ref_ptr<Geometry> result;
+
+            if (type == "Point")
+            {
+                result = new osgEarth::Point();
+                if (!isNull())
+                    parsePosition(result.get());
+            }
+            else if (type == "MultiPoint")
+            {
+                result = new PointSet();
+                if (!isNull() && open('[', ']'))
+                {
+                    do {
+                        if (!parsePosition(result.get()))
+                            break;
+                    } while (nextElement(']'));
+                }
+            }
+            else if (type == "LineString")
+            {
+                result = new LineString();
+                parsePositions(result.get());
+            }
+            else if (type == "MultiLineString")
+            {
+                osg::ref_ptr<MultiGeometry> multi = new MultiGeometry();
+                if (!isNull() && open('[', ']'))
+                {
+                    do {
+                        osg::ref_ptr<LineString> line = new LineString();
+                        if (!parsePositions(line.get()))
+                            break;
+                        multi->add(line.get());
+                    } while (nextElement(']'));
+                }
+                result = multi.get();
+            }
+            else if (type == "Polygon")
+            {
+                result = parsePolygon();
+            }
+            else if (type == "MultiPolygon")
+            {
+                osg::ref_ptr<MultiGeometry> multi = new MultiGeometry();
+                if (!isNull() && open('[', ']'))
+                {
+                    do {
+                        osg::ref_ptr<Polygon> polygon = parsePolygon();
+                        if (!ok)
+                            break;
+                        if (polygon.valid())
+                            multi->add(polygon.get());
+                    } while (nextElement(']'));
+                }
+                result = multi.get();
+            }
+            else
+            {
+                OE_DEBUG << LC << "Unsupported geometry type \"" << type << "\"" << std::endl;
+            }
+
+            p = ok ? resume : end;
+            return ok ? result.release() : nullptr;
+        }
+
+        Geometry* parseGeometry()
+        {
+            if (isNull() || !ok)
+                return nullptr;
+
+            std::string type;
+            Span coordinates;
+            osg::ref_ptr<MultiGeometry> collection;
+
+            if (open('{', '}'))
+            {
+                do {
+                    if (!parseString(key) || !expect(':'))
+                        return nullptr;
+
+                    if (key == "type")
+                    {
+                        if (!parseString(type))
+                            return nullptr;
+                    }
+                    else if (key == "coordinates")
+                    {
+                        if (!capture(coordinates))
+                            return nullptr;
+                    }
+                    else if (key == "geometries")
+                    {
+                        collection = new MultiGeometry();
+                        if (!isNull() && open('[', ']'))
+                        {
+                            do {
+                                osg::ref_ptr<Geometry> part = parseGeometry();
+                                if (!ok)
+                                    return nullptr;
+                                if (part.valid())
+                                    collection->add(part.get());
+                            } while (nextElement(']'));
+                        }
+                    }
+                    else if (!skipValue())
+                    {
+                        return nullptr;
+                    }
+                } while (nextElement('}'));
+            }
+
+            if (!ok)
+                return nullptr;
+
+            if (type == "GeometryCollection")
+                return collection.release();
+
+            if (coordinates.valid())
+                return parseCoordinates(type, coordinates);
+
+            return nullptr;
+        }
+
+        void parseProperties(Feature* feature)
+        {
+            if (isNull() || !open('{', '}'))
+                return;
+
+            do {
+                if (!parseString(key) || !expect(':'))
+                    return;
+
+                std::string name = toLower(key);
+
+                ws();
+                if (p >= end)
+                {
+                    fail();
+                    return;
+                }
+
+                char c = *p;
+                if (c == '"')
+                {
+                    if (!parseString(value))
+                        return;
+                    feature->set(name, value);
+                }
+                else if (c == 't' || c == 'f')
+                {
+                    // OGR reports booleans as integer fields
+                    bool b = (c == 't');
+                    if (!literal(b ? "true" : "false", b ? 4 : 5))
+                        return;
+                    feature->set(name, (long long)(b ? 1 : 0));
+                }
+                else if (c == 'n')
+                {
+                    if (!literal("null", 4))
+                        return;
+                    feature->setNull(name);
+                }
+                else if (c == '{' || c == '[')
+                {
+                    // nested values are kept as JSON text, as OGR does
+                    Span span;
+                    if (!capture(span))
+                        return;
+                    feature->set(name, std::string(span.begin, span.end - span.begin));
+                }
+                else
+                {
+                    double d;
+                    long long i;
+                    bool isInt;
+                    if (!parseNumber(d, i, isInt))
+                        return;
+                    if (isInt)
+                        feature->set(name, i);
+                    else
+                        feature->set(name, d);
+                }
+            } while (nextElement('}'));
+        }
+
+        void parseFeature()
+        {
+            osg::ref_ptr<Feature> feature = new Feature(nullptr, srs, Style(), nextFID);
+            bool hasFID = false;
+            std::string stringID;
+
+            if (open('{', '}'))
+            {
+                do {
+                    if (!parseString(key) || !expect(':'))
+                        return;
+
+                    if (key == "geometry")
+                    {
+                        osg::ref_ptr<Geometry> geom = parseGeometry();
+                        if (geom.valid())
+                            feature->setGeometry(geom.get());
+                    }
+                    else if (key == "properties")
+                    {
+                        parseProperties(feature.get());
+                    }
+                    else if (key == "id")
+                    {
+                        if (peek('"'))
+                        {
+                            parseString(stringID);
+                        }
+                        else if (!isNull())
+                        {
+                            double d;
+                            long long i;
+                            bool isInt;
+                            if (parseNumber(d, i, isInt) && isInt)
+                            {
+                                feature->setFID(i);
+                                hasFID = true;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        skipValue();
+                    }
+                } while (ok && nextElement('}'));
+            }
+
+            if (!ok)
+                return;
+
+            if (!stringID.empty() && !feature->hasAttr("id"))
+                feature->set("id", stringID);
+
+            if (!hasFID)
+                ++nextFID;
+
+            if (profile && profile->geoInterp().isSet())
+                feature->geoInterp() = profile->geoInterp().get();
+
+            output.push_back(feature.get());
+        }
+
+        void parseFeatures()
+        {
+            if (isNull() || !open('[', ']'))
+                return;
+
+            do {
+                parseFeature();
+            } while (ok && nextElement(']'));
+        }
+
+        bool parseRoot()
+        {
+            const char* rootBegin = p;
+            std::string type;
+            bool sawFeatures = false;
+
+            if (!open('{', '}'))
+                return false;
+
+            do {
+                if (!parseString(key) || !expect(':'))
+                    return false;
+
+                if (key == "type")
+                {
+                    parseString(type);
+                }
+                else if (key == "features")
+                {
+                    // Only a FeatureCollection has this member, so read it in place.
+                    parseFeatures();
+                    sawFeatures = true;
+                }
+                else
+                {
+                    skipValue();
+                }
+            } while (ok && nextElement('}'));
+
+            if (!ok)
+                return false;
+
+            if (type == "FeatureCollection")
+                return true;
+
+            // Single feature or bare geometry: re-read the root object as such.
+            const char* resume = p;
+            p = rootBegin;
+
+            if (type == "Feature")
+            {
+                parseFeature();
+            }
+            else if (!type.empty() && !sawFeatures)
+            {
+                osg::ref_ptr<Geometry> geom = parseGeometry();
+                if (!ok || !geom.valid())
+                    return false;
+
+                osg::ref_ptr<Feature> feature = new Feature(geom.get(), srs, Style(), nextFID++);
+                if (profile && profile->geoInterp().isSet())
+                    feature->geoInterp() = profile->geoInterp().get();
+                output.push_back(feature.get());
+            }
+            else
+            {
+                // not GeoJSON (e.g. ESRI JSON or TopoJSON)
+                return false;
+            }
+
+            p = resume;
+            return ok;
+        }
+    };
+}
+
+GeoJSONReader::GeoJSONReader() :
+    _rewindPolygons(true)
+{
+    //nop
+}
+
+bool
+GeoJSONReader::read(const char* data, std::size_t size, const FeatureProfile* profile, FeatureList& output) const
+{
+    if (data == nullptr || size == 0)
+        return false;
+
+    std::size_t start = output.size();
+
+    Parser parser(data, size, _rewindPolygons, profile, output);
+    if (!parser.parseRoot())
+    {
+        // don't return a partial result
+        output.resize(start);
+        return false;
+    }
+    return true;
+}
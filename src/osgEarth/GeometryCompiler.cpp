@@ -37,6 +37,7 @@
 #include <osgEarth/ShaderUtils>
 #include <osgEarth/Utils>
 #include <osgEarth/Metrics>
+#include <osgEarth/Threading>
 
 #include <osg/MatrixTransform>
 #include <osg/Timer>
@@ -49,6 +50,7 @@
 #define LC "[GeometryCompiler] "
 
 using namespace osgEarth;
+using namespace osgEarth::Threading;
 
 //#define PROFILING 1
 
@@ -76,7 +78,9 @@ _optimize              ( false ),
 _optimizeVertexOrdering( true ),
 _validate              ( false ),
 _maxPolyTilingAngle    ( 45.0f ),
-_useOSGTessellator     ( false )
+_useOSGTessellator     ( false ),
+_parallelism           ( 1u ),
+_minFeaturesPerChunk   ( 256u )
 {
 
 }
@@ -96,7 +100,9 @@ _optimize              ( s_defaults.optimize().value() ),
 _optimizeVertexOrdering( s_defaults.optimizeVertexOrdering().value() ),
 _validate              ( s_defaults.validate().value() ),
 _maxPolyTilingAngle    ( s_defaults.maxPolygonTilingAngle().value() ),
-_useOSGTessellator     (s_defaults.useOSGTessellator().value())
+_useOSGTessellator     (s_defaults.useOSGTessellator().value()),
+_parallelism           ( s_defaults.parallelism().value() ),
+_minFeaturesPerChunk   ( s_defaults.minFeaturesPerChunk().value() )
 {
     fromConfig(conf.getConfig());
 }
@@ -118,6 +124,12 @@ GeometryCompilerOptions::fromConfig( const Config& conf )
     conf.get( "validate", _validate );
     conf.get( "max_polygon_tiling_angle", _maxPolyTilingAngle );
     conf.get( "use_osg_tessellator", _useOSGTessellator);
+    if (_useOSGTessellator == true)
+    {
+        OE_WARN << LC << "use_osg_tessellator is deprecated and will be removed" << std::endl;
+    }
+    conf.get( "parallelism", _parallelism );
+    conf.get( "min_features_per_chunk", _minFeaturesPerChunk );
 
     conf.get( "shader_policy", "disable",  _shaderPolicy, SHADERPOLICY_DISABLE );
     conf.get( "shader_policy", "inherit",  _shaderPolicy, SHADERPOLICY_INHERIT );
@@ -145,6 +157,8 @@ GeometryCompilerOptions::getConfig() const
     conf.set( "validate", _validate );
     conf.set( "max_polygon_tiling_angle", _maxPolyTilingAngle );
     conf.set( "use_osg_tessellator", _useOSGTessellator);
+    conf.set( "parallelism", _parallelism );
+    conf.set( "min_features_per_chunk", _minFeaturesPerChunk );
 
     conf.set( "shader_policy", "disable",  _shaderPolicy, SHADERPOLICY_DISABLE );
     conf.set( "shader_policy", "inherit",  _shaderPolicy, SHADERPOLICY_INHERIT );
@@ -224,6 +238,244 @@ GeometryCompiler::compile(FeatureCursor*        cursor,
     return compile(workingSet, style, context);
 }
 
+namespace
+{
+    // Symbols that drive the filter chains, resolved once for the
+    // entire feature set (including any defaults).
+    struct CompileSymbols
+    {
+        const PointSymbol*     point;
+        const LineSymbol*      line;
+        const PolygonSymbol*   polygon;
+        const ExtrusionSymbol* extrusion;
+        const AltitudeSymbol*  altitude;
+        const TextSymbol*      text;
+        const IconSymbol*      icon;
+        const ModelSymbol*     model;
+        const RenderSymbol*    render;
+    };
+
+    // Runs the filter chains over one set of features and returns
+    // a group holding the results. This is the unit of work that
+    // may run concurrently on separate chunks of a feature list.
+    osg::Group* runFilterChains(
+        FeatureList&                   workingSet,
+        const Style&                   style,
+        const CompileSymbols&          sym,
+        const GeometryCompilerOptions& options,
+        FilterContext&                 sharedCX,
+        std::vector<std::string>*      history,
+        osg::ref_ptr<osg::Group>&      extrusionGroup)
+    {
+        osg::ref_ptr<osg::Group> resultGroup = new osg::Group();
+
+        // Perform tessellation first.
+        if ( sym.line )
+        {
+            if ( sym.line->tessellation().isSet() )
+            {
+                TessellateOperator filter;
+                filter.setNumPartitions( *sym.line->tessellation() );
+                filter.setDefaultGeoInterp( options.geoInterp().get() );
+                sharedCX = filter.push( workingSet, sharedCX );
+                if ( history ) history->push_back( "tessellation" );
+            }
+            else if ( sym.line->tessellationSize().isSet() )
+            {
+                TessellateOperator filter;
+                filter.setMaxPartitionSize( *sym.line->tessellationSize() );
+                filter.setDefaultGeoInterp( options.geoInterp().get() );
+                sharedCX = filter.push( workingSet, sharedCX );
+                if ( history ) history->push_back( "tessellationSize" );
+            }
+        }
+
+        // resample the geometry if necessary:
+        if (options.resampleMode().isSet())
+        {
+            ResampleFilter resample;
+            resample.resampleMode() = *options.resampleMode();
+            if (options.resampleMaxLength().isSet())
+            {
+                resample.maxLength() = *options.resampleMaxLength();
+            }
+            sharedCX = resample.push( workingSet, sharedCX );
+            if ( history ) history->push_back( "resample" );
+        }
+
+        // check whether we need to do elevation clamping:
+        bool altRequired =
+            options.ignoreAltitudeSymbol() != true &&
+            sym.altitude && (
+                sym.altitude->clamping() != AltitudeSymbol::CLAMP_NONE ||
+                sym.altitude->verticalOffset().isSet() ||
+                sym.altitude->verticalScale().isSet() ||
+                sym.altitude->script().isSet() );
+
+        // instance substitution (replaces marker)
+        if ( sym.model )
+        {
+            const InstanceSymbol* instance = (const InstanceSymbol*)sym.model;
+
+            // use a separate filter context since we'll be munging the data
+            FilterContext localCX = sharedCX;
+
+            if ( history ) history->push_back( "model");
+
+            if ( instance->placement() == InstanceSymbol::PLACEMENT_RANDOM   ||
+                instance->placement() == InstanceSymbol::PLACEMENT_INTERVAL )
+            {
+                ScatterFilter scatter;
+                scatter.setDensity( *instance->density() );
+                scatter.setRandom( instance->placement() == InstanceSymbol::PLACEMENT_RANDOM );
+                scatter.setRandomSeed( *instance->randomSeed() );
+                localCX = scatter.push( workingSet, localCX );
+                if ( history ) history->push_back( "scatter" );
+            }
+            else if ( instance->placement() == InstanceSymbol::PLACEMENT_CENTROID )
+            {
+                CentroidFilter centroid;
+                localCX = centroid.push( workingSet, localCX );
+                if ( history ) history->push_back( "centroid" );
+            }
+
+            if ( altRequired )
+            {
+                AltitudeFilter clamp;
+                clamp.setPropertiesFromStyle( style );
+                localCX = clamp.push( workingSet, localCX );
+                if ( history ) history->push_back( "altitude" );
+            }
+
+            SubstituteModelFilter sub( style );
+
+            // activate clustering
+            sub.setClustering( *options.clustering() );
+
+            // activate draw-instancing
+            sub.setUseDrawInstanced( *options.instancing() );
+
+            sub.setFilterUsage(*options.filterUsage());
+
+            // activate feature naming
+            if ( options.featureName().isSet() )
+                sub.setFeatureNameExpr( *options.featureName() );
+
+
+            osg::Node* node = sub.push( workingSet, localCX );
+            if ( node )
+            {
+                if ( history ) history->push_back( "substitute" );
+
+                resultGroup->addChild( node );
+            }
+        }
+
+        // extruded geometry
+        if ( sym.extrusion )
+        {
+            if ( altRequired )
+            {
+                AltitudeFilter clamp;
+                clamp.setPropertiesFromStyle( style );
+                sharedCX = clamp.push( workingSet, sharedCX );
+                if ( history ) history->push_back( "altitude" );
+                altRequired = false;
+            }
+
+            ExtrudeGeometryFilter extrude;
+            extrude.setStyle( style );
+
+            // apply per-feature naming if requested.
+            if ( options.featureName().isSet() )
+                extrude.setFeatureNameExpr( *options.featureName() );
+
+            if ( options.mergeGeometry().isSet() )
+                extrude.setMergeGeometry( *options.mergeGeometry() );
+
+            if ( options.filterUsage().isSet() )
+                extrude.setFilterUsage(*options.filterUsage());
+
+            osg::Node* node = extrude.push( workingSet, sharedCX );
+            if ( node )
+            {
+                if ( history ) history->push_back( "extrude" );
+                resultGroup->addChild( node );
+
+                extrusionGroup = dynamic_cast<osg::Group*>(node);
+                ASSERT_PREDICATE(extrusionGroup.get());
+            }
+        }
+
+        // simple geometry
+        else if ( sym.point || sym.line || sym.polygon )
+        {
+            if ( altRequired )
+            {
+                AltitudeFilter clamp;
+                clamp.setPropertiesFromStyle( style );
+                sharedCX = clamp.push( workingSet, sharedCX );
+                if ( history ) history->push_back( "altitude" );
+                altRequired = false;
+            }
+
+            BuildGeometryFilter filter( style );
+
+            filter.maxGranularity() = *options.maxGranularity();
+            filter.geoInterp()      = *options.geoInterp();
+            filter.useOSGTessellator() = *options.useOSGTessellator();
+
+            if (options.maxPolygonTilingAngle().isSet())
+                filter.maxPolygonTilingAngle() = *options.maxPolygonTilingAngle();
+
+            if ( options.featureName().isSet() )
+                filter.featureName() = *options.featureName();
+
+            if (options.optimizeVertexOrdering().isSet())
+                filter.optimizeVertexOrdering() = *options.optimizeVertexOrdering();
+
+            if (sym.render && sym.render->maxCreaseAngle().isSet())
+                filter.maxCreaseAngle() = sym.render->maxCreaseAngle().get();
+
+            osg::Node* node = filter.push( workingSet, sharedCX );
+            if ( node )
+            {
+                if ( history ) history->push_back( "geometry" );
+                resultGroup->addChild( node );
+            }
+        }
+
+        if ( sym.text || sym.icon )
+        {
+            // Only clamp annotation types when the technique is
+            // explicity set to MAP. Otherwise, the annotation subsystem
+            // will automatically use SCENE clamping.
+            bool altRequiredForAnnotations =
+                altRequired &&
+                sym.altitude->technique().isSetTo(sym.altitude->TECHNIQUE_MAP);
+
+            if ( altRequiredForAnnotations )
+            {
+                AltitudeFilter clamp;
+                clamp.setPropertiesFromStyle( style );
+                sharedCX = clamp.push( workingSet, sharedCX );
+                if ( history ) history->push_back( "altitude" );
+                altRequired = false;
+            }
+
+            BuildTextFilter filter( style );
+            osg::Node* node = filter.push( workingSet, sharedCX );
+            if ( node )
+            {
+                if ( history ) history->push_back( "text" );
+                resultGroup->addChild( node );
+            }
+        }
+
+        return resultGroup.release();
+    }
+}
+
 osg::Node*
 GeometryCompiler::compile(FeatureList&          workingSet,
     const Style&          style,
@@ -242,7 +494,7 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     std::vector<std::string> history;
     bool trackHistory = (_options.validate() == true);
 
-    osg::ref_ptr<osg::Group> resultGroup = new osg::Group();
+    osg::ref_ptr<osg::Group> resultGroup;
 
     // create a filter context that will track feature data through the process
     FilterContext sharedCX = context;
@@ -258,40 +510,20 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     osg::ref_ptr<PolygonSymbol> defaultPolygon;
 
     // go through the Style and figure out which filters to use.
-    const PointSymbol*     point     = style.get<PointSymbol>();
-    const LineSymbol*      line      = style.get<LineSymbol>();
-    const PolygonSymbol*   polygon   = style.get<PolygonSymbol>();
-    const ExtrusionSymbol* extrusion = style.get<ExtrusionSymbol>();
-    const AltitudeSymbol*  altitude  = style.get<AltitudeSymbol>();
-    const TextSymbol*      text      = style.get<TextSymbol>();
-    const IconSymbol*      icon      = style.get<IconSymbol>();
-    const ModelSymbol*     model     = style.get<ModelSymbol>();
-    const RenderSymbol*    render    = style.get<RenderSymbol>();
-
-    // Perform tessellation first.
-    if ( line )
-    {
-        if ( line->tessellation().isSet() )
-        {
-            TessellateOperator filter;
-            filter.setNumPartitions( *line->tessellation() );
-            filter.setDefaultGeoInterp( _options.geoInterp().get() );
-            sharedCX = filter.push( workingSet, sharedCX );
-            if ( trackHistory ) history.push_back( "tessellation" );
-        }
-        else if ( line->tessellationSize().isSet() )
-        {
-            TessellateOperator filter;
-            filter.setMaxPartitionSize( *line->tessellationSize() );
-            filter.setDefaultGeoInterp( _options.geoInterp().get() );
-            sharedCX = filter.push( workingSet, sharedCX );
-            if ( trackHistory ) history.push_back( "tessellationSize" );
-        }
-    }
+    CompileSymbols sym;
+    sym.point     = style.get<PointSymbol>();
+    sym.line      = style.get<LineSymbol>();
+    sym.polygon   = style.get<PolygonSymbol>();
+    sym.extrusion = style.get<ExtrusionSymbol>();
+    sym.altitude  = style.get<AltitudeSymbol>();
+    sym.text      = style.get<TextSymbol>();
+    sym.icon      = style.get<IconSymbol>();
+    sym.model     = style.get<ModelSymbol>();
+    sym.render    = style.get<RenderSymbol>();
 
     // if the style was empty, use some defaults based on the geometry type of the
     // first feature.
-    if ( !point && !line && !polygon && !extrusion && !text && !model && !icon && workingSet.size() > 0 )
+    if ( !sym.point && !sym.line && !sym.polygon && !sym.extrusion && !sym.text && !sym.model && !sym.icon && workingSet.size() > 0 )
     {
         Feature* first = workingSet.begin()->get();
         Geometry* geom = first->getGeometry();
@@ -302,16 +534,16 @@ GeometryCompiler::compile(FeatureList&          workingSet,
             case Geometry::TYPE_LINESTRING:
             case Geometry::TYPE_RING:
                 defaultLine = new LineSymbol();
-                line = defaultLine.get();
+                sym.line = defaultLine.get();
                 break;
             case Geometry::TYPE_POINT:
             case Geometry::TYPE_POINTSET:
                 defaultPoint = new PointSymbol();
-                point = defaultPoint.get();
+                sym.point = defaultPoint.get();
                 break;
             case Geometry::TYPE_POLYGON:
                 defaultPolygon = new PolygonSymbol();
-                polygon = defaultPolygon.get();
+                sym.polygon = defaultPolygon.get();
                 break;
             case Geometry::TYPE_MULTI:
             case Geometry::TYPE_UNKNOWN:
@@ -320,186 +552,93 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         }
     }
 
-    // resample the geometry if necessary:
-    if (_options.resampleMode().isSet())
+    // Decide how many chunks to use. Some operations depend on seeing the
+    // entire feature set at once (seeded scattering, clustering, and the
+    // zero-work extrusion callback), so those always run serially.
+    unsigned numChunks = 1u;
+    if (_options.parallelism().isSet() && _options.parallelism().get() > 1u)
     {
-        ResampleFilter resample;
-        resample.resampleMode() = *_options.resampleMode();
-        if (_options.resampleMaxLength().isSet())
+        const InstanceSymbol* instance = (const InstanceSymbol*)sym.model;
+        bool chunkable =
+            _options.clustering() != true &&
+            _options.filterUsage() != FILTER_USAGE_ZERO_WORK_CALLBACK_BASED &&
+            !(instance && (
+                instance->placement() == InstanceSymbol::PLACEMENT_RANDOM ||
+                instance->placement() == InstanceSymbol::PLACEMENT_INTERVAL));
+
+        if (chunkable)
         {
-            resample.maxLength() = *_options.resampleMaxLength();
+            unsigned minPerChunk = std::max(_options.minFeaturesPerChunk().get(), 1u);
+            unsigned maxChunks = (unsigned)(workingSet.size() / minPerChunk);
+            numChunks = osg::clampBetween(maxChunks, 1u, _options.parallelism().get());
         }
-        sharedCX = resample.push( workingSet, sharedCX );
-        if ( trackHistory ) history.push_back( "resample" );
     }
 
-    // check whether we need to do elevation clamping:
-    bool altRequired =
-        _options.ignoreAltitudeSymbol() != true &&
-        altitude && (
-            altitude->clamping() != AltitudeSymbol::CLAMP_NONE ||
-            altitude->verticalOffset().isSet() ||
-            altitude->verticalScale().isSet() ||
-            altitude->script().isSet() );
-
-    // instance substitution (replaces marker)
-    if ( model )
+    if (numChunks <= 1u)
     {
-        const InstanceSymbol* instance = (const InstanceSymbol*)model;
-
-        // use a separate filter context since we'll be munging the data
-        FilterContext localCX = sharedCX;
-
-        if ( trackHistory ) history.push_back( "model");
-
-        if ( instance->placement() == InstanceSymbol::PLACEMENT_RANDOM   ||
-            instance->placement() == InstanceSymbol::PLACEMENT_INTERVAL )
-        {
-            ScatterFilter scatter;
-            scatter.setDensity( *instance->density() );
-            scatter.setRandom( instance->placement() == InstanceSymbol::PLACEMENT_RANDOM );
-            scatter.setRandomSeed( *instance->randomSeed() );
-            localCX = scatter.push( workingSet, localCX );
-            if ( trackHistory ) history.push_back( "scatter" );
-        }
-        else if ( instance->placement() == InstanceSymbol::PLACEMENT_CENTROID )
-        {
-            CentroidFilter centroid;
-            localCX = centroid.push( workingSet, localCX );
-            if ( trackHistory ) history.push_back( "centroid" );
-        }
-
-        if ( altRequired )
-        {
-            AltitudeFilter clamp;
-            clamp.setPropertiesFromStyle( style );
-            localCX = clamp.push( workingSet, localCX );
-            if ( trackHistory ) history.push_back( "altitude" );
-        }
-
-        SubstituteModelFilter sub( style );
-
-        // activate clustering
-        sub.setClustering( *_options.clustering() );
-
-        // activate draw-instancing
-        sub.setUseDrawInstanced( *_options.instancing() );
-
-        sub.setFilterUsage(*_options.filterUsage());
-
-        // activate feature naming
-        if ( _options.featureName().isSet() )
-            sub.setFeatureNameExpr( *_options.featureName() );
-
-
-        osg::Node* node = sub.push( workingSet, localCX );
-        if ( node )
-        {
-            if ( trackHistory ) history.push_back( "substitute" );
-
-            resultGroup->addChild( node );
-        }
+        resultGroup = runFilterChains(
+            workingSet, style, sym, _options, sharedCX,
+            trackHistory ? &history : nullptr,
+            extrusionGroup);
     }
-
-    // extruded geometry
-    if ( extrusion )
+    else
     {
-        if ( altRequired )
+        // Partition the working set into contiguous chunks. Boundaries depend
+        // only on the input size and the chunk count, so the output is
+        // deterministic regardless of thread scheduling.
+        std::vector<FeatureList> chunks(numChunks);
+        std::vector<FilterContext> chunkCX(numChunks, sharedCX);
+        std::vector<osg::ref_ptr<osg::Group>> chunkResults(numChunks);
+        std::vector<osg::ref_ptr<osg::Group>> chunkExtrusions(numChunks);
+
+        std::size_t total = workingSet.size();
+        std::size_t index = 0u;
+        for (auto& feature : workingSet)
         {
-            AltitudeFilter clamp;
-            clamp.setPropertiesFromStyle( style );
-            sharedCX = clamp.push( workingSet, sharedCX );
-            if ( trackHistory ) history.push_back( "altitude" );
-            altRequired = false;
+            std::size_t c = (index++ * numChunks) / total;
+            chunks[c].push_back(feature);
         }
 
-        ExtrudeGeometryFilter extrude;
-        extrude.setStyle( style );
-
-        // apply per-feature naming if requested.
-        if ( _options.featureName().isSet() )
-            extrude.setFeatureNameExpr( *_options.featureName() );
-
-        if ( _options.mergeGeometry().isSet() )
-            extrude.setMergeGeometry( *_options.mergeGeometry() );
-
-        if ( _options.filterUsage().isSet() )
-            extrude.setFilterUsage(*_options.filterUsage());
-
-        osg::Node* node = extrude.push( workingSet, sharedCX );
-        if ( node )
-        {
-            if ( trackHistory ) history.push_back( "extrude" );
-            resultGroup->addChild( node );
-
-            extrusionGroup = dynamic_cast<osg::Group*>(node);
-            ASSERT_PREDICATE(extrusionGroup.get());
-        }
-    }
+        JobArena* arena = JobArena::get("oe.geometrycompiler");
+        JobGroup group;
 
-    // simple geometry
-    else if ( point || line || polygon )
-    {
-        if ( altRequired )
+        // dispatch all but the first chunk, which runs on this thread:
+        for (unsigned c = 1; c < numChunks; ++c)
         {
-            AltitudeFilter clamp;
-            clamp.setPropertiesFromStyle( style );
-            sharedCX = clamp.push( workingSet, sharedCX );
-            if ( trackHistory ) history.push_back( "altitude" );
-            altRequired = false;
+            Job job(arena, &group);
+            job.setName("GeometryCompiler chunk");
+            job.dispatch([&, c](Cancelable*)
+                {
+                    chunkResults[c] = runFilterChains(
+                        chunks[c], style, sym, _options, chunkCX[c],
+                        nullptr,
+                        chunkExtrusions[c]);
+                }
+            );
         }
 
-        BuildGeometryFilter filter( style );
-
-        filter.maxGranularity() = *_options.maxGranularity();
-        filter.geoInterp()      = *_options.geoInterp();
-        filter.useOSGTessellator() = *_options.useOSGTessellator();
-
-        if (_options.maxPolygonTilingAngle().isSet())
-            filter.maxPolygonTilingAngle() = *_options.maxPolygonTilingAngle();
-
-        if ( _options.featureName().isSet() )
-            filter.featureName() = *_options.featureName();
-
-        if (_options.optimizeVertexOrdering().isSet())
-            filter.optimizeVertexOrdering() = *_options.optimizeVertexOrdering();
-
-        if (render && render->maxCreaseAngle().isSet())
-            filter.maxCreaseAngle() = render->maxCreaseAngle().get();
+        chunkResults[0] = runFilterChains(
+            chunks[0], style, sym, _options, chunkCX[0],
+            trackHistory ? &history : nullptr,
+            chunkExtrusions[0]);
 
-        osg::Node* node = filter.push( workingSet, sharedCX );
-        if ( node )
-        {
-            if ( trackHistory ) history.push_back( "geometry" );
-            resultGroup->addChild( node );
-        }
-    }
+        group.join();
 
-    if ( text || icon )
-    {
-        // Only clamp annotation types when the technique is
-        // explicity set to MAP. Otherwise, the annotation subsystem
-        // will automatically use SCENE clamping.
-        bool altRequiredForAnnotations =
-            altRequired &&
-            altitude->technique().isSetTo(altitude->TECHNIQUE_MAP);
-
-        if ( altRequiredForAnnotations )
+        // merge in chunk order, then rebuild the working set so callers
+        // see the same features they would after a serial compile.
+        resultGroup = new osg::Group();
+        workingSet.clear();
+        for (unsigned c = 0; c < numChunks; ++c)
         {
-            AltitudeFilter clamp;
-            clamp.setPropertiesFromStyle( style );
-            sharedCX = clamp.push( workingSet, sharedCX );
-            if ( trackHistory ) history.push_back( "altitude" );
-            altRequired = false;
+            if (chunkResults[c].valid())
+            {
+                for (unsigned i = 0; i < chunkResults[c]->getNumChildren(); ++i)
+                    resultGroup->addChild(chunkResults[c]->getChild(i));
+            }
+            workingSet.insert(workingSet.end(), chunks[c].begin(), chunks[c].end());
         }
 
-        BuildTextFilter filter( style );
-        osg::Node* node = filter.push( workingSet, sharedCX );
-        if ( node )
-        {
-            if ( trackHistory ) history.push_back( "text" );
-            resultGroup->addChild( node );
-        }
+        sharedCX = chunkCX[0];
     }
 
     if (Registry::capabilities().supportsGLSL())
@@ -606,7 +745,7 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         OE_NOTICE << LC << "-- End Debugging --\n";
     }
 
-    if(extrusion)
+    if(sym.extrusion)
     {
         if (*_options.filterUsage() == FILTER_USAGE_ZERO_WORK_CALLBACK_BASED && extrusionGroup.get())
         {
@@ -17,18 +17,21 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/ImageLayer>
-#include <osgEarth/ImageMosaic>
+#include <osgEarth/ImageUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/Progress>
 #include <osgEarth/Capabilities>
 #include <osgEarth/Metrics>
 #include <osgEarth/NetworkMonitor>
 #include <cinttypes>
+#include <cstring>
 
 using namespace osgEarth;
 
 #define LC "[ImageLayer] \"" << getName() << "\" "
 
+#define ARENA_ASSEMBLE_IMAGE "oe.layer.assemble"
+
 // TESTING
 //#undef  OE_DEBUG
 //#define OE_DEBUG OE_INFO
@@ -552,6 +555,68 @@ ImageLayer::createImageInKeyProfile(
     return result;
 }
 
+GeoImage
+ImageLayer::createSourceImage(
+    const TileKey& key,
+    ProgressCallback* progress)
+{
+    Promise<GeoImage> promise;
+    Future<GeoImage> inFlight;
+    bool owner = false;
+    {
+        ScopedMutexLock lock(_sourceRequests);
+        SourceRequests::iterator i = _sourceRequests.find(key);
+        if (i != _sourceRequests.end())
+        {
+            inFlight = i->second;
+        }
+        else
+        {
+            _sourceRequests[key] = promise.getFuture();
+            owner = true;
+        }
+    }
+
+    if (!owner)
+    {
+        GeoImage shared = inFlight.join(progress);
+
+        // the other request may have been canceled; if so, try it ourselves.
+        if (shared.valid() || (progress && progress->isCanceled()))
+            return shared;
+        return createImageInKeyProfile(key, progress);
+    }
+
+    GeoImage result = createImageInKeyProfile(key, progress);
+
+    // always resolve, so waiters never block on an abandoned request
+    promise.resolve(result);
+    {
+        ScopedMutexLock lock(_sourceRequests);
+        _sourceRequests.erase(key);
+    }
+
+    return result;
+}
+
+namespace
+{
+    // One source image and the part of the layer profile it covers
+    // (a fallback image covers only the failed key's extent).
+    struct AssemblySource
+    {
+        GeoImage image;
+        GeoExtent coverage;
+        osg::ref_ptr<const osg::Image> pixels;
+        ImageUtils::PixelReader reader;
+    };
+
+    // Set on threads fetching source tiles for an assembly, so nested
+    // assemblies (e.g. inside composite layers) fetch serially instead of
+    // waiting on their own arena.
+    PerThread<bool> s_assemblyFetchThreads;
+}
+
 GeoImage
 ImageLayer::assembleImage(
     const TileKey& key,
@@ -564,167 +629,258 @@ ImageLayer::assembleImage(
         return GeoImage::INVALID;
     }
 
-    GeoImage mosaicedImage, result;
+    // Get a set of layer tiles that intersect the requested extent.
+    std::vector<TileKey> intersectingKeys;
+    getProfile()->getIntersectingTiles( key, intersectingKeys );
 
-    // Scale the extent if necessary to apply an "edge buffer"
-    GeoExtent ext = key.getExtent();
-    if ( options().edgeBufferRatio().isSet() )
+    if (intersectingKeys.empty())
     {
-        double ratio = options().edgeBufferRatio().get();
-        ext.scale(ratio, ratio);
+        OE_DEBUG << LC << "assembleImage: no intersections (" << key.str() << ")" << std::endl;
+        return GeoImage::INVALID;
     }
 
-    // Get a set of layer tiles that intersect the requested extent.
-    std::vector<TileKey> intersectingKeys;
-    getProfile()->getIntersectingTiles( key, intersectingKeys );
+    // Fetch all the intersecting tiles at once. This thread takes the first one.
+    std::vector<GeoImage> images(intersectingKeys.size());
+    bool& nested = s_assemblyFetchThreads.get();
 
-    if ( intersectingKeys.size() > 0 )
+    if (intersectingKeys.size() == 1u || nested)
+    {
+        for (unsigned i = 0; i < intersectingKeys.size(); ++i)
+        {
+            images[i] = createSourceImage(intersectingKeys[i], progress);
+        }
+    }
+    else
     {
-        double dst_minx, dst_miny, dst_maxx, dst_maxy;
-        key.getExtent().getBounds(dst_minx, dst_miny, dst_maxx, dst_maxy);
+        JobArena* arena = JobArena::get(ARENA_ASSEMBLE_IMAGE);
+        JobGroup fetches;
+
+        for (unsigned i = 1; i < intersectingKeys.size(); ++i)
+        {
+            Job job(arena, &fetches);
+            job.dispatch([&, i](Cancelable*)
+            {
+                bool& flag = s_assemblyFetchThreads.get();
+                flag = true;
+                images[i] = createSourceImage(intersectingKeys[i], progress);
+                flag = false;
+            });
+        }
 
-        // if we find at least one "real" tile in the mosaic, then the whole result tile is
-        // "real" (i.e. not a fallback tile)
-        bool retry = false;
-        ImageMosaic mosaic;
+        nested = true;
+        images[0] = createSourceImage(intersectingKeys[0], progress);
+        nested = false;
 
-        // keep track of failed tiles.
-        std::vector<TileKey> failedKeys;
+        fetches.join();
+    }
 
-        for( std::vector<TileKey>::iterator k = intersectingKeys.begin(); k != intersectingKeys.end(); ++k )
+    // Fail if the operation was canceled mid-stream.
+    if (progress && progress->isCanceled())
+    {
+        return GeoImage::INVALID;
+    }
+
+    std::vector<AssemblySource> sources;
+    sources.reserve(intersectingKeys.size());
+
+    std::vector<unsigned> failed;
+    for (unsigned i = 0; i < intersectingKeys.size(); ++i)
+    {
+        if (images[i].valid())
         {
-            GeoImage image = createImageInKeyProfile(*k, progress);
+            sources.push_back(AssemblySource());
+            sources.back().image = images[i];
+            sources.back().coverage = intersectingKeys[i].getExtent();
+        }
+        else
+        {
+            failed.push_back(i);
+        }
+    }
 
-            if ( image.valid() )
+    // Fail if we got no data and the LOD is greater than zero.
+    if (sources.empty() && key.getLOD() > 0)
+    {
+        OE_DEBUG << LC << "Couldn't create image for assembly " << std::endl;
+        return GeoImage::INVALID;
+    }
+
+    // We got at least one good tile, OR we got nothing but since the LOD==0 we have to
+    // fall back on a lower resolution. So go through the failed keys and fall back on
+    // lower resolution data to fill in the gaps. Failed keys often share an ancestor,
+    // so remember the ones we've already read.
+    std::vector<std::pair<TileKey, GeoImage> > parents;
+
+    for (unsigned f = 0; f < failed.size(); ++f)
+    {
+        const TileKey& failedKey = intersectingKeys[failed[f]];
+        GeoImage image;
+
+        for(TileKey parentKey = failedKey.createParentKey();
+            parentKey.valid() && !image.valid();
+            parentKey = parentKey.createParentKey())
+        {
+            bool found = false;
+            for (unsigned p = 0; p < parents.size() && !found; ++p)
             {
-                if ( !isCoverage() )
+                if (parents[p].first == parentKey)
                 {
-#if 0
-                    // Make sure all images in mosaic are based on "RGBA - unsigned byte" pixels.
-                    // This is not the smarter choice (in some case RGB would be sufficient) but
-                    // it ensure consistency between all images / layers.
-                    //
-                    // The main drawback is probably the CPU memory foot-print which would be reduced by allocating RGB instead of RGBA images.
-                    // On GPU side, this should not change anything because of data alignements : often RGB and RGBA textures have the same memory footprint
-                    //
-                    if (   (image.getImage()->getDataType() != GL_UNSIGNED_BYTE)
-                        || (image.getImage()->getPixelFormat() != GL_RGBA) )
-                    {
-                        osg::ref_ptr<osg::Image> convertedImg = ImageUtils::convertToRGBA8(image.getImage());
-                        if (convertedImg.valid())
-                        {
-                            image = GeoImage(convertedImg.get(), image.getExtent());
-                        }
-                    }
-#endif
+                    image = parents[p].second;
+                    found = true;
                 }
-
-                mosaic.getImages().push_back( TileImage(image.getImage(), *k) );
             }
-            else
-            {
-                // the tile source did not return a tile, so make a note of it.
-                failedKeys.push_back( *k );
 
-                if (progress && progress->isCanceled())
-                {
-                    retry = true;
-                    break;
-                }
+            if (!found)
+            {
+                image = createImageImplementation( parentKey, progress );
+                parents.push_back(std::make_pair(parentKey, image));
             }
         }
 
-        // Fail is: a) we got no data and the LOD is greater than zero; or
-        // b) the operation was canceled mid-stream.
-        if ( (mosaic.getImages().empty() && key.getLOD() > 0) || retry)
+        if (image.valid())
         {
-            // if we didn't get any data at LOD>0, fail.
-            OE_DEBUG << LC << "Couldn't create image for ImageMosaic " << std::endl;
-            return GeoImage::INVALID;
+            // sample the parent directly within the failed key's extent
+            sources.push_back(AssemblySource());
+            sources.back().image = image;
+            sources.back().coverage = failedKey.getExtent();
         }
-
-        // We got at least one good tile, OR we got nothing but since the LOD==0 we have to
-        // fall back on a lower resolution.
-        // So now we go through the failed keys and try to fall back on lower resolution data
-        // to fill in the gaps. The entire mosaic must be populated or this qualifies as a bad tile.
-        for(std::vector<TileKey>::iterator k = failedKeys.begin(); k != failedKeys.end(); ++k)
+        else
         {
-            GeoImage image;
+            // a tile completely failed, even with fallback.
+            // let it go. The empty areas will be transparent.
+            OE_DEBUG << LC << "Couldn't fallback on tiles for assembly" << std::endl;
+        }
+    }
 
-            for(TileKey parentKey = k->createParentKey();
-                parentKey.valid() && !image.valid();
-                parentKey = parentKey.createParentKey())
-            {
-                image = createImageImplementation( parentKey, progress );
-                if ( image.valid() )
-                {
-                    GeoImage cropped;
-
-                    if ( !isCoverage() )
-                    {
-#if 0
-                        if (   (image.getImage()->getDataType() != GL_UNSIGNED_BYTE)
-                            || (image.getImage()->getPixelFormat() != GL_RGBA) )
-                        {
-                            osg::ref_ptr<osg::Image> convertedImg = ImageUtils::convertToRGBA8(image.getImage());
-                            if (convertedImg.valid())
-                            {
-                                image = GeoImage(convertedImg.get(), image.getExtent());
-                            }
-                        }
-#endif
-
-                        cropped = image.crop( k->getExtent(), false, image.getImage()->s(), image.getImage()->t() );
-                    }
-
-                    else
-                    {
-                        // TODO: may not work.... test; tilekey extent will <> cropped extent
-                        cropped = image.crop( k->getExtent(), true, image.getImage()->s(), image.getImage()->t(), false );
-                    }
-
-                    // and queue it.
-                    mosaic.getImages().push_back( TileImage(cropped.getImage(), *k) );
+    if (sources.empty())
+    {
+        return GeoImage::INVALID;
+    }
 
-                }
-            }
+    // Keep the source data format (float, RG16, etc.) when we can read and write it;
+    // otherwise (e.g. compressed data) decode the sources to RGBA8.
+    const osg::Image* reference = sources[0].image.getImage();
+    bool convert =
+        !ImageUtils::PixelReader::supports(reference) ||
+        !ImageUtils::PixelWriter::supports(reference);
 
-            if ( !image.valid() )
-            {
-                // a tile completely failed, even with fallback. Eject.
-                OE_DEBUG << LC << "Couldn't fallback on tiles for ImageMosaic" << std::endl;
-                // let it go. The empty areas will be filled with alpha by ImageMosaic.
-            }
+    for (unsigned i = 0; i < sources.size(); ++i)
+    {
+        AssemblySource& source = sources[i];
+        const osg::Image* image = source.image.getImage();
+
+        if (convert || !ImageUtils::PixelReader::supports(image))
+        {
+            source.pixels = ImageUtils::convertToRGBA8(image);
+        }
+        else
+        {
+            source.pixels = image;
         }
 
-        // all set. Mosaic all the images together.
-        double rxmin, rymin, rxmax, rymax;
-        mosaic.getExtents( rxmin, rymin, rxmax, rymax );
+        if (!source.pixels.valid())
+        {
+            sources.erase(sources.begin() + i);
+            --i;
+            continue;
+        }
 
-        mosaicedImage = GeoImage(
-            mosaic.createImage(),
-            GeoExtent( getProfile()->getSRS(), rxmin, rymin, rxmax, rymax ) );
+        source.reader.setImage(source.pixels.get());
+        source.reader.setBilinear(true);
     }
-    else
+
+    if (sources.empty())
     {
-        OE_DEBUG << LC << "assembleImage: no intersections (" << key.str() << ")" << std::endl;
+        return GeoImage::INVALID;
+    }
+
+    // Resample the output tile directly from the sources, sampling at output pixel centers.
+    const GeoExtent& extent = key.getExtent();
+    const SpatialReference* keySRS = key.getProfile()->getSRS();
+    const SpatialReference* layerSRS = getProfile()->getSRS();
+    const unsigned width = getTileSize(), height = getTileSize();
+    const unsigned numPixels = width*height;
+    const double dx = extent.width() / (double)width;
+    const double dy = extent.height() / (double)height;
+
+    std::vector<osg::Vec3d> points(numPixels);
+    for (unsigned r = 0; r < height; ++r)
+    {
+        double y = extent.yMin() + dy*((double)r + 0.5);
+        for (unsigned c = 0; c < width; ++c)
+        {
+            points[r*width + c].set(extent.xMin() + dx*((double)c + 0.5), y, 0.0);
+        }
+    }
+
+    std::vector<unsigned char> valid(numPixels, 1u);
+    if (!keySRS->isHorizEquivalentTo(layerSRS))
+    {
+        if (!keySRS->transform(points, layerSRS))
+        {
+            // at least one point failed; redo them one at a time to find out which.
+            for (unsigned r = 0; r < height; ++r)
+            {
+                double y = extent.yMin() + dy*((double)r + 0.5);
+                for (unsigned c = 0; c < width; ++c)
+                {
+                    unsigned i = r*width + c;
+                    osg::Vec3d in(extent.xMin() + dx*((double)c + 0.5), y, 0.0);
+                    valid[i] = keySRS->transform(in, layerSRS, points[i]) ? 1u : 0u;
+                }
+            }
+        }
     }
 
-    // Final step: transform the mosaic into the requesting key's extent.
-    if ( mosaicedImage.valid() )
+    const osg::Image* format = sources[0].pixels.get();
+    osg::ref_ptr<osg::Image> output = new osg::Image();
+    output->allocateImage(width, height, 1, format->getPixelFormat(), format->getDataType());
+    output->setInternalTextureFormat(format->getInternalTextureFormat());
+    memset(output->data(), 0, output->getTotalSizeInBytes());
+
+    ImageUtils::PixelWriter write(output.get());
+    const bool wrap = layerSRS->isGeographic();
+    unsigned last = 0u;
+    osg::Vec4f color;
+
+    for (unsigned r = 0; r < height; ++r)
     {
-        // GeoImage::reproject() will automatically crop the image to the correct extents.
-        // so there is no need to crop after reprojection. Also note that if the SRS's are the
-        // same (even though extents are different), then this operation is technically not a
-        // reprojection but merely a resampling.
+        for (unsigned c = 0; c < width; ++c)
+        {
+            unsigned i = r*width + c;
+            if (!valid[i])
+                continue;
 
-        const GeoExtent& extent = key.getExtent();
+            double x = points[i].x(), y = points[i].y();
 
-        result = mosaicedImage.reproject(
-            key.getProfile()->getSRS(),
-            &extent,
-            getTileSize(), getTileSize(),
-            true);
+            // neighboring pixels usually come from the same source
+            int hit = -1;
+            for (unsigned n = 0; n < sources.size() && hit < 0; ++n)
+            {
+                unsigned s = (last + n) % sources.size();
+                const GeoExtent& cov = sources[s].coverage;
+                if (y < cov.yMin() || y > cov.yMax())
+                    continue;
+                if (x >= cov.xMin() && x <= cov.xMax())
+                    hit = s;
+                else if (wrap && x + 360.0 >= cov.xMin() && x + 360.0 <= cov.xMax())
+                    hit = s, x += 360.0;
+                else if (wrap && x - 360.0 >= cov.xMin() && x - 360.0 <= cov.xMax())
+                    hit = s, x -= 360.0;
+            }
+
+            if (hit < 0)
+                continue;
+
+            last = hit;
+            const AssemblySource& source = sources[hit];
+            const GeoExtent& ie = source.image.getExtent();
+            source.reader(
+                color,
+                (x - ie.xMin()) / ie.width(),
+                (y - ie.yMin()) / ie.height());
+            write(color, (int)c, (int)r);
+        }
     }
 
     if (progress && progress->isCanceled())
@@ -732,7 +888,7 @@ ImageLayer::assembleImage(
         return GeoImage::INVALID;
     }
 
-    return result;
+    return GeoImage(output.get(), extent);
 }
 
 Status
@@ -0,0 +1,1099 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/KMLFeatureSource>
+#include <osgEarth/FeatureCursor>
+#include <osgEarth/Filter>
+#include <osgEarth/StringUtils>
+#include <osgEarth/Threading>
+#include <osgEarth/rtree.h>
+#include <osgDB/FileNameUtils>
+#include <osg/Timer>
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+
+#define LC "[KMLFeatureSource] "
+
+using namespace osgEarth;
+
+namespace osgEarth { namespace KMLStreaming
+{
+    // Raw properties of a KML Style, keyed by element path relative to
+    // the Style (e.g. "linestyle/color"). Converted to a Style on demand.
+    typedef std::map<std::string, std::string> StyleRecord;
+
+    class Document
+    {
+    public:
+        Document() : _geometryType(Geometry::TYPE_UNKNOWN) { }
+
+        Status read(std::istream& in, const SpatialReference* srs);
+
+        //! Copy of a feature for a cursor, with its style if requested
+        Feature* createFeature(unsigned index, bool embeddedStyles);
+
+        //! Style for a shared KML style ID, for a style sheet
+        Style createSharedStyle(const std::string& id) const;
+
+        FeatureList _features;
+        RTree<unsigned, double, 2> _index;
+        Bounds _bounds;
+        FeatureSchema _schema;
+        Geometry::Type _geometryType;
+        std::unordered_map<std::string, StyleRecord> _styles;
+        std::unordered_map<std::string, std::string> _styleMaps;
+        std::vector<KMLFeatureSource::NetworkLink> _networkLinks;
+        std::string _referrer;
+
+    private:
+        // styles materialized so far, by style ID and geometry setup
+        Threading::Mutexed<std::unordered_map<std::string, Style> > _resolved;
+
+        const StyleRecord* findStyle(const std::string& id) const;
+
+        Style buildStyle(
+            const StyleRecord* record,
+            const std::string& altitudeMode,
+            bool extrude,
+            Geometry::Type type) const;
+
+        const Style& getStyle(const Feature* feature);
+    };
+} }
+
+using namespace osgEarth::KMLStreaming;
+
+namespace
+{
+    // Minimal pull parser for KML. Reads the stream in chunks and reports
+    // element starts and ends without building a tree. Character data
+    // (including CDATA) between two events is collected in "text", so at
+    // the end of a leaf element it holds that element's content.
+    class Tokenizer
+    {
+    public:
+        enum Event { START, END, DONE };
+
+        Tokenizer(std::istream& in) :
+            _in(in), _buf(1u << 16), _pos(0), _len(0), _selfClosing(false) { }
+
+        // element name: local part (no namespace prefix), lower case
+        std::string name;
+
+        // "id" and "name" attributes of the last START
+        std::string id;
+        std::string nameAttr;
+
+        // character data since the previous event
+        std::string text;
+
+        Event next()
+        {
+            text.clear();
+
+            if (_selfClosing)
+            {
+                _selfClosing = false;
+                return END;
+            }
+
+            for(;;)
+            {
+                int c = get();
+                if (c < 0)
+                    return DONE;
+
+                if (c != '<')
+                {
+                    std::size_t start = text.size();
+                    text.push_back((char)c);
+                    for (c = peek(); c >= 0 && c != '<'; c = peek())
+                        text.push_back((char)get());
+                    decode(text, start);
+                    continue;
+                }
+
+                c = get();
+                if (c == '?')
+                {
+                    readPast("?>", nullptr);
+                }
+                else if (c == '!')
+                {
+                    if (peek() == '[')
+                    {
+                        readPast("[CDATA[", nullptr);
+                        readPast("]]>", &text);
+                    }
+                    else if (peek() == '-')
+                    {
+                        readPast("-->", nullptr);
+                    }
+                    else
+                    {
+                        readPast(">", nullptr); // DOCTYPE
+                    }
+                }
+                else if (c == '/')
+                {
+                    c = readName(get());
+                    while (c >= 0 && c != '>')
+                        c = get();
+                    return END;
+                }
+                else
+                {
+                    c = readName(c);
+                    id.clear();
+                    nameAttr.clear();
+                    return readAttributes(c);
+                }
+            }
+        }
+
+    private:
+        std::istream& _in;
+        std::vector<char> _buf;
+        std::size_t _pos, _len;
+        bool _selfClosing;
+        std::string _attrName, _attrValue;
+
+        int get()
+        {
+            if (_pos == _len)
+            {
+                if (!_in)
+                    return -1;
+                _in.read(_buf.data(), _buf.size());
+                _len = (std::size_t)_in.gcount();
+                _pos = 0;
+                if (_len == 0)
+                    return -1;
+            }
+            return (unsigned char)_buf[_pos++];
+        }
+
+        int peek()
+        {
+            int c = get();
+            if (c >= 0)
+                --_pos;
+            return c;
+        }
+
+        static bool isSpace(int c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        // reads past the terminator, appending what came before it to "out"
+        bool readPast(const char* term, std::string* out)
+        {
+            const std::size_t n = std::strlen(term);
+            std::string tail;
+            std::string& s = out ? *out : tail;
+            const std::size_t start = s.size();
+
+            for (int c = get(); c >= 0; c = get())
+            {
+                s.push_back((char)c);
+                if (s.size() - start >= n && s.compare(s.size() - n, n, term) == 0)
+                {
+                    s.resize(s.size() - n);
+                    return true;
+                }
+                if (!out && s.size() > n)
+                    s.erase(0, 1);
+            }
+            return false;
+        }
+
+        // reads an element name starting with c; returns the next character
+        int readName(int c)
+        {
+            name.clear();
+            while (c >= 0 && !isSpace(c) && c != '/' && c != '>')
+            {
+                if (c == ':')
+                    name.clear();
+                else
+                    name.push_back((char)::tolower(c));
+                c = get();
+            }
+            return c;
+        }
+
+        Event readAttributes(int c)
+        {
+            for(;;)
+            {
+                while (isSpace(c))
+                    c = get();
+
+                if (c < 0 || c == '>')
+                    return START;
+
+                if (c == '/')
+                {
+                    while (c >= 0 && c != '>')
+                        c = get();
+                    _selfClosing = true;
+                    return START;
+                }
+
+                _attrName.clear();
+                while (c >= 0 && c != '=' && !isSpace(c) && c != '>' && c != '/')
+                {
+                    if (c == ':')
+                        _attrName.clear();
+                    else
+                        _attrName.push_back((char)::tolower(c));
+                    c = get();
+                }
+                while (isSpace(c))
+                    c = get();
+                if (c != '=')
+                    continue;
+
+                c = get();
+                while (isSpace(c))
+                    c = get();
+                if (c != '"' && c != '\'')
+                    continue;
+
+                int quote = c;
+                _attrValue.clear();
+                for (c = get(); c >= 0 && c != quote; c = get())
+                    _attrValue.push_back((char)c);
+                decode(_attrValue, 0);
+
+                if (_attrName == "id")
+                    id = _attrValue;
+                else if (_attrName == "name")
+                    nameAttr = _attrValue;
+
+                c = get();
+            }
+        }
+
+        // replaces XML entities in s, starting at "start"
+        static void decode(std::string& s, std::size_t start)
+        {
+            std::size_t amp = s.find('&', start);
+            if (amp == std::string::npos)
+                return;
+
+            std::string out(s, 0, amp);
+            for (std::size_t i = amp; i < s.size(); ++i)
+            {
+                std::size_t semi;
+                if (s[i] != '&' || (semi = s.find(';', i)) == std::string::npos || semi - i > 10)
+                {
+                    out.push_back(s[i]);
+                    continue;
+                }
+
+                std::string entity(s, i + 1, semi - i - 1);
+                if (entity == "lt") out.push_back('<');
+                else if (entity == "gt") out.push_back('>');
+                else if (entity == "amp") out.push_back('&');
+                else if (entity == "quot") out.push_back('"');
+                else if (entity == "apos") out.push_back('\'');
+                else if (!entity.empty() && entity[0] == '#')
+                {
+                    unsigned long code = entity.size() > 1 && (entity[1] == 'x' || entity[1] == 'X') ?
+                        std::strtoul(entity.c_str() + 2, nullptr, 16) :
+                        std::strtoul(entity.c_str() + 1, nullptr, 10);
+
+                    // encode as UTF-8
+                    if (code < 0x80) {
+                        out.push_back((char)code);
+                    }
+                    else if (code < 0x800) {
+                        out.push_back((char)(0xC0 | (code >> 6)));
+                        out.push_back((char)(0x80 | (code & 0x3F)));
+                    }
+                    else if (code < 0x10000) {
+                        out.push_back((char)(0xE0 | (code >> 12)));
+                        out.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+                        out.push_back((char)(0x80 | (code & 0x3F)));
+                    }
+                    else {
+                        out.push_back((char)(0xF0 | (code >> 18)));
+                        out.push_back((char)(0x80 | ((code >> 12) & 0x3F)));
+                        out.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+                        out.push_back((char)(0x80 | (code & 0x3F)));
+                    }
+                }
+                else
+                {
+                    out.append(s, i, semi - i + 1);
+                }
+                i = semi;
+            }
+            s.swap(out);
+        }
+    };
+
+    // Parses a KML coordinates string ("lon,lat[,alt] lon,lat[,alt] ...").
+    void parseCoordinates(const std::string& text, Geometry* geom)
+    {
+        const char* p = text.c_str();
+        const char* end = p + text.size();
+
+        while (p < end)
+        {
+            while (p < end && ::isspace((unsigned char)*p))
+                ++p;
+
+            double v[3] = { 0.0, 0.0, 0.0 };
+            int n = 0;
+            while (p < end && !::isspace((unsigned char)*p))
+            {
+                char* next;
+                double d = std::strtod(p, &next);
+                if (next == p)
+                {
+                    while (p < end && *p != ',' && !::isspace((unsigned char)*p))
+                        ++p;
+                }
+                else
+                {
+                    if (n < 3)
+                        v[n] = d;
+                    ++n;
+                    p = next;
+                }
+                if (p < end && *p == ',')
+                    ++p;
+            }
+
+            if (n >= 2)
+                geom->push_back(osg::Vec3d(v[0], v[1], v[2]));
+        }
+    }
+
+    // Parses a gx:coord value ("lon lat alt").
+    void parseTrackCoord(const std::string& text, Geometry* geom)
+    {
+        const char* p = text.c_str();
+        double v[3] = { 0.0, 0.0, 0.0 };
+        int n = 0;
+        for (; n < 3; ++n)
+        {
+            char* next;
+            v[n] = std::strtod(p, &next);
+            if (next == p)
+                break;
+            p = next;
+        }
+        if (n >= 2)
+            geom->push_back(osg::Vec3d(v[0], v[1], v[2]));
+    }
+
+    // ID of the style in a styleUrl ("#id" or "file.kml#id")
+    std::string styleIdFromUrl(const std::string& url)
+    {
+        std::string::size_type hash = url.find('#');
+        return hash == std::string::npos ? url : url.substr(hash + 1);
+    }
+
+    bool isGeometryElement(const std::string& name)
+    {
+        return
+            name == "point" || name == "linestring" || name == "linearring" ||
+            name == "polygon" || name == "multigeometry" ||
+            name == "track" || name == "multitrack";
+    }
+
+    Color kmlColor(const std::string& value)
+    {
+        return Color(Stringify() << "#" << value, Color::ABGR);
+    }
+}
+
+Status
+Document::read(std::istream& in, const SpatialReference* srs)
+{
+    Tokenizer xml(in);
+    std::vector<std::string> path;
+    bool foundRoot = false;
+
+    // placemark under construction
+    bool inPlacemark = false;
+    std::vector<std::pair<std::string, std::string> > attrs;
+    osg::ref_ptr<Geometry> geometry;
+    std::vector<osg::ref_ptr<Geometry> > geomStack;
+    bool innerBoundary = false;
+    std::string dataName;
+
+    // style, style map or network link under construction
+    bool inStyle = false;
+    std::size_t styleDepth = 0;
+    std::string styleId;
+    StyleRecord style;
+    std::map<std::string, std::string> inlineStyles;
+
+    bool inStyleMap = false;
+    std::string styleMapId, pairKey, pairUrl;
+
+    bool inNetworkLink = false;
+    KMLFeatureSource::NetworkLink link;
+
+    for (Tokenizer::Event e = xml.next(); e != Tokenizer::DONE; e = xml.next())
+    {
+        const std::string& name = xml.name;
+
+        if (e == Tokenizer::START)
+        {
+            if (name == "kml")
+                foundRoot = true;
+
+            if (name == "placemark")
+            {
+                inPlacemark = true;
+                attrs.clear();
+                geometry = nullptr;
+                geomStack.clear();
+            }
+            else if (name == "style")
+            {
+                inStyle = true;
+                styleDepth = path.size();
+                styleId = xml.id;
+                style.clear();
+            }
+            else if (name == "stylemap")
+            {
+                inStyleMap = true;
+                styleMapId = xml.id;
+            }
+            else if (name == "pair")
+            {
+                pairKey.clear();
+                pairUrl.clear();
+            }
+            else if (name == "networklink")
+            {
+                inNetworkLink = true;
+                link = KMLFeatureSource::NetworkLink();
+            }
+            else if (inPlacemark && !inStyle)
+            {
+                if (name == "point")
+                {
+                    geomStack.push_back(new osgEarth::Point());
+                }
+                else if (name == "linestring" || name == "track")
+                {
+                    geomStack.push_back(new LineString());
+                }
+                else if (name == "polygon")
+                {
+                    geomStack.push_back(new osgEarth::Polygon());
+                }
+                else if (name == "multigeometry" || name == "multitrack")
+                {
+                    geomStack.push_back(new MultiGeometry());
+                }
+                else if (name == "outerboundaryis" || name == "innerboundaryis")
+                {
+                    innerBoundary = (name == "innerboundaryis");
+                }
+                else if (name == "linearring")
+                {
+                    // rings of a polygon: the outer ring is the polygon itself
+                    osgEarth::Polygon* poly = geomStack.empty() ? nullptr :
+                        dynamic_cast<osgEarth::Polygon*>(geomStack.back().get());
+                    if (poly && innerBoundary)
+                    {
+                        Ring* hole = new Ring();
+                        poly->getHoles().push_back(hole);
+                        geomStack.push_back(hole);
+                    }
+                    else if (poly)
+                    {
+                        geomStack.push_back(poly);
+                    }
+                    else
+                    {
+                        geomStack.push_back(new Ring());
+                    }
+                }
+                else if (name == "data" || name == "simpledata")
+                {
+                    dataName = xml.nameAttr;
+                }
+            }
+
+            path.push_back(name);
+        }
+
+        else // END
+        {
+            if (path.empty())
+                continue;
+
+            const std::string& parent = path.size() >= 2 ? path[path.size() - 2] : path.back();
+
+            if (inStyle && name != "style")
+            {
+                std::string value = trim(xml.text);
+                if (!value.empty() && path.size() > styleDepth + 1)
+                {
+                    std::string key;
+                    for (std::size_t i = styleDepth + 1; i < path.size(); ++i)
+                    {
+                        if (!key.empty()) key += '/';
+                        key += path[i];
+                    }
+                    style[key] = value;
+                }
+            }
+            else if (name == "style")
+            {
+                inStyle = false;
+                if (inPlacemark)
+                {
+                    // share identical inline styles
+                    std::string signature;
+                    for (StyleRecord::const_iterator i = style.begin(); i != style.end(); ++i)
+                        signature += i->first + '=' + i->second + '\n';
+
+                    std::string& inlineId = inlineStyles[signature];
+                    if (inlineId.empty())
+                    {
+                        std::string newId = Stringify() << "inline" << inlineStyles.size();
+                        inlineId = newId;
+                        _styles[inlineId] = style;
+                    }
+                    attrs.push_back(std::make_pair(std::string("styleurl"), inlineId));
+                }
+                else if (!styleId.empty())
+                {
+                    _styles[styleId] = style;
+                }
+            }
+            else if (inStyleMap)
+            {
+                if (name == "key")
+                    pairKey = trim(xml.text);
+                else if (name == "styleurl" && parent == "pair")
+                    pairUrl = styleIdFromUrl(trim(xml.text));
+                else if (name == "pair" && pairKey == "normal" && !styleMapId.empty())
+                    _styleMaps[styleMapId] = pairUrl;
+                else if (name == "stylemap")
+                    inStyleMap = false;
+            }
+            else if (inNetworkLink)
+            {
+                if (name == "name" && parent == "networklink")
+                {
+                    link.name = trim(xml.text);
+                }
+                else if (name == "href" && (parent == "link" || parent == "url"))
+                {
+                    link.url = URI(trim(xml.text), URIContext(_referrer));
+                }
+                else if (name == "networklink")
+                {
+                    inNetworkLink = false;
+                    if (!link.url.empty())
+                        _networkLinks.push_back(link);
+                }
+            }
+            else if (inPlacemark)
+            {
+                if (name == "coordinates")
+                {
+                    if (!geomStack.empty())
+                        parseCoordinates(xml.text, geomStack.back().get());
+                }
+                else if (name == "coord")
+                {
+                    if (!geomStack.empty())
+                        parseTrackCoord(xml.text, geomStack.back().get());
+                }
+                else if (isGeometryElement(name))
+                {
+                    if (!geomStack.empty())
+                    {
+                        osg::ref_ptr<Geometry> geom = geomStack.back();
+                        geomStack.pop_back();
+
+                        Geometry* container = geomStack.empty() ? nullptr : geomStack.back().get();
+                        bool isRingOf = container && dynamic_cast<osgEarth::Polygon*>(container) && name == "linearring";
+                        bool valid = geom->size() > 0 || (geom->getType() == Geometry::TYPE_MULTI &&
+                            !static_cast<MultiGeometry*>(geom.get())->getComponents().empty());
+
+                        if (isRingOf || !valid)
+                        {
+                            // already part of its polygon, or empty
+                        }
+                        else if (container && container->getType() == Geometry::TYPE_MULTI)
+                        {
+                            static_cast<MultiGeometry*>(container)->getComponents().push_back(geom.get());
+                        }
+                        else if (!geometry.valid())
+                        {
+                            geometry = geom;
+                        }
+                    }
+                }
+                else if (name == "altitudemode" || name == "extrude")
+                {
+                    attrs.push_back(std::make_pair(name, toLower(trim(xml.text))));
+                }
+                else if (parent == "placemark" && (name == "name" || name == "description"))
+                {
+                    attrs.push_back(std::make_pair(name, trim(xml.text)));
+                }
+                else if (parent == "placemark" && name == "styleurl")
+                {
+                    attrs.push_back(std::make_pair(name, styleIdFromUrl(trim(xml.text))));
+                }
+                else if ((parent == "timestamp" && name == "when") ||
+                         (parent == "timespan" && (name == "begin" || name == "end")))
+                {
+                    attrs.push_back(std::make_pair(name, trim(xml.text)));
+                }
+                else if ((name == "value" && parent == "data") || name == "simpledata")
+                {
+                    if (!dataName.empty())
+                        attrs.push_back(std::make_pair(dataName, trim(xml.text)));
+                }
+                else if (name == "placemark")
+                {
+                    inPlacemark = false;
+
+                    if (geometry.valid() && geometry->isValid())
+                    {
+                        Feature* f = new Feature(geometry.get(), srs);
+                        f->setFID((FeatureID)_features.size());
+
+                        // altitude mode and style come from the first geometry
+                        // and style; for anything else the last value wins
+                        for (unsigned i = 0; i < attrs.size(); ++i)
+                        {
+                            if (!f->hasAttr(attrs[i].first) || (attrs[i].first != "altitudemode" && attrs[i].first != "styleurl"))
+                                f->set(attrs[i].first, attrs[i].second);
+                            _schema[attrs[i].first] = ATTRTYPE_STRING;
+                        }
+
+                        Bounds b = geometry->getBounds();
+                        double bmin[2] = { b.xMin(), b.yMin() };
+                        double bmax[2] = { b.xMax(), b.yMax() };
+                        _index.Insert(bmin, bmax, (unsigned)_features.size());
+                        _bounds.expandBy(b);
+
+                        Geometry::Type type = geometry->getType();
+                        if (_features.empty())
+                            _geometryType = type;
+                        else if (_geometryType != type)
+                            _geometryType = Geometry::TYPE_UNKNOWN;
+
+                        _features.push_back(f);
+                    }
+                    geometry = nullptr;
+                    geomStack.clear();
+                }
+            }
+
+            path.pop_back();
+        }
+    }
+
+    if (!foundRoot)
+    {
+        return Status(Status::ResourceUnavailable, "No KML document found");
+    }
+
+    if (!path.empty())
+    {
+        OE_WARN << LC << "KML document is truncated; using what was read" << std::endl;
+    }
+
+    return Status::NoError;
+}
+
+const StyleRecord*
+Document::findStyle(const std::string& id) const
+{
+    std::unordered_map<std::string, std::string>::const_iterator m = _styleMaps.find(id);
+    const std::string& styleId = m != _styleMaps.end() ? m->second : id;
+
+    std::unordered_map<std::string, StyleRecord>::const_iterator s = _styles.find(styleId);
+    return s != _styles.end() ? &s->second : nullptr;
+}
+
+Style
+Document::buildStyle(
+    const StyleRecord* record,
+    const std::string& altitudeMode,
+    bool extrude,
+    Geometry::Type type) const
+{
+    std::string empty;
+    auto value = [&](const char* key) -> const std::string&
+    {
+        if (!record)
+            return empty;
+        StyleRecord::const_iterator i = record->find(key);
+        return i != record->end() ? i->second : empty;
+    };
+
+    const bool isPoly = type == Geometry::TYPE_POLYGON;
+    const bool isLine = type == Geometry::TYPE_LINESTRING || type == Geometry::TYPE_RING;
+    const bool isPoint = type == Geometry::TYPE_POINT || type == Geometry::TYPE_POINTSET;
+
+    Style style;
+
+    if (isLine || isPoly)
+    {
+        LineSymbol* line = style.getOrCreate<LineSymbol>();
+        if (!value("linestyle/color").empty())
+            line->stroke()->color() = kmlColor(value("linestyle/color"));
+        float width = as<float>(value("linestyle/width"), 1.0f);
+        line->stroke()->width() = width > 0.0f ? width : 1.0f;
+    }
+
+    if (isPoly || extrude)
+    {
+        PolygonSymbol* poly = style.getOrCreate<PolygonSymbol>();
+        poly->fill()->color() = value("polystyle/color").empty() ?
+            Color(Color::White) : kmlColor(value("polystyle/color"));
+        if (value("polystyle/fill") == "0")
+            poly->fill()->color().a() = 0.0f;
+        if (!value("polystyle/outline").empty())
+            poly->outline() = as<int>(value("polystyle/outline"), 0) == 1;
+    }
+
+    if (isPoint)
+    {
+        std::string href = value("iconstyle/icon/href");
+        if (href.empty())
+            href = value("iconstyle/icon");
+        if (!href.empty())
+        {
+            IconSymbol* icon = style.getOrCreate<IconSymbol>();
+            icon->url()->setLiteral(href);
+            icon->url()->setURIContext(URIContext(_referrer));
+            icon->scale() = NumericExpression(as<double>(value("iconstyle/scale"), 1.0));
+        }
+
+        TextSymbol* text = style.getOrCreate<TextSymbol>();
+        text->content() = StringExpression("[name]");
+        if (!value("labelstyle/color").empty())
+            text->fill()->color() = kmlColor(value("labelstyle/color"));
+        if (!value("labelstyle/scale").empty())
+            text->size() = NumericExpression(16.0 * as<double>(value("labelstyle/scale"), 1.0));
+    }
+
+    AltitudeSymbol* alt = style.getOrCreate<AltitudeSymbol>();
+    if (altitudeMode == "absolute")
+    {
+        alt->clamping() = AltitudeSymbol::CLAMP_ABSOLUTE;
+    }
+    else if (altitudeMode == "relativetoground")
+    {
+        alt->clamping() = AltitudeSymbol::CLAMP_RELATIVE_TO_TERRAIN;
+        alt->technique() = AltitudeSymbol::TECHNIQUE_SCENE;
+    }
+    else
+    {
+        // clampToGround (the default); extrusion does not apply
+        alt->clamping() = AltitudeSymbol::CLAMP_TO_TERRAIN;
+        alt->technique() = isPoly || isLine ? AltitudeSymbol::TECHNIQUE_DRAPE : AltitudeSymbol::TECHNIQUE_SCENE;
+        if (extrude && !isPoly)
+            style.remove<PolygonSymbol>();
+        extrude = false;
+    }
+
+    if (extrude)
+    {
+        style.getOrCreate<ExtrusionSymbol>()->flatten() = false;
+    }
+
+    return style;
+}
+
+const Style&
+Document::getStyle(const Feature* feature)
+{
+    const std::string& id = feature->getString("styleurl");
+    const std::string& altitudeMode = feature->getString("altitudemode");
+    bool extrude = feature->getString("extrude") == "1";
+    Geometry::Type type = feature->getGeometry()->getComponentType();
+
+    std::string key = Stringify() << id << '|' << altitudeMode << '|' << extrude << '|' << (int)type;
+
+    Threading::ScopedMutexLock lock(_resolved);
+    std::unordered_map<std::string, Style>::iterator i = _resolved.find(key);
+    if (i == _resolved.end())
+    {
+        i = _resolved.insert(std::make_pair(key, buildStyle(findStyle(id), altitudeMode, extrude, type))).first;
+    }
+    return i->second;
+}
+
+Feature*
+Document::createFeature(unsigned index, bool embeddedStyles)
+{
+    Feature* f = new Feature(*_features[index].get(), osg::CopyOp::DEEP_COPY_ALL);
+    if (embeddedStyles)
+    {
+        f->style() = getStyle(f);
+    }
+    return f;
+}
+
+Style
+Document::createSharedStyle(const std::string& id) const
+{
+    // without a geometry type, include both line and polygon symbols
+    Style style = buildStyle(findStyle(id), std::string(), false, Geometry::TYPE_POLYGON);
+
+    const StyleRecord* record = findStyle(id);
+    if (record && (record->count("iconstyle/icon/href") || record->count("labelstyle/color")))
+    {
+        Style points = buildStyle(record, std::string(), false, Geometry::TYPE_POINT);
+        style.remove<AltitudeSymbol>();
+        style = style.combineWith(points);
+    }
+
+    style.setName(id);
+    return style;
+}
+
+//........................................................................
+
+Config
+KMLFeatureSource::Options::getConfig() const
+{
+    Config conf = FeatureSource::Options::getConfig();
+    conf.set("url", _url);
+    conf.set("embedded_styles", _embeddedStyles);
+    return conf;
+}
+
+void
+KMLFeatureSource::Options::fromConfig(const Config& conf)
+{
+    embeddedStyles().init(true);
+
+    conf.get("url", _url);
+    conf.get("embedded_styles", _embeddedStyles);
+}
+
+//........................................................................
+
+REGISTER_OSGEARTH_LAYER(kmlfeatures, KMLFeatureSource);
+
+OE_LAYER_PROPERTY_IMPL(KMLFeatureSource, URI, URL, url);
+OE_LAYER_PROPERTY_IMPL(KMLFeatureSource, bool, EmbeddedStyles, embeddedStyles);
+
+void
+KMLFeatureSource::init()
+{
+    FeatureSource::init();
+    _doc = nullptr;
+}
+
+KMLFeatureSource::~KMLFeatureSource()
+{
+    close();
+}
+
+Status
+KMLFeatureSource::openImplementation()
+{
+    Status parent = FeatureSource::openImplementation();
+    if (parent.isError())
+        return parent;
+
+    if (!options().url().isSet())
+        return Status(Status::ConfigurationError, "Missing required URL");
+
+    const URI& uri = options().url().get();
+
+    if (osgDB::getLowerCaseFileExtension(uri.full()) == "kmz")
+        return Status(Status::ConfigurationError, "KMZ archives are not supported; extract the KML document first");
+
+    osg::ref_ptr<const SpatialReference> srs = SpatialReference::create("wgs84");
+
+    std::shared_ptr<Document> doc = std::make_shared<Document>();
+    doc->_referrer = uri.full();
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    URIStream stream(uri, std::ios_base::in | std::ios_base::binary);
+    Status status = doc->read(stream, srs.get());
+    if (status.isError())
+        return Status(status.code(), Stringify() << status.message() << " in \"" << uri.full() << "\"");
+
+    OE_INFO << LC << "Read " << doc->_features.size() << " placemarks from \"" << uri.full() << "\" in "
+        << osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick()) << "s" << std::endl;
+
+    GeoExtent extent(srs.get(), doc->_bounds);
+    if (!extent.isValid())
+    {
+        extent = GeoExtent(srs.get());
+    }
+
+    FeatureProfile* profile = new FeatureProfile(extent);
+    if (options().geoInterp().isSet())
+        profile->geoInterp() = options().geoInterp().get();
+    setFeatureProfile(profile);
+
+    _doc = doc;
+
+    return Status::NoError;
+}
+
+Status
+KMLFeatureSource::closeImplementation()
+{
+    init();
+    return FeatureSource::closeImplementation();
+}
+
+const std::vector<KMLFeatureSource::NetworkLink>&
+KMLFeatureSource::getNetworkLinks() const
+{
+    return _doc ? _doc->_networkLinks : _noLinks;
+}
+
+StyleSheet*
+KMLFeatureSource::createStyleSheet() const
+{
+    StyleSheet* sheet = new StyleSheet();
+
+    std::shared_ptr<Document> doc = _doc;
+    if (doc)
+    {
+        for (std::unordered_map<std::string, StyleRecord>::const_iterator i = doc->_styles.begin(); i != doc->_styles.end(); ++i)
+            sheet->addStyle(doc->createSharedStyle(i->first));
+
+        for (std::unordered_map<std::string, std::string>::const_iterator i = doc->_styleMaps.begin(); i != doc->_styleMaps.end(); ++i)
+            sheet->addStyle(doc->createSharedStyle(i->first));
+    }
+
+    sheet->addSelector(StyleSelector("kml", StringExpression("[styleurl]")));
+    return sheet;
+}
+
+FeatureCursor*
+KMLFeatureSource::createFeatureCursorImplementation(const Query& query, ProgressCallback* progress)
+{
+    std::shared_ptr<Document> doc = _doc;
+    if (!doc)
+        return nullptr;
+
+    const FeatureProfile* profile = getFeatureProfile();
+    const bool embeddedStyles = options().embeddedStyles().get();
+
+    // establish the query bounds in the feature SRS:
+    Bounds bounds;
+    GeoExtent queryExtent = profile->getExtent();
+    if (query.bounds().isSet())
+    {
+        bounds = query.bounds().get();
+        queryExtent = GeoExtent(profile->getSRS(), bounds);
+    }
+    else if (query.tileKey().isSet())
+    {
+        queryExtent = query.tileKey()->getExtent().transform(profile->getSRS());
+        bounds = queryExtent.bounds();
+    }
+
+    std::vector<unsigned> hits;
+    if (bounds.isValid())
+    {
+        double bmin[2] = { bounds.xMin(), bounds.yMin() };
+        double bmax[2] = { bounds.xMax(), bounds.yMax() };
+        doc->_index.Search(bmin, bmax, &hits, INT_MAX);
+
+        // keep document order
+        std::sort(hits.begin(), hits.end());
+    }
+    else
+    {
+        hits.resize(doc->_features.size());
+        for (unsigned i = 0; i < hits.size(); ++i)
+            hits[i] = i;
+    }
+
+    FeatureList features;
+    for (unsigned i = 0; i < hits.size(); ++i)
+    {
+        if (progress && progress->isCanceled())
+            return nullptr;
+
+        if (isBlacklisted((FeatureID)hits[i]))
+            continue;
+
+        Feature* f = doc->createFeature(hits[i], embeddedStyles);
+        if (profile->geoInterp().isSet())
+            f->geoInterp() = profile->geoInterp().get();
+        features.push_back(f);
+    }
+
+    applyFilters(features, queryExtent);
+
+    return new FeatureListCursor(features);
+}
+
+int
+KMLFeatureSource::getFeatureCount() const
+{
+    return _doc ? (int)_doc->_features.size() : -1;
+}
+
+Feature*
+KMLFeatureSource::getFeature(FeatureID fid)
+{
+    std::shared_ptr<Document> doc = _doc;
+    if (doc && fid < (FeatureID)doc->_features.size() && !isBlacklisted(fid))
+    {
+        return doc->createFeature((unsigned)fid, options().embeddedStyles().get());
+    }
+    return nullptr;
+}
+
+const FeatureSchema&
+KMLFeatureSource::getSchema() const
+{
+    return _doc ? _doc->_schema : _emptySchema;
+}
+
+Geometry::Type
+KMLFeatureSource::getGeometryType() const
+{
+    return _doc ? _doc->_geometryType : Geometry::TYPE_UNKNOWN;
+}
+
+bool
+KMLFeatureSource::hasEmbeddedStyles() const
+{
+    return options().embeddedStyles().get();
+}
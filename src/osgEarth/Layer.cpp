@@ -327,6 +327,10 @@ Layer::init()
 Status
 Layer::open()
 {
+    // Layers may open concurrently (see Map::openLayers), and a layer may
+    // open another layer it references; serialize opens of the same layer.
+    Threading::ScopedRecursiveMutexLock lock(_openMutex);
+
     // Cannot open a layer that's already open OR is disabled.
     if (isOpen() || !getEnabled())
     {
@@ -26,6 +26,8 @@
 #include <osgEarth/FeatureSource>
 #include <osgDB/Registry>
 #include <list>
+#include <sstream>
+#include <cstring>
 #include <stdio.h>
 #include <stdlib.h>
 #include "vector_tile.pb.h"
@@ -310,7 +312,7 @@ namespace osgEarth { namespace MVT
         }
     }
 
-    bool readTile(std::istream& in, const TileKey& key, FeatureList& features)
+    bool readTileProtobuf(std::istream& in, const TileKey& key, FeatureList& features)
     {
         features.clear();
 
@@ -458,6 +460,461 @@ namespace osgEarth { namespace MVT
         return true;
     }
 
+    // Minimal reader for the protobuf wire format. It walks a buffer in
+    // place, so the tile is never copied into a message tree.
+    class PBFReader
+    {
+    public:
+        PBFReader(const char* data, std::size_t size) :
+            _p((const std::uint8_t*)data),
+            _end((const std::uint8_t*)data + size),
+            _tag(0u),
+            _ok(true) { }
+
+        //! Advance to the next field. False at the end of the message or on error.
+        bool next()
+        {
+            if (_p >= _end)
+                return false;
+            _tag = readVarint();
+            return _ok;
+        }
+
+        std::uint32_t field() const { return std::uint32_t(_tag >> 3); }
+        std::uint32_t wireType() const { return std::uint32_t(_tag & 0x7); }
+        bool more() const { return _p < _end; }
+        bool ok() const { return _ok; }
+
+        std::uint64_t readVarint()
+        {
+            std::uint64_t result = 0u;
+            for (int shift = 0; _p < _end && shift < 64; shift += 7)
+            {
+                std::uint8_t b = *_p++;
+                result |= std::uint64_t(b & 0x7f) << shift;
+                if ((b & 0x80) == 0)
+                    return result;
+            }
+            return fail();
+        }
+
+        float readFloat()
+        {
+            float value = 0.0f;
+            if (advance(4))
+                ::memcpy(&value, _p - 4, 4);
+            return value;
+        }
+
+        double readDouble()
+        {
+            double value = 0.0;
+            if (advance(8))
+                ::memcpy(&value, _p - 8, 8);
+            return value;
+        }
+
+        //! Read a length-delimited field as a view into the buffer
+        bool readBytes(const char*& data, std::size_t& size)
+        {
+            std::uint64_t len = readVarint();
+            if (!_ok || len > std::uint64_t(_end - _p))
+                return fail() != 0u;
+            data = (const char*)_p;
+            size = (std::size_t)len;
+            _p += len;
+            return true;
+        }
+
+        //! Skip the value of the current field
+        void skip()
+        {
+            const char* data;
+            std::size_t size;
+            switch (wireType())
+            {
+            case 0: readVarint(); break;
+            case 1: advance(8); break;
+            case 2: readBytes(data, size); break;
+            case 5: advance(4); break;
+            default: fail();
+            }
+        }
+
+    private:
+        const std::uint8_t* _p;
+        const std::uint8_t* _end;
+        std::uint64_t _tag;
+        bool _ok;
+
+        bool advance(std::size_t n)
+        {
+            if (std::size_t(_end - _p) < n)
+                return fail() != 0u;
+            _p += n;
+            return true;
+        }
+
+        std::uint64_t fail()
+        {
+            _ok = false;
+            _p = _end;
+            return 0u;
+        }
+    };
+
+    struct BufferView
+    {
+        const char* data;
+        std::size_t size;
+        std::string str() const { return std::string(data, size); }
+    };
+
+    // A value from the layer's value table, decoded on first use
+    struct LazyValue
+    {
+        enum Type { NONE, STRING, DOUBLE, INT, BOOL };
+        BufferView raw;
+        bool decoded;
+        Type type;
+        std::string s;
+        double d;
+        long long i;
+        bool b;
+
+        void decode()
+        {
+            decoded = true;
+            type = NONE;
+            PBFReader r(raw.data, raw.size);
+            while (r.next())
+            {
+                switch (r.field())
+                {
+                case 1: { BufferView v; if (r.readBytes(v.data, v.size)) { s = v.str(); type = STRING; } } break;
+                case 2: d = r.readFloat(); type = DOUBLE; break;
+                case 3: d = r.readDouble(); type = DOUBLE; break;
+                case 4: i = (long long)r.readVarint(); type = INT; break;
+                case 5: i = (long long)r.readVarint(); type = INT; break;
+                case 6: i = (long long)zig_zag_decode64(r.readVarint()); type = INT; break;
+                case 7: b = r.readVarint() != 0u; type = BOOL; break;
+                default: r.skip();
+                }
+            }
+        }
+
+        static std::int64_t zig_zag_decode64(std::uint64_t n)
+        {
+            return std::int64_t(n >> 1) ^ -std::int64_t(n & 1);
+        }
+    };
+
+    // Index of one layer's fields, built in a single pass so features can
+    // be decoded regardless of where the key and value tables appear.
+    struct LayerIndex
+    {
+        BufferView name;
+        std::uint32_t extent;
+        std::vector<BufferView> features;
+        std::vector<BufferView> keys;
+        std::vector<LazyValue> values;
+        std::vector<std::int8_t> keyWanted; // -1 = not yet checked
+        std::vector<std::string> keyStrings;
+
+        bool read(const char* data, std::size_t size)
+        {
+            extent = 4096u;
+            name = BufferView{ "", 0u };
+            features.clear();
+            keys.clear();
+            values.clear();
+
+            PBFReader r(data, size);
+            while (r.next())
+            {
+                BufferView v;
+                switch (r.field())
+                {
+                case 1: r.readBytes(name.data, name.size); break;
+                case 2: if (r.readBytes(v.data, v.size)) features.push_back(v); break;
+                case 3: if (r.readBytes(v.data, v.size)) keys.push_back(v); break;
+                case 4: if (r.readBytes(v.data, v.size)) { values.emplace_back(); values.back().raw = v; values.back().decoded = false; } break;
+                case 5: extent = (std::uint32_t)r.readVarint(); break;
+                default: r.skip();
+                }
+            }
+
+            keyWanted.assign(keys.size(), -1);
+            keyStrings.assign(keys.size(), std::string());
+            return r.ok() && extent > 0u;
+        }
+
+        //! Whether a key should be materialized, resolved once per layer
+        bool wants(std::uint32_t k, const AttributeNames* attributes)
+        {
+            if (keyWanted[k] < 0)
+            {
+                keyStrings[k] = keys[k].str();
+                keyWanted[k] =
+                    attributes == nullptr ||
+                    attributes->count(keyStrings[k]) > 0 ||
+                    (keyStrings[k] == "other_tags" && attributes->count("height") > 0) ? 1 : 0;
+            }
+            return keyWanted[k] > 0;
+        }
+    };
+
+    // Maps tile-space integer coordinates to the tile key's extent
+    struct TileTransform
+    {
+        double xmin, ymax, sx, sy;
+
+        TileTransform(const TileKey& key, std::uint32_t extent)
+        {
+            const GeoExtent& e = key.getExtent();
+            xmin = e.xMin();
+            ymax = e.yMax();
+            sx = e.width() / (double)extent;
+            sy = e.height() / (double)extent;
+        }
+
+        osg::Vec3d operator()(int x, int y) const
+        {
+            return osg::Vec3d(xmin + sx * (double)x, ymax - sy * (double)y, 0.0);
+        }
+    };
+
+    // Decodes a packed geometry command stream straight into osgEarth geometry.
+    Geometry* decodeGeometry(const BufferView& geom, eGeomType type, const TileTransform& xform)
+    {
+        PBFReader r(geom.data, geom.size);
+
+        osg::ref_ptr<MultiGeometry> parts = new MultiGeometry();
+        osg::ref_ptr<osgEarth::PointSet> points;
+        osg::ref_ptr<osgEarth::Geometry> current;
+        osg::ref_ptr<osgEarth::Polygon> currentPolygon;
+
+        if (type == MVT::Point)
+            points = new osgEarth::PointSet();
+
+        int x = 0, y = 0;
+
+        while (r.more() && r.ok())
+        {
+            std::uint32_t cmd_length = (std::uint32_t)r.readVarint();
+            std::uint32_t cmd = cmd_length & ((1 << CMD_BITS) - 1);
+            std::uint32_t count = cmd_length >> CMD_BITS;
+
+            if (cmd == CMD_MOVETO || cmd == CMD_LINETO)
+            {
+                for (std::uint32_t c = 0; c < count && r.ok(); ++c)
+                {
+                    x += (int)LazyValue::zig_zag_decode64(r.readVarint());
+                    y += (int)LazyValue::zig_zag_decode64(r.readVarint());
+                    osg::Vec3d p = xform(x, y);
+
+                    if (points.valid())
+                    {
+                        points->push_back(p);
+                    }
+                    else
+                    {
+                        if (!current.valid() || (cmd == CMD_MOVETO && type != MVT::Polygon))
+                        {
+                            current = type == MVT::Polygon ?
+                                (Geometry*)new osgEarth::Ring() :
+                                (Geometry*)new osgEarth::LineString();
+                            if (type != MVT::Polygon)
+                                parts->add(current.get());
+                        }
+                        current->push_back(p);
+                    }
+                }
+            }
+            else if (cmd == CMD_CLOSEPATH && type == MVT::Polygon && current.valid())
+            {
+                // MVT winds exterior rings clockwise, the opposite of osgEarth.
+                osgEarth::Ring* ring = static_cast<osgEarth::Ring*>(current.get());
+                Geometry::Orientation orientation = ring->getOrientation();
+                ring->close();
+
+                if (orientation == Geometry::ORIENTATION_CW)
+                {
+                    ring->rewind(Geometry::ORIENTATION_CCW);
+                    currentPolygon = new osgEarth::Polygon(&ring->asVector());
+                    parts->add(currentPolygon.get());
+                }
+                else if (orientation == Geometry::ORIENTATION_CCW)
+                {
+                    if (currentPolygon.valid())
+                    {
+                        ring->rewind(Geometry::ORIENTATION_CW);
+                        currentPolygon->getHoles().push_back(ring);
+                    }
+                    else
+                    {
+                        OE_INFO << LC << "Discarding improperly wound polygon (hole without an outer ring)\n";
+                    }
+                }
+                current = nullptr;
+            }
+        }
+
+        if (points.valid())
+            return points.release();
+
+        if (parts->getNumComponents() == 0)
+            return nullptr;
+
+        if (parts->getNumComponents() == 1)
+            return parts->getComponents().front().release();
+
+        return parts.release();
+    }
+
+    void applyAttribute(Feature* feature, const std::string& key, LazyValue& value)
+    {
+        if (!value.decoded)
+            value.decode();
+
+        switch (value.type)
+        {
+        case LazyValue::BOOL: feature->set(key, value.b); break;
+        case LazyValue::DOUBLE: feature->set(key, value.d); break;
+        case LazyValue::INT: feature->set(key, value.i); break;
+        case LazyValue::STRING: feature->set(key, value.s); break;
+        default: break;
+        }
+
+        // Special path for getting heights from our test dataset.
+        if (key == "other_tags" && value.type == LazyValue::STRING)
+        {
+            StringTokenizer tok("=>");
+            StringVector tized;
+            tok.tokenize(value.s, tized);
+            if (tized.size() == 3 && tized[0] == "height")
+            {
+                float height = as<float>(tized[2], FLT_MAX);
+                if (height != FLT_MAX)
+                {
+                    feature->set("height", height);
+                }
+            }
+        }
+    }
+
+    bool readTile(const char* data, std::size_t size, const TileKey& key, FeatureList& features, const AttributeNames* attributes)
+    {
+        features.clear();
+
+        const SpatialReference* srs = key.getProfile()->getSRS();
+        LayerIndex layer;
+
+        PBFReader tile(data, size);
+        while (tile.next())
+        {
+            if (tile.field() != 3)
+            {
+                tile.skip();
+                continue;
+            }
+
+            BufferView layerData;
+            if (!tile.readBytes(layerData.data, layerData.size) ||
+                !layer.read(layerData.data, layerData.size))
+            {
+                OE_WARN << LC << "Failed to parse mvt layer " << key.str() << std::endl;
+                return false;
+            }
+
+            std::string layerName = layer.name.str();
+            TileTransform xform(key, layer.extent);
+
+            for (auto& featureData : layer.features)
+            {
+                BufferView tags{ nullptr, 0u }, geom{ nullptr, 0u };
+                eGeomType geomType = MVT::Unknown;
+
+                PBFReader f(featureData.data, featureData.size);
+                while (f.next())
+                {
+                    switch (f.field())
+                    {
+                    case 2: f.readBytes(tags.data, tags.size); break;
+                    case 3: geomType = (eGeomType)f.readVarint(); break;
+                    case 4: f.readBytes(geom.data, geom.size); break;
+                    default: f.skip();
+                    }
+                }
+
+                if (geom.data == nullptr)
+                    continue;
+
+                osg::ref_ptr<Geometry> geometry = decodeGeometry(geom, geomType, xform);
+                if (!geometry.valid())
+                    continue;
+
+                // This is a bit of a hack, but if a point is outside of the extents we remove it.
+                // Lines and Polygons that extend outside of the tileset we keep though b/c we assume that they are just slightly going outside of the
+                // extent.  Should probably make this an option somewhere.
+                if (geomType == MVT::Point && !key.getExtent().contains(geometry->getBounds().center()))
+                    continue;
+
+                osg::ref_ptr<Feature> oeFeature = new Feature(geometry.get(), srs);
+
+                // Set the layer name as "mvt_layer" so we can filter it later
+                oeFeature->set("mvt_layer", layerName);
+
+                // Only the attributes the caller asked for get materialized.
+                PBFReader t(tags.data, tags.size);
+                while (t.more() && t.ok())
+                {
+                    std::uint32_t k = (std::uint32_t)t.readVarint();
+                    std::uint32_t v = (std::uint32_t)t.readVarint();
+                    if (k < layer.keys.size() && v < layer.values.size() && layer.wants(k, attributes))
+                    {
+                        applyAttribute(oeFeature.get(), layer.keyStrings[k], layer.values[v]);
+                    }
+                }
+
+                features.push_back(oeFeature.get());
+            }
+        }
+
+        if (!tile.ok())
+        {
+            OE_WARN << LC << "Failed to parse mvt " << key.str() << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool readTile(std::istream& in, const TileKey& key, FeatureList& features, const AttributeNames* attributes)
+    {
+        std::string buffer((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        // An uncompressed tile begins with its first layer (field 3, length-delimited);
+        // anything else is assumed to be zlib/gzip compressed.
+        if (!buffer.empty() && buffer[0] != 0x1A)
+        {
+            osg::ref_ptr< osgDB::BaseCompressor> compressor = osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
+            if (!compressor.valid())
+            {
+                return false;
+            }
+
+            std::istringstream compressed(buffer);
+            std::string value;
+            if (compressor->decompress(compressed, value))
+            {
+                buffer.swap(value);
+            }
+        }
+
+        return readTile(buffer.data(), buffer.size(), key, features, attributes);
+    }
+
 }} // namespace osgEarth::MVT
 
 //........................................................................
@@ -467,6 +924,7 @@ MVTFeatureSourceOptions::getConfig() const
 {
     Config conf = FeatureSource::Options::getConfig();
     conf.set("url", url());
+    conf.set("attributes", attributes());
     return conf;
 }
 
@@ -474,6 +932,25 @@ void
 MVTFeatureSourceOptions::fromConfig(const Config& conf)
 {
     conf.get("url", url());
+    conf.get("attributes", attributes());
+}
+
+namespace
+{
+    // Uncompressed blobs are decoded in place; compressed ones go through the stream path.
+    bool readTileBlob(const char* data, int dataLen, const TileKey& key, FeatureList& features, const MVT::AttributeNames* attributes)
+    {
+        if (dataLen > 0 && data[0] == 0x1A)
+        {
+            return MVT::readTile(data, (std::size_t)dataLen, key, features, attributes);
+        }
+        else
+        {
+            std::string dataBuffer(data, dataLen);
+            std::istringstream in(dataBuffer);
+            return MVT::readTile(in, key, features, attributes);
+        }
+    }
 }
 
 //........................................................................
@@ -501,6 +978,16 @@ MVTFeatureSource::openImplementation()
 
     setFeatureProfile(createFeatureProfile());
 
+    _attributes.clear();
+    if (options().attributes().isSet())
+    {
+        StringVector names;
+        StringTokenizer(options().attributes().get(), names, ", ", "", false, true);
+        _attributes.insert(names.begin(), names.end());
+        if (options().fidAttribute().isSet())
+            _attributes.insert(options().fidAttribute().get());
+    }
+
     return Status::NoError;
 }
 
@@ -565,9 +1052,7 @@ MVTFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
         // the pointer returned from _blob gets freed internally by sqlite, supposedly
         const char* data = (const char*)sqlite3_column_blob(select, 0);
         int dataLen = sqlite3_column_bytes(select, 0);
-        std::string dataBuffer(data, dataLen);
-        std::stringstream in(dataBuffer);
-        MVT::readTile(in, key, features);
+        readTileBlob(data, dataLen, key, features, _attributes.empty() ? nullptr : &_attributes);
     }
     else
     {
@@ -655,8 +1140,6 @@ MVTFeatureSource::iterateTiles(int zoomLevel, int limit, int offset, const GeoEx
         // the pointer returned from _blob gets freed internally by sqlite, supposedly
         const char* data = (const char*)sqlite3_column_blob(select, 3);
         int dataLen = sqlite3_column_bytes(select, 3);
-        std::string dataBuffer(data, dataLen);
-        std::stringstream in(dataBuffer);
 
         FeatureList features;
 
@@ -673,7 +1156,7 @@ MVTFeatureSource::iterateTiles(int zoomLevel, int limit, int offset, const GeoEx
         }
 
 
-        MVT::readTile(in, key, features);
+        readTileBlob(data, dataLen, key, features, _attributes.empty() ? nullptr : &_attributes);
 
         // apply filters before returning.
         applyFilters(features, key.getExtent());
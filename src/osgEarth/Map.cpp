@@ -19,11 +19,17 @@
 #include <osgEarth/Map>
 #include <osgEarth/MapModelChange>
 #include <osgEarth/Registry>
+#include <osg/Timer>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
 
 using namespace osgEarth;
 
 #define LC "[Map] "
 
+#define ARENA_OPEN_LAYERS "oe.map.open"
+
 //...................................................................
 
 Map::LayerCB::LayerCB(Map* map) : _map(map) { }
@@ -32,7 +38,15 @@ void Map::LayerCB::onOpen(Layer* layer)
 {
     osg::ref_ptr<Map> map;
     if (_map.lock(map))
+    {
+        // openLayers() notifies for these once they are all open
+        {
+            Threading::ScopedMutexLock lock(map->_openingLayers);
+            if (map->_openingLayers.find(layer) != map->_openingLayers.end())
+                return;
+        }
         map->notifyOnLayerOpenOrClose(layer);
+    }
 }
 
 void Map::LayerCB::onClose(Layer* layer)
@@ -630,11 +644,11 @@ Map::addLayers(const LayerVector& layers)
             continue;
 
         layer->setReadOptions(getReadOptions());
-
-        // open, but don't call addedToMap(layer) yet.
-        layer->open();
     }
 
+    // open, but don't call addedToMap(layer) yet.
+    openLayers(layers);
+
     unsigned firstIndex;
     unsigned count = 0;
     int newRevision;
@@ -686,6 +700,157 @@ Map::addLayers(const LayerVector& layers)
     }
 }
 
+namespace
+{
+    // Collects the indices of the layers in "layers" that "layer" references
+    // by name. A LayerReference to an external layer is stored in the
+    // layer's options as a simple key/value pair holding that layer's name.
+    void findDependencies(
+        const Layer* layer,
+        const LayerVector& layers,
+        std::vector<unsigned>& output)
+    {
+        Config conf = layer->getConfig();
+        for (ConfigSet::const_iterator c = conf.children().begin(); c != conf.children().end(); ++c)
+        {
+            if (c->key() == "name" || c->value().empty() || !c->children().empty())
+                continue;
+
+            for (unsigned j = 0; j < layers.size(); ++j)
+            {
+                if (layers[j].get() != layer && layers[j]->getName() == c->value())
+                    output.push_back(j);
+            }
+        }
+        std::sort(output.begin(), output.end());
+        output.erase(std::unique(output.begin(), output.end()), output.end());
+    }
+
+    // Formats a duration without touching the flags of the shared notify stream
+    std::string formatMillis(double ms)
+    {
+        std::ostringstream buf;
+        buf << std::fixed << std::setprecision(1) << ms << " ms";
+        return buf.str();
+    }
+}
+
+void
+Map::openLayers(const LayerVector& layers)
+{
+    LayerVector toOpen;
+    for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+    {
+        if (i->valid() && !i->get()->isOpen())
+            toOpen.push_back(*i);
+    }
+
+    if (toOpen.empty())
+        return;
+
+    const unsigned count = toOpen.size();
+
+    // Build the dependency graph.
+    std::vector<std::vector<unsigned> > dependents(count);
+    std::vector<unsigned> numDependencies(count, 0u);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        std::vector<unsigned> dependencies;
+        findDependencies(toOpen[i].get(), toOpen, dependencies);
+        for (unsigned d = 0; d < dependencies.size(); ++d)
+            dependents[dependencies[d]].push_back(i);
+        numDependencies[i] = dependencies.size();
+    }
+
+    // Defer the open notifications so we can issue them in order.
+    {
+        Threading::ScopedMutexLock lock(_openingLayers);
+        for (unsigned i = 0; i < count; ++i)
+            _openingLayers.insert(toOpen[i].get());
+    }
+
+    osg::Timer* timer = osg::Timer::instance();
+    osg::Timer_t start = timer->tick();
+    std::vector<double> times(count, 0.0);
+    std::vector<bool> done(count, false);
+
+    auto openLayer = [&](unsigned i)
+    {
+        osg::Timer_t t0 = timer->tick();
+        toOpen[i]->open();
+        times[i] = timer->delta_m(t0, timer->tick());
+    };
+
+    // Open the layers in waves. Each wave holds the layers whose
+    // dependencies are all open; the calling thread opens the first one.
+    std::vector<unsigned> wave;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if (numDependencies[i] == 0u)
+            wave.push_back(i);
+    }
+
+    JobArena* arena = JobArena::get(ARENA_OPEN_LAYERS);
+
+    while (!wave.empty())
+    {
+        JobGroup group;
+        for (unsigned w = 1; w < wave.size(); ++w)
+        {
+            unsigned i = wave[w];
+            Job job(arena, &group);
+            job.dispatch([&openLayer, i](Cancelable*) { openLayer(i); });
+        }
+        openLayer(wave[0]);
+        group.join();
+
+        std::vector<unsigned> next;
+        for (unsigned w = 0; w < wave.size(); ++w)
+        {
+            done[wave[w]] = true;
+            const std::vector<unsigned>& d = dependents[wave[w]];
+            for (unsigned j = 0; j < d.size(); ++j)
+            {
+                if (--numDependencies[d[j]] == 0u)
+                    next.push_back(d[j]);
+            }
+        }
+        std::sort(next.begin(), next.end());
+        wave.swap(next);
+    }
+
+    // Whatever is left references itself in a cycle; open it in order.
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if (!done[i])
+            openLayer(i);
+    }
+
+    {
+        Threading::ScopedMutexLock lock(_openingLayers);
+        for (unsigned i = 0; i < count; ++i)
+            _openingLayers.erase(toOpen[i].get());
+    }
+
+    // Now notify, in order, for the layers that were already in the map.
+    for (unsigned i = 0; i < count; ++i)
+    {
+        Layer* layer = toOpen[i].get();
+
+        OE_INFO << LC << "Opened layer \"" << layer->getName() << "\" in "
+            << formatMillis(times[i])
+            << (layer->getStatus().isError() ? " (failed)" : "") << std::endl;
+
+        if (layer->isOpen() && getIndexOfLayer(layer) != getNumLayers())
+        {
+            notifyOnLayerOpenOrClose(layer);
+        }
+    }
+
+    OE_INFO << LC << "Opened " << count << " layers in "
+        << formatMillis(timer->delta_m(start, timer->tick())) << std::endl;
+}
+
 void
 Map::installLayerCallbacks(Layer* layer)
 {
@@ -807,19 +807,19 @@ void
 MapNode::openMapLayers()
 {
     LayerVector layers;
-    _map->getLayers(layers);
+    _map->getLayers(layers, [](const Layer* layer) {
+        return !layer->getStatus().isError();
+    });
+
+    // open concurrently; the map notifies its callbacks in layer order
+    _map->openLayers(layers);
 
     for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
     {
         Layer* layer = i->get();
-
-        if (!layer->getStatus().isError())
+        if (layer->getStatus().isError())
         {
-            const Status& status = layer->open();
-            if (status.isError())
-            {
-                OE_WARN << LC << "Failed to open layer \"" << layer->getName() << "\" ... " << status.message() << std::endl;
-            }
+            OE_WARN << LC << "Failed to open layer \"" << layer->getName() << "\" ... " << layer->getStatus().message() << std::endl;
         }
     }
 }
@@ -26,6 +26,8 @@
 
 #include <osgDB/WriteFile>
 
+#include <unordered_set>
+
 using namespace osgEarth;
 using namespace MapBoxGL;
 
@@ -34,6 +36,7 @@ using namespace MapBoxGL;
 
 REGISTER_OSGEARTH_LAYER(mapboxglimage, MapBoxGLImageLayer);
 OE_LAYER_PROPERTY_IMPL(MapBoxGLImageLayer, URI, URL, url);
+OE_LAYER_PROPERTY_IMPL(MapBoxGLImageLayer, unsigned, TileCacheSize, tileCacheSize);
 
 void getIfSet(const Json::Value& object, const std::string& member, PropertyValue<float>& value)
 {
@@ -607,6 +610,7 @@ MapBoxGL::StyleSheet MapBoxGL::StyleSheet::load(const URI& location, const osgDB
             if (layerJson.isMember("filter"))
             {
                layer.filter()._filter = layerJson["filter"];
+               layer.filter().compile();
             }
 
             styleSheet._layers.emplace_back(std::move(layer));
@@ -662,13 +666,16 @@ MapBoxGLImageLayer::Options::getConfig() const
 {
     Config conf = ImageLayer::Options::getConfig();
     conf.set("url", _url);
+    conf.set("tile_cache_size", _tileCacheSize);
     return conf;
 }
 
 void
 MapBoxGLImageLayer::Options::fromConfig(const Config& conf)
 {
+    _tileCacheSize.init(128u);
     conf.get("url", url());
+    conf.get("tile_cache_size", tileCacheSize());
 }
 
 void
@@ -692,6 +699,9 @@ MapBoxGLImageLayer::openImplementation()
 
     _styleSheet = MapBoxGL::StyleSheet::load(getURL(), getReadOptions());
 
+    _sourceTiles.clear();
+    _sourceTiles.setMaxSize(options().tileCacheSize().get());
+
     return Status::NoError;
 }
 
@@ -710,338 +720,298 @@ MapBoxGLImageLayer::removedFromMap(const Map* map)
     ImageLayer::removedFromMap(map);
 }
 
-struct LayeredFeatures
-{
-    std::map< std::string, FeatureList > features;
-};
-
-
-bool evalFilter(const Json::Value& filter, osgEarth::Feature* feature)
+// https://docs.mapbox.com/mapbox-gl-js/style-spec/other/#other-filter
+struct MapBoxGL::StyleSheet::FilterExpression::Node
 {
-    if (!filter.isArray())
+    enum Op
     {
-        return false;
-    }
-
-    auto op = osgEarth::trim(filter[0u].asString());
-
-    // https://docs.mapbox.com/mapbox-gl-js/style-spec/other/#other-filter
-
-    // Comparison filters
-    if (op == "all")
+        ALL, ANY, NONE,
+        HAS, NOT_HAS,
+        EQ, NE, GT, GE, LT, LE,
+        IN, NOT_IN,
+        PASS, FAIL
+    };
+
+    // A literal operand, typed the way the JSON declared it
+    struct Literal
     {
-        bool finalResult = true;
-        for (unsigned int i = 1; i < filter.size(); ++i)
-        {
-            finalResult &= evalFilter(filter[i], feature);
-            // Early out.
-            if (!finalResult)
-            {
-                return false;
-            }
-        }
-        return finalResult;
-    }
-    else if (op == "any")
+        enum Type { STRING, BOOL, DOUBLE, INT } type;
+        std::string stringValue;
+        double doubleValue = 0.0;
+        long long intValue = 0;
+        bool boolValue = false;
+    };
+
+    Op op = PASS;
+    std::string key;      // lower-cased, the way Feature stores attributes
+    bool isType = false;  // key is "$type"
+    std::vector<Literal> values;
+    std::unordered_set<std::string> strings; // string members of an in/!in set
+    std::vector<Node> children;
+
+    static bool compileLiteral(const Json::Value& value, Literal& out)
     {
-        bool finalResult = false;
-        for (unsigned int i = 1; i < filter.size(); ++i)
-        {
-            finalResult |= evalFilter(filter[i], feature);
-            // Early out.
-            if (finalResult)
-            {
-                return true;
-            }
+        if (value.isString()) {
+            out.type = Literal::STRING;
+            out.stringValue = value.asString();
         }
-        return finalResult;
-    }
-    else if (op == "none")
-    {
-        bool finalResult = false;
-        for (unsigned int i = 1; i < filter.size(); ++i)
-        {
-            finalResult &= !evalFilter(filter[i], feature);
-            // Early out.
-            if (finalResult)
-            {
-                return false;
-            }
+        else if (value.isBool()) {
+            out.type = Literal::BOOL;
+            out.boolValue = value.asBool();
         }
-        return finalResult;
-    }
-    // Existential filters
-    else if (op == "has")
-    {
-        std::string key = filter[1u].asString();
-        return feature->hasAttr(key);
-    }
-    else if (op == "!has")
-    {
-        std::string key = filter[1u].asString();
-        return !feature->hasAttr(key);
+        else if (value.isDouble()) {
+            out.type = Literal::DOUBLE;
+            out.doubleValue = value.asDouble();
+        }
+        else if (value.isIntegral()) {
+            out.type = Literal::INT;
+            out.intValue = value.asInt();
+        }
+        else return false;
+        return true;
     }
 
-    // Comparison filters
-    else if (op == "==")
+    void compile(const Json::Value& filter)
     {
-        std::string key = filter[1u].asString();
-        const Json::Value& value = filter[2u];
+        op = filter.isArray() ? PASS : FAIL;
+        if (!filter.isArray() || filter.size() == 0)
+            return;
 
-        if (!feature->hasAttr(key)) return false;
+        std::string name = osgEarth::trim(filter[0u].asString());
 
-        if (key == "$type")
-        {
-            std::string typeString;
-            if (feature->getGeometry()->getType() == Geometry::Type::TYPE_LINESTRING)
-            {
-                typeString = "LineString";
-            }
-            else if (feature->getGeometry()->getType() == Geometry::Type::TYPE_POLYGON)
-            {
-                typeString = "Polygon";
-            }
-            else if (feature->getGeometry()->getType() == Geometry::Type::TYPE_POINT || feature->getGeometry()->getType() == Geometry::Type::TYPE_POINTSET)
-            {
-                typeString = "Point";
-            }
-            return typeString == value.asString();
-        }
-        else if (value.isString())
-        {
-            return feature->getString(key) == value.asString();
-        }
-        else if (value.isBool())
-        {
-            return feature->getBool(key) == value.asBool();
-        }
-        else if (value.isDouble())
-        {
-            return feature->getDouble(key) == value.asDouble();
-        }
-        else if (value.isIntegral())
+        if (name == "all" || name == "any" || name == "none")
         {
-            return feature->getInt(key) == value.asInt();
+            op = name == "all" ? ALL : name == "any" ? ANY : NONE;
+            children.resize(filter.size() - 1);
+            for (unsigned int i = 1; i < filter.size(); ++i)
+                children[i - 1].compile(filter[i]);
+            return;
         }
-        return false;
-    }
-    else if (op == "!=")
-    {
-        std::string key = filter[1u].asString();
-        const Json::Value& value = filter[2u];
 
-        if (!feature->hasAttr(key)) return false;
+        static const std::unordered_map<std::string, Op> ops = {
+            { "has", HAS }, { "!has", NOT_HAS },
+            { "==", EQ }, { "!=", NE }, { ">", GT }, { ">=", GE }, { "<", LT }, { "<=", LE },
+            { "in", IN }, { "!in", NOT_IN }
+        };
 
-        if (value.isString())
-        {
-            return feature->getString(key) != value.asString();
-        }
-        else if (value.isBool())
-        {
-            return feature->getBool(key) != value.asBool();
-        }
-        else if (value.isDouble())
-        {
-            return feature->getDouble(key) != value.asDouble();
-        }
-        else if (value.isIntegral())
-        {
-            return feature->getInt(key) != value.asInt();
-        }
-        return false;
-    }
-    else if (op == ">")
-    {
-        std::string key = filter[1u].asString();
-        const Json::Value& value = filter[2u];
+        auto i = ops.find(name);
+        if (i == ops.end() || filter.size() < 2)
+            return;
 
-        if (!feature->hasAttr(key)) return false;
+        op = i->second;
+        key = filter[1u].asString();
+        isType = (key == "$type");
+        key = osgEarth::toLower(key);
 
-        if (value.isString())
-        {
-            return feature->getString(key) > value.asString();
-        }
-        else if (value.isBool())
+        if (op == HAS || op == NOT_HAS)
+            return;
+
+        for (unsigned int v = 2; v < filter.size(); ++v)
         {
-            return feature->getBool(key) > value.asBool();
+            Literal literal;
+            if (!compileLiteral(filter[v], literal))
+                continue;
+
+            if ((op == IN || op == NOT_IN) && literal.type == Literal::STRING)
+                strings.insert(literal.stringValue);
+            else
+                values.push_back(std::move(literal));
         }
-        else if (value.isDouble())
+    }
+
+    template<typename T>
+    static bool compare(Op op, const T& lhs, const T& rhs)
+    {
+        switch (op)
         {
-            return feature->getDouble(key) > value.asDouble();
+        case EQ: return lhs == rhs;
+        case NE: return lhs != rhs;
+        case GT: return lhs > rhs;
+        case GE: return lhs >= rhs;
+        case LT: return lhs < rhs;
+        case LE: return lhs <= rhs;
+        default: return false;
         }
-        else if (value.isIntegral())
+    }
+
+    static bool compare(Op op, const AttributeValue& attr, const Literal& literal)
+    {
+        switch (literal.type)
         {
-            return feature->getInt(key) > value.asInt();
+        case Literal::STRING: return compare(op, attr.getString(), literal.stringValue);
+        case Literal::BOOL:   return compare(op, attr.getBool(), literal.boolValue);
+        case Literal::DOUBLE: return compare(op, attr.getDouble(), literal.doubleValue);
+        case Literal::INT:    return compare(op, attr.getInt(), literal.intValue);
         }
         return false;
     }
-    else if (op == ">=")
-    {
-        std::string key = filter[1u].asString();
-        const Json::Value& value = filter[2u];
 
-        if (!feature->hasAttr(key)) return false;
-
-        if (value.isString())
-        {
-            return feature->getString(key) >= value.asString();
-        }
-        else if (value.isBool())
-        {
-            return feature->getBool(key) >= value.asBool();
-        }
-        else if (value.isDouble())
-        {
-            return feature->getDouble(key) >= value.asDouble();
-        }
-        else if (value.isIntegral())
+    static const char* typeName(const Feature* feature)
+    {
+        const Geometry* geom = feature->getGeometry();
+        if (!geom)
+            return "";
+        switch (geom->getComponentType())
         {
-            return feature->getInt(key) >= value.asInt();
+        case Geometry::TYPE_POINT:
+        case Geometry::TYPE_POINTSET: return "Point";
+        case Geometry::TYPE_LINESTRING: return "LineString";
+        case Geometry::TYPE_POLYGON: return "Polygon";
+        default: return "";
         }
-        return false;
     }
-    else if (op == "<")
+
+    bool evaluate(const Feature* feature) const
     {
-        std::string key = filter[1u].asString();
-        const Json::Value& value = filter[2u];
+        switch (op)
+        {
+        case ALL:
+            for (auto& child : children)
+                if (!child.evaluate(feature))
+                    return false;
+            return true;
 
-        if (!feature->hasAttr(key)) return false;
+        case ANY:
+            for (auto& child : children)
+                if (child.evaluate(feature))
+                    return true;
+            return false;
 
-        if (value.isString())
-        {
-            return feature->getString(key) < value.asString();
+        case NONE:
+            for (auto& child : children)
+                if (child.evaluate(feature))
+                    return false;
+            return true;
+
+        case PASS:
+            return true;
+
+        case FAIL:
+            return false;
+
+        default:
+            break;
         }
-        else if (value.isBool())
+
+        // resolve the attribute once for the whole comparison
+        AttributeValue typeValue;
+        const AttributeValue* attr = nullptr;
+        if (isType)
         {
-            return feature->getBool(key) < value.asBool();
+            typeValue.first = ATTRTYPE_STRING;
+            typeValue.second.stringValue = typeName(feature);
+            typeValue.second.set = true;
+            attr = &typeValue;
         }
-        else if (value.isDouble())
+        else
         {
-            return feature->getDouble(key) < value.asDouble();
+            auto i = feature->getAttrs().find(key);
+            if (i != feature->getAttrs().end())
+                attr = &i->second;
         }
-        else if (value.isIntegral())
+
+        switch (op)
         {
-            return feature->getInt(key) < value.asInt();
-        }
-        return false;
-    }
-    else if (op == "<=")
-    {
-        std::string key = filter[1u].asString();
-        const Json::Value& value = filter[2u];
+        case HAS:
+            return attr != nullptr;
 
-        if (!feature->hasAttr(key)) return false;
+        case NOT_HAS:
+            return attr == nullptr;
 
-        if (value.isString())
+        case IN:
+        case NOT_IN:
         {
-            return feature->getString(key) <= value.asString();
-        }
-        else if (value.isBool())
-        {
-            return feature->getBool(key) <= value.asBool();
-        }
-        else if (value.isDouble())
-        {
-            return feature->getDouble(key) <= value.asDouble();
+            if (!attr)
+                return op == NOT_IN;
+
+            bool found = !strings.empty() && strings.count(attr->getString()) > 0;
+            for (unsigned int v = 0; !found && v < values.size(); ++v)
+                found = compare(EQ, *attr, values[v]);
+
+            return op == IN ? found : !found;
         }
-        else if (value.isIntegral())
-        {
-            return feature->getInt(key) <= value.asInt();
+
+        default:
+            return attr && !values.empty() && compare(op, *attr, values.front());
         }
-        return false;
     }
-    // Set membership filters
-    else if (op == "in")
+};
+
+void
+MapBoxGL::StyleSheet::FilterExpression::compile()
+{
+    if (_filter.empty())
+    {
+        _compiled = nullptr;
+    }
+    else
     {
-        std::string key = filter[1u].asString();
+        auto node = std::make_shared<Node>();
+        node->compile(_filter);
+        _compiled = node;
+    }
+}
 
-        if (!feature->hasAttr(key)) return false;
+bool
+MapBoxGL::StyleSheet::FilterExpression::evaluate(const Feature* feature) const
+{
+    return !_compiled || _compiled->evaluate(feature);
+}
 
-        for (unsigned int i = 2; i < filter.size(); ++i)
-        {
-            const Json::Value& value = filter[i];
+MapBoxGLImageLayer::LayeredFeaturesPtr
+MapBoxGLImageLayer::getSourceTile(const std::string& sourceName, FeatureSource* featureSource, const TileKey& key, ProgressCallback* progress) const
+{
+    // Walk up from the requested key until some ancestor has data. Every
+    // key on the way is cached, empty or not, so the children of an
+    // underzoomed tile share a single read of their ancestor.
+    std::vector<std::string> misses;
+    LayeredFeaturesPtr result;
 
-            if (value.isString())
-            {
-                if (feature->getString(key) == value.asString())
-                {
-                    return true;
-                }
-            }
-            else if (value.isBool())
-            {
-                if (feature->getBool(key) == value.asBool())
-                {
-                    return true;
-                }
-            }
-            else if (value.isDouble())
-            {
-                if (feature->getDouble(key) == value.asDouble())
-                {
-                    return true;
-                }
-            }
-            else if (value.isIntegral())
-            {
-                if (feature->getInt(key) == value.asInt())
-                {
-                    return true;
-                }
-            }
-        }
-        return false;
-    }
-    else if (op == "!in")
+    for (TileKey queryKey = key; queryKey.valid(); queryKey = queryKey.createParentKey())
     {
-        std::string key = filter[1u].asString();
-
-        std::string featureValue = feature->getString(key);
+        std::string cacheKey = sourceName + "/" + queryKey.str();
 
-        if (!feature->hasAttr(key))
+        LRUCache< std::string, LayeredFeaturesPtr >::Record record;
+        if (_sourceTiles.get(cacheKey, record))
         {
-            return true;
+            result = record.value();
         }
-
-        for (unsigned int i = 2; i < filter.size(); ++i)
+        else
         {
-            const Json::Value& value = filter[i];
+            FeatureList allFeatures;
 
-            if (value.isString())
+            osg::ref_ptr< FeatureCursor > cursor = featureSource->createFeatureCursor(queryKey, progress);
+            if (progress && progress->isCanceled())
             {
-                if (feature->getString(key) == value.asString())
-                {
-                    return false;
-                }
-            }
-            else if (value.isBool())
-            {
-                if (feature->getBool(key) == value.asBool())
-                {
-                    return false;
-                }
+                return nullptr;
             }
-            else if (value.isDouble())
+
+            if (cursor.valid())
             {
-                if (feature->getDouble(key) == value.asDouble())
-                {
-                    return false;
-                }
+                cursor->fill(allFeatures);
             }
-            else if (value.isIntegral())
+
+            auto layered = std::make_shared<LayeredFeatures>();
+            const SpatialReference* srs = key.getExtent().getSRS();
+            for (auto& f : allFeatures)
             {
-                if (feature->getInt(key) == value.asInt())
-                {
-                    return false;
-                }
+                // Transform once here rather than in every tile that renders it
+                f->transform(srs);
+                layered->features[f->getString("mvt_layer")].push_back(f.get());
             }
+
+            result = layered;
+            _sourceTiles.insert(cacheKey, result);
         }
-        return true;
+
+        if (!result->features.empty())
+            break;
     }
 
-    return true;
+    return result;
 }
 
+
 GeoImage
 MapBoxGLImageLayer::createImageImplementation(const TileKey& key, ProgressCallback* progress) const
 {
@@ -1074,7 +1044,7 @@ MapBoxGLImageLayer::createImageImplementation(const TileKey& key, ProgressCallba
     }
     osg::ref_ptr< Session > session = new Session(_map.get(), styleSheet.get(), nullptr, nullptr);
 
-    std::map< std::string, LayeredFeatures > sourceToFeatures;
+    std::unordered_map< std::string, LayeredFeaturesPtr > sourceToFeatures;
 
     for (auto& layer : _styleSheet.layers())
     {
@@ -1102,59 +1072,17 @@ MapBoxGLImageLayer::createImageImplementation(const TileKey& key, ProgressCallba
                 continue;
             }
 
-            // TODO:  Maybe you don't need to zoom up for each layer, only once per feature source.
-
-            LayeredFeatures layeredFeatures;
-            // See if we already got the features for this tile for this source
+            // Features for this source come from the shared tile cache, so the
+            // neighbors and children of this tile can reuse the same read.
+            LayeredFeaturesPtr layeredFeatures;
             auto featuresItr = sourceToFeatures.find(layer.source());
             if (featuresItr == sourceToFeatures.end())
             {
-                FeatureList allFeatures;
-                TileKey queryKey = key;
-                while (allFeatures.empty() && queryKey.valid())
+                layeredFeatures = getSourceTile(layer.source(), featureSource.get(), key, progress);
+                if (progress && progress->isCanceled())
                 {
-                    // Get all the features from the feature source as well as it's neighbors so we can render labels and icons nicely along the edges
-                    // TODO:  This is having issues at higher zoom levels and not returning all the features
-                    /*
-                    double buffer = 0.1;
-                    Distance bufferDistance(buffer * queryKey.getExtent().width(), queryKey.getProfile()->getSRS()->getUnits());
-                    osg::ref_ptr< FeatureCursor > cursor = featureSource->createFeatureCursor(
-                        queryKey,
-                        bufferDistance,
-                        nullptr, nullptr, progress);
-                        */
-
-                    // Just get the features for this tile.
-                    osg::ref_ptr< FeatureCursor > cursor = featureSource->createFeatureCursor(queryKey, progress);
-                    if (progress && progress->isCanceled())
-                    {
-                        return GeoImage::INVALID;
-                    }
-
-
-                    if (cursor.valid())
-                    {
-                        cursor->fill(allFeatures);
-                    }
-
-                    if (allFeatures.empty())
-                    {
-                        queryKey = queryKey.createParentKey();           
-                        /*
-                        if (queryKey.getLevelOfDetail() < featureSource->getFeatureProfile()->getMaxLevel())
-                        {
-                            std::cout << "Not underzooming " << key.str() << " to " << queryKey.str() << " with a max level of " << featureSource->getFeatureProfile()->getMaxLevel() << std::endl;
-                            break;
-                        }
-                        */
-                    }
-                }
-
-                for (auto& f : allFeatures)
-                {
-                    layeredFeatures.features[f->getString("mvt_layer")].push_back(f.get());
+                    return GeoImage::INVALID;
                 }
-
                 sourceToFeatures[layer.source()] = layeredFeatures;
             }
             else
@@ -1162,25 +1090,25 @@ MapBoxGLImageLayer::createImageImplementation(const TileKey& key, ProgressCallba
                 layeredFeatures = featuresItr->second;
             }
 
+            if (!layeredFeatures)
+            {
+                continue;
+            }
 
-            if (layeredFeatures.features.find(layer.sourceLayer()) != layeredFeatures.features.end())
-            {                
-                // Run any filters on the layer.
+            auto layerFeatures = layeredFeatures->features.find(layer.sourceLayer());
+            if (layerFeatures != layeredFeatures->features.end())
+            {
+                // Run any filters on the layer. The rasterizer resamples and
+                // transforms geometry in place, so render copies of the cached
+                // features, never the shared ones.
                 FeatureList features;
-                if (!layer.filter()._filter.empty())
+                for (auto& f : layerFeatures->second)
                 {
-                    for (auto& f : layeredFeatures.features[layer.sourceLayer()])
+                    if (layer.filter().evaluate(f.get()))
                     {
-                        if (evalFilter(layer.filter()._filter, f.get()))
-                        {
-                            features.push_back(f.get());
-                        }
+                        features.push_back(new Feature(*f, osg::CopyOp::DEEP_COPY_ALL));
                     }
                 }
-                else
-                {
-                    features = layeredFeatures.features[layer.sourceLayer()];
-                }
 
                 if (features.empty())
                 {
@@ -24,7 +24,9 @@
 
 #include <osgEarth/Registry>
 #include <osgEarth/StringUtils>
+#include <osgEarth/Threading>
 #include <list>
+#include <unordered_set>
 #include <cpl_error.h>
 #include <ogr_api.h>
 #include <gdal.h>
@@ -48,6 +50,112 @@ namespace osgEarth { namespace OGR
         return h;
     }
 
+    /**
+     * Read-only dataset handles leased to feature cursors, so that
+     * querying a source tile by tile doesn't re-open it every time.
+     * A lease is used by one cursor at a time, so no GDAL locking is needed.
+     */
+    class DatasetPool
+    {
+    public:
+        DatasetPool(const std::string& source, const std::string& driver, const std::string& layer, unsigned maxIdle) :
+            _source(source),
+            _driver(driver),
+            _layer(layer),
+            _maxIdle(maxIdle),
+            _mutex("OE.OGR.DatasetPool")
+        {
+            //nop
+        }
+
+        ~DatasetPool()
+        {
+            clear();
+        }
+
+        //! Leases an open dataset and layer, opening a new one if none are idle.
+        bool acquire(void*& ds, void*& layer)
+        {
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                if (!_idle.empty())
+                {
+                    ds = _idle.back().first;
+                    layer = _idle.back().second;
+                    _idle.pop_back();
+                    _leased.insert(ds);
+                    return true;
+                }
+            }
+
+            const char* driverList[2] = { _driver.c_str(), nullptr };
+
+            ds = GDALOpenEx(
+                _source.c_str(),
+                GDAL_OF_VECTOR | GDAL_OF_READONLY,
+                _driver.empty() ? nullptr : driverList,
+                nullptr,
+                nullptr);
+
+            layer = ds ? openLayer((OGRDataSourceH)ds, _layer) : nullptr;
+
+            if (!layer)
+            {
+                if (ds)
+                    OGRReleaseDataSource((OGRDataSourceH)ds);
+                ds = nullptr;
+                return false;
+            }
+
+            Threading::ScopedMutexLock lock(_mutex);
+            _leased.insert(ds);
+            return true;
+        }
+
+        //! Returns a leased handle to the pool after clearing its query state.
+        //! Handles leased before the last clear() are closed instead.
+        void release(void* ds, void* layer)
+        {
+            OGR_L_SetSpatialFilter((OGRLayerH)layer, nullptr);
+            OGR_L_SetAttributeFilter((OGRLayerH)layer, nullptr);
+            OGR_L_ResetReading((OGRLayerH)layer);
+
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                if (_leased.erase(ds) > 0 && _idle.size() < _maxIdle)
+                {
+                    _idle.emplace_back(ds, layer);
+                    return;
+                }
+            }
+
+            OGRReleaseDataSource((OGRDataSourceH)ds);
+        }
+
+        //! Closes all idle handles. Call this when the underlying data changes.
+        void clear()
+        {
+            std::vector<std::pair<void*, void*>> idle;
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                _leased.clear();
+                idle.swap(_idle);
+            }
+
+            for (auto& handles : idle)
+                OGRReleaseDataSource((OGRDataSourceH)handles.first);
+        }
+
+    private:
+        std::string _source;
+        std::string _driver;
+        std::string _layer;
+        unsigned _maxIdle;
+        Threading::Mutex _mutex;
+        std::vector<std::pair<void*, void*>> _idle;
+        std::unordered_set<void*> _leased;
+    };
+
     /**
      * Determine whether a point is valid or not.  Some shapefiles can have points that are ridiculously big, which are really invalid data
      * but shapefiles have no way of marking the data as invalid.  So instead we check for really large values that are indiciative of something being wrong.
@@ -94,7 +202,8 @@ OGR::OGRFeatureCursor::OGRFeatureCursor(
     const FeatureFilterChain* filters,
     bool rewindPolygons,
     unsigned chunkSize,
-    ProgressCallback* progress) :
+    ProgressCallback* progress,
+    std::shared_ptr<DatasetPool> pool) :
 
 FeatureCursor     ( progress ),
 _source           ( source ),
@@ -108,7 +217,8 @@ _nextHandleToQueue( 0L ),
 _resultSetEndReached(false),
 _profile          ( profile ),
 _filters          ( filters ),
-_rewindPolygons   ( rewindPolygons )
+_rewindPolygons   ( rewindPolygons ),
+_pool             ( pool )
 {
     std::string expr;
     std::string from = OGR_FD_GetName(OGR_L_GetLayerDefn(_layerHandle));
@@ -232,7 +342,12 @@ OGR::OGRFeatureCursor::~OGRFeatureCursor()
         OGR_G_DestroyGeometry( _spatialFilter );
 
     if ( _dsHandle )
-        OGRReleaseDataSource( _dsHandle );
+    {
+        if ( _pool )
+            _pool->release( _dsHandle, _layerHandle );
+        else
+            OGRReleaseDataSource( _dsHandle );
+    }
 }
 
 bool
@@ -364,12 +479,15 @@ OGRFeatureSource::Options::getConfig() const
     conf.set("geometry_url", _geometryUrl);
     conf.set("layer", _layer);
     conf.set("query", _query);
+    conf.set("pool_size", _poolSize);
     return conf;
 }
 
 void
 OGRFeatureSource::Options::fromConfig(const Config& conf)
 {
+    _poolSize.init(Threading::getConcurrency());
+
     conf.get("url", _url);
     conf.get("connection", _connection);
     conf.get("ogr_driver", _ogrDriver);
@@ -379,6 +497,7 @@ OGRFeatureSource::Options::fromConfig(const Config& conf)
     conf.get("geometry_url", _geometryUrl);
     conf.get("layer", _layer);
     conf.get("query", _query);
+    conf.get("pool_size", _poolSize);
 }
 
 //........................................................................
@@ -404,11 +523,18 @@ OGRFeatureSource::init()
     _needsSync = false;
     _writable = false;
     _geometryType = Geometry::TYPE_UNKNOWN;
+    _pool = nullptr;
 }
 
 Status
 OGRFeatureSource::closeImplementation()
 {
+    if (_pool)
+    {
+        _pool->clear();
+        _pool = nullptr;
+    }
+
     if (_layerHandle)
     {
         if (_needsSync)
@@ -635,6 +761,16 @@ OGRFeatureSource::openImplementation()
         // establish the feature schema:
         initSchema();
 
+        // cursors lease read handles from this pool instead of opening the source each time.
+        if (options().poolSize() > 0u)
+        {
+            _pool = std::make_shared<OGR::DatasetPool>(
+                _source,
+                driverName,
+                options().layer().get(),
+                options().poolSize().get());
+        }
+
         // establish the geometry type for this feature layer:
         OGRwkbGeometryType wkbType = OGR_FD_GetGeomType(OGR_L_GetLayerDefn(_layerHandle));
         if (
@@ -804,6 +940,10 @@ OGRFeatureSource::buildSpatialIndex()
        std::string bufStr;
        bufStr = buf.str();
        OGR_DS_ExecuteSQL(_dsHandle, bufStr.c_str(), 0L, 0L);
+
+       // pooled handles were opened before the index existed
+       if (_pool)
+           _pool->clear();
    }
 }
 
@@ -822,25 +962,32 @@ OGRFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
         OGRDataSourceH dsHandle = 0L;
         OGRLayerH layerHandle = 0L;
 
-        const char* openOptions[2] = {
-            "OGR_GPKG_INTEGRITY_CHECK=NO",
-            nullptr
-        };
-
-        dsHandle = GDALOpenEx(
-            _source.c_str(),
-            GDAL_OF_VECTOR | GDAL_OF_READONLY,
-            nullptr,
-            nullptr, //openOptions,
-            nullptr);
-
-        // open the handles safely:
-        // Each cursor requires its own DS handle so that multi-threaded access will work.
-        // The cursor impl will dispose of the new DS handle.
-        //dsHandle = OGROpenShared(_source.c_str(), 0, &_ogrDriverHandle);
-        if (dsHandle)
+        if (_pool)
         {
-            layerHandle = OGR::openLayer(dsHandle, options().layer().get());
+            // lease a handle; the cursor returns it to the pool when it's done.
+            void* ds = nullptr;
+            void* layer = nullptr;
+            if (_pool->acquire(ds, layer))
+            {
+                dsHandle = (OGRDataSourceH)ds;
+                layerHandle = (OGRLayerH)layer;
+            }
+        }
+        else
+        {
+            // Each cursor requires its own DS handle so that multi-threaded access will work.
+            // The cursor impl will dispose of the new DS handle.
+            dsHandle = GDALOpenEx(
+                _source.c_str(),
+                GDAL_OF_VECTOR | GDAL_OF_READONLY,
+                nullptr,
+                nullptr,
+                nullptr);
+
+            if (dsHandle)
+            {
+                layerHandle = OGR::openLayer(dsHandle, options().layer().get());
+            }
         }
 
         if (dsHandle && layerHandle)
@@ -863,7 +1010,8 @@ OGRFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
                 getFilters(),
                 _options->rewindPolygons().get(),
                 0, // default chunksize
-                progress
+                progress,
+                _pool
                 );
         }
         else
@@ -886,6 +1034,8 @@ OGRFeatureSource::deleteFeature(FeatureID fid)
         if (OGR_L_DeleteFeature(_layerHandle, fid) == OGRERR_NONE)
         {
             _needsSync = true;
+            if (_pool)
+                _pool->clear();
             return true;
         }
     }
@@ -998,6 +1148,10 @@ OGRFeatureSource::insertFeature(Feature* feature)
         return false;
     }
 
+    // pooled read handles won't see the new feature
+    if (_pool)
+        _pool->clear();
+
     dirty();
 
     return true;
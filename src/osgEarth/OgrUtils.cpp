@@ -20,6 +20,10 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 #include <osgEarth/OgrUtils>
+#include <osgEarth/GeoJSONReader>
+#include <osgEarth/Registry>
+#include <cpl_vsi.h>
+#include <atomic>
 
 #define LC "[FeatureSource] "
 
@@ -46,6 +50,22 @@ namespace
         return OGR_F_IsFieldSet(handle, i);
     #endif
     }
+
+    bool isJSON(const std::string& mime)
+    {
+        return
+            startsWith(mime, "application/json") ||
+            startsWith(mime, "json") ||
+            startsWith(mime, "application/x-javascript") ||
+            startsWith(mime, "text/javascript") ||
+            startsWith(mime, "text/x-javascript") ||
+            startsWith(mime, "text/x-json");
+    }
+
+    bool isGML(const std::string& mime)
+    {
+        return startsWith(mime, "text/xml");
+    }
 }
 
 void
@@ -612,4 +632,90 @@ OgrUtils::getAttributeType( OGRFieldType type )
     };
 }
 
+bool
+OgrUtils::readFeatures(
+    const std::string& buffer,
+    const std::string& mimeType,
+    const FeatureProfile* profile,
+    bool rewindPolygons,
+    FeatureList& output)
+{
+    bool json = isJSON(mimeType);
+    bool gml = isGML(mimeType);
+
+    // GeoJSON is parsed natively, with no global lock.
+    if (json)
+    {
+        GeoJSONReader reader;
+        reader.setRewindPolygons(rewindPolygons);
+        if (reader.read(buffer, profile, output))
+            return true;
+    }
+
+    // OGR is not thread-safe
+    GDAL_SCOPED_LOCK;
+
+    // find the right driver for the given mime type
+    OGRSFDriverH ogrDriver =
+        json ? OGRGetDriverByName("GeoJSON") :
+        gml ? OGRGetDriverByName("GML") :
+        0L;
+
+    if (!ogrDriver)
+    {
+        OE_WARN << LC << "Cannot read features; unsupported content-type \"" << mimeType << "\"" << std::endl;
+        return false;
+    }
+
+    // GeoJSON opens directly from memory; GML needs a file, so
+    // give it one in GDAL's in-memory file system.
+    std::string name;
+    OGRDataSourceH ds = 0L;
+    if (gml)
+    {
+        static std::atomic<unsigned> s_count(0u);
+        name = Stringify() << "/vsimem/oe_features_" << s_count++ << ".xml";
+        VSILFILE* file = VSIFileFromMemBuffer(name.c_str(), (GByte*)buffer.data(), buffer.size(), FALSE);
+        if (file)
+        {
+            VSIFCloseL(file);
+            ds = OGROpen(name.c_str(), FALSE, &ogrDriver);
+        }
+    }
+    else
+    {
+        ds = OGROpen(buffer.c_str(), FALSE, &ogrDriver);
+    }
+
+    if (!ds)
+    {
+        OE_WARN << LC << "Cannot read features from \"" << mimeType << "\" data" << std::endl;
+        if (!name.empty())
+            VSIUnlink(name.c_str());
+        return false;
+    }
+
+    // read the feature data.
+    OGRLayerH layer = OGR_DS_GetLayer(ds, 0);
+    if (layer)
+    {
+        OGR_L_ResetReading(layer);
+        OGRFeatureH feat_handle;
+        while ((feat_handle = OGR_L_GetNextFeature(layer)) != NULL)
+        {
+            osg::ref_ptr<Feature> f = createFeature(feat_handle, profile, rewindPolygons);
+            if (f.valid())
+            {
+                output.push_back(f.get());
+            }
+            OGR_F_Destroy(feat_handle);
+        }
+    }
+
+    OGR_DS_Destroy(ds);
 
+    if (!name.empty())
+        VSIUnlink(name.c_str());
+
+    return true;
+}
@@ -191,6 +191,9 @@ _blacklist("Reg.BlackList(OE)")
 
     // Default concurrency for async image layers
     JobArena::setConcurrency("oe.layer.async", 4u);
+
+    // Default concurrency for opening map layers (mostly I/O bound)
+    JobArena::setConcurrency("oe.map.open", 8u);
 }
 
 Registry::~Registry()
@@ -0,0 +1,397 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/SRSKernels>
+#include <osgEarth/StringUtils>
+#include <osg/Math>
+#include <cmath>
+
+using namespace osgEarth;
+using namespace osgEarth::Internal;
+
+namespace
+{
+    const double WGS84_A = 6378137.0;
+    const double WGS84_B = 6356752.314245179;
+    const double HALF_PI = 0.5 * osg::PI;
+    const double EPS10 = 1e-10;
+
+    // Normalizes a longitude (radians) to [-pi, pi], like PROJ's adjlon().
+    inline double adjlon(double lon)
+    {
+        if (fabs(lon) < osg::PI + 1e-12)
+            return lon;
+        lon += osg::PI;
+        lon -= 2.0 * osg::PI * floor(lon / (2.0 * osg::PI));
+        return lon - osg::PI;
+    }
+
+    inline void fail(double& x, double& y)
+    {
+        x = HUGE_VAL;
+        y = HUGE_VAL;
+    }
+}
+
+SRSKernel::SRSKernel() :
+    type(NONE),
+    a(0.0), e(0.0),
+    lon0(0.0), lat0(0.0),
+    k0(1.0),
+    x0(0.0), y0(0.0)
+{
+    for (int j = 0; j < 6; ++j)
+        alpha[j] = beta[j] = 0.0;
+}
+
+void
+SRSKernel::init(const std::string& proj4, bool geographic, double semiMajor, double semiMinor)
+{
+    type = NONE;
+
+    if (proj4.empty() || semiMajor <= 0.0 || semiMinor <= 0.0)
+        return;
+
+    StringTable p;
+    StringTokenizer(proj4, p);
+
+    auto has = [&p](const char* key) {
+        return p.find(key) != p.end();
+    };
+    auto num = [&p](const char* key, double defaultValue) {
+        auto i = p.find(key);
+        return i != p.end() ? as<double>(i->second, defaultValue) : defaultValue;
+    };
+
+    // Anything that implies a datum shift, a non-Greenwich meridian, or
+    // unusual axes or units is left to PROJ.
+    if (has("+pm") || has("+axis") || has("+geoidgrids") || has("+to_meter") ||
+        has("+lon_wrap") || has("+over") || has("+init"))
+    {
+        return;
+    }
+
+    if (has("+datum") && toLower(p["+datum"]) != "wgs84")
+        return;
+
+    if (has("+nadgrids") && p["+nadgrids"] != "@null")
+        return;
+
+    if (has("+towgs84"))
+    {
+        std::vector<std::string> params;
+        StringTokenizer(p["+towgs84"], params, ",");
+        for (auto& param : params)
+            if (as<double>(param, 1.0) != 0.0)
+                return;
+    }
+
+    if (!geographic && has("+units") && p["+units"] != "m")
+        return;
+
+    const std::string& proj = p["+proj"];
+
+    bool isWGS84 =
+        osg::equivalent(semiMajor, WGS84_A, 1e-6) &&
+        osg::equivalent(semiMinor, WGS84_B, 1e-4);
+
+    bool isSphere =
+        osg::equivalent(semiMajor, WGS84_A, 1e-6) &&
+        osg::equivalent(semiMinor, semiMajor, 1e-6);
+
+    a = semiMajor;
+    e = sqrt(1.0 - (semiMinor*semiMinor) / (semiMajor*semiMajor));
+    lon0 = osg::DegreesToRadians(num("+lon_0", 0.0));
+    lat0 = osg::DegreesToRadians(num("+lat_0", 0.0));
+    x0 = num("+x_0", 0.0);
+    y0 = num("+y_0", 0.0);
+    double k = has("+k_0") ? num("+k_0", 1.0) : num("+k", 1.0);
+    double lat_ts = osg::DegreesToRadians(num("+lat_ts", 0.0));
+
+    if (geographic)
+    {
+        if ((proj == "longlat" || proj == "latlong") && isWGS84)
+        {
+            type = GEOGRAPHIC;
+        }
+    }
+
+    else if (
+        (proj == "webmerc" && osg::equivalent(semiMajor, WGS84_A, 1e-6)) ||
+        (proj == "merc" && isSphere))
+    {
+        if (lat0 == 0.0)
+        {
+            type = SPHERICAL_MERCATOR;
+            k0 = a * k * cos(lat_ts);
+        }
+    }
+
+    else if (proj == "eqc" && osg::equivalent(semiMajor, WGS84_A, 1e-6))
+    {
+        type = EQUIRECTANGULAR;
+        k0 = a * cos(lat_ts);
+    }
+
+    else if ((proj == "utm" || proj == "tmerc") && isWGS84)
+    {
+        if (proj == "utm")
+        {
+            int zone = (int)num("+zone", 0.0);
+            if (zone < 1 || zone > 60)
+                return;
+            lon0 = osg::DegreesToRadians(6.0 * (double)zone - 183.0);
+            lat0 = 0.0;
+            k = 0.9996;
+            x0 = 500000.0;
+            y0 = has("+south") ? 10000000.0 : 0.0;
+        }
+
+        // a non-zero latitude of origin needs the meridian arc; leave it to PROJ
+        if (lat0 != 0.0)
+            return;
+
+        type = TRANSVERSE_MERCATOR;
+
+        // Kruger series coefficients, to 6th order in the third flattening
+        double n = (semiMajor - semiMinor) / (semiMajor + semiMinor);
+        double n2 = n*n, n3 = n2*n, n4 = n3*n, n5 = n4*n, n6 = n5*n;
+
+        // rectifying radius, times the scale factor
+        k0 = k * a / (1.0 + n) * (1.0 + n2/4.0 + n4/64.0 + n6/256.0);
+
+        alpha[0] = n/2.0 - 2.0*n2/3.0 + 5.0*n3/16.0 + 41.0*n4/180.0 - 127.0*n5/288.0 + 7891.0*n6/37800.0;
+        alpha[1] = 13.0*n2/48.0 - 3.0*n3/5.0 + 557.0*n4/1440.0 + 281.0*n5/630.0 - 1983433.0*n6/1935360.0;
+        alpha[2] = 61.0*n3/240.0 - 103.0*n4/140.0 + 15061.0*n5/26880.0 + 167603.0*n6/181440.0;
+        alpha[3] = 49561.0*n4/161280.0 - 179.0*n5/168.0 + 6601661.0*n6/7257600.0;
+        alpha[4] = 34729.0*n5/80640.0 - 3418889.0*n6/1995840.0;
+        alpha[5] = 212378941.0*n6/319334400.0;
+
+        beta[0] = n/2.0 - 2.0*n2/3.0 + 37.0*n3/96.0 - n4/360.0 - 81.0*n5/512.0 + 96199.0*n6/604800.0;
+        beta[1] = n2/48.0 + n3/15.0 - 437.0*n4/1440.0 + 46.0*n5/105.0 - 1118711.0*n6/3870720.0;
+        beta[2] = 17.0*n3/480.0 - 37.0*n4/840.0 - 209.0*n5/4480.0 + 5569.0*n6/90720.0;
+        beta[3] = 4397.0*n4/161280.0 - 11.0*n5/504.0 - 830251.0*n6/7257600.0;
+        beta[4] = 4583.0*n5/161280.0 - 108847.0*n6/3991680.0;
+        beta[5] = 20648693.0*n6/638668800.0;
+    }
+}
+
+bool
+SRSKernel::transform(
+    const SRSKernel& from,
+    const SRSKernel& to,
+    double* x,
+    double* y,
+    unsigned count,
+    bool& ok)
+{
+    if (from.type == NONE || to.type == NONE)
+        return false;
+
+    // Every classified system is WGS84-based, so projected-to-projected
+    // simply goes through geographic coordinates.
+    ok = true;
+
+    if (from.type != GEOGRAPHIC)
+        ok = from.inverse(x, y, count) && ok;
+
+    if (to.type != GEOGRAPHIC)
+        ok = to.forward(x, y, count) && ok;
+
+    return true;
+}
+
+bool
+SRSKernel::forward(double* x, double* y, unsigned count) const
+{
+    bool ok = true;
+
+    if (type == SPHERICAL_MERCATOR)
+    {
+        for (unsigned i = 0; i < count; ++i)
+        {
+            double lam = adjlon(osg::DegreesToRadians(x[i]) - lon0);
+            double phi = osg::DegreesToRadians(y[i]);
+            if (!(fabs(phi) < HALF_PI - EPS10) || !std::isfinite(lam))
+            {
+                fail(x[i], y[i]);
+                ok = false;
+                continue;
+            }
+            x[i] = x0 + k0 * lam;
+            y[i] = y0 + k0 * log(tan(0.25*osg::PI + 0.5*phi));
+        }
+    }
+
+    else if (type == EQUIRECTANGULAR)
+    {
+        for (unsigned i = 0; i < count; ++i)
+        {
+            double lam = adjlon(osg::DegreesToRadians(x[i]) - lon0);
+            double phi = osg::DegreesToRadians(y[i]);
+            if (!(fabs(phi) <= HALF_PI + EPS10) || !std::isfinite(lam))
+            {
+                fail(x[i], y[i]);
+                ok = false;
+                continue;
+            }
+            x[i] = x0 + k0 * lam;
+            y[i] = y0 + a * (phi - lat0);
+        }
+    }
+
+    else if (type == TRANSVERSE_MERCATOR)
+    {
+        for (unsigned i = 0; i < count; ++i)
+        {
+            double lam = adjlon(osg::DegreesToRadians(x[i]) - lon0);
+            double phi = osg::DegreesToRadians(y[i]);
+            if (!(fabs(phi) <= HALF_PI + EPS10) || !std::isfinite(lam))
+            {
+                fail(x[i], y[i]);
+                ok = false;
+                continue;
+            }
+
+            // conformal latitude; this form stays finite at the poles
+            double sinphi = sin(phi);
+            double sinchi = tanh(atanh(sinphi) - e * atanh(e * sinphi));
+            double coschi = sqrt(1.0 - sinchi*sinchi);
+
+            double xip = atan2(sinchi, coschi * cos(lam));
+            double etap = atanh(coschi * sin(lam));
+
+            double xi = xip, eta = etap;
+            for (int j = 0; j < 6; ++j)
+            {
+                double k = 2.0 * (double)(j + 1);
+                xi  += alpha[j] * sin(k*xip) * cosh(k*etap);
+                eta += alpha[j] * cos(k*xip) * sinh(k*etap);
+            }
+
+            if (!std::isfinite(xi) || !std::isfinite(eta))
+            {
+                fail(x[i], y[i]);
+                ok = false;
+                continue;
+            }
+
+            x[i] = x0 + k0 * eta;
+            y[i] = y0 + k0 * xi;
+        }
+    }
+
+    return ok;
+}
+
+bool
+SRSKernel::inverse(double* x, double* y, unsigned count) const
+{
+    bool ok = true;
+
+    if (type == SPHERICAL_MERCATOR)
+    {
+        for (unsigned i = 0; i < count; ++i)
+        {
+            if (!std::isfinite(x[i]) || !std::isfinite(y[i]))
+            {
+                fail(x[i], y[i]);
+                ok = false;
+                continue;
+            }
+            double lam = (x[i] - x0) / k0;
+            double phi = atan(sinh((y[i] - y0) / k0));
+            x[i] = osg::RadiansToDegrees(adjlon(lam + lon0));
+            y[i] = osg::RadiansToDegrees(phi);
+        }
+    }
+
+    else if (type == EQUIRECTANGULAR)
+    {
+        for (unsigned i = 0; i < count; ++i)
+        {
+            double lam = (x[i] - x0) / k0;
+            double phi = (y[i] - y0) / a + lat0;
+            if (!(fabs(phi) <= HALF_PI + EPS10) || !std::isfinite(lam))
+            {
+                fail(x[i], y[i]);
+                ok = false;
+                continue;
+            }
+            x[i] = osg::RadiansToDegrees(adjlon(lam + lon0));
+            y[i] = osg::RadiansToDegrees(phi);
+        }
+    }
+
+    else if (type == TRANSVERSE_MERCATOR)
+    {
+        const double e2m = 1.0 - e*e;
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            double xi = (y[i] - y0) / k0;
+            double eta = (x[i] - x0) / k0;
+            if (!std::isfinite(xi) || !std::isfinite(eta))
+            {
+                fail(x[i], y[i]);
+                ok = false;
+                continue;
+            }
+
+            double xip = xi, etap = eta;
+            for (int j = 0; j < 6; ++j)
+            {
+                double k = 2.0 * (double)(j + 1);
+                xip  -= beta[j] * sin(k*xi) * cosh(k*eta);
+                etap -= beta[j] * cos(k*xi) * sinh(k*eta);
+            }
+
+            double sinhetap = sinh(etap);
+            double cosxip = cos(xip);
+            double lam = atan2(sinhetap, cosxip);
+
+            // tangent of the conformal latitude, then Newton's method for
+            // the geodetic latitude (Karney 2011, eqs. 19-21)
+            double r = sqrt(sinhetap*sinhetap + cosxip*cosxip);
+            double phi;
+            if (r > 0.0)
+            {
+                double taup = sin(xip) / r;
+                double tau = taup / e2m;
+                for (int iter = 0; iter < 4; ++iter)
+                {
+                    double tau1 = sqrt(1.0 + tau*tau);
+                    double sig = sinh(e * atanh(e * tau / tau1));
+                    double taupa = sqrt(1.0 + sig*sig) * tau - sig * tau1;
+                    tau += (taup - taupa) * (1.0 + e2m * tau*tau) /
+                        (e2m * tau1 * sqrt(1.0 + taupa*taupa));
+                }
+                phi = atan(tau);
+            }
+            else
+            {
+                phi = xip > 0.0 ? HALF_PI : -HALF_PI;
+            }
+
+            x[i] = osg::RadiansToDegrees(adjlon(lam + lon0));
+            y[i] = osg::RadiansToDegrees(phi);
+        }
+    }
+
+    return ok;
+}
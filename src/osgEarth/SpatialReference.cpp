@@ -24,6 +24,7 @@
 #include <osgEarth/Math>
 #include <ogr_spatialref.h>
 #include <cpl_conv.h>
+#include <atomic>
 
 #define LC "[SpatialReference] "
 
@@ -58,6 +59,9 @@ namespace
         }
     }
 
+    // whether transformXYPointArrays may use the closed-form kernels
+    std::atomic<bool> s_useTransformKernels(true);
+
     // Make a MatrixTransform suitable for use with a Locator object based on the given extents.
     // Calling Locator::setTransformAsExtents doesn't work with OSG 2.6 due to the fact that the
     // _inverse member isn't updated properly.  Calling Locator::setTransform works correctly.
@@ -720,6 +724,18 @@ SpatialReference::createEquirectangularSRS() const
         getVertInitString());
 }
 
+void
+SpatialReference::setUseTransformKernels(bool value)
+{
+    s_useTransformKernels = value;
+}
+
+bool
+SpatialReference::getUseTransformKernels()
+{
+    return s_useTransformKernels;
+}
+
 bool
 SpatialReference::isMercator() const
 {
@@ -982,6 +998,14 @@ SpatialReference::transformXYPointArrays(
     if (!valid())
         return false;
 
+    // Common WGS84 pairs have closed-form kernels that skip PROJ entirely
+    bool ok;
+    if (s_useTransformKernels &&
+        Internal::SRSKernel::transform(_kernel, out_srs->_kernel, x, y, count, ok))
+    {
+        return ok;
+    }
+
     // Transform the X and Y values inside an exclusive GDAL/OGR lock
     optional<TransformInfo>& xform = local._xformCache[out_srs->getWKT()];
     if (!xform.isSet())
@@ -1510,6 +1534,12 @@ SpatialReference::init()
         }
     }
 
+    // Closed-form transform kernel, if this is one of the common systems:
+    if (!_is_user_defined && !_is_cube && !_is_ltp && !isGeocentric())
+    {
+        _kernel.init(_proj4, isGeographic(), _ellipsoid.getSemiMajorAxis(), _ellipsoid.getSemiMinorAxis());
+    }
+
     // Build a 'normalized' initialization key.
     if ( !_proj4.empty() )
     {
@@ -348,108 +348,21 @@ TFSFeatureSource::getFeatures(const std::string& buffer, const TileKey& key, con
     }
     else
     {
-        // find the right driver for the given mime type
-        //OGR_SCOPED_LOCK;
-
-        // find the right driver for the given mime type
-        OGRSFDriverH ogrDriver =
-            isJSON(mimeType) ? OGRGetDriverByName("GeoJSON") :
-            isGML(mimeType) ? OGRGetDriverByName("GML") :
-            0L;
-
-        // fail if we can't find an appropriate OGR driver:
-        if (!ogrDriver)
-        {
-            OE_WARN << LC << "Error reading TFS response; cannot grok content-type \"" << mimeType << "\""
-                << std::endl;
-            return false;
-        }
-
-        OGRDataSourceH ds = OGROpen(buffer.c_str(), FALSE, &ogrDriver);
-
-        if (!ds)
-        {
-            OE_WARN << LC << "Error reading TFS response" << std::endl;
+        FeatureList parsed;
+        if (!OgrUtils::readFeatures(buffer, mimeType, getFeatureProfile(), *_options->rewindPolygons(), parsed))
             return false;
-        }
 
-        // read the feature data.
-        OGRLayerH layer = OGR_DS_GetLayer(ds, 0);
-        if (layer)
+        for (auto& f : parsed)
         {
-            const SpatialReference* srs = _layer.getSRS();
-
-            OGR_L_ResetReading(layer);
-            OGRFeatureH feat_handle;
-            while ((feat_handle = OGR_L_GetNextFeature(layer)) != NULL)
-            {
-                if (feat_handle)
-                {
-                    osg::ref_ptr<Feature> f = OgrUtils::createFeature(feat_handle, getFeatureProfile(), *_options->rewindPolygons());
-                    if (f.valid() && !isBlacklisted(f->getFID()))
-                    {
-                        features.push_back(f.release());
-                    }
-                    OGR_F_Destroy(feat_handle);
-                }
-            }
+            if (!isBlacklisted(f->getFID()))
+                features.push_back(f);
         }
-
-        // Destroy the datasource
-        OGR_DS_Destroy(ds);
     }
 
     return true;
 }
 
 
-std::string
-TFSFeatureSource::getExtensionForMimeType(const std::string& mime)
-{
-    //OGR is particular sometimes about the extension of files when it's reading them so it's good to have
-    //the temp file have an appropriate extension
-    if ((mime.compare("text/xml") == 0) ||
-        (mime.compare("text/xml; subtype=gml/2.1.2") == 0) ||
-        (mime.compare("text/xml; subtype=gml/3.1.1") == 0)
-        )
-    {
-        return ".xml";
-    }
-    else if ((mime.compare("application/json") == 0) ||
-        (mime.compare("json") == 0) ||
-
-        (mime.compare("application/x-javascript") == 0) ||
-        (mime.compare("text/javascript") == 0) ||
-        (mime.compare("text/x-javascript") == 0) ||
-        (mime.compare("text/x-json") == 0)
-        )
-    {
-        return ".json";
-    }
-    return "";
-}
-
-bool
-TFSFeatureSource::isGML(const std::string& mime) const
-{
-    return
-        startsWith(mime, "text/xml");
-}
-
-
-bool
-TFSFeatureSource::isJSON(const std::string& mime) const
-{
-    return
-        (mime.compare("application/json") == 0) ||
-        (mime.compare("json") == 0) ||
-
-        (mime.compare("application/x-javascript") == 0) ||
-        (mime.compare("text/javascript") == 0) ||
-        (mime.compare("text/x-javascript") == 0) ||
-        (mime.compare("text/x-json") == 0);
-}
-
 std::string
 TFSFeatureSource::createURL(const Query& query)
 {
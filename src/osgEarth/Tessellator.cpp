@@ -22,6 +22,7 @@
 #include <iterator>
 #include <limits.h>
 #include <osgEarth/Tessellator>
+#include <osgEarth/Notify>
 
 #ifdef OSGEARTH_CXX11
 
@@ -55,6 +56,20 @@ namespace mapbox {
                 return t.y();
             };
         };
+
+        template <>
+        struct nth<0, osg::Vec2d> {
+            inline static double get(const osg::Vec2d &t) {
+                return t.x();
+            };
+        };
+
+        template <>
+        struct nth<1, osg::Vec2d> {
+            inline static double get(const osg::Vec2d &t) {
+                return t.y();
+            };
+        };
     }
 }
 
@@ -244,6 +259,121 @@ void rotateToXY(std::vector<std::vector<osg::Vec3d>>& polygon)
     }
 }
 
+// Picks the dominant plane of one polygon in a batch, using the
+// same shoelace comparison as rotateToXY.
+int dominantPlane(const Tessellator::Batch& batch, uint32_t firstRing, uint32_t lastRing)
+{
+    double area[3] = { 0, 0, 0 };
+
+    for (uint32_t r = firstRing; r < lastRing; ++r)
+    {
+        uint32_t begin = batch.rings[r], end = batch.rings[r + 1];
+        if (end - begin < 3)
+            continue;
+
+        uint32_t j = end - 1;
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const osg::Vec3d& a = batch.points[j];
+            const osg::Vec3d& b = batch.points[i];
+            area[AREA_PLANE_XY] += (a.x() + b.x()) * (a.y() - b.y());
+            area[AREA_PLANE_XZ] += (a.x() + b.x()) * (a.z() - b.z());
+            area[AREA_PLANE_YZ] += (a.y() + b.y()) * (a.z() - b.z());
+            j = i;
+        }
+    }
+
+    int plane = AREA_PLANE_XZ;
+
+    double absArea[] = { std::abs(area[AREA_PLANE_XY]), std::abs(area[AREA_PLANE_XZ]), std::abs(area[AREA_PLANE_YZ]) };
+    if (absArea[0] > absArea[1] && absArea[0] > absArea[2]) {
+        plane = AREA_PLANE_XY;
+    }
+    if (absArea[1] > absArea[0] && absArea[1] > absArea[2]) {
+        plane = AREA_PLANE_XZ;
+    }
+    if (absArea[2] > absArea[0] && absArea[2] > absArea[1]) {
+        plane = AREA_PLANE_YZ;
+    }
+    return plane;
+}
+
+// Non-owning views over the scratch buffers, so earcut can run
+// without copying rings into nested vectors.
+struct RingView
+{
+    using value_type = osg::Vec2d;
+    const osg::Vec2d* _data;
+    std::size_t _size;
+    std::size_t size() const { return _size; }
+    const osg::Vec2d& operator[](std::size_t i) const { return _data[i]; }
+};
+
+struct PolygonView
+{
+    const RingView* _rings;
+    std::size_t _size;
+    bool empty() const { return _size == 0; }
+    std::size_t size() const { return _size; }
+    const RingView& operator[](std::size_t i) const { return _rings[i]; }
+};
+
+}
+
+
+// Scratch memory retained by a Tessellator between calls
+struct Tessellator::Scratch
+{
+    mapbox::detail::Earcut<uint32_t> earcut; // reused for its index buffer
+    std::vector<osg::Vec2d> points;
+    std::vector<uint32_t> remap;
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    std::vector<RingView> rings;
+    std::vector<uint32_t> indices;
+};
+
+Tessellator::Tessellator() :
+    _scratch(new Scratch())
+{
+    //nop
+}
+
+Tessellator::~Tessellator()
+{
+    //nop
+}
+
+void
+Tessellator::Batch::clear()
+{
+    points.clear();
+    rings.clear();
+    polygons.clear();
+}
+
+uint32_t
+Tessellator::Batch::add(const osgEarth::Geometry* input)
+{
+    if (polygons.empty())
+        polygons.push_back(0u);
+    if (rings.empty())
+        rings.push_back((uint32_t)points.size());
+
+    uint32_t first = (uint32_t)points.size();
+
+    if (input)
+    {
+        ConstGeometryIterator iter(input, true);
+        while (iter.hasMore())
+        {
+            const Geometry* part = iter.next();
+            points.insert(points.end(), part->begin(), part->end());
+            rings.push_back((uint32_t)points.size());
+        }
+    }
+
+    polygons.push_back((uint32_t)rings.size() - 1u);
+    return first;
 }
 
 
@@ -596,3 +726,127 @@ Tessellator::tessellate2D(
 
     return true;
 }
+
+void
+Tessellator::tessellatePolygon(
+    const Batch& batch,
+    unsigned p,
+    Plane plane,
+    std::vector<uint32_t>& out_indices)
+{
+    Scratch& scratch = *_scratch;
+
+    uint32_t firstRing = batch.polygons[p];
+    uint32_t lastRing = batch.polygons[p + 1];
+    if (firstRing == lastRing)
+        return;
+
+    int axis = plane == PLANE_AUTO ?
+        dominantPlane(batch, firstRing, lastRing) :
+        AREA_PLANE_XY;
+
+    scratch.points.clear();
+    scratch.remap.clear();
+    scratch.ranges.clear();
+
+    // project the rings into 2D, dropping any degenerate ones:
+    for (uint32_t r = firstRing; r < lastRing; ++r)
+    {
+        uint32_t begin = batch.rings[r], end = batch.rings[r + 1];
+        std::size_t start = scratch.points.size();
+        bool valid = (end - begin >= 3);
+
+        for (uint32_t i = begin; valid && i < end; ++i)
+        {
+            const osg::Vec3d& v = batch.points[i];
+            if (!v.valid())
+            {
+                valid = false;
+                break;
+            }
+
+            switch (axis) {
+                case AREA_PLANE_XY: scratch.points.emplace_back(v.x(), v.y()); break;
+                case AREA_PLANE_XZ: scratch.points.emplace_back(v.x(), v.z()); break;
+                case AREA_PLANE_YZ: scratch.points.emplace_back(v.y(), v.z()); break;
+            }
+            scratch.remap.push_back(i);
+        }
+
+        if (!valid)
+        {
+            scratch.points.resize(start);
+            scratch.remap.resize(start);
+
+            // without a usable outer ring there is nothing to tessellate.
+            if (r == firstRing)
+                break;
+        }
+        else
+        {
+            scratch.ranges.emplace_back((uint32_t)start, (uint32_t)(scratch.points.size() - start));
+        }
+    }
+
+    if (scratch.ranges.empty() || scratch.remap.empty() || scratch.remap[0] != batch.rings[firstRing])
+        return;
+
+    scratch.rings.clear();
+    for (auto& range : scratch.ranges)
+        scratch.rings.push_back(RingView{ &scratch.points[range.first], range.second });
+
+    scratch.earcut(PolygonView{ scratch.rings.data(), scratch.rings.size() });
+
+    for (auto i : scratch.earcut.indices)
+        out_indices.push_back(scratch.remap[i]);
+}
+
+bool
+Tessellator::tessellate2D(
+    const Batch& batch,
+    std::vector<uint32_t>& out_indices,
+    Plane plane)
+{
+    for (unsigned p = 0; p < batch.size(); ++p)
+    {
+        tessellatePolygon(batch, p, plane, out_indices);
+    }
+
+    return true;
+}
+
+bool
+Tessellator::tessellate2D(
+    const Batch& batch,
+    const std::vector<osg::Geometry*>& targets,
+    Plane plane)
+{
+    OE_SOFT_ASSERT_AND_RETURN(targets.size() >= batch.size(), __func__, false);
+
+    std::vector<uint32_t>& indices = _scratch->indices;
+    bool triangulated = false;
+
+    for (unsigned p = 0; p < batch.size(); ++p)
+    {
+        if (targets[p] == nullptr)
+            continue;
+
+        indices.clear();
+        tessellatePolygon(batch, p, plane, indices);
+        if (indices.empty())
+            continue;
+
+        // make the indices relative to the polygon's first point
+        uint32_t first = batch.rings[batch.polygons[p]];
+
+        osg::DrawElementsUInt* de = new osg::DrawElementsUInt(GL_TRIANGLES);
+        de->reserve(indices.size());
+        for (auto i : indices)
+            de->push_back(i - first);
+
+        targets[p]->addPrimitiveSet(de);
+        triangulated = true;
+    }
+
+    return triangulated;
+}
@@ -0,0 +1,888 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/TrackSet>
+#include <osgEarth/LabelNode>
+#include <osgEarth/MapNode>
+#include <osgEarth/Horizon>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/VirtualProgram>
+#include <osgEarth/ShaderGenerator>
+#include <osgEarth/Lighting>
+#include <osgEarth/NodeUtils>
+#include <osg/Depth>
+#include <osg/BlendFunc>
+#include <osgUtil/CullVisitor>
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+#define LC "[TrackSet] "
+
+using namespace osgEarth;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    const char* iconVS =
+        "#version " GLSL_VERSION_STR "\n"
+        "out vec2 oe_TrackSet_texcoord; \n"
+        "void oe_TrackSet_icon_VS(inout vec4 vertex) { \n"
+        "    oe_TrackSet_texcoord = gl_MultiTexCoord0.st; \n"
+        "} \n";
+
+    const char* iconFS =
+        "#version " GLSL_VERSION_STR "\n"
+        "in vec2 oe_TrackSet_texcoord; \n"
+        "uniform sampler2D oe_TrackSet_tex; \n"
+        "void oe_TrackSet_icon_FS(inout vec4 color) { \n"
+        "    color = texture(oe_TrackSet_tex, oe_TrackSet_texcoord); \n"
+        "} \n";
+
+    template<typename T>
+    void appendVector(std::vector<T>& lhs, std::vector<T>& rhs)
+    {
+        lhs.insert(lhs.end(), rhs.begin(), rhs.end());
+    }
+
+    unsigned maxID(const std::vector<unsigned>& ids, unsigned value)
+    {
+        for (std::vector<unsigned>::const_iterator i = ids.begin(); i != ids.end(); ++i)
+            value = std::max(value, *i + 1u);
+        return value;
+    }
+
+    // Orders label candidates by priority, then by distance from the eye
+    struct SortLabelCandidates
+    {
+        const std::vector<float>& _priority;
+        const TrackSet::Projection& _proj;
+        SortLabelCandidates(const std::vector<float>& priority, const TrackSet::Projection& proj) :
+            _priority(priority), _proj(proj) { }
+
+        bool operator()(unsigned lhs, unsigned rhs) const
+        {
+            float lp = _priority[_proj.ids[lhs]], rp = _priority[_proj.ids[rhs]];
+            if (lp != rp)
+                return lp > rp;
+            return _proj.screen[lhs].z() < _proj.screen[rhs].z();
+        }
+    };
+
+    struct SetLabelStyle : public PerObjectFastMap<osg::Camera*, TrackSet::CameraData>::Functor
+    {
+        const Style& _style;
+        SetLabelStyle(const Style& style) : _style(style) { }
+        void operator()(TrackSet::CameraData& data)
+        {
+            for (unsigned i = 0; i < data.labels.size(); ++i)
+                data.labels[i]->setStyle(_style);
+        }
+    };
+
+    struct AcceptLabels : public PerObjectFastMap<osg::Camera*, TrackSet::CameraData>::Functor
+    {
+        osg::NodeVisitor& _nv;
+        AcceptLabels(osg::NodeVisitor& nv) : _nv(nv) { }
+        void operator()(TrackSet::CameraData& data)
+        {
+            for (unsigned i = 0; i < data.labels.size(); ++i)
+                data.labels[i]->accept(_nv);
+        }
+    };
+
+    struct ResizeGLObjects : public PerObjectFastMap<osg::Camera*, TrackSet::CameraData>::ConstFunctor
+    {
+        unsigned _size;
+        ResizeGLObjects(unsigned size) : _size(size) { }
+        void operator()(const TrackSet::CameraData& data) const
+        {
+            if (data.hud.valid())
+                data.hud->resizeGLObjectBuffers(_size);
+            for (unsigned i = 0; i < data.labels.size(); ++i)
+                data.labels[i]->resizeGLObjectBuffers(_size);
+        }
+    };
+
+    struct ReleaseGLObjects : public PerObjectFastMap<osg::Camera*, TrackSet::CameraData>::ConstFunctor
+    {
+        osg::State* _state;
+        ReleaseGLObjects(osg::State* state) : _state(state) { }
+        void operator()(const TrackSet::CameraData& data) const
+        {
+            if (data.hud.valid())
+                data.hud->releaseGLObjects(_state);
+            for (unsigned i = 0; i < data.labels.size(); ++i)
+                data.labels[i]->releaseGLObjects(_state);
+        }
+    };
+}
+
+//------------------------------------------------------------------------
+
+void
+TrackSet::Updates::setPosition(unsigned id, double lon, double lat, double alt)
+{
+    _positionIds.push_back(id);
+    _positions.push_back(osg::Vec3d(lon, lat, alt));
+}
+
+void
+TrackSet::Updates::setHeading(unsigned id, float heading)
+{
+    _headingIds.push_back(id);
+    _headings.push_back(heading);
+}
+
+void
+TrackSet::Updates::setIcon(unsigned id, unsigned icon)
+{
+    _iconIds.push_back(id);
+    _icons.push_back((unsigned short)icon);
+}
+
+void
+TrackSet::Updates::setPriority(unsigned id, float priority)
+{
+    _priorityIds.push_back(id);
+    _priorities.push_back(priority);
+}
+
+void
+TrackSet::Updates::setField(unsigned id, unsigned field, const std::string& value)
+{
+    _fieldIds.push_back(id);
+    _fieldIndices.push_back(field);
+    _fieldValues.push_back(value);
+}
+
+void
+TrackSet::Updates::remove(unsigned id)
+{
+    _removeIds.push_back(id);
+}
+
+bool
+TrackSet::Updates::empty() const
+{
+    return
+        _positionIds.empty() &&
+        _headingIds.empty() &&
+        _iconIds.empty() &&
+        _priorityIds.empty() &&
+        _fieldIds.empty() &&
+        _removeIds.empty();
+}
+
+void
+TrackSet::Updates::clear()
+{
+    _positionIds.clear();
+    _positions.clear();
+    _headingIds.clear();
+    _headings.clear();
+    _iconIds.clear();
+    _icons.clear();
+    _priorityIds.clear();
+    _priorities.clear();
+    _fieldIds.clear();
+    _fieldIndices.clear();
+    _fieldValues.clear();
+    _removeIds.clear();
+}
+
+void
+TrackSet::Updates::append(Updates& rhs)
+{
+    if (empty())
+    {
+        // common case: take the other batch's buffers without copying
+        _positionIds.swap(rhs._positionIds);
+        _positions.swap(rhs._positions);
+        _headingIds.swap(rhs._headingIds);
+        _headings.swap(rhs._headings);
+        _iconIds.swap(rhs._iconIds);
+        _icons.swap(rhs._icons);
+        _priorityIds.swap(rhs._priorityIds);
+        _priorities.swap(rhs._priorities);
+        _fieldIds.swap(rhs._fieldIds);
+        _fieldIndices.swap(rhs._fieldIndices);
+        _fieldValues.swap(rhs._fieldValues);
+        _removeIds.swap(rhs._removeIds);
+    }
+    else
+    {
+        appendVector(_positionIds, rhs._positionIds);
+        appendVector(_positions, rhs._positions);
+        appendVector(_headingIds, rhs._headingIds);
+        appendVector(_headings, rhs._headings);
+        appendVector(_iconIds, rhs._iconIds);
+        appendVector(_icons, rhs._icons);
+        appendVector(_priorityIds, rhs._priorityIds);
+        appendVector(_priorities, rhs._priorities);
+        appendVector(_fieldIds, rhs._fieldIds);
+        appendVector(_fieldIndices, rhs._fieldIndices);
+        _fieldValues.reserve(_fieldValues.size() + rhs._fieldValues.size());
+        for (unsigned i = 0; i < rhs._fieldValues.size(); ++i)
+        {
+            _fieldValues.push_back(std::string());
+            _fieldValues.back().swap(rhs._fieldValues[i]);
+        }
+        // a later batch that sets a position brings back a track that an
+        // earlier batch removed, so drop those queued removals
+        if (!_removeIds.empty() && !rhs._positionIds.empty())
+        {
+            std::unordered_set<unsigned> repositioned(rhs._positionIds.begin(), rhs._positionIds.end());
+            _removeIds.erase(
+                std::remove_if(_removeIds.begin(), _removeIds.end(),
+                    [&](unsigned id) { return repositioned.count(id) > 0; }),
+                _removeIds.end());
+        }
+        appendVector(_removeIds, rhs._removeIds);
+    }
+    rhs.clear();
+}
+
+//------------------------------------------------------------------------
+
+TrackSet::TrackSet(MapNode* mapNode) :
+_pendingMutex(OE_MUTEX_NAME),
+_mapNode(mapNode),
+_geocentric(false),
+_atlasCols(0u),
+_atlasRows(0u),
+_atlasDirty(false),
+_iconSize(32.0f),
+_maxLabels(256u)
+{
+    // This class makes its own shaders
+    ShaderGenerator::setIgnoreHint(this, true);
+
+    // tracks are culled individually in traverse()
+    setCullingActive(false);
+
+    ADJUST_UPDATE_TRAV_COUNT(this, +1);
+
+    _iconStateSet = new osg::StateSet();
+    _iconStateSet->setMode(GL_BLEND, osg::StateAttribute::ON);
+    _iconStateSet->setAttributeAndModes(new osg::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA), 1);
+    _iconStateSet->setAttributeAndModes(new osg::Depth(osg::Depth::ALWAYS, 0, 1, false), 1);
+    Lighting::set(_iconStateSet.get(), osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED);
+
+    VirtualProgram* vp = VirtualProgram::getOrCreate(_iconStateSet.get());
+    vp->setName("TrackSet");
+    vp->setFunction("oe_TrackSet_icon_VS", iconVS, ShaderComp::LOCATION_VERTEX_MODEL);
+    vp->setFunction("oe_TrackSet_icon_FS", iconFS, ShaderComp::LOCATION_FRAGMENT_COLORING);
+    _iconStateSet->addUniform(new osg::Uniform("oe_TrackSet_tex", 0));
+
+    TextSymbol* text = _labelStyle.getOrCreate<TextSymbol>();
+    text->alignment() = TextSymbol::ALIGN_LEFT_CENTER;
+    text->pixelOffset() = osg::Vec2s((short)(_iconSize*0.5f), 0);
+
+    setupSRS();
+}
+
+TrackSet::~TrackSet()
+{
+    //nop
+}
+
+void
+TrackSet::setMapNode(MapNode* mapNode)
+{
+    if (_mapNode.get() != mapNode)
+    {
+        _mapNode = mapNode;
+        setupSRS();
+    }
+}
+
+MapNode*
+TrackSet::getMapNode() const
+{
+    return _mapNode.get();
+}
+
+void
+TrackSet::setupSRS()
+{
+    osg::ref_ptr<MapNode> mapNode;
+    const SpatialReference* mapSRS =
+        _mapNode.lock(mapNode) ? mapNode->getMapSRS() : SpatialReference::get("wgs84");
+
+    _geoSRS = mapSRS->getGeographicSRS();
+    _geocentric = mapSRS->isGeographic();
+    _worldSRS = _geocentric ? mapSRS->getGeocentricSRS() : mapSRS;
+    _horizon = _geocentric ? new Horizon(mapSRS) : 0L;
+
+    // re-place any existing tracks in the new world SRS
+    std::vector<unsigned> ids;
+    std::vector<osg::Vec3d> points;
+    for (unsigned i = 0; i < _active.size(); ++i)
+    {
+        if (_active[i])
+        {
+            ids.push_back(i);
+            points.push_back(_lla[i]);
+        }
+    }
+    if (!ids.empty())
+    {
+        transformPositions(ids, points);
+    }
+}
+
+unsigned
+TrackSet::addIcon(osg::Image* image)
+{
+    _iconImages.push_back(image);
+    _atlasDirty = true;
+    return _iconImages.size() - 1u;
+}
+
+void
+TrackSet::setIconSize(float pixels)
+{
+    _iconSize = pixels;
+}
+
+void
+TrackSet::setLabelStyle(const Style& style)
+{
+    _labelStyle = style;
+    SetLabelStyle functor(_labelStyle);
+    _cameraDataMap.forEach(functor);
+}
+
+void
+TrackSet::setMaxLabels(unsigned value)
+{
+    _maxLabels = value;
+}
+
+void
+TrackSet::submit(Updates& updates)
+{
+    if (updates.empty())
+        return;
+
+    Threading::ScopedMutexLock lock(_pendingMutex);
+    _pending.append(updates);
+}
+
+void
+TrackSet::resize(unsigned size)
+{
+    if (size <= _world.size())
+        return;
+
+    _lla.resize(size);
+    _world.resize(size);
+    _north.resize(size, osg::Vec3f(0, 1, 0));
+    _heading.resize(size, 0.0f);
+    _icon.resize(size, 0u);
+    _priority.resize(size, 0.0f);
+    _active.resize(size, 0u);
+    for (unsigned f = 0; f < _fields.size(); ++f)
+        _fields[f].resize(size);
+}
+
+void
+TrackSet::transformPositions(const std::vector<unsigned>& ids, std::vector<osg::Vec3d>& points)
+{
+    // one batched SRS transform for the whole update
+    _geoSRS->transform(points, _worldSRS.get());
+
+    for (unsigned i = 0; i < ids.size(); ++i)
+    {
+        unsigned id = ids[i];
+        _world[id] = points[i];
+
+        if (_geocentric)
+        {
+            // local north vector on the ellipsoid
+            double lon = osg::DegreesToRadians(_lla[id].x());
+            double lat = osg::DegreesToRadians(_lla[id].y());
+            _north[id].set(
+                -sin(lat)*cos(lon),
+                -sin(lat)*sin(lon),
+                cos(lat));
+        }
+        else
+        {
+            _north[id].set(0, 1, 0);
+        }
+    }
+}
+
+void
+TrackSet::applyUpdates()
+{
+    {
+        Threading::ScopedMutexLock lock(_pendingMutex);
+        _applying.clear();
+        _applying.append(_pending);
+    }
+
+    if (_atlasDirty)
+    {
+        buildAtlas();
+    }
+
+    if (_applying.empty())
+        return;
+
+    Updates& u = _applying;
+
+    unsigned size = _world.size();
+    size = maxID(u._positionIds, size);
+    size = maxID(u._headingIds, size);
+    size = maxID(u._iconIds, size);
+    size = maxID(u._priorityIds, size);
+    size = maxID(u._fieldIds, size);
+    size = maxID(u._removeIds, size);
+    resize(size);
+
+    if (!u._positionIds.empty())
+    {
+        for (unsigned i = 0; i < u._positionIds.size(); ++i)
+        {
+            unsigned id = u._positionIds[i];
+            _lla[id] = u._positions[i];
+            _active[id] = 1u;
+        }
+        transformPositions(u._positionIds, u._positions);
+    }
+
+    for (unsigned i = 0; i < u._headingIds.size(); ++i)
+        _heading[u._headingIds[i]] = u._headings[i];
+
+    for (unsigned i = 0; i < u._iconIds.size(); ++i)
+        _icon[u._iconIds[i]] = u._icons[i];
+
+    for (unsigned i = 0; i < u._priorityIds.size(); ++i)
+        _priority[u._priorityIds[i]] = u._priorities[i];
+
+    for (unsigned i = 0; i < u._fieldIds.size(); ++i)
+    {
+        unsigned field = u._fieldIndices[i];
+        if (field >= _fields.size())
+        {
+            _fields.resize(field + 1u);
+            for (unsigned f = 0; f < _fields.size(); ++f)
+                _fields[f].resize(_world.size());
+        }
+        _fields[field][u._fieldIds[i]].swap(u._fieldValues[i]);
+    }
+
+    for (unsigned i = 0; i < u._removeIds.size(); ++i)
+        _active[u._removeIds[i]] = 0u;
+
+    u.clear();
+}
+
+void
+TrackSet::buildAtlas()
+{
+    _atlasDirty = false;
+
+    unsigned cell = 0u;
+    for (unsigned i = 0; i < _iconImages.size(); ++i)
+    {
+        if (_iconImages[i].valid())
+            cell = std::max(cell, (unsigned)std::max(_iconImages[i]->s(), _iconImages[i]->t()));
+    }
+
+    if (cell == 0u)
+    {
+        _atlas = 0L;
+        _atlasCols = _atlasRows = 0u;
+        _iconStateSet->removeTextureAttribute(0, osg::StateAttribute::TEXTURE);
+        return;
+    }
+
+    // square-ish grid of equal cells keeps the texture within size limits
+    unsigned count = _iconImages.size();
+    _atlasCols = (unsigned)ceil(sqrt((double)count));
+    _atlasRows = (count + _atlasCols - 1u) / _atlasCols;
+
+    osg::ref_ptr<osg::Image> atlas = new osg::Image();
+    atlas->allocateImage(cell*_atlasCols, cell*_atlasRows, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    atlas->setInternalTextureFormat(GL_RGBA8);
+    ::memset(atlas->data(), 0, atlas->getTotalSizeInBytes());
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if (!_iconImages[i].valid())
+            continue;
+
+        osg::ref_ptr<osg::Image> rgba = ImageUtils::convertToRGBA8(_iconImages[i].get());
+        if (!rgba.valid())
+        {
+            OE_WARN << LC << "Failed to convert icon " << i << " to RGBA" << std::endl;
+            continue;
+        }
+
+        if (rgba->s() != (int)cell || rgba->t() != (int)cell)
+        {
+            osg::ref_ptr<osg::Image> resized;
+            if (ImageUtils::resizeImage(rgba.get(), cell, cell, resized))
+                rgba = resized.get();
+        }
+
+        ImageUtils::copyAsSubImage(rgba.get(), atlas.get(), (i % _atlasCols)*cell, (i / _atlasCols)*cell);
+    }
+
+    _atlas = new osg::Texture2D(atlas.get());
+    _atlas->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+    _atlas->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+    _atlas->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    _atlas->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    _atlas->setResizeNonPowerOfTwoHint(false);
+    _iconStateSet->setTextureAttributeAndModes(0, _atlas.get(), osg::StateAttribute::ON);
+}
+
+void
+TrackSet::project(const osg::Matrixd& mvpw,
+                  const osg::Vec3d& eye,
+                  double width,
+                  double height,
+                  Projection& output) const
+{
+    output.ids.clear();
+    output.screen.clear();
+    output.rotation.clear();
+
+    osg::ref_ptr<Horizon> horizon;
+    if (_horizon.valid())
+    {
+        horizon = new Horizon(*_horizon.get());
+        horizon->setEye(eye);
+    }
+
+    const double* m = mvpw.ptr();
+    const double margin = _iconSize * 0.5;
+
+    for (unsigned i = 0; i < _world.size(); ++i)
+    {
+        if (!_active[i])
+            continue;
+
+        const osg::Vec3d& p = _world[i];
+
+        double w = p.x()*m[3] + p.y()*m[7] + p.z()*m[11] + m[15];
+        if (w <= 0.0)
+            continue;
+
+        double x = (p.x()*m[0] + p.y()*m[4] + p.z()*m[8] + m[12]) / w;
+        double y = (p.x()*m[1] + p.y()*m[5] + p.z()*m[9] + m[13]) / w;
+        double z = (p.x()*m[2] + p.y()*m[6] + p.z()*m[10] + m[14]) / w;
+
+        if (x < -margin || x > width + margin ||
+            y < -margin || y > height + margin ||
+            z < 0.0 || z > 1.0)
+        {
+            continue;
+        }
+
+        if (horizon.valid() && !horizon->isVisible(p))
+            continue;
+
+        // screen-space direction of north, so the icon can be rotated
+        // to its heading regardless of the camera orientation:
+        float rotation = -osg::DegreesToRadians(_heading[i]);
+        osg::Vec3d n = p + osg::Vec3d(_north[i]) * ((eye - p).length() * 0.01);
+        double nw = n.x()*m[3] + n.y()*m[7] + n.z()*m[11] + m[15];
+        if (nw > 0.0)
+        {
+            double dx = (n.x()*m[0] + n.y()*m[4] + n.z()*m[8] + m[12]) / nw - x;
+            double dy = (n.x()*m[1] + n.y()*m[5] + n.z()*m[9] + m[13]) / nw - y;
+            if (dx != 0.0 || dy != 0.0)
+                rotation += atan2(-dx, dy);
+        }
+
+        output.ids.push_back(i);
+        output.screen.push_back(osg::Vec3f(x, y, z));
+        output.rotation.push_back(rotation);
+    }
+}
+
+TrackSet::CameraData&
+TrackSet::getCameraData(osg::Camera* camera)
+{
+    CameraData& data = _cameraDataMap.get(camera);
+
+    if (!data.hud.valid())
+    {
+        data.icons = new osg::Geometry();
+        data.icons->setName("TrackSet icons");
+        data.icons->setDataVariance(osg::Object::DYNAMIC);
+        data.icons->setUseDisplayList(false);
+        data.icons->setUseVertexBufferObjects(true);
+        data.icons->setVertexArray(new osg::Vec3Array());
+        data.icons->setTexCoordArray(0, new osg::Vec2Array(), osg::Array::BIND_PER_VERTEX);
+        osg::Vec4Array* colors = new osg::Vec4Array(osg::Array::BIND_OVERALL);
+        colors->push_back(osg::Vec4(1, 1, 1, 1));
+        data.icons->setColorArray(colors);
+        data.icons->addPrimitiveSet(new osg::DrawElementsUInt(GL_TRIANGLES));
+
+        osg::Geode* geode = new osg::Geode();
+        geode->addDrawable(data.icons.get());
+
+        data.hud = new osg::Camera();
+        data.hud->setReferenceFrame(osg::Transform::ABSOLUTE_RF);
+        data.hud->setRenderOrder(osg::Camera::NESTED_RENDER);
+        data.hud->setClearMask(0);
+        data.hud->setAllowEventFocus(false);
+        data.hud->setViewMatrix(osg::Matrix::identity());
+        data.hud->setStateSet(_iconStateSet.get());
+        data.hud->addChild(geode);
+    }
+
+    return data;
+}
+
+void
+TrackSet::updateIcons(CameraData& data)
+{
+    osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(data.icons->getVertexArray());
+    osg::Vec2Array* tcoords = static_cast<osg::Vec2Array*>(data.icons->getTexCoordArray(0));
+    osg::DrawElementsUInt* elements = static_cast<osg::DrawElementsUInt*>(data.icons->getPrimitiveSet(0));
+
+    verts->clear();
+    tcoords->clear();
+    elements->clear();
+
+    const Projection& proj = data.projection;
+
+    if (_atlas.valid() && !proj.ids.empty())
+    {
+        verts->reserve(proj.ids.size() * 4u);
+        tcoords->reserve(proj.ids.size() * 4u);
+        elements->reserve(proj.ids.size() * 6u);
+
+        const float half = _iconSize * 0.5f;
+        const float du = 1.0f / (float)_atlasCols;
+        const float dv = 1.0f / (float)_atlasRows;
+
+        for (unsigned i = 0; i < proj.ids.size(); ++i)
+        {
+            unsigned icon = _icon[proj.ids[i]];
+            if (icon >= _iconImages.size())
+                continue;
+
+            const osg::Vec3f& s = proj.screen[i];
+            float c = cosf(proj.rotation[i]) * half;
+            float r = sinf(proj.rotation[i]) * half;
+
+            // rotated quad corners (LL, LR, UR, UL) around the screen point
+            GLuint base = verts->size();
+            verts->push_back(osg::Vec3f(s.x() - c + r, s.y() - r - c, 0.0f));
+            verts->push_back(osg::Vec3f(s.x() + c + r, s.y() + r - c, 0.0f));
+            verts->push_back(osg::Vec3f(s.x() + c - r, s.y() + r + c, 0.0f));
+            verts->push_back(osg::Vec3f(s.x() - c - r, s.y() - r + c, 0.0f));
+
+            float u0 = (float)(icon % _atlasCols) * du;
+            float v0 = (float)(icon / _atlasCols) * dv;
+            tcoords->push_back(osg::Vec2f(u0, v0));
+            tcoords->push_back(osg::Vec2f(u0 + du, v0));
+            tcoords->push_back(osg::Vec2f(u0 + du, v0 + dv));
+            tcoords->push_back(osg::Vec2f(u0, v0 + dv));
+
+            elements->push_back(base);
+            elements->push_back(base + 1);
+            elements->push_back(base + 2);
+            elements->push_back(base);
+            elements->push_back(base + 2);
+            elements->push_back(base + 3);
+        }
+    }
+
+    verts->dirty();
+    tcoords->dirty();
+    elements->dirty();
+    data.icons->dirtyBound();
+}
+
+void
+TrackSet::updateLabels(CameraData& data)
+{
+    const Projection& proj = data.projection;
+
+    // candidates are visible tracks with at least one non-empty field
+    std::vector<unsigned> candidates;
+    if (_maxLabels > 0u && !_fields.empty())
+    {
+        for (unsigned i = 0; i < proj.ids.size(); ++i)
+        {
+            unsigned id = proj.ids[i];
+            for (unsigned f = 0; f < _fields.size(); ++f)
+            {
+                if (!_fields[f][id].empty())
+                {
+                    candidates.push_back(i);
+                    break;
+                }
+            }
+        }
+    }
+
+    unsigned count = std::min((unsigned)candidates.size(), _maxLabels);
+    if (count < candidates.size())
+    {
+        std::partial_sort(
+            candidates.begin(), candidates.begin() + count, candidates.end(),
+            SortLabelCandidates(_priority, proj));
+    }
+
+    // grow the label pool as needed
+    while (data.labels.size() < count)
+    {
+        LabelNode* label = new LabelNode();
+        label->setDynamic(true);
+        label->setStyle(_labelStyle);
+        label->setHorizonCulling(false);
+        label->setOcclusionCulling(false);
+        data.labels.push_back(label);
+        data.labelText.push_back(std::string());
+    }
+
+    std::string text;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        unsigned id = proj.ids[candidates[i]];
+        LabelNode* label = data.labels[i].get();
+
+        text.clear();
+        for (unsigned f = 0; f < _fields.size(); ++f)
+        {
+            if (!_fields[f][id].empty())
+            {
+                if (!text.empty())
+                    text += '\n';
+                text += _fields[f][id];
+            }
+        }
+
+        if (text != data.labelText[i])
+        {
+            label->setText(text);
+            data.labelText[i] = text;
+        }
+
+        label->setPosition(GeoPoint(_geoSRS.get(), _lla[id], ALTMODE_ABSOLUTE));
+
+        if (label->getPriority() != _priority[id])
+            label->setPriority(_priority[id]);
+
+        label->setNodeMask(~0);
+    }
+
+    for (unsigned i = count; i < data.labels.size(); ++i)
+    {
+        data.labels[i]->setNodeMask(0);
+    }
+}
+
+void
+TrackSet::cull(osgUtil::CullVisitor* cv)
+{
+    const osg::Viewport* viewport = cv->getViewport();
+    if (!viewport)
+        return;
+
+    CameraData& data = getCameraData(cv->getCurrentCamera());
+
+    const osg::Matrixd& mv = *cv->getModelViewMatrix();
+    osg::Matrixd mvpw = mv * (*cv->getProjectionMatrix()) * viewport->computeWindowMatrix();
+    osg::Vec3d eye = osg::Vec3d(0, 0, 0) * osg::Matrixd::inverse(mv);
+
+    // window coordinates from the projection include the viewport origin,
+    // so the HUD covers the same range:
+    project(mvpw, eye, viewport->width(), viewport->height(), data.projection);
+    for (unsigned i = 0; i < data.projection.screen.size(); ++i)
+    {
+        data.projection.screen[i].x() -= viewport->x();
+        data.projection.screen[i].y() -= viewport->y();
+    }
+
+    data.hud->setProjectionMatrix(osg::Matrix::ortho2D(0, viewport->width(), 0, viewport->height()));
+
+    updateIcons(data);
+    data.hud->accept(*cv);
+
+    updateLabels(data);
+    for (unsigned i = 0; i < data.labels.size(); ++i)
+    {
+        data.labels[i]->accept(*cv);
+    }
+}
+
+void
+TrackSet::traverse(osg::NodeVisitor& nv)
+{
+    if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+    {
+        applyUpdates();
+    }
+
+    if (nv.getVisitorType() == nv.CULL_VISITOR)
+    {
+        osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(&nv);
+        if (cv)
+        {
+            cull(cv);
+        }
+    }
+    else
+    {
+        AcceptLabels accept(nv);
+        _cameraDataMap.forEach(accept);
+    }
+
+    osg::Node::traverse(nv);
+}
+
+void
+TrackSet::resizeGLObjectBuffers(unsigned maxSize)
+{
+    osg::Node::resizeGLObjectBuffers(maxSize);
+
+    if (_atlas.valid())
+        _atlas->resizeGLObjectBuffers(maxSize);
+
+    ResizeGLObjects functor(maxSize);
+    _cameraDataMap.forEach(functor);
+}
+
+void
+TrackSet::releaseGLObjects(osg::State* state) const
+{
+    osg::Node::releaseGLObjects(state);
+
+    if (_atlas.valid())
+        _atlas->releaseGLObjects(state);
+
+    ReleaseGLObjects functor(state);
+    _cameraDataMap.forEach(functor);
+}
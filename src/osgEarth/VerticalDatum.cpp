@@ -20,6 +20,8 @@
 #include <osgEarth/VerticalDatum>
 #include <osgEarth/Threading>
 #include <osgEarth/GeoData>
+#include <osgEarth/Containers>
+#include <osgEarth/Math>
 
 #include <osgDB/ReadFile>
 #include <stdlib.h>
@@ -37,7 +39,54 @@ namespace
     VDatumCache _vdatumCache;
     Threading::Mutex _vdataCacheMutex("VDatumCache(OE)");
     bool _vdatumWarning = false;
-} 
+
+    // Identifies the posts of a heightfield being converted between two datums
+    struct OffsetGridKey
+    {
+        const VerticalDatum* from;
+        const VerticalDatum* to;
+        const SpatialReference* srs;
+        double xmin, ymin, xmax, ymax;
+        unsigned cols, rows;
+
+        bool operator == (const OffsetGridKey& rhs) const {
+            return
+                from == rhs.from && to == rhs.to && srs == rhs.srs &&
+                xmin == rhs.xmin && ymin == rhs.ymin && xmax == rhs.xmax && ymax == rhs.ymax &&
+                cols == rhs.cols && rows == rhs.rows;
+        }
+    };
+
+    // Because the units conversion is linear, converting a post is always
+    // out = scale * in + offset(lat, lon). The grid holds the offset for
+    // every post, row-major like the heightfield itself.
+    struct OffsetGrid
+    {
+        // hold the datums so their addresses (in the key) stay unique
+        osg::ref_ptr<const VerticalDatum> from, to;
+        std::vector<float> offsets;
+    };
+    using OffsetGridPtr = std::shared_ptr<const OffsetGrid>;
+}
+
+namespace std {
+    template<> struct hash<OffsetGridKey> {
+        inline size_t operator()(const OffsetGridKey& k) const {
+            std::hash<double> h;
+            return osgEarth::hash_value_unsigned(
+                osgEarth::hash_value_unsigned((std::size_t)k.from, (std::size_t)k.to, (std::size_t)k.srs),
+                osgEarth::hash_value_unsigned(h(k.xmin), h(k.ymin), h(k.xmax), h(k.ymax)),
+                osgEarth::hash_value_unsigned((std::size_t)k.cols, (std::size_t)k.rows));
+        }
+    };
+}
+
+namespace
+{
+    // Recently used grids; elevation tiles at the same key and size (from
+    // several layers, or re-requested) share a grid.
+    LRUCache<OffsetGridKey, OffsetGridPtr> _offsetGrids(true, 64u);
+}
 
 VerticalDatum*
 VerticalDatum::get( const std::string& initString )
@@ -151,34 +200,76 @@ VerticalDatum::transform(const VerticalDatum* from,
 
     unsigned cols = hf->getNumColumns();
     unsigned rows = hf->getNumRows();
-    
-    osg::Vec3d sw(extent.west(), extent.south(), 0.0);
-    osg::Vec3d ne(extent.east(), extent.north(), 0.0);
-    
-    double xstep = std::abs(extent.east() - extent.west()) / double(cols-1);
-    double ystep = std::abs(extent.north() - extent.south()) / double(rows-1);
+    if ( cols < 2 || rows < 2 )
+        return false;
 
-    if ( !extent.getSRS()->isGeographic() )
+    Units fromUnits = from ? from->getUnits() : Units::METERS;
+    Units toUnits = to ? to->getUnits() : Units::METERS;
+    float scale = (float)fromUnits.convertTo(toUnits, 1.0);
+
+    OffsetGridKey key;
+    key.from = from;
+    key.to = to;
+    key.srs = extent.getSRS();
+    key.xmin = extent.west(), key.ymin = extent.south();
+    key.xmax = extent.east(), key.ymax = extent.north();
+    key.cols = cols, key.rows = rows;
+
+    OffsetGridPtr grid;
+
+    LRUCache<OffsetGridKey, OffsetGridPtr>::Record record;
+    if (_offsetGrids.get(key, record))
     {
-        const SpatialReference* geoSRS = extent.getSRS()->getGeographicSRS();
-        extent.getSRS()->transform(sw, geoSRS, sw);
-        extent.getSRS()->transform(ne, geoSRS, ne);
-        xstep = (ne.x()-sw.x()) / double(cols-1);
-        ystep = (ne.y()-sw.y()) / double(rows-1);
+        grid = record.value();
     }
-
-    for( unsigned c=0; c<cols; ++c)
+    else
     {
-        double lon = sw.x() + xstep*double(c);
+        osg::Vec3d sw(extent.west(), extent.south(), 0.0);
+        osg::Vec3d ne(extent.east(), extent.north(), 0.0);
+
+        double xstep = std::abs(extent.east() - extent.west()) / double(cols-1);
+        double ystep = std::abs(extent.north() - extent.south()) / double(rows-1);
+
+        if ( !extent.getSRS()->isGeographic() )
+        {
+            const SpatialReference* geoSRS = extent.getSRS()->getGeographicSRS();
+            extent.getSRS()->transform(sw, geoSRS, sw);
+            extent.getSRS()->transform(ne, geoSRS, ne);
+            xstep = (ne.x()-sw.x()) / double(cols-1);
+            ystep = (ne.y()-sw.y()) / double(rows-1);
+        }
+
+        auto newGrid = std::make_shared<OffsetGrid>();
+        newGrid->from = from;
+        newGrid->to = to;
+        newGrid->offsets.resize(cols*rows);
+
+        float* offset = &newGrid->offsets[0];
         for( unsigned r=0; r<rows; ++r)
         {
             double lat = sw.y() + ystep*double(r);
-            float& h = hf->getHeight(c, r);
-            if (h != NO_DATA_VALUE)
+            for( unsigned c=0; c<cols; ++c)
             {
-                VerticalDatum::transform( from, to, lat, lon, h );
+                double lon = sw.x() + xstep*double(c);
+
+                // the converted value of a zero height is the offset:
+                double z = 0.0;
+                VerticalDatum::transform( from, to, lat, lon, z );
+                *offset++ = (float)z;
             }
         }
+
+        grid = newGrid;
+        _offsetGrids.insert(key, grid);
+    }
+
+    // single fused pass over the posts:
+    float* h = &hf->getFloatArray()->front();
+    const float* offset = &grid->offsets[0];
+    unsigned count = cols*rows;
+    for( unsigned i=0; i<count; ++i)
+    {
+        h[i] = h[i] != NO_DATA_VALUE ? scale*h[i] + offset[i] : h[i];
     }
 
     return true;
@@ -314,133 +314,23 @@ WFSFeatureSource::openImplementation()
 
 
 
-void
-WFSFeatureSource::saveResponse(const std::string buffer, const std::string& filename)
-{
-    std::ofstream fout;
-    fout.open(filename.c_str(), std::ios::out | std::ios::binary);
-    fout.write(buffer.c_str(), buffer.size());
-    fout.close();
-}
-
 bool
 WFSFeatureSource::getFeatures(const std::string& buffer, const std::string& mimeType, FeatureList& features)
 {
-    // Unnecessary - dataset is created and destroyed locally
-    //OGR_SCOPED_LOCK;
-
-    bool json = isJSON(mimeType);
-    bool gml = isGML(mimeType);
-
-    // find the right driver for the given mime type
-    OGRSFDriverH ogrDriver =
-        json ? OGRGetDriverByName("GeoJSON") :
-        gml ? OGRGetDriverByName("GML") :
-        0L;
-
-    // fail if we can't find an appropriate OGR driver:
-    if (!ogrDriver)
-    {
-        OE_WARN << LC << "Error reading WFS response; cannot grok content-type \"" << mimeType << "\""
-            << std::endl;
+    FeatureList parsed;
+    if (!OgrUtils::readFeatures(buffer, mimeType, getFeatureProfile(), *_options->rewindPolygons(), parsed))
         return false;
-    }
 
-    std::string tmpName;
-
-    OGRDataSourceH ds = 0;
-    //GML needs to be saved to a temp file to load from disk.  GeoJSON can be loaded directly from memory
-    if (gml)
-    {
-        std::string ext = getExtensionForMimeType(mimeType);
-        //Save the response to a temp file
-        std::string tmpPath = getTempPath();
-        tmpName = getTempName(tmpPath, ext);
-        saveResponse(buffer, tmpName);
-        ds = OGROpen(tmpName.c_str(), FALSE, &ogrDriver);
-    }
-    else if (json)
+    for (auto& f : parsed)
     {
-        //Open GeoJSON directly from memory
-        ds = OGROpen(buffer.c_str(), FALSE, &ogrDriver);
-    }
-
-
-    if (!ds)
-    {
-        OE_WARN << LC << "Error reading WFS response" << std::endl;
-        return false;
-    }
-
-    // read the feature data.
-    OGRLayerH layer = OGR_DS_GetLayer(ds, 0);
-    if (layer)
-    {
-        OGR_L_ResetReading(layer);
-        OGRFeatureH feat_handle;
-        while ((feat_handle = OGR_L_GetNextFeature(layer)) != NULL)
-        {
-            if (feat_handle)
-            {
-                osg::ref_ptr<Feature> f = OgrUtils::createFeature(feat_handle, getFeatureProfile(), *_options->rewindPolygons());
-                if (f.valid() && !isBlacklisted(f->getFID()))
-                {
-                    features.push_back(f.release());
-                }
-                OGR_F_Destroy(feat_handle);
-            }
-        }
-    }
-
-    // Destroy the datasource
-    OGR_DS_Destroy(ds);
-
-    //Delete the temp file if one was created
-    if (!tmpName.empty())
-    {
-        remove(tmpName.c_str());
+        if (!isBlacklisted(f->getFID()))
+            features.push_back(f);
     }
 
     return true;
 }
 
 
-std::string
-WFSFeatureSource::getExtensionForMimeType(const std::string& mime)
-{
-    //OGR is particular sometimes about the extension of files when it's reading them so it's good to have
-    //the temp file have an appropriate extension
-    if (isGML(mime))
-    {
-        return ".xml";
-    }
-    else if (isJSON(mime))
-    {
-        return ".json";
-    }
-    return "";
-}
-
-bool
-WFSFeatureSource::isGML(const std::string& mime) const
-{
-    return
-        startsWith(mime, "text/xml");
-}
-
-
-bool
-WFSFeatureSource::isJSON(const std::string& mime) const
-{
-    return
-        startsWith(mime, "application/json") ||
-        startsWith(mime, "json") ||
-        startsWith(mime, "application/x-javascript") ||
-        startsWith(mime, "text/javascript") ||
-        startsWith(mime, "text/x-javascript") ||
-        startsWith(mime, "text/x-json");
-}
-
 std::string
 WFSFeatureSource::createURL(const Query& query) const
 {
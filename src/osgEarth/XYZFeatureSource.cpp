@@ -28,7 +28,6 @@
 #define LC "[XYZFeatureSource] " << getName() << " : "
 
 using namespace osgEarth;
-#define OGR_SCOPED_LOCK GDAL_SCOPED_LOCK
 
 //........................................................................
 
@@ -212,108 +211,21 @@ XYZFeatureSource::getFeatures(const std::string& buffer, const TileKey& key, con
     }
     else
     {
-        // find the right driver for the given mime type
-        OGR_SCOPED_LOCK;
-
-        // find the right driver for the given mime type
-        OGRSFDriverH ogrDriver =
-            isJSON(mimeType) ? OGRGetDriverByName("GeoJSON") :
-            isGML(mimeType) ? OGRGetDriverByName("GML") :
-            0L;
-
-        // fail if we can't find an appropriate OGR driver:
-        if (!ogrDriver)
-        {
-            OE_WARN << LC << "Error reading response; cannot grok content-type \"" << mimeType << "\""
-                << std::endl;
+        FeatureList parsed;
+        if (!OgrUtils::readFeatures(buffer, mimeType, getFeatureProfile(), *_options->rewindPolygons(), parsed))
             return false;
-        }
 
-        OGRDataSourceH ds = OGROpen(buffer.c_str(), FALSE, &ogrDriver);
-
-        if (!ds)
+        for (auto& f : parsed)
         {
-            OE_WARN << LC << "Error reading response" << std::endl;
-            return false;
+            if (!isBlacklisted(f->getFID()))
+                features.push_back(f);
         }
-
-        // read the feature data.
-        OGRLayerH layer = OGR_DS_GetLayer(ds, 0);
-        if (layer)
-        {
-            const SpatialReference* srs = getFeatureProfile()->getSRS();
-
-            OGR_L_ResetReading(layer);
-            OGRFeatureH feat_handle;
-            while ((feat_handle = OGR_L_GetNextFeature(layer)) != NULL)
-            {
-                if (feat_handle)
-                {
-                    osg::ref_ptr<Feature> f = OgrUtils::createFeature(feat_handle, getFeatureProfile(), *_options->rewindPolygons());
-                    if (f.valid() && !isBlacklisted(f->getFID()))
-                    {
-                        features.push_back(f.release());
-                    }
-                    OGR_F_Destroy(feat_handle);
-                }
-            }
-        }
-
-        // Destroy the datasource
-        OGR_DS_Destroy(ds);
     }
 
     return true;
 }
 
 
-std::string
-XYZFeatureSource::getExtensionForMimeType(const std::string& mime)
-{
-    //OGR is particular sometimes about the extension of files when it's reading them so it's good to have
-    //the temp file have an appropriate extension
-    if ((mime.compare("text/xml") == 0) ||
-        (mime.compare("text/xml; subtype=gml/2.1.2") == 0) ||
-        (mime.compare("text/xml; subtype=gml/3.1.1") == 0)
-        )
-    {
-        return ".xml";
-    }
-    else if ((mime.compare("application/json") == 0) ||
-        (mime.compare("json") == 0) ||
-
-        (mime.compare("application/x-javascript") == 0) ||
-        (mime.compare("text/javascript") == 0) ||
-        (mime.compare("text/x-javascript") == 0) ||
-        (mime.compare("text/x-json") == 0)
-        )
-    {
-        return ".json";
-    }
-    return "";
-}
-
-bool
-XYZFeatureSource::isGML(const std::string& mime) const
-{
-    return
-        startsWith(mime, "text/xml");
-}
-
-
-bool
-XYZFeatureSource::isJSON(const std::string& mime) const
-{
-    return
-        (mime.compare("application/json") == 0) ||
-        (mime.compare("json") == 0) ||
-
-        (mime.compare("application/x-javascript") == 0) ||
-        (mime.compare("text/javascript") == 0) ||
-        (mime.compare("text/x-javascript") == 0) ||
-        (mime.compare("text/x-json") == 0);
-}
-
 URI
 XYZFeatureSource::createURL(const Query& query)
 {
@@ -24,6 +24,7 @@
 #include <osgEarth/Metrics>
 #include <osg/Point>
 #include <osgUtil/MeshOptimizers>
+#include <algorithm>
 #include <cstdlib> // for getenv
 
 using namespace osgEarth;
@@ -35,7 +36,9 @@ using namespace osgEarth::REX;
 GeometryPool::GeometryPool() :
 _enabled ( true ),
 _debug   ( false ),
-_geometryMapMutex("GeometryPool(OE)")
+_geometryMapMutex("GeometryPool(OE)"),
+_constrainedUseCount(0u),
+_maxConstrainedMeshes(256u)
 {
     ADJUST_UPDATE_TRAV_COUNT(this, +1);
 
@@ -77,10 +80,31 @@ GeometryPool::getPooledGeometry(
         }
     }
 
-    MeshEditor meshEditor(tileKey, tileSize, map, nullptr);
+    MeshEditor meshEditor(tileKey, tileSize, map);
 
     if ( _enabled )
     {
+        // Constrained meshes are expensive to cut, and the same tiles page
+        // in and out repeatedly, so reuse them until a constraint changes.
+        ConstrainedKey constrainedKey;
+        if (meshEditor.hasConstraintLayers())
+        {
+            constrainedKey.tileKey = tileKey;
+            constrainedKey.size = tileSize;
+            constrainedKey.signature = meshEditor.getSignature();
+
+            Threading::ScopedMutexLock lock(_geometryMapMutex);
+            ConstrainedMap::iterator i = _constrainedMap.find(constrainedKey);
+            if (i != _constrainedMap.end())
+            {
+                i->second.lastUsed = ++_constrainedUseCount;
+                out = i->second.geometry.get();
+                return;
+            }
+        }
+
+        meshEditor.loadEdits(nullptr);
+
         // first check the sharing cache:
         if (!meshEditor.hasEdits())
         {
@@ -111,10 +135,20 @@ GeometryPool::getPooledGeometry(
                 _geometryMap[geomKey] = out.get();
             }
         }
+
+        if (meshEditor.hasConstraintLayers() && !(progress && progress->isCanceled()))
+        {
+            Threading::ScopedMutexLock lock(_geometryMapMutex);
+            ConstrainedEntry& entry = _constrainedMap[constrainedKey];
+            entry.geometry = out.get();
+            entry.lastUsed = ++_constrainedUseCount;
+        }
     }
 
     else
     {
+        meshEditor.loadEdits(nullptr);
+
         out = createGeometry(
             tileKey,
             tileSize,
@@ -464,6 +498,35 @@ GeometryPool::traverse(osg::NodeVisitor& nv)
         {
             _geometryMap.erase(*key);
         }
+
+        // trim the constrained mesh cache, least recently used first,
+        // skipping any mesh that a live tile is still using.
+        if (_constrainedMap.size() > _maxConstrainedMeshes)
+        {
+            std::vector<std::pair<unsigned, ConstrainedMap::iterator>> unused;
+            for (ConstrainedMap::iterator i = _constrainedMap.begin(); i != _constrainedMap.end(); ++i)
+            {
+                // unconstrained entries alias the shared pool, which owns them
+                const SharedGeometry* geom = i->second.geometry.get();
+                if (geom == nullptr || !geom->hasConstraints() || geom->referenceCount() == 1)
+                {
+                    unused.emplace_back(i->second.lastUsed, i);
+                }
+            }
+
+            std::sort(unused.begin(), unused.end(),
+                [](const std::pair<unsigned, ConstrainedMap::iterator>& lhs, const std::pair<unsigned, ConstrainedMap::iterator>& rhs) {
+                    return lhs.first < rhs.first; });
+
+            std::size_t excess = _constrainedMap.size() - _maxConstrainedMeshes;
+            for (std::size_t n = 0; n < unused.size() && n < excess; ++n)
+            {
+                ConstrainedEntry& entry = unused[n].second->second;
+                if (entry.geometry.valid() && entry.geometry->hasConstraints())
+                    entry.geometry->releaseGLObjects(NULL);
+                _constrainedMap.erase(unused[n].second);
+            }
+        }
     }
 
     osg::Group::traverse(nv);
@@ -475,6 +538,7 @@ GeometryPool::clear()
     releaseGLObjects(NULL);
     Threading::ScopedMutexLock lock(_geometryMapMutex);
     _geometryMap.clear();
+    _constrainedMap.clear();
 }
 
 void
@@ -490,6 +554,12 @@ GeometryPool::resizeGLObjectBuffers(unsigned maxsize)
         {
             i->second->resizeGLObjectBuffers(maxsize);
         }
+
+        for (ConstrainedMap::const_iterator i = _constrainedMap.begin(); i != _constrainedMap.end(); ++i)
+        {
+            if (i->second.geometry.valid() && i->second.geometry->hasConstraints())
+                i->second.geometry->resizeGLObjectBuffers(maxsize);
+        }
     }
 }
 
@@ -513,6 +583,16 @@ GeometryPool::releaseGLObjects(osg::State* state) const
                     i->second->releaseGLObjects(state);
             }
 
+            for (ConstrainedMap::const_iterator i = _constrainedMap.begin(); i != _constrainedMap.end(); ++i)
+            {
+                if (!i->second.geometry.valid() || !i->second.geometry->hasConstraints())
+                    continue;
+                else if (_releaser.valid())
+                    objects.push_back(i->second.geometry.get());
+                else
+                    i->second.geometry->releaseGLObjects(state);
+            }
+
             if (_releaser.valid() && !objects.empty())
             {
                 OE_DEBUG << LC << "Released " << objects.size() << " objects in the geometry pool\n";
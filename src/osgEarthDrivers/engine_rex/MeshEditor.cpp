@@ -8,6 +8,7 @@
 //#include <osgEarth/rtree.h>
 #include <osgEarth/weemesh.h>
 #include <algorithm>
+#include <cfloat>
 #include <iostream>
 
 #define LC "[MeshEditor] "
@@ -16,7 +17,135 @@ using namespace osgEarth;
 using namespace osgEarth::REX;
 using namespace weemesh;
 
-MeshEditor::MeshEditor(const TileKey& key, unsigned tileSize, const Map* map, ProgressCallback* progress) :
+namespace
+{
+    // Point-in-ring test that buckets the ring's edges into horizontal
+    // bands, so a query only visits the edges that can cross its scanline.
+    // Uses exactly the same crossing rule as Ring::contains2D.
+    class BandedRing
+    {
+    public:
+        BandedRing(const Ring& ring)
+        {
+            bool is_open = ring.isOpen();
+            unsigned i = is_open ? 0 : 1;
+            unsigned j = is_open ? ring.size() - 1 : 0;
+
+            _ymin = DBL_MAX, _ymax = -DBL_MAX;
+            for (; i < ring.size(); j = i++)
+            {
+                // horizontal edges can never satisfy the crossing rule
+                if (ring[i].y() == ring[j].y())
+                    continue;
+
+                _edges.push_back(Edge{ ring[i].x(), ring[i].y(), ring[j].x(), ring[j].y() });
+                _ymin = std::min(_ymin, std::min(ring[i].y(), ring[j].y()));
+                _ymax = std::max(_ymax, std::max(ring[i].y(), ring[j].y()));
+            }
+
+            if (_edges.empty())
+                return;
+
+            unsigned numBands = osg::clampBetween((unsigned)_edges.size() / 2u, 1u, 256u);
+            _scale = (double)numBands / (_ymax - _ymin);
+            _bands.resize(numBands);
+
+            for (unsigned e = 0; e < _edges.size(); ++e)
+            {
+                const Edge& edge = _edges[e];
+                unsigned b0 = band(std::min(edge.yi, edge.yj));
+                unsigned b1 = band(std::max(edge.yi, edge.yj));
+                for (unsigned b = b0; b <= b1; ++b)
+                    _bands[b].push_back(e);
+            }
+        }
+
+        bool contains(double x, double y) const
+        {
+            // no edge can satisfy the crossing rule outside [ymin, ymax)
+            if (_edges.empty() || y < _ymin || y >= _ymax)
+                return false;
+
+            bool result = false;
+            for (unsigned e : _bands[band(y)])
+            {
+                const Edge& edge = _edges[e];
+                if ((((edge.yi <= y) && (y < edge.yj)) ||
+                     ((edge.yj <= y) && (y < edge.yi))) &&
+                    (x < (edge.xj - edge.xi) * (y - edge.yi) / (edge.yj - edge.yi) + edge.xi))
+                {
+                    result = !result;
+                }
+            }
+            return result;
+        }
+
+    private:
+        struct Edge { double xi, yi, xj, yj; };
+        std::vector<Edge> _edges;
+        std::vector<std::vector<unsigned>> _bands;
+        double _ymin, _ymax, _scale;
+
+        // monotonic in y, so an edge spanning [lo, hi] is listed in
+        // every band a query inside that span can map to.
+        unsigned band(double y) const
+        {
+            int b = (int)((y - _ymin) * _scale);
+            return (unsigned)osg::clampBetween(b, 0, (int)_bands.size() - 1);
+        }
+    };
+
+    // Banded version of Polygon::contains2D
+    class BandedPolygon
+    {
+    public:
+        BandedPolygon(const Polygon& polygon) : _outer(polygon)
+        {
+            for (auto& hole : polygon.getHoles())
+                _holes.emplace_back(*hole.get());
+        }
+
+        bool contains(double x, double y) const
+        {
+            if (!_outer.contains(x, y))
+                return false;
+
+            for (auto& hole : _holes)
+                if (hole.contains(x, y))
+                    return false;
+
+            return true;
+        }
+
+    private:
+        BandedRing _outer;
+        std::vector<BandedRing> _holes;
+    };
+
+    // Transforms a part's points (in the tile's SRS) into the tile's local
+    // tangent plane, converting the whole part at once.
+    void toLocal(Geometry* part, const SpatialReference* tileSRS, const osg::Matrix& world2local)
+    {
+        if (tileSRS->isGeographic() || tileSRS->isCube())
+        {
+            tileSRS->transform(part->asVector(), tileSRS->getGeocentricSRS());
+
+            for (auto& point : *part)
+                point = point * world2local;
+        }
+        else
+        {
+            osg::Vec3d world;
+            for (auto& point : *part)
+            {
+                tileSRS->transformToWorld(point, world);
+                point = world * world2local;
+            }
+        }
+    }
+}
+
+MeshEditor::MeshEditor(const TileKey& key, unsigned tileSize, const Map* map) :
     _key( key ), 
     _tileSize(tileSize),
     _tileEmpty(false)
@@ -37,6 +166,29 @@ MeshEditor::MeshEditor(const TileKey& key, unsigned tileSize, const Map* map, Pr
         if (!layer->getExtent().intersects(keyExtent))
             continue;
 
+        FeatureSource* fs = layer->getFeatureSource();
+        if (fs)
+        {
+            _layers.push_back(layer);
+
+            _signature.push_back((int)layer->getUID());
+            _signature.push_back(layer->getRevision());
+            _signature.push_back((int)fs->getUID());
+            _signature.push_back(fs->getRevision());
+            _signature.push_back(
+                (layer->getRemoveInterior() ? 1 : 0) |
+                (layer->getHasElevation() ? 2 : 0));
+        }
+    }
+}
+
+void
+MeshEditor::loadEdits(ProgressCallback* progress)
+{
+    const GeoExtent& keyExtent = _key.getExtent();
+
+    for(auto& layer : _layers)
+    {
         // For each feature, check that it intersects the tile key,
         // and then xform it to the correct SRS and clone it for
         // editing.
@@ -44,7 +196,7 @@ MeshEditor::MeshEditor(const TileKey& key, unsigned tileSize, const Map* map, Pr
         if (fs)
         {
             osg::ref_ptr<FeatureCursor> cursor = fs->createFeatureCursor(
-                key,
+                _key,
                 progress);
 
             Edit edit;
@@ -196,7 +348,6 @@ MeshEditor::createTileMesh(
         for (auto& feature : edit._features)
         {
             GeometryIterator geom_iter(feature->getGeometry(), true);
-            osg::Vec3d world, unit;
             while (geom_iter.hasMore())
             {
                 if (mesh._triangles.size() >= max_num_triangles)
@@ -210,11 +361,7 @@ MeshEditor::createTileMesh(
 
                 Geometry* part = geom_iter.next();
 
-                for (auto& point : *part)
-                {
-                    tileSRS->transformToWorld(point, world);
-                    point = world * world2local;
-                }
+                toLocal(part, tileSRS, world2local);
 
                 int marker = default_marker;
 
@@ -281,12 +428,14 @@ MeshEditor::createTileMesh(
                     {
                         std::list<triangle_t*> trisToRemove;
 
+                        BandedPolygon polygon(*static_cast<Polygon*>(part));
+
                         for (auto& tri_iter : mesh._triangles)
                         {
                             triangle_t& tri = tri_iter.second;
                             vert_t c = (tri.p0 + tri.p1 + tri.p2) * (1.0 / 3.0);
 
-                            bool inside = part->contains2D(c.x(), c.y());
+                            bool inside = polygon.contains(c.x(), c.y());
 
                             if ((inside == true) && edit._layer->getRemoveInterior())
                             {
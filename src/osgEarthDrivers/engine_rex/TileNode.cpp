@@ -71,7 +71,8 @@ TileNode::TileNode(
     _loadQueue("TileNode LoadQueue(OE)"),
     _createChildAsync(true),
     _nextLoadManifestPtr(nullptr),
-    _loadPriority(0.0f)
+    _loadPriority(0.0f),
+    _registryHandle(~std::uint64_t(0))
 {
     OE_HARD_ASSERT(context != nullptr, __func__);
 
@@ -28,26 +28,41 @@ using namespace osgEarth;
 #define OE_TEST OE_NULL
 //#define OE_TEST OE_INFO
 
-#define SENTRY_VALUE NULL
-
 #define PROFILING_REX_TILES "Live Terrain Tiles"
 
 //----------------------------------------------------------------------------
 
+TileNodeRegistry::SlotBlock::SlotBlock()
+{
+    for (unsigned i = 0; i < SLOT_BLOCK_SIZE; ++i)
+    {
+        _tile[i] = nullptr;
+        _generation[i] = 0u;
+        _lastFrame[i] = ~0u;
+        _lastTime[i] = DBL_MAX;
+        _lastRange[i] = FLT_MAX;
+    }
+}
+
 TileNodeRegistry::TileNodeRegistry(const std::string& name) :
 _name              ( name ),
 _revisioningEnabled( false ),
 _notifyNeighbors   ( false ),
 _firstLOD          ( 0u ),
+_numSlots          ( 0u ),
+_scanCursor        ( 0u ),
 _mutex("TileNodeRegistry(OE)")
 {
-    _tracker.push_front(SENTRY_VALUE);
-    _sentryptr = _tracker.begin();
+    for (unsigned b = 0; b < MAX_SLOT_BLOCKS; ++b)
+        _slotBlocks[b] = nullptr;
 }
 
 TileNodeRegistry::~TileNodeRegistry()
 {
     releaseAll(NULL);
+
+    for (unsigned b = 0; b < MAX_SLOT_BLOCKS; ++b)
+        delete _slotBlocks[b].load();
 }
 
 void
@@ -113,6 +128,69 @@ TileNodeRegistry::setDirty(const GeoExtent& extent,
     _mutex.unlock();
 }
 
+TileNodeRegistry::Handle
+TileNodeRegistry::acquireSlot(TileNode* tile)
+{
+    // ASSUME EXCLUSIVE LOCK
+
+    unsigned slot;
+    if (!_freeSlots.empty())
+    {
+        slot = _freeSlots.back();
+        _freeSlots.pop_back();
+    }
+    else
+    {
+        slot = _numSlots;
+        unsigned b = slot >> SLOT_BLOCK_BITS;
+        if (b >= MAX_SLOT_BLOCKS)
+        {
+            OE_WARN << LC << "Out of tile tracking slots; " << tile->getKey().str() << " will not expire" << std::endl;
+            return INVALID_HANDLE;
+        }
+        if (_slotBlocks[b].load() == nullptr)
+        {
+            // publish the new block so cull can see it
+            _slotBlocks[b].store(new SlotBlock(), std::memory_order_release);
+        }
+        ++_numSlots;
+    }
+
+    SlotBlock* block = _slotBlocks[slot >> SLOT_BLOCK_BITS].load();
+    unsigned i = slot & SLOT_BLOCK_MASK;
+    block->_tile[i] = tile;
+    resetSlot(slot);
+
+    return (Handle(block->_generation[i].load()) << 32) | Handle(slot);
+}
+
+void
+TileNodeRegistry::resetSlot(unsigned slot)
+{
+    // ASSUME EXCLUSIVE LOCK
+
+    SlotBlock* block = _slotBlocks[slot >> SLOT_BLOCK_BITS].load();
+    unsigned i = slot & SLOT_BLOCK_MASK;
+    block->_lastTime[i].store(DBL_MAX, std::memory_order_relaxed);
+    block->_lastFrame[i].store(~0u, std::memory_order_relaxed);
+    block->_lastRange[i].store(FLT_MAX, std::memory_order_relaxed);
+}
+
+void
+TileNodeRegistry::releaseSlot(unsigned slot)
+{
+    // ASSUME EXCLUSIVE LOCK
+
+    SlotBlock* block = _slotBlocks[slot >> SLOT_BLOCK_BITS].load();
+    unsigned i = slot & SLOT_BLOCK_MASK;
+    block->_tile[i] = nullptr;
+
+    // invalidate outstanding handles to this slot
+    block->_generation[i].fetch_add(1u, std::memory_order_release);
+
+    _freeSlots.push_back(slot);
+}
+
 void
 TileNodeRegistry::add(TileNode* tile)
 {
@@ -124,7 +202,6 @@ TileNodeRegistry::add(TileNode* tile)
     // not yet itself been removed by the Unloader. So we have to check!
 
     bool recyclingOrphan = false;
-    TrackerEntry* se;
     TableEntry* te;
 
     TileTable::iterator i = _tiles.find(tile->getKey());
@@ -133,26 +210,22 @@ TileNodeRegistry::add(TileNode* tile)
         // found an orphan! Reuse and overwrite it.
         recyclingOrphan = true;
         te = &i->second;
-        se = (*te->_trackerptr);
-        _tracker.erase(te->_trackerptr); // since we need to move it to the front
+        if (te->_handle != INVALID_HANDLE)
+        {
+            releaseSlot(unsigned(te->_handle & 0xFFFFFFFFu));
+        }
+        te->_tile->setRegistryHandle(INVALID_HANDLE);
         OE_DEBUG << "Reused orphaned tile record " << tile->getKey().str() << std::endl;
     }
     else
     {
         te = &_tiles[tile->getKey()];
-        se = new TrackerEntry();
     }
 
-    // init the tracker entry and place it at the front of the tracker:
-    se->_tile = tile;
-    se->_lastTime = DBL_MAX;
-    se->_lastFrame = ~0;
-    se->_lastRange = FLT_MAX;
-    _tracker.push_front(se);
-
-    // init the table entry:
+    // init the table entry and its tracking slot:
     te->_tile = tile;
-    te->_trackerptr = _tracker.begin();
+    te->_handle = acquireSlot(tile);
+    tile->setRegistryHandle(te->_handle);
     
     // Start waiting on our neighbors.
     // (If we're recycling and orphaned record, we need to remove old listeners first)
@@ -252,16 +325,23 @@ TileNodeRegistry::releaseAll(ResourceReleaser* releaser)
         }
     }
 
-    _tiles.clear();
-
-    for (Tracker::iterator i = _tracker.begin(); i != _tracker.end(); ++i)
+    // release the slots first, while the table still holds the tiles:
+    for (unsigned slot = 0; slot < _numSlots; ++slot)
     {
-        TrackerEntry* e = *i;
-        delete e;
+        SlotBlock* block = _slotBlocks[slot >> SLOT_BLOCK_BITS].load();
+        unsigned i = slot & SLOT_BLOCK_MASK;
+        if (block->_tile[i])
+        {
+            block->_tile[i]->setRegistryHandle(INVALID_HANDLE);
+            block->_tile[i] = nullptr;
+        }
+        block->_generation[i].fetch_add(1u, std::memory_order_release);
     }
-    _tracker.clear();
-    _tracker.push_front(SENTRY_VALUE);
-    _sentryptr = _tracker.begin();
+    _numSlots = 0u;
+    _freeSlots.clear();
+    _scanCursor = 0u;
+
+    _tiles.clear();
 
     _notifiers.clear();
 
@@ -278,34 +358,37 @@ TileNodeRegistry::releaseAll(ResourceReleaser* releaser)
 void
 TileNodeRegistry::update(TileNode* tile, osg::NodeVisitor& nv)
 {
-    _mutex.lock();
+    // No lock: slot blocks never move once published, and a stale
+    // handle is caught by the generation check.
+    Handle handle = tile->getRegistryHandle();
+    unsigned slot = unsigned(handle & 0xFFFFFFFFu);
+    unsigned b = slot >> SLOT_BLOCK_BITS;
 
-    // Find the tracker for this tile and update its timestamp
-    TileTable::iterator i = _tiles.find(tile->getKey());
-    if (i != _tiles.end())
-    {
-        TableEntry& e = i->second;
-        TrackerEntry* se = (*e._trackerptr);
-        se->_lastTime = _clock->getTime();
-        se->_lastFrame = _clock->getFrame();
-
-        const osg::BoundingSphere& bs = tile->getBound();
-        float range = nv.getDistanceToViewPoint(bs.center(), true) - bs.radius();
-        se->_lastRange = osg::minimum(se->_lastRange, range);
-
-        // Move the tracker to the front of the list (ahead of the sentry).
-        // Once a cull traversal is complete, all visited tiles will be
-        // in front of the sentry, leaving all non-visited tiles behind it.
-        _tracker.erase(e._trackerptr);
-        _tracker.push_front(se);
-        e._trackerptr = _tracker.begin();
-    }
-    else
+    SlotBlock* block = 
+        handle != INVALID_HANDLE && b < MAX_SLOT_BLOCKS ?
+        _slotBlocks[b].load(std::memory_order_acquire) :
+        nullptr;
+
+    unsigned i = slot & SLOT_BLOCK_MASK;
+
+    if (block == nullptr ||
+        block->_generation[i].load(std::memory_order_acquire) != unsigned(handle >> 32))
     {
         OE_WARN << LC << "UPDATE FAILED - TILE " << tile->getKey().str() << " not in TILE TABLE!" << std::endl;
+        return;
     }
 
-    _mutex.unlock();
+    block->_lastTime[i].store(_clock->getTime(), std::memory_order_relaxed);
+    block->_lastFrame[i].store(_clock->getFrame(), std::memory_order_relaxed);
+
+    const osg::BoundingSphere& bs = tile->getBound();
+    float range = nv.getDistanceToViewPoint(bs.center(), true) - bs.radius();
+
+    // multiple views may cull concurrently, so keep the minimum atomically
+    std::atomic<float>& lastRange = block->_lastRange[i];
+    float current = lastRange.load(std::memory_order_relaxed);
+    while (range < current && 
+        !lastRange.compare_exchange_weak(current, range, std::memory_order_relaxed));
 }
 
 void
@@ -319,25 +402,62 @@ TileNodeRegistry::collectDormantTiles(
 {
     _mutex.lock();
 
-    unsigned count = 0u;
+    // Pass 1: sweep the stamp arrays block by block, in slot order starting
+    // at the cursor where the last sweep stopped, and gather the slots whose
+    // stamps are all past the expiry thresholds. The tests are combined
+    // without branching so the inner loop stays a flat pass over memory.
+    // Every range resets for the next frame's cull.
+    _dormantSlots.clear();
+
+    if (_scanCursor >= _numSlots)
+        _scanCursor = 0u;
+
+    for (unsigned pass = 0; pass < 2; ++pass)
+    {
+        unsigned first = pass == 0 ? _scanCursor : 0u;
+        unsigned last = pass == 0 ? _numSlots : _scanCursor;
+
+        for (unsigned slot = first; slot < last; )
+        {
+            SlotBlock* block = _slotBlocks[slot >> SLOT_BLOCK_BITS].load();
+            unsigned i = slot & SLOT_BLOCK_MASK;
+            unsigned end = std::min(SLOT_BLOCK_SIZE - i, last - slot) + i;
+
+            for (; i < end; ++i, ++slot)
+            {
+                bool dormant =
+                    (block->_tile[i] != nullptr) &
+                    (block->_lastTime[i].load(std::memory_order_relaxed) < oldestAllowableTime) &
+                    (block->_lastFrame[i].load(std::memory_order_relaxed) < oldestAllowableFrame) &
+                    (block->_lastRange[i].load(std::memory_order_relaxed) > farthestAllowableRange);
+
+                block->_lastRange[i].store(FLT_MAX, std::memory_order_relaxed);
+
+                if (dormant)
+                    _dormantSlots.push_back(slot);
+            }
+        }
+    }
 
-    // After cull, all visited tiles are in front of the sentry, and all
-    // non-visited tiles are behind it. Start at the sentry position and
-    // iterate over the non-visited tiles, checking them for deletion.
-    Tracker::iterator i = _sentryptr;
-    Tracker::iterator tmp;
-    for(++i; i != _tracker.end() && count < maxTiles; ++i)
+    // Pass 2: apply the per-tile checks and remove up to maxTiles tiles.
+    unsigned count = 0u;
+    for (auto slot : _dormantSlots)
     {
-        TrackerEntry* se = *i;
+        if (count >= maxTiles)
+        {
+            // start here next time so every tile gets its turn
+            _scanCursor = slot;
+            break;
+        }
 
-        const TileKey& key = se->_tile->getKey();
+        SlotBlock* block = _slotBlocks[slot >> SLOT_BLOCK_BITS].load();
+        TileNode* tile = block->_tile[slot & SLOT_BLOCK_MASK];
 
-        if (se->_tile->getDoNotExpire() == false &&
-            se->_lastTime < oldestAllowableTime &&
-            se->_lastFrame < oldestAllowableFrame &&
-            se->_lastRange > farthestAllowableRange &&
-            se->_tile->areSiblingsDormant())
+        if (tile->getDoNotExpire() == false &&
+            tile->areSiblingsDormant())
         {
+            const TileKey& key = tile->getKey();
+
             if (_notifyNeighbors)
             {
                 // remove neighbor listeners:
@@ -345,34 +465,19 @@ TileNodeRegistry::collectDormantTiles(
                 stopListeningFor(key.createNeighborKey(0, 1), key);
             }
 
-            // back up the iterator so we can safely erase the tracker entry:
-            tmp = i;
-            --i;
-
             // put the tile on the output list:
-            output.push_back(se->_tile);
+            output.push_back(tile);
+
+            tile->setRegistryHandle(INVALID_HANDLE);
+            releaseSlot(slot);
 
             // remove it from the main tile table:
             _tiles.erase(key);
 
-            // remove it from the tracker list:
-            _tracker.erase(tmp);
-            delete se;
-
             ++count;
         }
-        else
-        {
-            // reset the range in preparation for the next frame.
-            se->_lastRange = FLT_MAX;
-        }
     }
 
-    // reset the sentry.
-    _tracker.erase(_sentryptr);
-    _tracker.push_front(SENTRY_VALUE);
-    _sentryptr =_tracker.begin();
-
     _mutex.unlock();
 
     OE_PROFILING_PLOT(PROFILING_REX_TILES, (float)(_tiles.size()));
@@ -136,8 +136,12 @@ namespace
 
 namespace
 {
-    // Create a "feature" object in the global namespace.
-    void setFeature(duk_context* ctx, Feature const* feature, bool complete)
+    // Maximum number of compiled scripts each thread context holds
+    const unsigned MAX_COMPILED_SCRIPTS = 64u;
+
+    // Create a complete "feature" object (properties, geometry, and API
+    // bindings) in the global namespace.
+    void setFeature(duk_context* ctx, Feature const* feature)
     {
         if (!feature)
             return;
@@ -146,68 +150,151 @@ namespace
 
         duk_push_global_object(ctx); // [global]
 
-        // Complete profile: properties, geometry, and API bindings.
-        if ( complete )
-        {
-            std::string geojson = feature->getGeoJSON();
-            duk_push_string(ctx, geojson.c_str());               // [global, json]
-            duk_json_decode(ctx, -1);                            // [global, feature]
-            duk_push_pointer(ctx, (void*)feature);               // [global, feature, ptr]
-            duk_put_prop_string(ctx, -2, "__ptr");               // [global, feature]
-            duk_put_prop_string(ctx, -2, "feature");             // [global]
-
-            // add the save() function and the "attributes" alias.
-            duk_eval_string_noresult(ctx,
-                "feature.save = function() {"
-                "    oe_duk_save_feature(this.__ptr);"
-                "} ");
-
-            duk_eval_string_noresult(ctx,
-                "Object.defineProperty(feature, 'attributes', {get:function() {return feature.properties;}});");
-
-            GeometryAPI::bindToFeature(ctx);
+        std::string geojson = feature->getGeoJSON();
+        duk_push_string(ctx, geojson.c_str());               // [global, json]
+        duk_json_decode(ctx, -1);                            // [global, feature]
+        duk_push_pointer(ctx, (void*)feature);               // [global, feature, ptr]
+        duk_put_prop_string(ctx, -2, "__ptr");               // [global, feature]
+        duk_put_prop_string(ctx, -2, "feature");             // [global]
+
+        // add the save() function and the "attributes" alias.
+        duk_eval_string_noresult(ctx,
+            "feature.save = function() {"
+            "    oe_duk_save_feature(this.__ptr);"
+            "} ");
+
+        duk_eval_string_noresult(ctx,
+            "Object.defineProperty(feature, 'attributes', {get:function() {return feature.properties;}});");
+
+        GeometryAPI::bindToFeature(ctx);
+
+        duk_pop(ctx);
+    }
+
+    // The minimal profile binds "feature" once per context. Its members
+    // are getters that read the current feature, whose address lives in
+    // the heap's user data, so switching features costs nothing and only
+    // the attributes a script touches are ever converted.
+    inline Feature const* currentFeature(duk_context* ctx)
+    {
+        duk_memory_functions funcs;
+        duk_get_memory_functions(ctx, &funcs);
+        return funcs.udata ? *static_cast<Feature const* const*>(funcs.udata) : nullptr;
+    }
+
+    // pushes an attribute value; returns false if it has no JS equivalent
+    bool pushAttribute(duk_context* ctx, const AttributeValue& value)
+    {
+        switch(value.first) {
+        case ATTRTYPE_DOUBLE: duk_push_number(ctx, value.getDouble()); break;
+        case ATTRTYPE_INT:    duk_push_number(ctx, (double)value.getInt()); break;
+        case ATTRTYPE_BOOL:   duk_push_boolean(ctx, value.getBool()?1:0); break;
+        case ATTRTYPE_DOUBLEARRAY: return false;
+        case ATTRTYPE_STRING:
+        default:              duk_push_string(ctx, value.getString().c_str()); break;
         }
+        return true;
+    }
 
-        // Minimal profile: ID and properties only. MUCH faster!
-        else
-        {
-            duk_idx_t feature_i = duk_push_object(ctx);     // [global] [feature]
-            {
-                duk_push_number(ctx, feature->getFID());       // [global] [feature] [id]
-                duk_put_prop_string(ctx, feature_i, "id");  // [global] [feature]
+    static duk_ret_t oe_duk_feature_id(duk_context* ctx)
+    {
+        Feature const* feature = currentFeature(ctx);
+        if (!feature)
+            return 0;
+        duk_push_number(ctx, (double)feature->getFID());
+        return 1;
+    }
 
-                duk_idx_t props_i = duk_push_object(ctx);   // [global] [feature] [properties]
-                {
-                    const AttributeTable& attrs = feature->getAttrs();
-                    for(AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
-                    {
-                        AttributeType type = a->second.first;
-                        switch(type) {
-                        case ATTRTYPE_DOUBLE: duk_push_number (ctx, a->second.getDouble()); break;          // [global] [feature] [properties] [name]
-                        case ATTRTYPE_INT:    duk_push_number(ctx, (double)a->second.getInt()); break;             // [global] [feature] [properties] [name]
-                        case ATTRTYPE_BOOL:   duk_push_boolean(ctx, a->second.getBool()?1:0); break;            // [global] [feature] [properties] [name]
-                        case ATTRTYPE_DOUBLEARRAY: break;
-                        case ATTRTYPE_STRING:
-                        default:              duk_push_string (ctx, a->second.getString().c_str()); break;  // [global] [feature] [properties] [name]
-                        }
-                        duk_put_prop_string(ctx, props_i, a->first.c_str()); // [global] [feature] [properties]
-                    }
-                }
-                duk_put_prop_string(ctx, feature_i, "properties"); // [global] [feature]
+    static duk_ret_t oe_duk_geometry_type(duk_context* ctx)
+    {
+        Feature const* feature = currentFeature(ctx);
+        if (!feature || !feature->getGeometry())
+            return 0;
+        duk_push_string(ctx, Geometry::toString(feature->getGeometry()->getComponentType()).c_str());
+        return 1;
+    }
 
-                duk_idx_t geometry_i = duk_push_object(ctx);  // [global] [feature] [geometry]
-                {
-                    duk_push_string(ctx, Geometry::toString(feature->getGeometry()->getComponentType()).c_str()); // [global] [feature] [geometry] [type]
-                    duk_put_prop_string(ctx, geometry_i, "type"); // [global] [feature] [geometry]
-                }
-                duk_put_prop_string(ctx, feature_i, "geometry");
+    // Proxy trap: properties[key]
+    static duk_ret_t oe_duk_properties_get(duk_context* ctx)
+    {
+        // [target, key, receiver]
+        Feature const* feature = currentFeature(ctx);
+        if (!feature || duk_is_symbol(ctx, 1) || !duk_is_string(ctx, 1))
+            return 0;
+
+        const AttributeTable& attrs = feature->getAttrs();
+        AttributeTable::const_iterator a = attrs.find(duk_get_string(ctx, 1));
+        if (a == attrs.end())
+            return 0;
+
+        return pushAttribute(ctx, a->second) ? 1 : 0;
+    }
+
+    // Proxy trap: key in properties
+    static duk_ret_t oe_duk_properties_has(duk_context* ctx)
+    {
+        // [target, key]
+        Feature const* feature = currentFeature(ctx);
+        bool has =
+            feature && !duk_is_symbol(ctx, 1) && duk_is_string(ctx, 1) &&
+            feature->hasAttr(duk_get_string(ctx, 1));
+        duk_push_boolean(ctx, has ? 1 : 0);
+        return 1;
+    }
+
+    // Proxy trap: Object.keys(properties), for..in
+    static duk_ret_t oe_duk_properties_keys(duk_context* ctx)
+    {
+        // [target]
+        duk_idx_t array_i = duk_push_array(ctx);
+        Feature const* feature = currentFeature(ctx);
+        if (feature)
+        {
+            duk_uarridx_t n = 0;
+            const AttributeTable& attrs = feature->getAttrs();
+            for(AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+            {
+                if (a->second.first == ATTRTYPE_DOUBLEARRAY)
+                    continue;
+                duk_push_string(ctx, a->first.c_str());
+                duk_put_prop_index(ctx, array_i, n++);
             }
-            duk_put_prop_string(ctx, -2, "feature"); // [global] [feature]
         }
-
-        duk_pop(ctx);
+        return 1;
     }
 
+    // Create the lazy "feature" object in the global namespace.
+    void bindLazyFeature(duk_context* ctx)
+    {
+        duk_push_global_object(ctx);                                // [global]
+        duk_idx_t feature_i = duk_push_object(ctx);                 // [global, feature]
+        {
+            duk_push_string(ctx, "id");                             // [global, feature, "id"]
+            duk_push_c_function(ctx, oe_duk_feature_id, 0);         // [global, feature, "id", getter]
+            duk_def_prop(ctx, feature_i, DUK_DEFPROP_HAVE_GETTER);  // [global, feature]
+
+            duk_push_string(ctx, "properties");                     // [global, feature, "properties"]
+            duk_push_object(ctx);                                   // [global, feature, "properties", target]
+            duk_push_object(ctx);                                   // [global, feature, "properties", target, handler]
+            duk_push_c_function(ctx, oe_duk_properties_get, 3);
+            duk_put_prop_string(ctx, -2, "get");
+            duk_push_c_function(ctx, oe_duk_properties_has, 2);
+            duk_put_prop_string(ctx, -2, "has");
+            duk_push_c_function(ctx, oe_duk_properties_keys, 1);
+            duk_put_prop_string(ctx, -2, "ownKeys");
+            duk_push_proxy(ctx, 0);                                 // [global, feature, "properties", proxy]
+            duk_def_prop(ctx, feature_i, DUK_DEFPROP_HAVE_VALUE);   // [global, feature]
+
+            duk_push_string(ctx, "geometry");                       // [global, feature, "geometry"]
+            duk_idx_t geometry_i = duk_push_object(ctx);            // [global, feature, "geometry", geometry]
+            duk_push_string(ctx, "type");
+            duk_push_c_function(ctx, oe_duk_geometry_type, 0);
+            duk_def_prop(ctx, geometry_i, DUK_DEFPROP_HAVE_GETTER); // [global, feature, "geometry", geometry]
+            duk_def_prop(ctx, feature_i, DUK_DEFPROP_HAVE_VALUE);   // [global, feature]
+        }
+        duk_put_prop_string(ctx, -2, "feature");                    // [global]
+        duk_pop(ctx);                                               // []
+    }
 }
 
 //............................................................................
@@ -215,8 +302,7 @@ namespace
 DuktapeEngine::Context::Context()
 {
     _ctx = nullptr;
-    _bytecode = nullptr;
-    _errorCount = 0u;
+    _feature = nullptr;
 }
 
 void
@@ -224,8 +310,8 @@ DuktapeEngine::Context::initialize(const ScriptEngineOptions& options, bool comp
 {
     if ( _ctx == nullptr)
     {
-        // new heap + context.
-        _ctx = duk_create_heap_default();
+        // new heap + context. The user data points at the current feature.
+        _ctx = duk_create_heap(nullptr, nullptr, nullptr, &_feature, nullptr);
 
         // if there is a static script, evaluate it first. This will register
         // any functions or objects with the EcmaScript global object.
@@ -257,6 +343,11 @@ DuktapeEngine::Context::initialize(const ScriptEngineOptions& options, bool comp
         }
 
         duk_pop(_ctx); // []
+
+        if ( !complete )
+        {
+            bindLazyFeature(_ctx);
+        }
     }
 }
 
@@ -294,52 +385,70 @@ DuktapeEngine::compile(
 
     duk_context* ctx = c._ctx;
 
-    if (code != c._bytecodeSource)
+    std::size_t key = std::hash<std::string>()(code);
+
+    auto i = c._compiled.find(key);
+    if (i != c._compiled.end() && i->second.source == code)
     {
-        c._bytecodeSource = code;
-        c._errorCount = 0u;
+        CompiledScript& entry = i->second;
+        c._lru.splice(c._lru.begin(), c._lru, entry.lru);
 
-        if (duk_pcompile_string(ctx, 0, code.c_str()) != 0) // [function|error]
+        if (!entry.ok)
         {
-            std::string resultString = duk_safe_to_string(ctx, -1);
-            OE_WARN << LC << "Compile error: " << resultString << std::endl;
-            c._errorCount++;
-            duk_pop(ctx); // []
-            result = ScriptResult("", false, resultString); // return error.
+            // this code caused a previous compile error, so bail out.
+            result = ScriptResult("", false, "Compile error");
             return false;
         }
 
-        duk_dump_function(ctx); // [buffer]
-        duk_size_t size;
-        void* bytecode = duk_get_buffer(ctx, 0, &size);
-        if (bytecode == nullptr)
+        duk_push_heap_stash(ctx);                           // [stash]
+        duk_get_prop_string(ctx, -1, entry.slot.c_str());   // [stash, function]
+        duk_remove(ctx, -2);                                // [function]
+        return true;
+    }
+
+    // New script (or a hash collision, which simply replaces the entry):
+    if (i == c._compiled.end())
+    {
+        c._lru.push_front(key);
+        CompiledScript& entry = c._compiled[key];
+        entry.slot = Stringify() << "oe_script_" << std::hex << key;
+        entry.lru = c._lru.begin();
+
+        // evict the least recently used script:
+        if (c._compiled.size() > MAX_COMPILED_SCRIPTS)
         {
-            // error. remove the buffer and return.
-            duk_pop(ctx); // []
-            OE_WARN << LC << "Allocation error; cannot continue" << std::endl;
-            result = ScriptResult("", false, "Allocation error"); // return error
-            c._errorCount++;
-            return false;
+            std::size_t oldest = c._lru.back();
+            c._lru.pop_back();
+            duk_push_heap_stash(ctx);
+            duk_del_prop_string(ctx, -1, c._compiled[oldest].slot.c_str());
+            duk_pop(ctx);
+            c._compiled.erase(oldest);
         }
-
-        if (c._bytecode) delete[] c._bytecode;
-        c._bytecode = new unsigned char[size];
-        ::memcpy(c._bytecode, (unsigned char*)bytecode, size);
-        c._bytecodeSize = size;
     }
-    else if (c._errorCount == 0u)
+    else
     {
-        void* buf = duk_push_buffer(ctx, (duk_size_t)c._bytecodeSize, (duk_bool_t)0); // [buffer]
-        ::memcpy(buf, c._bytecode, c._bytecodeSize);
+        c._lru.splice(c._lru.begin(), c._lru, i->second.lru);
     }
-    else
+
+    CompiledScript& entry = c._compiled[key];
+    entry.source = code;
+    entry.ok = false;
+
+    if (duk_pcompile_string(ctx, 0, code.c_str()) != 0) // [function|error]
     {
-        // this code caused a previous compile error, so bail out.
+        std::string resultString = duk_safe_to_string(ctx, -1);
+        OE_WARN << LC << "Compile error: " << resultString << std::endl;
+        duk_pop(ctx); // []
+        result = ScriptResult("", false, resultString); // return error.
         return false;
     }
 
-    // convert bytecode to a function object:
-    duk_load_function(ctx); // [function]
+    // keep the function in the stash so it survives between calls
+    duk_push_heap_stash(ctx);                           // [function, stash]
+    duk_dup(ctx, -2);                                   // [function, stash, function]
+    duk_put_prop_string(ctx, -2, entry.slot.c_str());   // [function, stash]
+    duk_pop(ctx);                                       // [function]
+    entry.ok = true;
 
     return true;
 }
@@ -379,8 +488,10 @@ DuktapeEngine::run(
 
     for (auto& feature : features)
     {
-        // Load the next feature into the global object:
-        setFeature(c._ctx, feature.get(), complete);
+        // Point the global "feature" at the next feature:
+        c._feature = feature.get();
+        if (complete)
+            setFeature(ctx, feature.get());
 
         // Duplicate the function on the top since we'll be calling it multiple times
         duk_dup_top(ctx); // [function function]
@@ -393,7 +504,6 @@ DuktapeEngine::run(
         if (rc != DUK_EXEC_SUCCESS)
         {
             OE_WARN << LC << "Runtime error: " << resultString << std::endl;
-            c._errorCount++;
             results.emplace_back(EMPTY_STRING, false, resultString); // error
         }
         else
@@ -404,6 +514,7 @@ DuktapeEngine::run(
 
     // Pop the function, clearing the stack
     duk_pop(ctx); // []
+    c._feature = nullptr;
 
     return true;
 }
@@ -437,11 +548,11 @@ DuktapeEngine::run(
     }
 
     // load the feature into the global namespace:
-	if ( feature != c._feature.get() )
+    c._feature = feature;
+    if (complete)
     {
-		setFeature(ctx, feature, complete);
-        c._feature = feature;
-	}
+        setFeature(ctx, feature);
+    }
 
     std::string resultString;
 
@@ -452,7 +563,6 @@ DuktapeEngine::run(
     if (rc != DUK_EXEC_SUCCESS)
     {
         OE_WARN << LC << "Runtime error: " << resultString << std::endl;
-        c._errorCount++;
         return ScriptResult(EMPTY_STRING, false, resultString); // error
     }
 
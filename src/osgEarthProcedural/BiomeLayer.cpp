@@ -22,6 +22,7 @@
 #include "BiomeLayer"
 #include "Random"
 #include <osgEarth/rtree.h>
+#include <cfloat>
 
 using namespace osgEarth;
 using namespace osgEarth::Procedural;
@@ -74,6 +75,91 @@ namespace
 
     typedef RTree<RecordPtr, double, 2> MySpatialIndex;
     
+    // Control records that can be nearest to some point of one tile,
+    // stored as the centers and half-sizes the R-tree uses to measure
+    // distance so that per-pixel distances compare bit-for-bit with a
+    // KNNSearch of the full index.
+    struct Candidates
+    {
+        std::vector<double> cx, cy, hx, hy, d2;
+        std::vector<int> biomeid;
+
+        void add(const Record& r)
+        {
+            const Segment2d& s = r._segment;
+            double xmin = std::min(s._a.x(), s._b.x()), xmax = std::max(s._a.x(), s._b.x());
+            double ymin = std::min(s._a.y(), s._b.y()), ymax = std::max(s._a.y(), s._b.y());
+            double half_x = 0.5*(xmax - xmin);
+            double half_y = 0.5*(ymax - ymin);
+            cx.push_back(xmin + half_x);
+            cy.push_back(ymin + half_y);
+            hx.push_back(half_x);
+            hy.push_back(half_y);
+            biomeid.push_back(r._biomeid);
+        }
+
+        // Gathers every record whose distance to the rectangle is no greater
+        // than the largest possible nearest-record distance within it.
+        void gather(const MySpatialIndex* index, double xmin, double ymin, double xmax, double ymax)
+        {
+            std::vector<RecordPtr> hits;
+            std::vector<double> ranges_squared;
+
+            osg::Vec3d center(0.5*(xmin + xmax), 0.5*(ymin + ymax), 0.0);
+            index->KNNSearch(center.ptr(), &hits, &ranges_squared, 1u, 0.0);
+            if (hits.empty())
+                return;
+
+            // No point in the rectangle is farther than this from its nearest
+            // record. The slack keeps rounding from ever excluding a record.
+            double bound =
+                sqrt(ranges_squared[0]) +
+                0.5*sqrt((xmax - xmin)*(xmax - xmin) + (ymax - ymin)*(ymax - ymin));
+            bound += bound * 1e-9 + 1e-12;
+
+            double a_min[2] = { xmin - bound, ymin - bound };
+            double a_max[2] = { xmax + bound, ymax + bound };
+            hits.clear();
+            index->Search(a_min, a_max, &hits, ~0);
+
+            for (auto& hit : hits)
+            {
+                const Segment2d& s = hit->_segment;
+                double dx = std::max(std::max(xmin - std::max(s._a.x(), s._b.x()), std::min(s._a.x(), s._b.x()) - xmax), 0.0);
+                double dy = std::max(std::max(ymin - std::max(s._a.y(), s._b.y()), std::min(s._a.y(), s._b.y()) - ymax), 0.0);
+                if (dx*dx + dy*dy <= bound*bound)
+                    add(*hit);
+            }
+
+            d2.resize(cx.size());
+        }
+
+        // Finds the biome of the nearest record. Returns false if two records
+        // with different biomes are equally near, since the R-tree's choice
+        // then depends on its internal ordering.
+        bool nearest(double x, double y, int& out)
+        {
+            const int n = (int)cx.size();
+            for (int i = 0; i < n; ++i)
+            {
+                double dx = std::max(fabs(x - cx[i]) - hx[i], 0.0);
+                double dy = std::max(fabs(y - cy[i]) - hy[i], 0.0);
+                d2[i] = 0.0 + dx*dx + dy*dy;
+            }
+
+            double best = DBL_MAX;
+            bool tied = false;
+            for (int i = 0; i < n; ++i)
+            {
+                if (d2[i] < best)
+                    best = d2[i], out = biomeid[i], tied = false;
+                else if (d2[i] == best && biomeid[i] != out)
+                    tied = true;
+            }
+            return n > 0 && !tied;
+        }
+    };
+
     struct BiomeTrackerToken : public osg::Object
     {
         META_Object(osgEarth, BiomeTrackerToken);
@@ -236,14 +322,22 @@ BiomeLayer::createImageImplementation(
     ImageUtils::PixelWriter write(image.get());
 
     osg::Vec4 value;
-    float noise = 1.0f;
     std::vector<RecordPtr> hits;
-    std::vector<double> ranges_squared;
     Random prng(key.hash());
     double radius = options().blendRadius().get();
     std::set<int> biomeids_seen;
 
-    GeoImageIterator iter(GeoImage(image.get(), key.getExtent()));
+    // Only a handful of control records can be nearest to any point of
+    // this tile (after jittering by the blend radius), so collect them once
+    // and test each pixel against that short list instead of the whole index.
+    const GeoExtent& extent = key.getExtent();
+    Candidates candidates;
+    candidates.gather(
+        index,
+        extent.xMin() - radius, extent.yMin() - radius,
+        extent.xMax() + radius, extent.yMax() + radius);
+
+    GeoImageIterator iter(GeoImage(image.get(), extent));
 
     iter.forEachPixelOnCenter([&]()
         {
@@ -253,22 +347,26 @@ BiomeLayer::createImageImplementation(
             double x = iter.x() + radius * (prng.next()*2.0 - 1.0);
             double y = iter.y() + radius * (prng.next()*2.0 - 1.0);
 
-            // find the closest biome vector to the point:
-            index->KNNSearch(
-                osg::Vec3d(x,y,0).ptr(),
-                &hits,
-                nullptr,
-                1u,
-                0.0);
-
-            if (hits.size() > 0)
+            // find the closest biome vector to the point, deferring to
+            // the full index when the short list can't decide:
+            if (!candidates.nearest(x, y, biomeid))
             {
-                biomeid = hits[0]->_biomeid;
+                biomeid = 0;
+
+                index->KNNSearch(
+                    osg::Vec3d(x,y,0).ptr(),
+                    &hits,
+                    nullptr,
+                    1u,
+                    0.0);
 
-                if (biomeid > 0)
-                    biomeids_seen.insert(biomeid);
+                if (hits.size() > 0)
+                    biomeid = hits[0]->_biomeid;
             }
 
+            if (biomeid > 0)
+                biomeids_seen.insert(biomeid);
+
             value.r() = (float)biomeid / 255.0f;
 
             write(value, iter.s(), iter.t());
@@ -25,6 +25,7 @@
 #include <osgEarth/Map>
 #include <osgEarth/ElevationPool>
 #include <osgEarth/Math>
+#include <osgEarth/Threading>
 #include <osgEarth/rtree.h>
 
 #include <osgDB/ReadFile>
@@ -33,6 +34,8 @@
 
 #define LC "[LifeMapLayer] " << getName() << ": "
 
+#define ARENA_LIFEMAP "oe.lifemap"
+
 using namespace osgEarth;
 using namespace osgEarth::Procedural;
 
@@ -101,9 +104,14 @@ namespace
     constexpr unsigned TURBULENT = 2;
     constexpr unsigned CLUMPY = 3;
 
-    // raster sampling coordinate scaler
-    void scaleCoordsToRefLOD(osg::Vec2& tc, const TileKey& key, unsigned refLOD)
+    // Scale and bias that map a tile's [0..1] coordinates into the
+    // coordinate space of its ancestor at refLOD. Both axes share the
+    // scale, so the mapping is separable and can be precomputed per
+    // row and per column.
+    void getRefLODScaleBias(const TileKey& key, unsigned refLOD, double& scale, double& biasX, double& biasY)
     {
+        scale = 1.0, biasX = 0.0, biasY = 0.0;
+
         if (key.getLOD() <= refLOD)
             return;
 
@@ -114,38 +122,154 @@ namespace
         double factor = exp2(dL);
         double invFactor = 1.0f/factor;
 
-        double rx = tc.x() * invFactor;
-        double ry = tc.y() * invFactor;
-
         double tx = (double)key.getTileX();
         double ty = (double)(tilesY - key.getTileY() - 1);
 
-        double ax = floor(tx * invFactor);
-        double ay = floor(ty * invFactor);
+        double bx = floor(tx * invFactor) * factor;
+        double by = floor(ty * invFactor) * factor;
+
+        scale = invFactor;
+        biasX = (tx - bx) / factor;
+        biasY = (ty - by) / factor;
+    }
+
+    // One axis of a bilinear lookup into the noise texture, matching
+    // PixelReader's repeating "sample as image" mode.
+    struct NoiseTap
+    {
+        unsigned i0, i1;
+        float mix;
+
+        void set(float u, unsigned size)
+        {
+            u = u >= 0.0f ? (u - floorf(u)) : (u - ceilf(u));
+            float max = (float)(size - 1);
+            float s = u * max;
+            float s0 = std::max(floorf(s), 0.0f);
+            float s1 = std::min(s0 + 1.0f, max);
+            i0 = (unsigned)s0, i1 = (unsigned)s1;
+            mix = s0 < s1 ? (s - s0) / (s1 - s0) : 0.0f;
+        }
+    };
 
-        double bx = ax * factor;
-        double by = ay * factor;
+    // Bilinear sampler for the RGBA8 noise texture that reads
+    // the bytes directly instead of going through a PixelReader.
+    struct NoiseSampler
+    {
+        const unsigned char* _data;
+        unsigned _rowStep;
 
-        double cx = bx + factor;
-        double cy = by + factor;
+        NoiseSampler(const osg::Image* image) :
+            _data(image->data()),
+            _rowStep(image->getRowStepInBytes()) { }
 
-        if (factor >= 1.0f)
+        inline void operator()(osg::Vec4f& out, const NoiseTap& s, const NoiseTap& t) const
         {
-            rx += (tx-bx)/(cx-bx);
-            ry += (ty-by)/(cy-by);
+            const unsigned char* row0 = _data + t.i0*_rowStep;
+            const unsigned char* row1 = _data + t.i1*_rowStep;
+            const unsigned char* UL = row0 + 4u*s.i0;
+            const unsigned char* UR = row0 + 4u*s.i1;
+            const unsigned char* LL = row1 + 4u*s.i0;
+            const unsigned char* LR = row1 + 4u*s.i1;
+
+            const float s1 = s.mix, s0 = 1.0f - s.mix;
+            const float t1 = t.mix * (1.0f / 255.0f), t0 = (1.0f - t.mix) * (1.0f / 255.0f);
+
+            for (int c = 0; c < 4; ++c)
+            {
+                float top = (float)UL[c] * s0 + (float)UR[c] * s1;
+                float bot = (float)LL[c] * s0 + (float)LR[c] * s1;
+                out[c] = top * t0 + bot * t1;
+            }
         }
+    };
 
-        tc.set(rx, ry);
+    float quantizeTo9bits(float x)
+    {
+        float tmp = x - (float)(int)(x);
+        float frac = (float)(int)(tmp*256.0f + 0.5f) / 256.0f;
+        return frac < 0.0f ? 0.0f : frac > 1.0f ? 1.0f : frac;
     }
 
-    void getNoise(
-        osg::Vec4& noise,
-        ImageUtils::PixelReader& read,
-        const osg::Vec2& coords)
+    // One axis of a bilinear texture lookup, matching PixelReader's
+    // clamped "sample as texture" mode (a port of Mesa's linear filter).
+    struct TexelTap
+    {
+        int i0, i1;
+        double mix;
+
+        void set(double u, int size)
+        {
+            double unnorm = (u * (double)size) - 0.5;
+            double snap = (floorf(unnorm) + 0.5) / (double)size;
+            snap = quantizeTo9bits(snap);
+            i0 = (int)floor(snap * (double)(size - 1));
+            i1 = (i0 + 1 < size) ? i0 + 1 : i0;
+            mix = unnorm >= 0.0 ? (unnorm - floor(unnorm)) : (unnorm - ceil(unnorm));
+        }
+    };
+
+    // Reads texels from 8-bit RGB(A) images directly and falls back
+    // on a PixelReader for any other format.
+    struct TexelReader
     {
-        read(noise, coords.x(), coords.y());
-        //noise *= 2.0;
-        //noise.r() -= 1.0, noise.g() -= 1.0, noise.b() -= 1.0, noise.a() -= 1.0;
+        ImageUtils::PixelReader _reader;
+        const unsigned char* _data;
+        unsigned _rowStep;
+        unsigned _components;
+
+        TexelReader() : _data(nullptr), _rowStep(0u), _components(0u) { }
+
+        void setImage(const osg::Image* image)
+        {
+            _reader.setImage(image);
+            _data = nullptr;
+            if (image->getDataType() == GL_UNSIGNED_BYTE &&
+                (image->getPixelFormat() == GL_RGBA || image->getPixelFormat() == GL_RGB))
+            {
+                _data = image->data();
+                _rowStep = image->getRowStepInBytes();
+                _components = image->getPixelFormat() == GL_RGBA ? 4u : 3u;
+            }
+        }
+
+        inline void read(osg::Vec4f& out, int s, int t) const
+        {
+            if (_data)
+            {
+                const unsigned char* p = _data + t*_rowStep + s*_components;
+                out.set(
+                    (float)p[0] / 255.0f,
+                    (float)p[1] / 255.0f,
+                    (float)p[2] / 255.0f,
+                    _components == 4u ? (float)p[3] / 255.0f : 1.0f);
+            }
+            else
+            {
+                _reader(out, s, t);
+            }
+        }
+
+        inline void operator()(osg::Vec4f& out, const TexelTap& s, const TexelTap& t) const
+        {
+            osg::Vec4f p1, p2, p3, p4;
+            read(p1, s.i0, t.i0);
+            read(p2, s.i1, t.i0);
+            read(p3, s.i0, t.i1);
+            read(p4, s.i1, t.i1);
+
+            p1 = p1 * (1.0 - s.mix) + p2 * s.mix;
+            p2 = p3 * (1.0 - s.mix) + p4 * s.mix;
+            out = p1 * (1.0 - t.mix) + p2 * t.mix;
+        }
+    };
+
+    // Nearest-neighbor texel index along one axis with clamp-to-edge,
+    // matching PixelReader's non-bilinear mode.
+    int nearestTexel(double u, int size)
+    {
+        const double umin = 1.0 / (2.0 * (double)size);
+        return u < umin ? 0 : u > (1.0 - umin) ? size - 1 : (int)floorf(u*(double)size);
     }
 
     struct LandUseTile
@@ -416,16 +540,12 @@ LifeMapLayer::createImageImplementation(
     if (!_map.lock(map))
         return GeoImage::INVALID;
 
-    // collect the elevation data:
-    osg::ref_ptr<ElevationTexture> elevTile;
-    ElevationPool* ep = map->getElevationPool();
-    ep->getTile(key, true, elevTile, &_workingSet, progress);
-
-    if (!elevTile.valid())
-        return GeoImage::INVALID;
+    GeoExtent extent = key.getExtent();
 
-    // ensure we have a normal map for slopes and curvatures:
-    elevTile->generateNormalMap(map.get(), &_workingSet, progress);
+    // Fetch the land use, land cover, density mask and color inputs
+    // in parallel while this thread collects the elevation data.
+    JobArena* arena = JobArena::get(ARENA_LIFEMAP);
+    JobGroup inputs;
 
     // if we're using land use data, fetch that now:
     LandUseTile landuse;
@@ -441,23 +561,24 @@ LifeMapLayer::createImageImplementation(
         // the catalog:
         landuse_table = getBiomeLayer()->getBiomeCatalog()->getLandUseTable();
 
-        // populate the tile with features that exist in the catalog:
-        landuse.load(
-            lu_key,
-            getLandUseLayer(),
-            nullptr, // filters
-            Distance(std::max(x_jitter, y_jitter), lu_extent.getSRS()->getUnits()),
-            landuse_table);
+        Job job(arena, &inputs);
+        job.setName("LifeMap land use");
+        job.dispatch([&](Cancelable*)
+        {
+            // populate the tile with features that exist in the catalog:
+            landuse.load(
+                lu_key,
+                getLandUseLayer(),
+                nullptr, // filters
+                Distance(std::max(x_jitter, y_jitter), lu_extent.getSRS()->getUnits()),
+                landuse_table);
+        });
     }
 
-    GeoExtent extent = key.getExtent();
-
     // bring in the land cover data if requested:
     osg::ref_ptr<osg::Image> landcover;
-    ImageUtils::PixelReader readLandCover;
-    osg::Vec4 landcover_pixel;
     osg::Matrixf landcover_matrix;
-    const LifeMapValueTable* landcover_table;
+    const LifeMapValueTable* landcover_table = nullptr;
     std::unordered_map<std::string, int> specialTextureIndexLUT;
     if (getBiomeLayer())
     {
@@ -465,20 +586,22 @@ LifeMapLayer::createImageImplementation(
 
         if (getUseLandCover() && !_landCoverLayers.empty() && _landCoverDictionary.valid() && landcover_table)
         {
-            TileKey landcover_key(key);
-
-            // fall back until we get a valid result
-            for (; !landcover.valid() && landcover_key.valid(); landcover_key.makeParent())
+            Job job(arena, &inputs);
+            job.setName("LifeMap land cover");
+            job.dispatch([&](Cancelable*)
             {
-                _landCoverLayers.populateLandCoverImage(landcover, landcover_key, progress);
-                if (landcover.valid())
+                TileKey landcover_key(key);
+
+                // fall back until we get a valid result
+                for (; !landcover.valid() && landcover_key.valid(); landcover_key.makeParent())
                 {
-                    readLandCover.setImage(landcover.get());
-                    readLandCover.setBilinear(false);
-                    readLandCover.setSampleAsTexture(true);
-                    extent.createScaleBias(landcover_key.getExtent(), landcover_matrix);
+                    _landCoverLayers.populateLandCoverImage(landcover, landcover_key, progress);
+                    if (landcover.valid())
+                    {
+                        extent.createScaleBias(landcover_key.getExtent(), landcover_matrix);
+                    }
                 }
-            }
+            });
 
             int index = 1; // start at one b/c zero means no special asset
             for (auto& tex : getBiomeLayer()->getBiomeCatalog()->getAssets().getSpecialTextures())
@@ -488,58 +611,74 @@ LifeMapLayer::createImageImplementation(
         }
     }
 
+    // the mask layer zero's out density(etc)
     GeoImage densityMask;
-    ImageUtils::PixelReader readDensityMask;
-    osg::Vec4 dm_pixel;
     osg::Matrixf dm_matrix;
 
-    // the mask layer zero's out density(etc)
     if (getDensityMaskLayer())
     {
-        TileKey dm_key(key);
-
-        while(dm_key.valid() && !densityMask.valid())
+        Job job(arena, &inputs);
+        job.setName("LifeMap density mask");
+        job.dispatch([&](Cancelable*)
         {
-            densityMask = getDensityMaskLayer()->createImage(dm_key, progress);
-            if (!densityMask.valid())
-                dm_key.makeParent();
-        }
+            TileKey dm_key(key);
 
-        if (densityMask.valid())
-        {
-            readDensityMask.setImage(densityMask.getImage());
-            readDensityMask.setBilinear(true);
-            readDensityMask.setSampleAsTexture(true);
-            extent.createScaleBias(dm_key.getExtent(), dm_matrix);
-        }
+            while (dm_key.valid() && !densityMask.valid())
+            {
+                densityMask = getDensityMaskLayer()->createImage(dm_key, progress);
+                if (!densityMask.valid())
+                    dm_key.makeParent();
+            }
+
+            if (densityMask.valid())
+            {
+                extent.createScaleBias(dm_key.getExtent(), dm_matrix);
+            }
+        });
     }
 
     // the color layer alters lifemap values based on colors.
     GeoImage color;
-    ImageUtils::PixelReader readColor;
-    osg::Vec4 color_pixel;
     osg::Matrixf color_matrix;
 
     if (getColorLayer())
     {
-        TileKey color_key(key);
-
-        while (color_key.valid() && !color.valid())
+        Job job(arena, &inputs);
+        job.setName("LifeMap color");
+        job.dispatch([&](Cancelable*)
         {
-            color = getColorLayer()->createImage(color_key, progress);
-            if (!color.valid())
-                color_key.makeParent();
-        }
+            TileKey color_key(key);
 
-        if (color.valid())
-        {
-            readColor.setImage(color.getImage());
-            readColor.setBilinear(true);
-            readColor.setSampleAsTexture(true);
-            extent.createScaleBias(color_key.getExtent(), color_matrix);
-        }
+            while (color_key.valid() && !color.valid())
+            {
+                color = getColorLayer()->createImage(color_key, progress);
+                if (!color.valid())
+                    color_key.makeParent();
+            }
+
+            if (color.valid())
+            {
+                extent.createScaleBias(color_key.getExtent(), color_matrix);
+            }
+        });
+    }
+
+    // collect the elevation data:
+    osg::ref_ptr<ElevationTexture> elevTile;
+    ElevationPool* ep = map->getElevationPool();
+    ep->getTile(key, true, elevTile, &_workingSet, progress);
+
+    // ensure we have a normal map for slopes and curvatures:
+    if (elevTile.valid())
+    {
+        elevTile->generateNormalMap(map.get(), &_workingSet, progress);
     }
 
+    inputs.join();
+
+    if (!elevTile.valid())
+        return GeoImage::INVALID;
+
     // assemble the image:
     osg::ref_ptr<osg::Image> image = new osg::Image();
     image->allocateImage(
@@ -549,293 +688,323 @@ LifeMapLayer::createImageImplementation(
         GL_RGBA,
         GL_UNSIGNED_BYTE);
 
-    ImageUtils::PixelWriter write(image.get());
-    osg::Vec4 pixel, temp;
-    //ElevationSample elevSample;
+    const int size = getTileSize();
+
     float elevation;
     osg::Vec3 normal;
     float slope;
     const osg::Vec3 up(0,0,1);
-    
-    std::string lu_id;
+    osg::Vec4 pixel;
     osg::Vec4f hsl;
 
-    osg::Vec2 noiseCoords[4];
+    ImageUtils::PixelReader readLandCover;
+    osg::Vec4 landcover_pixel;
+    if (landcover.valid())
+    {
+        readLandCover.setImage(landcover.get());
+        readLandCover.setBilinear(false);
+        readLandCover.setSampleAsTexture(true);
+    }
+
+    TexelReader readDensityMask;
+    osg::Vec4 dm_pixel;
+    if (densityMask.valid())
+    {
+        readDensityMask.setImage(densityMask.getImage());
+    }
+
+    TexelReader readColor;
+    osg::Vec4 color_pixel;
+    if (color.valid())
+    {
+        readColor.setImage(color.getImage());
+    }
+
+    const float slopeIntensity = options().slopeIntensity().get();
+    const float landCoverWeight = options().landCoverWeight().get();
+    const float colorWeight = options().colorWeight().get();
+    const float terrainWeight = options().terrainWeight().get();
+    const bool useTerrain = getUseTerrain();
+
+    // Everything that depends only on the column is computed once up
+    // front, and everything that depends only on the row is computed once
+    // per row, so the inner loop does no coordinate transforms at all.
     osg::Vec4 noise[4];
     const unsigned noiseLOD[4] = { 0u, 9u, 13u, 16u };
-    ImageUtils::PixelReader noiseSampler(_noiseFunc.get());
-    noiseSampler.setBilinear(true);
-    noiseSampler.setSampleAsRepeatingTexture(true);
+    NoiseSampler sampleNoise(_noiseFunc.get());
+    const unsigned noiseSize = _noiseFunc->s();
+    double noiseScale[4], noiseBiasX[4], noiseBiasY[4];
+    for (int n = 0; n < 4; ++n)
+    {
+        getRefLODScaleBias(key, noiseLOD[n], noiseScale[n], noiseBiasX[n], noiseBiasY[n]);
+    }
 
-    GeoImage result(image.get(), extent);
+    // same pixel-center convention as GeoImageIterator::forEachPixelOnCenter
+    const double span = (double)(size - 1) / (double)size;
+    const double bias = 0.5 / (double)size;
 
-    GeoImageIterator i(result);
-    i.forEachPixelOnCenter([&]() {
+    std::vector<double> col_u(size), col_x(size);
+    std::vector<NoiseTap> col_noise(4 * size);
+    std::vector<int> col_landcover(landcover.valid() ? size : 0);
+    std::vector<TexelTap> col_dm(densityMask.valid() ? size : 0);
+    std::vector<TexelTap> col_color(color.valid() ? size : 0);
 
-        Sample sample[4];
+    for (int s = 0; s < size; ++s)
+    {
+        double u = bias + span * (double)s / (double)(size - 1);
+        col_u[s] = u;
+        col_x[s] = extent.xMin() + extent.width()*u;
 
-        // Generate noise:
         for (int n = 0; n < 4; ++n)
-        {
-            //TODO: well?
-            if (true)//key.getLOD() >= noiseLOD[n])
-            {
-                noiseCoords[n].set(i.u(), i.v());
-                scaleCoordsToRefLOD(noiseCoords[n], key, noiseLOD[n]);
-                getNoise(noise[n], noiseSampler, noiseCoords[n]);
-            }
-        }
+            col_noise[n*size + s].set((float)((float)u * noiseScale[n] + noiseBiasX[n]), noiseSize);
+
+        if (landcover.valid())
+            col_landcover[s] = nearestTexel(u * landcover_matrix(0, 0) + landcover_matrix(3, 0), landcover->s());
+
+        if (densityMask.valid())
+            col_dm[s].set(clamp(u * dm_matrix(0, 0) + dm_matrix(3, 0), 0.0, 1.0), densityMask.getImage()->s());
 
-        // Establish elevation at this pixel:
-        elevation = elevTile->getElevation(i.x(), i.y()).elevation().as(Units::METERS);
+        if (color.valid())
+            col_color[s].set(u * color_matrix(0, 0) + color_matrix(3, 0), color.getImage()->s());
+    }
+
+    for (int t = 0; t < size; ++t)
+    {
+        if (progress && progress->isCanceled())
+            return GeoImage::INVALID;
 
-        // Normal map at this pixel:
-        normal = elevTile->getNormal(i.x(), i.y());
+        double v = bias + span * (double)t / (double)(size - 1);
+        double y = extent.yMin() + extent.height()*v;
 
-        // exaggerate the slope value
-        //slope = harden(harden(1.0 - (normal * up)));
-        slope = 1.0 - (normal*up);
-        slope = clamp(slope*2.0f, 0.0f, 1.0f); // make 0.5 the maximum slope
-        slope *= options().slopeIntensity().get();
+        NoiseTap row_noise[4];
+        for (int n = 0; n < 4; ++n)
+            row_noise[n].set((float)((float)v * noiseScale[n] + noiseBiasY[n]), noiseSize);
 
-        // NOISE VALUES:
-        float dense_noise =
-            (0.3*noise[0][RANDOM]) +
-            (0.3*noise[1][SMOOTH]) +
-            (0.4*noise[2][CLUMPY]);
+        int row_landcover = 0;
+        if (landcover.valid())
+            row_landcover = nearestTexel(v * landcover_matrix(1, 1) + landcover_matrix(3, 1), landcover->t());
 
-        float lush_noise =
-            noise[2][SMOOTH];
-            //noise[1][SMOOTH];
+        TexelTap row_dm;
+        if (densityMask.valid())
+            row_dm.set(clamp(v * dm_matrix(1, 1) + dm_matrix(3, 1), 0.0, 1.0), densityMask.getImage()->t());
 
-        float rugged_noise =
-            0.5*noise[1][CLUMPY] +
-            0.5*noise[2][RANDOM];
+        TexelTap row_color;
+        if (color.valid())
+            row_color.set(v * color_matrix(1, 1) + color_matrix(3, 1), color.getImage()->t());
 
+        unsigned char* out = image->data(0, t);
 
-        // LAND USE CONTRIBUTION:
-        if (!landuse.empty())
+        for (int s = 0; s < size; ++s, out += 4)
         {
-            double xx = i.x() + x_jitter * 0.3*(noise[2][CLUMPY] * 2.0 - 1.0);
-            double yy = i.y() + y_jitter * 0.3*(noise[2][SMOOTH] * 2.0 - 1.0);
+            const double x = col_x[s];
 
-            const LifeMapValue* lu = landuse.get(xx, yy, landuse_table);
+            Sample sample[4];
 
-            if (lu)
+            // Generate noise:
+            for (int n = 0; n < 4; ++n)
             {
-                if (lu->dense().isSet())
-                {
-                    sample[LANDUSE].dense.value = lu->dense().get() + 0.2*(dense_noise*2.0 - 1.0);
-                    sample[LANDUSE].dense.weight = 1.0f;
-                }
+                sampleNoise(noise[n], col_noise[n*size + s], row_noise[n]);
+            }
 
-                if (lu->lush().isSet())
-                {
-                    sample[LANDUSE].lush.value = lu->lush().get() + 0.2*(lush_noise*2.0 - 1.0);
-                    sample[LANDUSE].lush.weight = 1.0f;
-                }
+            // Establish elevation at this pixel:
+            elevation = elevTile->getElevationUV(col_u[s], v).elevation().as(Units::METERS);
 
-                if (lu->rugged().isSet())
-                {
-                    sample[LANDUSE].rugged.value = lu->rugged().get() + 0.2*(rugged_noise*2.0 - 1.0);
-                    sample[LANDUSE].rugged.weight = 1.0f;
-                }
+            // Normal map at this pixel:
+            normal = elevTile->getNormal(x, y);
 
-                sample[LANDUSE].weight = 1.0f;
-            }
-        }
+            // exaggerate the slope value
+            slope = 1.0 - (normal*up);
+            slope = clamp(slope*2.0f, 0.0f, 1.0f); // make 0.5 the maximum slope
+            slope *= slopeIntensity;
 
-        // LANDCOVER CONTRIBUTION:
-        if (landcover.valid())
-        {
-            double uu = i.u() * landcover_matrix(0, 0) + landcover_matrix(3, 0);
-            double vv = i.v() * landcover_matrix(1, 1) + landcover_matrix(3, 1);
+            // NOISE VALUES:
+            float dense_noise =
+                (0.3*noise[0][RANDOM]) +
+                (0.3*noise[1][SMOOTH]) +
+                (0.4*noise[2][CLUMPY]);
 
-            readLandCover(landcover_pixel, uu, vv);
+            float lush_noise =
+                noise[2][SMOOTH];
 
-            const LandCoverClass* lcc = _landCoverDictionary->getClassByValue(
-                (int)landcover_pixel.r());
+            float rugged_noise =
+                0.5*noise[1][CLUMPY] +
+                0.5*noise[2][RANDOM];
 
-            if (lcc)
-            {
-                const LifeMapValue* value = landcover_table->getValue(lcc->getName());
-                if (value)
-                {
-                    bool has_special = value->special().isSet();
 
-                    if (has_special)
-                    {
-                        sample[LANDCOVER].special =
-                            specialTextureIndexLUT[value->special().get()];
-                    }
+            // LAND USE CONTRIBUTION:
+            if (!landuse.empty())
+            {
+                double xx = x + x_jitter * 0.3*(noise[2][CLUMPY] * 2.0 - 1.0);
+                double yy = y + y_jitter * 0.3*(noise[2][SMOOTH] * 2.0 - 1.0);
 
-                    const int ni = 3;
+                const LifeMapValue* lu = landuse.get(xx, yy, landuse_table);
 
-                    if (value->dense().isSet())
+                if (lu)
+                {
+                    if (lu->dense().isSet())
                     {
-                        float dn = has_special ? 0.0f : (dense_noise*2.0f - 1.0f)*noise[ni][RANDOM];
-                        //sample[LANDCOVER].dense.value = value->dense().get() + 0.2*(dense_noise*2.0 - 1.0);
-                        sample[LANDCOVER].dense.value = value->dense().get() + dn;
-                        sample[LANDCOVER].dense.weight = 1.0f;
+                        sample[LANDUSE].dense.value = lu->dense().get() + 0.2*(dense_noise*2.0 - 1.0);
+                        sample[LANDUSE].dense.weight = 1.0f;
                     }
 
-                    if (value->lush().isSet())
+                    if (lu->lush().isSet())
                     {
-                        float dn = has_special ? 0.0f : (lush_noise*2.0f - 1.0f)*noise[ni][CLUMPY];
-                        //sample[LANDCOVER].lush.value = value->lush().get() + 0.2*(lush_noise*2.0 - 1.0);
-                        sample[LANDCOVER].lush.value = value->lush().get() + dn;
-                        sample[LANDCOVER].lush.weight = 1.0f;
+                        sample[LANDUSE].lush.value = lu->lush().get() + 0.2*(lush_noise*2.0 - 1.0);
+                        sample[LANDUSE].lush.weight = 1.0f;
                     }
 
-                    if (value->rugged().isSet())
+                    if (lu->rugged().isSet())
                     {
-                        float dn = has_special ? 0.0f : (rugged_noise*2.0f - 1.0f)*noise[ni][SMOOTH];
-                        //sample[LANDCOVER].rugged.value = value->rugged().get() + 0.2*(rugged_noise*2.0 - 1.0);
-                        sample[LANDCOVER].rugged.value = value->rugged().get() + dn;
-                        sample[LANDCOVER].rugged.weight = 1.0f;
+                        sample[LANDUSE].rugged.value = lu->rugged().get() + 0.2*(rugged_noise*2.0 - 1.0);
+                        sample[LANDUSE].rugged.weight = 1.0f;
                     }
 
-                    sample[LANDCOVER].weight = options().landCoverWeight().get(); // 1.0f;
+                    sample[LANDUSE].weight = 1.0f;
                 }
             }
-        }
 
-        // COLOR CONTRIBUTION:
-        if (color.valid())
-        {
-            sample[COLOR].weight = options().colorWeight().get(); // 1.0f;
-
-            double uu = i.u() * color_matrix(0, 0) + color_matrix(3, 0);
-            double vv = i.v() * color_matrix(1, 1) + color_matrix(3, 1);
-            readColor(color_pixel, uu, vv);
-
-            // adjust lifemap based on the "greenness" of the pixel
-            // https://www.sciencedirect.com/science/article/pii/S2214317315000347
-
-            // normalize
-            //Color c(color_pixel.r(), color_pixel.g(), color_pixel.b(), 0.0f);
-            //float total = c.r() + c.g() + c.b();
-            //c /= total;
-
-            //float ExG = 2.0f*c.g() - c.r() - c.b();
-            //float ExGR = ExG - (1.4f*c.r() - c.g());
-            //if (ExGR > 0.0)
-            //{
-            //    dense *= (1.0 + ExGR);
-            //    rugged /= (1.0 + ExGR);
-            //}
-            //lush = clamp(ExGR, 0.0f, 1.0f);
-
-            ////float VEG = c.g() / (pow(c.r(), 0.667)*pow(c.b(), 0.333));
-            //c = color_pixel;
-            
-            // normalized color: (do this???)
-            Color c(color_pixel.r(), color_pixel.g(), color_pixel.b(), 0.0f);
-            c /= (c.r() + c.g() + c.b());
-
-            // convert to HSL:
-            hsl = c.asHSL();
-            //rgb2hsl(c, hsl);
-
-            constexpr float red = 0.0f;
-            constexpr float green = 0.3333333f;
-            constexpr float blue = 0.6666667f;
-            constexpr float green_amp = 3.0f;
-            constexpr float lush_amp = 2.0f; // old=1.2f
-
-            float inv_green = fabs(hsl[0] - green);
-            if (inv_green > 0.5f) inv_green = 1.0f - inv_green;
-            float greenness = 1.0f - 2.0f*inv_green;
-            greenness = pow(greenness, green_amp);
-
-            float inv_red = fabs(hsl[0] - red);
-            if (inv_red > 0.5f) inv_red = 1.0f - inv_red;
-            float redness = 1.0f - 2.0*inv_red;
-
-            sample[COLOR].dense.value = greenness;
-            sample[COLOR].dense.weight = 1.0f;
-
-            sample[COLOR].lush.value = clamp(lush_amp * (hsl[1] - 0.5f*hsl[2]), 0.0f, 1.0f);
-            sample[COLOR].lush.weight = 1.0f;
-
-            sample[COLOR].rugged.value = (redness + (1.0f - hsl[1]) + hsl[2]) / 3.0f;
-            sample[COLOR].rugged.value = clamp(sample[COLOR].rugged.value - 0.5, 0.0, 1.0) * 2.0;
-            sample[COLOR].rugged.weight = (getUseTerrain() ? 0.0f : 1.0f);
-        }
+            // LANDCOVER CONTRIBUTION:
+            if (landcover.valid())
+            {
+                readLandCover(landcover_pixel, col_landcover[s], row_landcover);
 
-        // TERRAIN CONTRIBUTION:
-        if (getUseTerrain())
-        {
-            sample[TERRAIN].weight = options().terrainWeight().get();
+                const LandCoverClass* lcc = _landCoverDictionary->getClassByValue(
+                    (int)landcover_pixel.r());
+
+                if (lcc)
+                {
+                    const LifeMapValue* value = landcover_table->getValue(lcc->getName());
+                    if (value)
+                    {
+                        bool has_special = value->special().isSet();
+
+                        if (has_special)
+                        {
+                            sample[LANDCOVER].special =
+                                specialTextureIndexLUT[value->special().get()];
+                        }
+
+                        const int ni = 3;
+
+                        if (value->dense().isSet())
+                        {
+                            float dn = has_special ? 0.0f : (dense_noise*2.0f - 1.0f)*noise[ni][RANDOM];
+                            sample[LANDCOVER].dense.value = value->dense().get() + dn;
+                            sample[LANDCOVER].dense.weight = 1.0f;
+                        }
+
+                        if (value->lush().isSet())
+                        {
+                            float dn = has_special ? 0.0f : (lush_noise*2.0f - 1.0f)*noise[ni][CLUMPY];
+                            sample[LANDCOVER].lush.value = value->lush().get() + dn;
+                            sample[LANDCOVER].lush.weight = 1.0f;
+                        }
+
+                        if (value->rugged().isSet())
+                        {
+                            float dn = has_special ? 0.0f : (rugged_noise*2.0f - 1.0f)*noise[ni][SMOOTH];
+                            sample[LANDCOVER].rugged.value = value->rugged().get() + dn;
+                            sample[LANDCOVER].rugged.weight = 1.0f;
+                        }
+
+                        sample[LANDCOVER].weight = landCoverWeight;
+                    }
+                }
+            }
 
-            if (sample[COLOR].weight == 0.0f)
+            // COLOR CONTRIBUTION:
+            if (color.valid())
             {
-                sample[TERRAIN].dense.value = -(0.8f * slope);
-                sample[TERRAIN].dense.weight = 1.0f;
+                sample[COLOR].weight = colorWeight;
+
+                readColor(color_pixel, col_color[s], row_color);
+
+                // adjust lifemap based on the "greenness" of the pixel
+                // https://www.sciencedirect.com/science/article/pii/S2214317315000347
+
+                // normalized color:
+                Color c(color_pixel.r(), color_pixel.g(), color_pixel.b(), 0.0f);
+                c /= (c.r() + c.g() + c.b());
+
+                // convert to HSL:
+                hsl = c.asHSL();
+
+                constexpr float red = 0.0f;
+                constexpr float green = 0.3333333f;
+                constexpr float green_amp = 3.0f;
+                constexpr float lush_amp = 2.0f; // old=1.2f
 
-                sample[TERRAIN].lush.value = -(0.75f*slope);
-                sample[TERRAIN].lush.weight = 1.0f;
+                float inv_green = fabs(hsl[0] - green);
+                if (inv_green > 0.5f) inv_green = 1.0f - inv_green;
+                float greenness = 1.0f - 2.0f*inv_green;
+                greenness = pow(greenness, green_amp);
+
+                float inv_red = fabs(hsl[0] - red);
+                if (inv_red > 0.5f) inv_red = 1.0f - inv_red;
+                float redness = 1.0f - 2.0*inv_red;
+
+                sample[COLOR].dense.value = greenness;
+                sample[COLOR].dense.weight = 1.0f;
+
+                sample[COLOR].lush.value = clamp(lush_amp * (hsl[1] - 0.5f*hsl[2]), 0.0f, 1.0f);
+                sample[COLOR].lush.weight = 1.0f;
+
+                sample[COLOR].rugged.value = (redness + (1.0f - hsl[1]) + hsl[2]) / 3.0f;
+                sample[COLOR].rugged.value = clamp(sample[COLOR].rugged.value - 0.5, 0.0, 1.0) * 2.0;
+                sample[COLOR].rugged.weight = (useTerrain ? 0.0f : 1.0f);
             }
 
-            sample[TERRAIN].rugged.value = slope;
-            sample[TERRAIN].rugged.weight = 1.0f;
-        }
+            // TERRAIN CONTRIBUTION:
+            if (useTerrain)
+            {
+                sample[TERRAIN].weight = terrainWeight;
 
-        // CALCULATE WEIGHTED AVERAGES:
-        pixel.set(0.0f, 0.0f, 0.0f, 0.0f);
+                if (sample[COLOR].weight == 0.0f)
+                {
+                    sample[TERRAIN].dense.value = -(0.8f * slope);
+                    sample[TERRAIN].dense.weight = 1.0f;
 
-        float
-            dense_total = 0.0f,
-            lush_total = 0.0f,
-            rugged_total = 0.0f;
+                    sample[TERRAIN].lush.value = -(0.75f*slope);
+                    sample[TERRAIN].lush.weight = 1.0f;
+                }
 
-        float
-            dense_factor = 0.0f,
-            lush_factor = 0.0f,
-            rugged_factor = 0.0f;
+                sample[TERRAIN].rugged.value = slope;
+                sample[TERRAIN].rugged.weight = 1.0f;
+            }
 
-        for (int i = 0; i < 4; ++i)
-        {
-            dense_factor = sample[i].dense.weight*sample[i].weight;
-            pixel[LIFEMAP_DENSE] += sample[i].dense.value*dense_factor;
-            dense_total += dense_factor;
-            
-            lush_factor = sample[i].lush.weight*sample[i].weight;
-            pixel[LIFEMAP_LUSH] += sample[i].lush.value*lush_factor;
-            lush_total += lush_factor;
-
-            rugged_factor = sample[i].rugged.weight*sample[i].weight;
-            pixel[LIFEMAP_RUGGED] += sample[i].rugged.value*rugged_factor;
-            rugged_total += rugged_factor;
-
-            if (sample[i].special > 0)
-                pixel[LIFEMAP_SPECIAL] = (float)sample[i].special / 255.0f;
-        }
+            // CALCULATE WEIGHTED AVERAGES:
+            pixel.set(0.0f, 0.0f, 0.0f, 0.0f);
 
-        // for a special encoding, zero out the other values
-        if (pixel[LIFEMAP_SPECIAL] > 0)
-            pixel[LIFEMAP_RUGGED] = pixel[LIFEMAP_DENSE] = pixel[LIFEMAP_LUSH] = 0.0f;
+            for (int i = 0; i < 4; ++i)
+            {
+                pixel[LIFEMAP_DENSE] += sample[i].dense.value*(sample[i].dense.weight*sample[i].weight);
+                pixel[LIFEMAP_LUSH] += sample[i].lush.value*(sample[i].lush.weight*sample[i].weight);
+                pixel[LIFEMAP_RUGGED] += sample[i].rugged.value*(sample[i].rugged.weight*sample[i].weight);
 
-        // MASK CONTRIBUTION (applied to final data)
-        if (densityMask.valid())
-        {
-            double uu = clamp(i.u() * dm_matrix(0, 0) + dm_matrix(3, 0), 0.0, 1.0);
-            double vv = clamp(i.v() * dm_matrix(1, 1) + dm_matrix(3, 1), 0.0, 1.0);
-            readDensityMask(dm_pixel, uu, vv);
+                if (sample[i].special > 0)
+                    pixel[LIFEMAP_SPECIAL] = (float)sample[i].special / 255.0f;
+            }
 
-            pixel[LIFEMAP_DENSE] *= dm_pixel.r();
-            pixel[LIFEMAP_LUSH] *= (0.25 + 0.75*dm_pixel.r()); // 75% effect
-            pixel[LIFEMAP_RUGGED] *= dm_pixel.r();
-        }
+            // for a special encoding, zero out the other values
+            if (pixel[LIFEMAP_SPECIAL] > 0)
+                pixel[LIFEMAP_RUGGED] = pixel[LIFEMAP_DENSE] = pixel[LIFEMAP_LUSH] = 0.0f;
 
-        for (int i = 0; i < 4; ++i)
-        {
-            pixel[i] = clamp(pixel[i], 0.0f, 1.0f);
-        }
+            // MASK CONTRIBUTION (applied to final data)
+            if (densityMask.valid())
+            {
+                readDensityMask(dm_pixel, col_dm[s], row_dm);
 
-        write(pixel, i.s(), i.t());
+                pixel[LIFEMAP_DENSE] *= dm_pixel.r();
+                pixel[LIFEMAP_LUSH] *= (0.25 + 0.75*dm_pixel.r()); // 75% effect
+                pixel[LIFEMAP_RUGGED] *= dm_pixel.r();
+            }
 
-    });
+            for (int i = 0; i < 4; ++i)
+            {
+                out[i] = (unsigned char)(clamp(pixel[i], 0.0f, 1.0f) * 255.0f);
+            }
+        }
+    }
 
-    return std::move(result);
+    return GeoImage(image.get(), extent);
 }
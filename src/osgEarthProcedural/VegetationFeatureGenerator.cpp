@@ -23,12 +23,16 @@
 #include "NoiseTextureFactory"
 #include <osgEarth/ImageUtils>
 #include <osg/ComputeBoundsVisitor>
+#include <deque>
+#include <memory>
 
 using namespace osgEarth;
 using namespace osgEarth::Procedural;
 
 #define LC "[VegetationFeatureGenerator] "
 
+#define ARENA_VEGETATION_EXPORT "oe.vegetation.export"
+
 //...................................................................
 
 namespace
@@ -247,6 +251,124 @@ VegetationFeatureGenerator::getFeatures(const GeoExtent& extent, FeatureList& ou
     return Status::NoError;
 }
 
+Status
+VegetationFeatureGenerator::forEachTile(
+    const GeoExtent& extent,
+    const TileCallback& callback,
+    unsigned concurrency,
+    unsigned maxPendingTiles,
+    ProgressCallback* progress) const
+{
+    if (!_map.valid() || _map->getProfile()==NULL)
+        return Status(Status::ConfigurationError, "No map, or profile not set");
+
+    if (!_veglayer.valid())
+        return Status(Status::ConfigurationError, "No VegetationLayer");
+
+    if (extent.isInvalid())
+        return Status(Status::ConfigurationError, "Invalid extent");
+
+    unsigned lod = _veglayer->options().groups()[AssetGroup::TREES].lod().get();
+
+    std::vector<TileKey> keys;
+    _map->getProfile()->getIntersectingTiles(extent, lod, keys);
+    if (keys.empty())
+        return Status(Status::AssertionFailure, "No keys intersect extent");
+
+    concurrency = std::max(concurrency, 1u);
+    if (maxPendingTiles == 0u)
+        maxPendingTiles = 4u * concurrency;
+
+    JobArena::setConcurrency(ARENA_VEGETATION_EXPORT, concurrency);
+    JobArena* arena = JobArena::get(ARENA_VEGETATION_EXPORT);
+
+    struct TileResult
+    {
+        Status status;
+        FeatureList features;
+    };
+    using TileResultPtr = std::shared_ptr<TileResult>;
+
+    // Tiles are generated out of order on the arena but consumed strictly
+    // in key order, through a window that bounds how many finished tiles
+    // can be waiting in memory.
+    std::deque<Future<TileResultPtr>> pending;
+    std::size_t next = 0;
+    Status status;
+
+    for (std::size_t i = 0; i < keys.size(); ++i)
+    {
+        while (next < keys.size() && pending.size() < maxPendingTiles)
+        {
+            TileKey key = keys[next++];
+            Job job(arena);
+            job.setName("Vegetation export");
+            pending.push_back(job.dispatch<TileResultPtr>(
+                [this, key](Cancelable* c)
+                {
+                    TileResultPtr result = std::make_shared<TileResult>();
+                    if (c && c->isCanceled())
+                        result->status.set(Status::GeneralError, "Canceled");
+                    else
+                        result->status = getFeatures(key, result->features);
+                    return result;
+                }));
+        }
+
+        TileResultPtr result = pending.front().join(progress);
+        pending.pop_front();
+
+        if (progress && progress->isCanceled())
+        {
+            status.set(Status::GeneralError, "Canceled");
+            break;
+        }
+
+        if (!result)
+        {
+            status.set(Status::AssertionFailure, Stringify() << "No result for key " << keys[i].str());
+            break;
+        }
+
+        if (result->status.isError())
+        {
+            status = result->status;
+            break;
+        }
+
+        callback(keys[i], result->features);
+    }
+
+    // jobs still in flight reference this generator, so wait them out
+    for (auto& future : pending)
+        future.join();
+
+    return status;
+}
+
+Status
+VegetationFeatureGenerator::writeFeatures(
+    const GeoExtent& extent,
+    FeatureSource* output,
+    unsigned concurrency,
+    ProgressCallback* progress) const
+{
+    if (!output)
+        return Status(Status::ConfigurationError, "No output feature source");
+
+    return forEachTile(
+        extent,
+        [output](const TileKey&, FeatureList& features)
+        {
+            for (auto& feature : features)
+                output->insertFeature(feature.get());
+            features.clear();
+        },
+        concurrency,
+        0u,
+        progress);
+}
+
 Status
 VegetationFeatureGenerator::getFeatures(const TileKey& key, FeatureList& output) const
 {
@@ -0,0 +1,125 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/FlatGeobufFeatureSource>
+#include <osgEarth/FeatureCursor>
+#include <cstdio>
+
+using namespace osgEarth;
+
+TEST_CASE("FlatGeobufFeatureSource round-trips features through its index") {
+    const std::string filename = "osgEarth_tests_roundtrip.fgb";
+    osg::ref_ptr<const SpatialReference> wgs84 = SpatialReference::create("wgs84");
+
+    // a 10x10 grid of points, enough for a multi-level index
+    FeatureList features;
+    for (int y = 0; y < 10; ++y)
+    {
+        for (int x = 0; x < 10; ++x)
+        {
+            osgEarth::Point* point = new osgEarth::Point();
+            point->push_back(osg::Vec3d(x, y, 0));
+            Feature* f = new Feature(point, wgs84.get());
+            f->set("name", std::string("p") + std::to_string(10 * y + x));
+            f->set("x", (long long)x);
+            f->set("y", (double)y + 0.5);
+            features.push_back(f);
+        }
+    }
+
+    REQUIRE(FlatGeobufFeatureSource::write(filename, features, wgs84.get()).isOK());
+
+    osg::ref_ptr<FlatGeobufFeatureSource> fs = new FlatGeobufFeatureSource();
+    fs->setURL(filename);
+    REQUIRE(fs->open().isOK());
+    REQUIRE(fs->getFeatureCount() == 100);
+    REQUIRE(fs->getGeometryType() == Geometry::TYPE_POINT);
+    REQUIRE(fs->getSchema().find("name")->second == ATTRTYPE_STRING);
+    REQUIRE(fs->getSchema().find("x")->second == ATTRTYPE_INT);
+    REQUIRE(fs->getSchema().find("y")->second == ATTRTYPE_DOUBLE);
+
+    SECTION("Bounds query returns only intersecting features") {
+        Query query;
+        query.bounds() = Bounds(2.5, 2.5, 4.5, 3.5);
+        osg::ref_ptr<FeatureCursor> cursor = fs->createFeatureCursor(query, nullptr);
+        REQUIRE(cursor.valid());
+
+        FeatureList result;
+        cursor->fill(result);
+        REQUIRE(result.size() == 2);
+
+        for (auto& f : result)
+        {
+            REQUIRE(f->getGeometry()->getType() == Geometry::TYPE_POINT);
+            const osg::Vec3d& p = f->getGeometry()->front();
+            REQUIRE(p.y() == 3.0);
+            REQUIRE((p.x() == 3.0 || p.x() == 4.0));
+            REQUIRE(f->getInt("x") == (long long)p.x());
+            REQUIRE(f->getDouble("y") == 3.5);
+            REQUIRE(f->getString("name") == std::string("p") + std::to_string(30 + (int)p.x()));
+
+            osg::ref_ptr<Feature> byFID = fs->getFeature(f->getFID());
+            REQUIRE(byFID.valid());
+            REQUIRE(byFID->getString("name") == f->getString("name"));
+        }
+    }
+
+    SECTION("Polygons keep their holes") {
+        osgEarth::Polygon* poly = new osgEarth::Polygon();
+        poly->push_back(osg::Vec3d(0, 0, 0));
+        poly->push_back(osg::Vec3d(10, 0, 0));
+        poly->push_back(osg::Vec3d(10, 10, 0));
+        poly->push_back(osg::Vec3d(0, 10, 0));
+        Ring* hole = new Ring();
+        hole->push_back(osg::Vec3d(2, 2, 0));
+        hole->push_back(osg::Vec3d(2, 4, 0));
+        hole->push_back(osg::Vec3d(4, 4, 0));
+        hole->push_back(osg::Vec3d(4, 2, 0));
+        poly->getHoles().push_back(hole);
+
+        FeatureList polys;
+        polys.push_back(new Feature(poly, wgs84.get()));
+
+        const std::string polyfile = "osgEarth_tests_polygon.fgb";
+        REQUIRE(FlatGeobufFeatureSource::write(polyfile, polys, wgs84.get()).isOK());
+
+        osg::ref_ptr<FlatGeobufFeatureSource> ps = new FlatGeobufFeatureSource();
+        ps->setURL(polyfile);
+        REQUIRE(ps->open().isOK());
+
+        osg::ref_ptr<Feature> f = ps->getFeature(0);
+        REQUIRE(f.valid());
+        REQUIRE(f->getGeometry()->getType() == Geometry::TYPE_POLYGON);
+        osgEarth::Polygon* read = static_cast<osgEarth::Polygon*>(f->getGeometry());
+        REQUIRE(read->size() == 4);
+        REQUIRE(read->getHoles().size() == 1);
+        REQUIRE(read->getHoles().front()->size() == 4);
+
+        ps->close();
+        ::remove(polyfile.c_str());
+    }
+
+    fs->close();
+    ::remove(filename.c_str());
+}
@@ -0,0 +1,93 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/GeoJSONReader>
+#include <osgEarth/Feature>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+TEST_CASE("GeoJSONReader reads a FeatureCollection") {
+    const std::string json =
+        "{ \"type\": \"FeatureCollection\", \"features\": ["
+        "  { \"type\": \"Feature\", \"id\": 42,"
+        "    \"properties\": { \"Name\": \"A \\\"quoted\\\" \\u00e9\", \"count\": 7, \"area\": 1.5e2, \"flag\": true, \"none\": null, \"tags\": [1,2] },"
+        "    \"geometry\": { \"type\": \"Point\", \"coordinates\": [10.5, -20.25, 3] } },"
+        "  { \"type\": \"Feature\","
+        "    \"geometry\": { \"coordinates\": [[0,0],[1,1],[1,1],[2,0]], \"type\": \"LineString\" },"
+        "    \"properties\": {} }"
+        "] }";
+
+    FeatureList features;
+    GeoJSONReader reader;
+    REQUIRE(reader.read(json, nullptr, features));
+    REQUIRE(features.size() == 2);
+
+    Feature* point = features.front().get();
+    REQUIRE(point->getFID() == 42);
+    REQUIRE(point->getString("name") == "A \"quoted\" \xc3\xa9");
+    REQUIRE(point->getInt("count") == 7);
+    REQUIRE(point->getDouble("area") == 150.0);
+    REQUIRE(point->getInt("flag") == 1);
+    REQUIRE(point->getString("tags") == "[1,2]");
+    REQUIRE(point->getGeometry()->getType() == Geometry::TYPE_POINT);
+    REQUIRE(point->getGeometry()->front() == osg::Vec3d(10.5, -20.25, 3.0));
+
+    // "type" after "coordinates" still works, and consecutive duplicates are dropped
+    Feature* line = features.back().get();
+    REQUIRE(line->getGeometry()->getType() == Geometry::TYPE_LINESTRING);
+    REQUIRE(line->getGeometry()->size() == 3);
+}
+
+TEST_CASE("GeoJSONReader reads polygons with holes") {
+    const std::string json =
+        "{ \"type\": \"Feature\", \"properties\": null, \"geometry\": { \"type\": \"MultiPolygon\", \"coordinates\": ["
+        "  [ [[0,0],[10,0],[10,10],[0,10],[0,0]], [[2,2],[2,4],[4,4],[4,2],[2,2]] ],"
+        "  [ [[20,0],[30,0],[30,10],[20,0]] ]"
+        "] } }";
+
+    FeatureList features;
+    GeoJSONReader reader;
+    REQUIRE(reader.read(json, nullptr, features));
+    REQUIRE(features.size() == 1);
+
+    const MultiGeometry* multi = dynamic_cast<const MultiGeometry*>(features.front()->getGeometry());
+    REQUIRE(multi != nullptr);
+    REQUIRE(multi->getNumComponents() == 2);
+
+    const Polygon* first = dynamic_cast<const Polygon*>(multi->getComponents()[0].get());
+    REQUIRE(first != nullptr);
+    REQUIRE(first->size() == 4);
+    REQUIRE(first->getHoles().size() == 1);
+    REQUIRE(first->getOrientation() == Geometry::ORIENTATION_CCW);
+    REQUIRE(first->getHoles()[0]->getOrientation() == Geometry::ORIENTATION_CW);
+}
+
+TEST_CASE("GeoJSONReader rejects input that is not GeoJSON") {
+    FeatureList features;
+    GeoJSONReader reader;
+    REQUIRE_FALSE(reader.read(std::string("{ \"features\": [ { \"attributes\": {}, \"geometry\": { \"x\": 1, \"y\": 2 } } ] }"), nullptr, features));
+    REQUIRE_FALSE(reader.read(std::string("{ \"type\": \"FeatureCollection\", \"features\": [ { \"type\": "), nullptr, features));
+    REQUIRE(features.empty());
+}
@@ -0,0 +1,134 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/KMLFeatureSource>
+#include <osgEarth/FeatureCursor>
+#include <cstdio>
+#include <fstream>
+
+using namespace osgEarth;
+
+TEST_CASE("KMLFeatureSource streams placemarks into indexed features") {
+    const std::string filename = "osgEarth_tests_placemarks.kml";
+    {
+        std::ofstream out(filename.c_str());
+        out <<
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<kml xmlns=\"http://www.opengis.net/kml/2.2\" xmlns:gx=\"http://www.google.com/kml/ext/2.2\">\n"
+            "<Document>\n"
+            "  <Style id=\"red\"><LineStyle><color>ff0000ff</color><width>3</width></LineStyle></Style>\n"
+            "  <StyleMap id=\"redmap\"><Pair><key>normal</key><styleUrl>#red</styleUrl></Pair></StyleMap>\n"
+            "  <Folder>\n"
+            "    <Placemark>\n"
+            "      <name>Fish &amp; Chips</name>\n"
+            "      <description><![CDATA[<b>open</b> late]]></description>\n"
+            "      <ExtendedData><Data name=\"stars\"><value>4</value></Data></ExtendedData>\n"
+            "      <Point><coordinates>1.5,2.5,10</coordinates></Point>\n"
+            "    </Placemark>\n"
+            "    <Placemark>\n"
+            "      <name>Route</name>\n"
+            "      <styleUrl>#redmap</styleUrl>\n"
+            "      <LineString><coordinates>\n"
+            "        10,10 11,11\n"
+            "        12,10\n"
+            "      </coordinates></LineString>\n"
+            "    </Placemark>\n"
+            "    <Placemark>\n"
+            "      <name>Park</name>\n"
+            "      <Polygon><outerBoundaryIs><LinearRing><coordinates>20,20 30,20 30,30 20,30 20,20</coordinates></LinearRing></outerBoundaryIs>\n"
+            "      <innerBoundaryIs><LinearRing><coordinates>22,22 24,22 24,24 22,22</coordinates></LinearRing></innerBoundaryIs></Polygon>\n"
+            "    </Placemark>\n"
+            "    <Placemark>\n"
+            "      <name>Track</name>\n"
+            "      <gx:Track><when>2020-01-01T00:00:00Z</when><gx:coord>-5 -5 100</gx:coord><gx:coord>-6 -6 200</gx:coord></gx:Track>\n"
+            "    </Placemark>\n"
+            "    <Placemark><name>Nowhere</name></Placemark>\n"
+            "  </Folder>\n"
+            "  <NetworkLink><name>More</name><Link><href>more.kml</href></Link></NetworkLink>\n"
+            "</Document>\n"
+            "</kml>\n";
+    }
+
+    osg::ref_ptr<KMLFeatureSource> fs = new KMLFeatureSource();
+    fs->setURL(filename);
+    REQUIRE(fs->open().isOK());
+    REQUIRE(fs->getFeatureCount() == 4);
+    REQUIRE(fs->getNetworkLinks().size() == 1);
+    REQUIRE(fs->getNetworkLinks().front().name == "More");
+
+    SECTION("Placemarks keep their geometry and attributes") {
+        osg::ref_ptr<Feature> point = fs->getFeature(0);
+        REQUIRE(point.valid());
+        REQUIRE(point->getGeometry()->getType() == Geometry::TYPE_POINT);
+        REQUIRE(point->getGeometry()->front() == osg::Vec3d(1.5, 2.5, 10));
+        REQUIRE(point->getString("name") == "Fish & Chips");
+        REQUIRE(point->getString("description") == "<b>open</b> late");
+        REQUIRE(point->getString("stars") == "4");
+
+        osg::ref_ptr<Feature> line = fs->getFeature(1);
+        REQUIRE(line->getGeometry()->getType() == Geometry::TYPE_LINESTRING);
+        REQUIRE(line->getGeometry()->size() == 3);
+        REQUIRE(line->getString("styleurl") == "redmap");
+
+        // the style map resolves to the shared style
+        REQUIRE(line->style().isSet());
+        const LineSymbol* stroke = line->style()->get<LineSymbol>();
+        REQUIRE(stroke != nullptr);
+        REQUIRE(stroke->stroke()->width() == 3.0f);
+
+        osg::ref_ptr<Feature> park = fs->getFeature(2);
+        REQUIRE(park->getGeometry()->getType() == Geometry::TYPE_POLYGON);
+        osgEarth::Polygon* poly = static_cast<osgEarth::Polygon*>(park->getGeometry());
+        REQUIRE(poly->size() == 5);
+        REQUIRE(poly->getHoles().size() == 1);
+        REQUIRE(poly->getHoles().front()->size() == 4);
+
+        osg::ref_ptr<Feature> track = fs->getFeature(3);
+        REQUIRE(track->getGeometry()->getType() == Geometry::TYPE_LINESTRING);
+        REQUIRE(track->getGeometry()->back() == osg::Vec3d(-6, -6, 200));
+    }
+
+    SECTION("Bounds query returns only intersecting placemarks") {
+        Query query;
+        query.bounds() = Bounds(9.0, 9.0, 25.0, 25.0);
+        osg::ref_ptr<FeatureCursor> cursor = fs->createFeatureCursor(query, nullptr);
+        REQUIRE(cursor.valid());
+
+        FeatureList result;
+        cursor->fill(result);
+        REQUIRE(result.size() == 2);
+        REQUIRE(result.front()->getString("name") == "Route");
+        REQUIRE(result.back()->getString("name") == "Park");
+    }
+
+    SECTION("Style sheet selects shared styles by ID") {
+        osg::ref_ptr<StyleSheet> sheet = fs->createStyleSheet();
+        REQUIRE(sheet->getStyle("red", false) != nullptr);
+        REQUIRE(sheet->getStyle("redmap", false) != nullptr);
+        REQUIRE(sheet->getSelectors().size() == 1);
+    }
+
+    fs->close();
+    ::remove(filename.c_str());
+}
@@ -23,6 +23,8 @@
 #include <osgEarth/catch.hpp>
 
 #include <osgEarth/SpatialReference>
+#include <osgEarth/GeoData>
+#include <osgEarth/VerticalDatum>
 
 using namespace osgEarth;
 
@@ -166,6 +168,44 @@ TEST_CASE("Vertical Datum Tests") {
     REQUIRE(osg::equivalent(output.z(), 0.0, eps));
 }
 
+TEST_CASE("Vertical Datum heightfield conversion") {
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    const SpatialReference* wgs84_egm96 = SpatialReference::get("wgs84", "egm96");
+    GeoExtent extent(wgs84, -10.0, 30.0, 10.0, 50.0);
+
+    const unsigned size = 17;
+    osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
+    hf->allocate(size, size);
+    for (unsigned r = 0; r < size; ++r)
+        for (unsigned c = 0; c < size; ++c)
+            hf->setHeight(c, r, (float)(c*10 + r));
+    hf->setHeight(3, 4, NO_DATA_VALUE);
+
+    // convert twice; the second pass uses the cached offset grid
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        osg::ref_ptr<osg::HeightField> copy = new osg::HeightField(*hf.get(), osg::CopyOp::DEEP_COPY_ALL);
+        REQUIRE(VerticalDatum::transform(wgs84->getVerticalDatum(), wgs84_egm96->getVerticalDatum(), extent, copy.get()));
+
+        for (unsigned r = 0; r < size; ++r)
+        {
+            for (unsigned c = 0; c < size; ++c)
+            {
+                double expected = hf->getHeight(c, r);
+                if (expected == NO_DATA_VALUE)
+                {
+                    REQUIRE(copy->getHeight(c, r) == NO_DATA_VALUE);
+                    continue;
+                }
+                double lon = extent.west() + extent.width() * (double)c / (double)(size - 1);
+                double lat = extent.south() + extent.height() * (double)r / (double)(size - 1);
+                VerticalDatum::transform(wgs84->getVerticalDatum(), wgs84_egm96->getVerticalDatum(), lat, lon, expected);
+                REQUIRE(osg::equivalent((double)copy->getHeight(c, r), expected, 1e-3));
+            }
+        }
+    }
+}
+
 TEST_CASE("getGeographicsSRS") {
     const SpatialReference* mercator = SpatialReference::get("spherical-mercator", "egm96");
     const SpatialReference* geo = mercator->getGeographicSRS();
@@ -197,4 +237,107 @@ TEST_CASE("getGeocentricSRS") {
 
     REQUIRE(ecef->transform(np_ecef, wgs84, temp));
     REQUIRE(vec_eq(temp, np_wgs84));
-}
\ No newline at end of file
+}
+namespace
+{
+    // Transforms the points with the closed-form kernels and with PROJ,
+    // there and back, and returns the largest difference in each direction.
+    void compareKernelsToPROJ(
+        const SpatialReference* from,
+        const SpatialReference* to,
+        const std::vector<osg::Vec3d>& input,
+        double& maxForwardError,
+        double& maxInverseError)
+    {
+        std::vector<osg::Vec3d> fast(input), proj(input);
+
+        SpatialReference::setUseTransformKernels(false);
+        REQUIRE(from->transform(proj, to));
+        SpatialReference::setUseTransformKernels(true);
+        REQUIRE(from->transform(fast, to));
+
+        maxForwardError = 0.0;
+        for (unsigned i = 0; i < input.size(); ++i)
+            maxForwardError = std::max(maxForwardError, (fast[i] - proj[i]).length());
+
+        SpatialReference::setUseTransformKernels(false);
+        REQUIRE(to->transform(proj, from));
+        SpatialReference::setUseTransformKernels(true);
+        REQUIRE(to->transform(fast, from));
+
+        maxInverseError = 0.0;
+        for (unsigned i = 0; i < input.size(); ++i)
+            maxInverseError = std::max(maxInverseError, (fast[i] - proj[i]).length());
+    }
+}
+
+TEST_CASE("Transform kernels match PROJ") {
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    double forward, inverse;
+
+    SECTION("Spherical mercator") {
+        std::vector<osg::Vec3d> points;
+        for (double lat = -85.0; lat <= 85.0; lat += 5.0)
+            for (double lon = -180.0; lon <= 180.0; lon += 7.5)
+                points.emplace_back(lon, lat, 0.0);
+
+        compareKernelsToPROJ(wgs84, SpatialReference::get("spherical-mercator"), points, forward, inverse);
+        REQUIRE(forward < 1e-6);  // meters
+        REQUIRE(inverse < 1e-9);  // degrees
+    }
+
+    SECTION("Plate carree") {
+        std::vector<osg::Vec3d> points;
+        for (double lat = -90.0; lat <= 90.0; lat += 5.0)
+            for (double lon = -180.0; lon <= 180.0; lon += 7.5)
+                points.emplace_back(lon, lat, 0.0);
+
+        compareKernelsToPROJ(wgs84, SpatialReference::get("plate-carree"), points, forward, inverse);
+        REQUIRE(forward < 1e-6);
+        REQUIRE(inverse < 1e-9);
+    }
+
+    SECTION("UTM") {
+        // zone 33N (central meridian 15E), including points well outside the zone
+        std::vector<osg::Vec3d> points;
+        for (double lat = 0.0; lat <= 84.0; lat += 3.0)
+            for (double lon = 3.0; lon <= 27.0; lon += 1.5)
+                points.emplace_back(lon, lat, 0.0);
+
+        compareKernelsToPROJ(wgs84, SpatialReference::get("+proj=utm +zone=33 +datum=WGS84 +units=m +no_defs"), points, forward, inverse);
+        REQUIRE(forward < 1e-4);
+        REQUIRE(inverse < 1e-9);
+
+        // zone 19S
+        points.clear();
+        for (double lat = -80.0; lat <= 0.0; lat += 4.0)
+            for (double lon = -75.0; lon <= -63.0; lon += 1.0)
+                points.emplace_back(lon, lat, 0.0);
+
+        compareKernelsToPROJ(wgs84, SpatialReference::get("+proj=utm +zone=19 +south +datum=WGS84 +units=m +no_defs"), points, forward, inverse);
+        REQUIRE(forward < 1e-4);
+        REQUIRE(inverse < 1e-9);
+    }
+
+    SECTION("Projected to projected") {
+        std::vector<osg::Vec3d> points;
+        for (double lat = 30.0; lat <= 60.0; lat += 2.0)
+            for (double lon = 9.0; lon <= 21.0; lon += 1.0)
+                points.emplace_back(lon, lat, 0.0);
+
+        const SpatialReference* utm = SpatialReference::get("+proj=utm +zone=33 +datum=WGS84 +units=m +no_defs");
+        REQUIRE(wgs84->transform(points, utm));
+
+        compareKernelsToPROJ(utm, SpatialReference::get("spherical-mercator"), points, forward, inverse);
+        REQUIRE(forward < 1e-4);
+        REQUIRE(inverse < 1e-4);
+    }
+
+    SECTION("Known UTM value") {
+        // 40N on the central meridian of zone 18 is k0 times the meridian arc
+        osg::Vec3d output;
+        REQUIRE(wgs84->transform(osg::Vec3d(-75.0, 40.0, 0.0), SpatialReference::get("+proj=utm +zone=18 +datum=WGS84 +units=m +no_defs"), output));
+        REQUIRE(osg::equivalent(output.x(), 500000.0, 1e-6));
+        REQUIRE(osg::equivalent(output.y(), 4427757.219, 1e-3));
+    }
+}
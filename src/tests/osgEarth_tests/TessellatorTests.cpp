@@ -0,0 +1,111 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/Tessellator>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    Ring* makeSquare(Ring* ring, double x, double y, double size)
+    {
+        ring->push_back(x, y);
+        ring->push_back(x + size, y);
+        ring->push_back(x + size, y + size);
+        ring->push_back(x, y + size);
+        return ring;
+    }
+}
+
+TEST_CASE("Tessellator batch triangulates polygons with holes") {
+    osg::ref_ptr<Polygon> square = new Polygon();
+    makeSquare(square.get(), 0, 0, 10);
+
+    osg::ref_ptr<Polygon> holed = new Polygon();
+    makeSquare(holed.get(), 20, 0, 10);
+    holed->getHoles().push_back(makeSquare(new Ring(), 22, 2, 6));
+
+    Tessellator tess;
+    Tessellator::Batch batch;
+    uint32_t first = batch.add(square.get());
+    uint32_t second = batch.add(holed.get());
+
+    REQUIRE(batch.size() == 2);
+    REQUIRE(first == 0);
+    REQUIRE(second == 4);
+
+    std::vector<uint32_t> indices;
+    REQUIRE(tess.tessellate2D(batch, indices));
+
+    // 2 triangles for the square, 8 for the square with a square hole
+    REQUIRE(indices.size() == 3 * (2 + 8));
+    for (auto i : indices)
+        REQUIRE(i < batch.points.size());
+
+    SECTION("Reusing the tessellator and batch gives the same result") {
+        std::vector<uint32_t> again;
+        batch.clear();
+        batch.add(square.get());
+        batch.add(holed.get());
+        REQUIRE(tess.tessellate2D(batch, again));
+        REQUIRE(again == indices);
+    }
+
+    SECTION("Each polygon's triangles go to its own geometry") {
+        osg::ref_ptr<osg::Geometry> a = new osg::Geometry();
+        osg::ref_ptr<osg::Geometry> b = new osg::Geometry();
+        std::vector<osg::Geometry*> targets { a.get(), b.get() };
+        REQUIRE(tess.tessellate2D(batch, targets));
+
+        REQUIRE(a->getNumPrimitiveSets() == 1);
+        REQUIRE(a->getPrimitiveSet(0)->getNumIndices() == 3 * 2);
+        REQUIRE(b->getNumPrimitiveSets() == 1);
+        REQUIRE(b->getPrimitiveSet(0)->getNumIndices() == 3 * 8);
+
+        // indices are relative to each polygon's first point
+        for (unsigned i = 0; i < b->getPrimitiveSet(0)->getNumIndices(); ++i)
+            REQUIRE(b->getPrimitiveSet(0)->index(i) < 8);
+    }
+}
+
+TEST_CASE("Tessellator batch skips degenerate polygons") {
+    osg::ref_ptr<Polygon> line = new Polygon();
+    line->push_back(0, 0);
+    line->push_back(10, 0);
+
+    osg::ref_ptr<Polygon> square = new Polygon();
+    makeSquare(square.get(), 0, 0, 10);
+
+    Tessellator tess;
+    Tessellator::Batch batch;
+    batch.add(line.get());
+    uint32_t offset = batch.add(square.get());
+
+    std::vector<uint32_t> indices;
+    REQUIRE(tess.tessellate2D(batch, indices));
+    REQUIRE(indices.size() == 6);
+    for (auto i : indices)
+        REQUIRE(i >= offset);
+}
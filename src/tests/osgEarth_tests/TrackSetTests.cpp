@@ -0,0 +1,90 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/TrackSet>
+#include <osg/Viewport>
+
+using namespace osgEarth;
+
+namespace
+{
+    // IDs of the tracks visible from a camera looking down at (0,0)
+    std::vector<unsigned> visibleTracks(const TrackSet* tracks)
+    {
+        osg::Vec3d eye(2.0e7, 0.0, 0.0);
+        osg::Matrixd mvpw =
+            osg::Matrixd::lookAt(eye, osg::Vec3d(0, 0, 0), osg::Vec3d(0, 0, 1)) *
+            osg::Matrixd::perspective(30.0, 1.0, 1.0e6, 1.0e8) *
+            osg::ref_ptr<osg::Viewport>(new osg::Viewport(0, 0, 512, 512))->computeWindowMatrix();
+
+        TrackSet::Projection projection;
+        tracks->project(mvpw, eye, 512, 512, projection);
+        return projection.ids;
+    }
+}
+
+TEST_CASE("TrackSet applies submitted batches in order") {
+
+    osg::ref_ptr<TrackSet> tracks = new TrackSet();
+    TrackSet::Updates updates;
+
+    updates.setPosition(0, 0.0, 0.0, 0.0);
+    updates.setPosition(1, 1.0, 1.0, 0.0);
+    tracks->submit(updates);
+    REQUIRE(updates.empty());
+    tracks->applyUpdates();
+    REQUIRE(visibleTracks(tracks.get()) == std::vector<unsigned>({ 0u, 1u }));
+
+    SECTION("A removal hides the track") {
+        updates.remove(1);
+        tracks->submit(updates);
+        tracks->applyUpdates();
+        REQUIRE(visibleTracks(tracks.get()) == std::vector<unsigned>({ 0u }));
+    }
+
+    SECTION("Removals in a batch take effect after its positions") {
+        updates.setPosition(1, 2.0, 2.0, 0.0);
+        updates.remove(1);
+        tracks->submit(updates);
+        tracks->applyUpdates();
+        REQUIRE(visibleTracks(tracks.get()) == std::vector<unsigned>({ 0u }));
+    }
+
+    SECTION("A position in a later batch shows a removed track again") {
+        updates.remove(1);
+        tracks->submit(updates);
+        updates.setPosition(1, 2.0, 2.0, 0.0);
+        tracks->submit(updates);
+        tracks->applyUpdates();
+        REQUIRE(visibleTracks(tracks.get()) == std::vector<unsigned>({ 0u, 1u }));
+    }
+
+    SECTION("A removal in a later batch hides a repositioned track") {
+        updates.setPosition(1, 2.0, 2.0, 0.0);
+        tracks->submit(updates);
+        updates.remove(1);
+        tracks->submit(updates);
+        tracks->applyUpdates();
+        REQUIRE(visibleTracks(tracks.get()) == std::vector<unsigned>({ 0u }));
+    }
+}